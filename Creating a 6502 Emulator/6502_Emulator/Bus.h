@@ -10,4 +10,13 @@ class Bus {
 public:
     virtual uint8_t read( c6502 *cpu, Addr address, bool sync = false ) = 0;
     virtual void write( c6502 *cpu, Addr address, uint8_t ) = 0;
+
+    // Called by backends that clock the chip a whole cycle at a time, such as the netlist, before each
+    // cycle. Signal changes made here are seen by the cycle, as those made at the start of a read or
+    // write are by c6502.
+    virtual void cycleStart() {}
+
+    // Called by backends that don't make an access on every cycle, such as aot, with the cycles they
+    // skipped, so that buses that count or pace cycles keep up
+    virtual void skipCycles(uint64_t cycles) {}
 };
\ No newline at end of file
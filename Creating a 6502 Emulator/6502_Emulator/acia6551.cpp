@@ -0,0 +1,178 @@
+#include "acia6551.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+Acia6551::Acia6551(Scheduler &scheduler, int in_fd, int out_fd, Mode mode, uint64_t flush_cycles, uint64_t poll_cycles) :
+    scheduler_(scheduler),
+    flush_event_( [this]() { flush(); } ),
+    poll_event_( [this]() { poll(); } ),
+    in_fd_(in_fd),
+    out_fd_(out_fd),
+    mode_(mode),
+    flush_cycles_(flush_cycles),
+    poll_cycles_(poll_cycles)
+{
+    if( mode_==Mode::Poll )
+        scheduler_.schedule(poll_event_, scheduler_.now() + poll_cycles_);
+}
+
+Acia6551::~Acia6551() {
+    scheduler_.cancel(flush_event_);
+    scheduler_.cancel(poll_event_);
+    flush();
+}
+
+uint8_t Acia6551::read(uint8_t reg) {
+    switch( reg & 3 ) {
+    case DATA: {
+        uint8_t value = rx_.count>0 ? rx_.pop() : 0;
+        idle_polls_ = 0;
+        updateIrq();
+        return value;
+    }
+    case STATUS: {
+        if( rx_.count==0 ) {
+            if( mode_==Mode::Blocking && !input_ended_ ) {
+                // Whatever the guest printed so far should be out before we wait for an answer
+                flush();
+                fill(true);
+            }
+            // The transmitter is polled through the same register, so one poll doesn't mean much
+            if( rx_.count==0 && input_ended_ && ++idle_polls_>=2 && on_input_end )
+                on_input_end();
+        }
+
+        updateIrq();
+        return StatusTdre | ( rx_.count>0 ? StatusRdrf : 0 ) | ( irq_ ? StatusIrq : 0 );
+    }
+    case COMMAND: return command_;
+    case CONTROL: return control_;
+    }
+
+    return 0;
+}
+
+void Acia6551::write(uint8_t reg, uint8_t value) {
+    switch( reg & 3 ) {
+    case DATA:
+        if( tx_.full() )
+            flush();
+        tx_.push(value);
+        stats_.transmitted++;
+        idle_polls_ = 0;
+
+        if( !flush_event_.scheduled() )
+            scheduler_.schedule(flush_event_, scheduler_.now() + flush_cycles_);
+        updateIrq();
+        break;
+    case STATUS:
+        // Programmed reset
+        command_ &= 0xe0;
+        command_ |= 0x02;
+        updateIrq();
+        break;
+    case COMMAND:
+        command_ = value;
+        updateIrq();
+        break;
+    case CONTROL:
+        control_ = value;
+        break;
+    }
+}
+
+void Acia6551::flush() {
+    scheduler_.cancel(flush_event_);
+
+    while( tx_.count>0 ) {
+        // At most two pieces, as the ring may wrap
+        size_t first = std::min(tx_.count, BufferSize - tx_.head);
+        iovec pieces[2] = {
+            { &tx_.data[tx_.head], first },
+            { &tx_.data[0], tx_.count - first }
+        };
+
+        ssize_t written = writev(out_fd_, pieces, pieces[1].iov_len>0 ? 2 : 1);
+        stats_.writes++;
+        if( written<0 ) {
+            if( errno==EINTR )
+                continue;
+            throw std::runtime_error( std::string("ACIA output failed: ") + strerror(errno) );
+        }
+
+        tx_.head = (tx_.head + written) % BufferSize;
+        tx_.count -= written;
+    }
+}
+
+void Acia6551::fill(bool block) {
+    while( !rx_.full() && !input_ended_ ) {
+        // Straight into the ring's free space, up to where it wraps
+        size_t tail = (rx_.head + rx_.count) % BufferSize;
+        size_t space = std::min(BufferSize - rx_.count, BufferSize - tail);
+
+        // in_fd_ is left blocking: on a terminal it shares its file status flags with the output, and with
+        // whatever runs after us
+        if( !block ) {
+            pollfd pending{ .fd = in_fd_, .events = POLLIN };
+            int ready = ::poll(&pending, 1, 0);
+            if( ready<0 ) {
+                if( errno==EINTR )
+                    continue;
+                throw std::runtime_error( std::string("ACIA input failed: ") + strerror(errno) );
+            }
+            if( ready==0 )
+                break;
+        }
+
+        ssize_t got = ::read(in_fd_, &rx_.data[tail], space);
+        stats_.reads++;
+        if( got<0 ) {
+            if( errno==EINTR )
+                continue;
+            if( errno==EAGAIN || errno==EWOULDBLOCK )
+                break;
+            throw std::runtime_error( std::string("ACIA input failed: ") + strerror(errno) );
+        }
+
+        if( got==0 )
+            input_ended_ = true;
+        rx_.count += got;
+        stats_.received += got;
+
+        // One blocking read is enough to have something to return
+        if( block || size_t(got)<space )
+            break;
+    }
+}
+
+void Acia6551::poll() {
+    scheduler_.schedule(poll_event_, scheduler_.now() + poll_cycles_);
+
+    fill(false);
+    updateIrq();
+}
+
+// Level triggered: the receiver interrupts while there is data, the transmitter (always empty) whenever
+// enabled. COMMAND bit 0 (DTR) enables both, bit 1 disables the receiver's, and bits 2-3 at 01 enable
+// the transmitter's.
+void Acia6551::updateIrq() {
+    bool rx_irq = !(command_ & 0x02) && rx_.count>0;
+    bool tx_irq = (command_ & 0x0c)==0x04;
+    bool irq = (command_ & 0x01) && (rx_irq || tx_irq);
+
+    if( irq==irq_ )
+        return;
+
+    irq_ = irq;
+    if( on_irq )
+        on_irq(irq);
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "scheduler.h"
+
+#include <array>
+#include <functional>
+
+#include <stddef.h>
+#include <stdint.h>
+
+// MOS 6551 ACIA, connected to a pair of host file descriptors.
+//
+// Characters never cost a system call each. Transmitted ones collect in a ring buffer, which goes out
+// in a single writev() when it fills, when the scheduler's flush event comes round, or on flush().
+// Received ones come in through read()s of as much as is available:
+//  - Blocking mode reads when the guest finds the receive buffer empty, waiting for input if need be.
+//    Right for guests that just wait for the next character.
+//  - Poll mode never blocks. Input is picked up by a scheduler event every poll_cycles, so guests can
+//    get on with other work while there is none.
+//
+// The baud rate is ignored: the transmitter is always ready, and received characters are available
+// as soon as they have been read from the host. The buffers can't overrun; the host just waits.
+class Acia6551 {
+public:
+    enum Register : uint8_t { DATA, STATUS, COMMAND, CONTROL };
+    enum class Mode { Blocking, Poll };
+
+    static constexpr uint8_t StatusRdrf = 0x08, StatusTdre = 0x10, StatusIrq = 0x80;
+
+    // Called when the IRQ output changes, typically wired to c6502::setIrq
+    std::function<void (bool active)> on_irq;
+    // Called when the guest keeps polling for input after the last of it, so the run can end
+    std::function<void ()> on_input_end;
+
+    struct Stats {
+        size_t transmitted, received;
+        size_t writes, reads;
+    };
+
+private:
+    static constexpr size_t BufferSize = 4096;
+
+    // Single threaded, so plain indices will do
+    struct Ring {
+        std::array<uint8_t, BufferSize> data;
+        size_t head = 0, count = 0;
+
+        bool full() const { return count==BufferSize; }
+        void push(uint8_t value) { data[ (head + count++) % BufferSize ] = value; }
+        uint8_t pop() { uint8_t value = data[head]; head = (head+1) % BufferSize; count--; return value; }
+    };
+
+    Scheduler &scheduler_;
+    Scheduler::Event flush_event_, poll_event_;
+    int in_fd_, out_fd_;
+    Mode mode_;
+    uint64_t flush_cycles_, poll_cycles_;
+
+    Ring tx_, rx_;
+    bool input_ended_ = false;
+    unsigned idle_polls_ = 0;
+    uint8_t command_ = 0x02, control_ = 0;
+    bool irq_ = false;
+
+    Stats stats_{};
+
+public:
+    Acia6551(Scheduler &scheduler, int in_fd, int out_fd, Mode mode, uint64_t flush_cycles = 20000,
+            uint64_t poll_cycles = 2000);
+    ~Acia6551();
+
+    Acia6551(const Acia6551 &that) = delete;
+    Acia6551 &operator=(const Acia6551 &that) = delete;
+
+    uint8_t read(uint8_t reg);
+    void write(uint8_t reg, uint8_t value);
+
+    void flush();
+
+    Stats stats() const { return stats_; }
+
+private:
+    // Reads whatever the host has, blocking first if asked to
+    void fill(bool block);
+    void poll();
+    void updateIrq();
+};
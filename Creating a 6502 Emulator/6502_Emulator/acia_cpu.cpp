@@ -0,0 +1,121 @@
+// Runs a console filter on c6502: the guest reads characters from a 6551 ACIA connected to stdin,
+// upper cases them and writes them back out through the ACIA to stdout. Reports on stderr how many
+// host system calls the traffic took.
+
+#include "Bus.h"
+#include "acia6551.h"
+#include "c6502.h"
+#include "scheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+using Image = std::array<uint8_t, 65536>;
+
+static constexpr Addr CodeAddress = 0x0400;
+static constexpr Addr AciaAddress = 0xc000;
+
+static constexpr uint8_t FilterProgram[] = {
+    0xad, 0x01, 0xc0,       // wait:  LDA STATUS
+    0x29, 0x08,             //        AND #RDRF
+    0xf0, 0xf9,             //        BEQ wait
+    0xad, 0x00, 0xc0,       //        LDA DATA
+    0xc9, 0x61,             //        CMP #'a'
+    0x90, 0x06,             //        BCC out
+    0xc9, 0x7b,             //        CMP #'z'+1
+    0xb0, 0x02,             //        BCS out
+    0x29, 0xdf,             //        AND #$DF
+    0x48,                   // out:   PHA
+    0xad, 0x01, 0xc0,       // tx:    LDA STATUS
+    0x29, 0x10,             //        AND #TDRE
+    0xf0, 0xf9,             //        BEQ tx
+    0x68,                   //        PLA
+    0x8d, 0x00, 0xc0,       //        STA DATA
+    0x4c, 0x00, 0x04,       //        JMP wait
+};
+
+class InputDone {};
+
+class AciaBus : public Bus {
+    Image       &memory;
+    Scheduler   &scheduler;
+    Acia6551    &acia;
+
+public:
+    AciaBus(Image &memory, Scheduler &scheduler, Acia6551 &acia) : memory(memory), scheduler(scheduler), acia(acia) {}
+
+    virtual uint8_t read( c6502 *cpu, Addr address, bool sync = false ) override {
+        scheduler.tick();
+
+        if( (address & 0xfffc)==AciaAddress )
+            return acia.read(address);
+
+        return memory[address];
+    }
+
+    virtual void write( c6502 *cpu, Addr address, uint8_t value ) override {
+        scheduler.tick();
+
+        if( (address & 0xfffc)==AciaAddress )
+            acia.write(address, value);
+        else
+            memory[address] = value;
+    }
+};
+
+static void usage(const char *name) {
+    std::cerr<<"Usage: "<<name<<" [-p] < input > output\n"
+            "  -p    Poll for input from the scheduler rather than blocking when the guest waits for it\n";
+    exit(2);
+}
+
+int main(int argc, char *argv[]) {
+    auto mode = Acia6551::Mode::Blocking;
+
+    int opt;
+    while( (opt = getopt(argc, argv, "p")) != -1 ) {
+        switch( opt ) {
+        case 'p': mode = Acia6551::Mode::Poll; break;
+        default: usage(argv[0]);
+        }
+    }
+
+    if( argc!=optind )
+        usage(argv[0]);
+
+    Image memory{};
+    memcpy(&memory[CodeAddress], FilterProgram, sizeof(FilterProgram));
+
+    Scheduler scheduler;
+    Acia6551 acia(scheduler, STDIN_FILENO, STDOUT_FILENO, mode);
+    acia.on_input_end = []() { throw InputDone(); };
+
+    AciaBus bus(memory, scheduler, acia);
+    c6502 cpu(bus);
+    cpu.setSignalLogging(false);
+    cpu.setState( c6502::State{ .regA = 0, .regX = 0, .regY = 0, .regSp = 0xfd, .regStatus = 0x34,
+            .pc = CodeAddress } );
+
+    auto start = std::chrono::steady_clock::now();
+    try {
+        cpu.runCpu();
+    } catch( InputDone ex ) {
+    }
+    acia.flush();
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - start );
+
+    auto stats = acia.stats();
+    char buffer[160];
+    snprintf(buffer, sizeof(buffer), "%zu bytes in with %zu reads, %zu bytes out with %zu writes, %llu cycles in %.3fs\n",
+            stats.received, stats.reads, stats.transmitted, stats.writes, (unsigned long long)scheduler.now(),
+            elapsed.count() / 1e6);
+    std::cerr<<buffer;
+
+    return 0;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "Bus.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Golden results of the ALU instructions for every combination of A, M and the C, D and V flags, as
+// produced from the perfect6502 netlist by gen_alu and checked against c6502 by check_alu.
+//
+// File layout: a Header, then per op a Section followed by its Results, ordered by AluTable::index().
+namespace AluTable {
+
+static constexpr char Magic[8] = { '6', '5', '0', '2', 'A', 'L', 'U', '\n' };
+static constexpr uint32_t Version = 1;
+
+// The CPU variant the netlist models
+static constexpr char Variant[16] = "nmos";
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t netlist_checksum;
+    char variant[16];
+    uint32_t num_sections;
+};
+
+struct Section {
+    char name[8];
+    uint8_t opcode;
+    uint8_t has_operand;
+    // Results only cover A values below this, so partial tables can be generated for testing
+    uint16_t num_a;
+    uint32_t num_results;
+};
+
+struct Result {
+    uint8_t regA;
+    uint8_t regStatus;
+};
+
+struct Op {
+    const char *name;
+    uint8_t opcode;
+    // Ops without an operand ignore M, and have one result per A and flags combination
+    bool has_operand;
+};
+
+// BIT has no immediate mode on the NMOS part, so its operand lives in the zero page
+static constexpr Addr BitOperand = 0x0010;
+
+static constexpr Op Ops[] = {
+    { "adc", 0x69, true },
+    { "sbc", 0xe9, true },
+    { "cmp", 0xc9, true },
+    { "bit", 0x24, true },
+    { "asl", 0x0a, false },
+    { "lsr", 0x4a, false },
+    { "rol", 0x2a, false },
+    { "ror", 0x6a, false },
+};
+
+// The input flags, as the low bits of the index
+static constexpr unsigned FlagC = 0x01, FlagD = 0x02, FlagV = 0x04;
+static constexpr unsigned NumFlagCombinations = 8;
+
+inline size_t resultsPerA(const Op &op) {
+    return (op.has_operand ? 256 : 1) * NumFlagCombinations;
+}
+
+inline size_t index(const Op &op, uint8_t a, uint8_t m, unsigned flags) {
+    return a*resultsPerA(op) + (op.has_operand ? m*NumFlagCombinations : 0) + flags;
+}
+
+// The status register the op starts with. Interrupts are masked, and N and Z are left to the op.
+inline uint8_t status(unsigned flags) {
+    return 0x34 | ( flags & FlagC ? 0x01 : 0 ) | ( flags & FlagD ? 0x08 : 0 ) | ( flags & FlagV ? 0x40 : 0 );
+}
+
+} // namespace AluTable
@@ -0,0 +1,234 @@
+#include "aot.h"
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+
+uint64_t AotProgram::hash(const uint8_t *rom, size_t size) {
+    uint64_t result = 0xcbf29ce484222325;
+    for( size_t i = 0; i<size; ++i )
+        result = (result ^ rom[i]) * 0x100000001b3;
+
+    return result;
+}
+
+AotCpu::AotCpu(Bus &bus, const AotProgram &program, const uint8_t *memory) :
+    bus_(bus), program_(program), interpreter_(*this), context_(*this)
+{
+    if( AotProgram::hash(memory + program.first, program.last - program.first + 1)!=program.rom_hash )
+        throw std::runtime_error( std::string("Memory doesn't hold the ROM ") + program.name + " was translated from" );
+
+    for( unsigned page = program.first >> 8; page<=unsigned(program.last >> 8); ++page )
+        pages_[page] = sharedPage(program, page, memory);
+
+    interpreter_.setSignalLogging(false);
+}
+
+// Keyed by the page's bytes as well, so a page is only shared between memories that agree on it
+std::shared_ptr<const AotPage> AotCpu::sharedPage(const AotProgram &program, unsigned page, const uint8_t *memory) {
+    static std::mutex mutex;
+    static std::map< std::tuple<const AotProgram *, unsigned, uint64_t>, std::weak_ptr<const AotPage> > cache;
+
+    uint32_t first = std::max<uint32_t>(page << 8, program.first), end = std::min<uint32_t>( (page+1) << 8, program.last + 1 );
+    auto key = std::make_tuple( &program, page, AotProgram::hash(memory + first, end - first) );
+
+    std::lock_guard lock(mutex);
+    if( auto shared = cache[key].lock() )
+        return shared;
+
+    auto built = std::make_shared<AotPage>();
+    for( size_t i = 0; i<program.num_blocks; ++i ) {
+        const AotBlock &block = program.blocks[i];
+
+        if( block.start >> 8 == page )
+            built->entry[block.start & 0xff] = block.function;
+        for( uint32_t address = std::max<uint32_t>(block.start, first); address<std::min(block.end, end); ++address )
+            built->translated.set(address & 0xff);
+    }
+
+    cache[key] = built;
+    return built;
+}
+
+void AotCpu::run(uint64_t cycles) {
+    stop_at_ = cycles_ + cycles;
+
+    while( cycles_<stop_at_ ) {
+        if( reset_ ) {
+            read(nullptr, pc_);
+            continue;
+        }
+
+        uint64_t before = cycles_;
+
+        // Two reads of the PC and three of the stack before the vector
+        if( reset_released_ ) {
+            reset_released_ = false;
+            context_.s -= 3;
+            context_.flag(AotContext::I, true);
+            pc_ = context_.read16(0xfffc);
+            chargeCycles(7, before);
+            continue;
+        }
+
+        if( written_to_code_ )
+            invalidateWritten();
+        if( takeInterrupt() ) {
+            chargeCycles(7, before);
+            continue;
+        }
+
+        if( AotFunction function = entry(pc_) ) {
+            native_blocks_++;
+            context_.cycles = 0;
+            pc_ = function(context_);
+            chargeCycles(context_.cycles, before);
+        } else {
+            interpret();
+        }
+    }
+}
+
+void AotCpu::setReset(bool state) {
+    if( reset_ && !state )
+        reset_released_ = true;
+    reset_ = state;
+}
+
+void AotCpu::setIrq(bool state) {
+    irq_ = state;
+    if( interpreting_ )
+        interpreter_.setIrq(state);
+}
+
+void AotCpu::setNmi(bool state) {
+    if( !nmi_ && state )
+        nmi_pending_ = true;
+    nmi_ = state;
+
+    if( interpreting_ )
+        interpreter_.setNmi(state);
+}
+
+void AotCpu::setSo(bool state) {
+    if( !so_ && state )
+        context_.flag(AotContext::V, true);
+    so_ = state;
+
+    if( interpreting_ )
+        interpreter_.setSo(state);
+}
+
+std::optional<CpuBackend::Registers> AotCpu::registers() const {
+    return Registers{ .regA = context_.a, .regX = context_.x, .regY = context_.y, .regSp = context_.s,
+            .regStatus = context_.p, .pc = pc_ };
+}
+
+uint8_t AotCpu::read( c6502 *cpu, Addr address, bool sync ) {
+    // c6502 hands back on the instruction boundary where translated code can take over again
+    if( interpreting_ && sync && ( entry(address) || cycles_>=stop_at_ ) )
+        throw ReachedBlock();
+
+    cycles_++;
+    return bus_.read(nullptr, address, sync);
+}
+
+void AotCpu::write( c6502 *cpu, Addr address, uint8_t value ) {
+    cycles_++;
+    bus_.write(nullptr, address, value);
+
+    const AotPage *page = pages_[address >> 8].get();
+    if( page && page->translated.test(address & 0xff) ) {
+        written_.set(address);
+        written_to_code_ = true;
+    }
+}
+
+// Blocks whose code was written to no longer match their translation, and are left to c6502
+void AotCpu::invalidateWritten() {
+    for( size_t i = 0; i<program_.num_blocks; ++i ) {
+        const AotBlock &block = program_.blocks[i];
+
+        for( uint32_t address = block.start; address<block.end; ++address ) {
+            if( written_.test( Addr(address) ) ) {
+                auto &page = pages_[block.start >> 8];
+                if( page->entry[block.start & 0xff] ) {
+                    auto copy = std::make_shared<AotPage>(*page);
+                    copy->entry[block.start & 0xff] = nullptr;
+                    page = std::move(copy);
+                }
+                break;
+            }
+        }
+    }
+
+    written_.reset();
+    written_to_code_ = false;
+}
+
+void AotCpu::interpret() {
+    interpreted_entries_++;
+    if( pc_>=program_.first && pc_<=program_.last )
+        missed_.insert(pc_);
+
+    interpreter_.setState( c6502::State{ .regA = context_.a, .regX = context_.x, .regY = context_.y,
+            .regSp = context_.s, .regStatus = context_.p, .pc = pc_,
+            .irq = irq_, .nmi = nmi_, .ready = false, .so = so_, .nmi_pending = nmi_pending_,
+            .delayed_ops = delayed_ops_ } );
+
+    interpreting_ = true;
+    try {
+        interpreter_.runCpu();
+    } catch( ReachedBlock ex ) {
+    } catch( ... ) {
+        leaveInterpreter();
+        throw;
+    }
+    leaveInterpreter();
+}
+
+void AotCpu::leaveInterpreter() {
+    interpreting_ = false;
+
+    c6502::State state = interpreter_.getState();
+    context_.a = state.regA;
+    context_.x = state.regX;
+    context_.y = state.regY;
+    context_.s = state.regSp;
+    context_.p = state.regStatus;
+    pc_ = state.pc;
+    nmi_pending_ = state.nmi_pending;
+    delayed_ops_ = state.delayed_ops;
+}
+
+void AotCpu::chargeCycles(uint64_t cycles, uint64_t before) {
+    uint64_t accesses = cycles_ - before;
+    if( cycles<=accesses )
+        return;
+
+    cycles_ += cycles - accesses;
+    bus_.skipCycles(cycles - accesses);
+}
+
+bool AotCpu::takeInterrupt() {
+    bool taken = false;
+    if( nmi_pending_ ) {
+        nmi_pending_ = false;
+        pc_ = context_.interrupt(pc_, 0xfffa, false);
+        taken = true;
+    } else if( irq_ && !context_.flag(AotContext::I) ) {
+        pc_ = context_.interrupt(pc_, 0xfffe, false);
+        taken = true;
+    }
+
+    // c6502 can hand back with a CLI or SEI pending, which changes I only once interrupts are checked
+    if( delayed_ops_!=c6502::DelayedOps::None ) {
+        context_.flag(AotContext::I, delayed_ops_==c6502::DelayedOps::SEI);
+        delayed_ops_ = c6502::DelayedOps::None;
+    }
+
+    return taken;
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "Bus.h"
+#include "c6502.h"
+#include "core6502.h"
+#include "cpu_backend.h"
+
+#include <array>
+#include <bitset>
+#include <memory>
+#include <optional>
+#include <set>
+
+#include <stdint.h>
+
+// Runtime for ROM images translated ahead of time into C++ by recompile.
+//
+// Each basic block of the ROM becomes a native function that runs the whole block against an
+// AotContext and returns the address to go on from. Anything that isn't a translated block start, such
+// as code reached through a computed jump, code outside the ROM, or a block whose bytes have since been
+// written to, runs on c6502 until it reaches a translated block again.
+//
+// Translated code makes the bus accesses the instructions ask for, plus one SYNC read per opcode fetch
+// so devices that watch fetches keep working, but not the dummy and operand cycles. Those are charged
+// to the bus through skipCycles() instead, once each block has run, so cycle counts and pacing come out
+// as on c6502. Its instruction semantics are Core6502's.
+
+class AotContext;
+
+using AotFunction = Addr (*)(AotContext &context);
+
+struct AotBlock {
+    Addr start;
+    // One past the block's last byte
+    uint32_t end;
+    AotFunction function;
+};
+
+struct AotProgram {
+    const char *name;
+    // The ROM the blocks were translated from, which must be in memory at the same place to use them
+    Addr first, last;
+    uint64_t rom_hash;
+    const AotBlock *blocks;
+    size_t num_blocks;
+
+    // FNV-1a, as the recompiler computes rom_hash
+    static uint64_t hash(const uint8_t *rom, size_t size);
+};
+
+// The translated blocks that start in one 256 byte page of a program. Pages are immutable, and shared
+// by every AotCpu running the same program over the same bytes.
+struct AotPage {
+    std::array<AotFunction, 256> entry{};
+    // Bytes in this page that belong to a block, wherever the block starts
+    std::bitset<256> translated;
+};
+
+class AotContext : public Core6502<AotContext> {
+    Bus &bus_;
+
+public:
+    // Charged by translated code: each block's instructions, and the penalties it incurs
+    uint64_t cycles = 0;
+
+    explicit AotContext(Bus &bus) : bus_(bus) {}
+
+    // base + index, for a read, which takes another cycle when that crosses a page
+    Addr indexed(Addr base, uint8_t index) {
+        Addr address = base + index;
+        cycles += (address ^ base) >> 8 != 0;
+        return address;
+    }
+
+    void fetch(Addr address) { bus_.read(nullptr, address, true); }
+    uint8_t read(Addr address) { return bus_.read(nullptr, address); }
+    void write(Addr address, uint8_t value) { bus_.write(nullptr, address, value); }
+};
+
+// Runs a translated program as a CPU backend. run(cycles) stops at the first block or instruction
+// boundary after that many cycles, rather than exactly on it.
+class AotCpu : public CpuBackend, private Bus {
+    Bus &bus_;
+    const AotProgram &program_;
+    c6502 interpreter_;
+
+    // Pages come from a process wide cache, so many instances of one ROM share a single translation.
+    // A page is only copied, and then private to the instance, once code in it is written to.
+    std::array<std::shared_ptr<const AotPage>, 256> pages_;
+    std::bitset<65536> written_;
+    AotContext context_;
+    Addr pc_ = 0;
+
+    // Accesses made, and the cycles skipped by translated code
+    uint64_t cycles_ = 0, stop_at_ = 0;
+    bool interpreting_ = false, written_to_code_ = false;
+    bool reset_ = false, reset_released_ = false;
+    bool irq_ = false, nmi_ = false, nmi_pending_ = false, so_ = false;
+    c6502::DelayedOps delayed_ops_ = c6502::DelayedOps::None;
+
+    uint64_t native_blocks_ = 0, interpreted_entries_ = 0;
+    std::set<Addr> missed_;
+
+public:
+    // Fails if the program's ROM isn't what memory holds at its address
+    AotCpu(Bus &bus, const AotProgram &program, const uint8_t *memory);
+
+    AotCpu(const AotCpu &that) = delete;
+    AotCpu &operator=(const AotCpu &that) = delete;
+
+    const char *name() const override { return "aot"; }
+    void run(uint64_t cycles) override;
+
+    void setReset(bool state) override;
+    void setIrq(bool state) override;
+    void setNmi(bool state) override;
+    void setReady(bool state) override {}
+    void setSo(bool state) override;
+
+    std::optional<Registers> registers() const override;
+
+    // Blocks run natively, and times c6502 had to take over
+    uint64_t nativeBlocks() const { return native_blocks_; }
+    uint64_t interpretedEntries() const { return interpreted_entries_; }
+    // Addresses in the ROM c6502 took over at, which recompile can be given as more entry points
+    const std::set<Addr> &missedEntries() const { return missed_; }
+
+private:
+    class ReachedBlock {};
+
+    uint8_t read( c6502 *cpu, Addr address, bool sync = false ) override;
+    void write( c6502 *cpu, Addr address, uint8_t value ) override;
+
+    // The translated block starting at address, if there is one to run
+    AotFunction entry(Addr address) const {
+        const AotPage *page = pages_[address >> 8].get();
+        return page ? page->entry[address & 0xff] : nullptr;
+    }
+    static std::shared_ptr<const AotPage> sharedPage(const AotProgram &program, unsigned page, const uint8_t *memory);
+    void invalidateWritten();
+    void interpret();
+    void leaveInterpreter();
+    bool takeInterrupt();
+    // Makes up to the bus the cycles that what ran since cycles_ was at before took, beyond its accesses
+    void chargeCycles(uint64_t cycles, uint64_t before);
+};
@@ -0,0 +1,342 @@
+// Apple I running Apple I BASIC on c6502, or another CPU backend picked with -B, fed a script on stdin.
+// With -c the same script is also run on the perfect6502 netlist and the two transcripts compared; with
+// -b the run is timed, and with -r it is paced to a real clock rate.
+//
+// The machine is RAM everywhere except for the BASIC ROM at 0xE000 and the keyboard/display PIA at
+// 0xD010-0xD013. The run ends when BASIC waits for a key and the script has none left.
+
+#include "Bus.h"
+#include "aot.h"
+#include "c6502.h"
+#include "cpu_backend.h"
+#include "throttle.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <string>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+using Image = std::array<uint8_t, 65536>;
+
+static constexpr Addr RomAddress = 0xe000;
+static constexpr size_t RomSize = 4096;
+
+// The PIA is only partially decoded, and BASIC uses the 0xD0F2 mirror for the display
+static constexpr Addr PiaMask = 0xff1c, PiaMatch = 0xd010;
+static constexpr Addr Kbd = 0, KbdCr = 1, Dsp = 2;
+
+// BASIC's key wait loop (LDA KBDCR / BPL), and its display routine
+static constexpr Addr GetcharAddress = 0xe003;
+static constexpr Addr EchoAddress = 0xe3c9;
+static constexpr Addr EchoColumn = 0x0024;
+
+static constexpr size_t ResetCycles = 8;
+
+// Generated by recompile from the BASIC ROM
+extern const AotProgram apple1basic;
+
+class ScriptDone {};
+class CycleLimit {};
+
+// The keyboard and display PIA, with the keyboard replaced by a script. A key is only offered while
+// BASIC sits in its key wait loop: KBDCR is also polled while a program runs, and any key there stops
+// the program.
+class Pia {
+    std::string input;
+    size_t next_input = 0;
+    Addr last_fetch = 0;
+
+public:
+    std::string output;
+
+    explicit Pia(std::string script) : input(std::move(script)) {}
+
+    static bool decodes(Addr address) { return (address & PiaMask)==PiaMatch; }
+
+    void fetch(Addr address) { last_fetch = address; }
+
+    uint8_t read(Addr address) {
+        switch( address & 3 ) {
+        case Kbd:
+            return key();
+        case KbdCr:
+            if( last_fetch!=GetcharAddress )
+                return 0;
+            if( next_input==input.size() )
+                throw ScriptDone();
+            return 0x80;
+        default:
+            // The display is always ready
+            return 0;
+        }
+    }
+
+    void write(Addr address, uint8_t value) {
+        if( (address & 3)==Dsp )
+            display(value);
+    }
+
+    uint8_t key() {
+        if( next_input==input.size() )
+            throw ScriptDone();
+
+        char ch = input[next_input++];
+        return ( ch=='\n' ? '\r' : ch ) | 0x80;
+    }
+
+    void display(uint8_t value) {
+        value &= 0x7f;
+        output.push_back( value=='\r' ? '\n' : value );
+    }
+};
+
+class Apple1Bus : public Bus {
+    Image       &memory;
+    Pia         &pia;
+    size_t      max_cycles;
+
+public:
+    size_t cycles = 0;
+    Throttle *throttle = nullptr;
+
+    Apple1Bus(Image &memory, Pia &pia, size_t max_cycles) : memory(memory), pia(pia), max_cycles(max_cycles) {}
+
+    virtual uint8_t read( c6502 *cpu, Addr address, bool sync = false ) override {
+        tick();
+
+        if( sync )
+            pia.fetch(address);
+        if( Pia::decodes(address) )
+            return pia.read(address);
+
+        return memory[address];
+    }
+
+    virtual void write( c6502 *cpu, Addr address, uint8_t value ) override {
+        tick();
+
+        if( Pia::decodes(address) )
+            pia.write(address, value);
+        else
+            memory[address] = value;
+    }
+
+    virtual void skipCycles(uint64_t skipped) override {
+        for( uint64_t i = 0; i<skipped; ++i )
+            tick();
+    }
+
+private:
+    void tick() {
+        if( cycles++==max_cycles )
+            throw CycleLimit();
+        if( throttle )
+            throttle->tick();
+    }
+};
+
+struct Options {
+    const char *backend = "c6502";
+    bool compare = false;
+    unsigned benchmark_runs = 0;
+    bool hle = false;
+    size_t max_cycles = 1000000000;
+    double clock_mhz = 0;
+    uint32_t quantum_cycles = 1000;
+    const char *missed_file = nullptr;
+};
+
+struct Run {
+    std::string output;
+    size_t cycles;
+    std::chrono::microseconds elapsed;
+    bool finished;
+    // With aot, the ROM addresses that had to be interpreted
+    std::set<Addr> missed;
+};
+
+// Replaces BASIC's key wait and display routines with native ones
+static void install_hooks(c6502 &cpu, Image &memory, Pia &pia) {
+    cpu.setHook(GetcharAddress, [&pia](c6502::State &state) {
+        state.regA = pia.key();
+        state.regStatus = (state.regStatus & ~0x02) | 0x80;
+    });
+
+    // Keeps the column count the ROM routine maintains, and leaves the flags as its CMP #$8D and
+    // BIT DSP would
+    cpu.setHook(EchoAddress, [&memory, &pia](c6502::State &state) {
+        if( state.regA==0x8d )
+            memory[EchoColumn] = 0;
+        memory[EchoColumn]++;
+        pia.display(state.regA);
+
+        state.regStatus = (state.regStatus & ~0xc3) | 0x02 | ( state.regA>=0x8d ? 0x01 : 0 );
+    });
+}
+
+static Run run(const char *backend_name, const Options &options, const Image &image, const std::string &script,
+        Throttle *throttle = nullptr) {
+    Image memory = image;
+    Pia pia(script);
+    Apple1Bus bus(memory, pia, options.max_cycles);
+    std::unique_ptr<CpuBackend> backend = strcmp(backend_name, "aot")==0 ?
+            std::make_unique<AotCpu>(bus, apple1basic, memory.data()) : makeCpuBackend(backend_name, bus);
+    if( !backend )
+        throw std::runtime_error( std::string("Unknown CPU backend ") + backend_name );
+
+    if( options.hle )
+        install_hooks(dynamic_cast<C6502Backend &>(*backend).cpu(), memory, pia);
+
+    bool finished = true;
+    auto start = std::chrono::steady_clock::now();
+    try {
+        backend->setReset(true);
+        backend->run(ResetCycles);
+        backend->setReset(false);
+
+        bus.throttle = throttle;
+        while( true )
+            backend->run(options.max_cycles);
+    } catch( ScriptDone ex ) {
+    } catch( CycleLimit ex ) {
+        finished = false;
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - start );
+
+    Run result{ .output = std::move(pia.output), .cycles = bus.cycles, .elapsed = elapsed, .finished = finished };
+    if( auto aot = dynamic_cast<AotCpu *>( backend.get() ) )
+        result.missed = aot->missedEntries();
+
+    return result;
+}
+
+static void report(const char *core, const Run &run) {
+    char buffer[128];
+    snprintf(buffer, sizeof(buffer), "%s: %zu cycles in %.3fs, %.3f emulated MHz%s\n", core, run.cycles,
+            run.elapsed.count() / 1e6, double(run.cycles) / std::max<int64_t>(run.elapsed.count(), 1),
+            run.finished ? "" : " (cycle limit reached)");
+    std::cerr<<buffer;
+}
+
+static void usage(const char *name) {
+    std::cerr<<"Usage: "<<name<<" [-B backend] [-c] [-b runs] [-H] [-n max_cycles] [-r mhz [-q cycles]] [-m missed] apple1basic.bin < script\n"
+            "  -B    CPU to run: c6502 (default), netlist, trace:<file>, or aot for BASIC translated ahead of time\n"
+            "  -c    Also run the script on the perfect6502 netlist and compare the output\n"
+            "  -b    Time this many runs and report emulated MHz\n"
+            "  -H    Replace BASIC's keyboard and display routines with native hooks (c6502 only)\n"
+            "  -r    Run in real time at this clock rate (the Apple I ran at 1.023)\n"
+            "  -q    Cycles per real time quantum, between sleeps (default 1000)\n"
+            "  -m    With -B aot, write the ROM addresses that weren't translated, for recompile -E\n";
+    exit(2);
+}
+
+int main(int argc, char *argv[]) {
+    Options options;
+
+    int opt;
+    while( (opt = getopt(argc, argv, "B:cb:Hn:r:q:m:")) != -1 ) {
+        switch( opt ) {
+        case 'B': options.backend = optarg; break;
+        case 'c': options.compare = true; break;
+        case 'b': options.benchmark_runs = strtoul(optarg, nullptr, 0); break;
+        case 'H': options.hle = true; break;
+        case 'n': options.max_cycles = strtoull(optarg, nullptr, 0); break;
+        case 'r': options.clock_mhz = strtod(optarg, nullptr); break;
+        case 'q': options.quantum_cycles = strtoul(optarg, nullptr, 0); break;
+        case 'm': options.missed_file = optarg; break;
+        default: usage(argv[0]);
+        }
+    }
+
+    if( argc-optind != 1 || options.clock_mhz<0 || options.quantum_cycles==0 ||
+            ( options.hle && strcmp(options.backend, "c6502")!=0 ) ||
+            ( options.missed_file && strcmp(options.backend, "aot")!=0 ) )
+        usage(argv[0]);
+
+    Image image{};
+    std::ifstream rom(argv[optind], std::ios::binary);
+    if( !rom.read( reinterpret_cast<char *>(&image[RomAddress]), RomSize ) ) {
+        std::cerr<<"Failed reading "<<RomSize<<" bytes of ROM from "<<argv[optind]<<"\n";
+        return 2;
+    }
+    image[0xfffc] = RomAddress & 0xff;
+    image[0xfffd] = RomAddress >> 8;
+
+    std::string script( std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>{} );
+
+    std::optional<Throttle> throttle;
+    if( options.clock_mhz>0 )
+        throttle.emplace(options.clock_mhz * 1e6, options.quantum_cycles);
+
+    Run run = ::run(options.backend, options, image, script, throttle ? &*throttle : nullptr);
+    std::cout<<run.output<<std::flush;
+    if( !run.finished )
+        std::cerr<<options.backend<<" reached the cycle limit\n";
+
+    if( options.missed_file ) {
+        std::ofstream missed(options.missed_file);
+        char buffer[8];
+        for( Addr address : run.missed ) {
+            snprintf(buffer, sizeof(buffer), "%04X\n", address);
+            missed<<buffer;
+        }
+        if( !missed ) {
+            std::cerr<<"Failed writing "<<options.missed_file<<"\n";
+            return 2;
+        }
+    }
+
+    if( throttle ) {
+        auto stats = throttle->stats();
+        char buffer[160];
+        snprintf(buffer, sizeof(buffer), "Real time: %.3fs for %zu cycles, %llu/%llu quanta late, jitter p50 %lldus p99 %lldus max %lldus\n",
+                run.elapsed.count() / 1e6, run.cycles, (unsigned long long)stats.late_quanta, (unsigned long long)stats.quanta,
+                (long long)stats.jitter_p50_ns / 1000, (long long)stats.jitter_p99_ns / 1000, (long long)stats.jitter_max_ns / 1000);
+        std::cerr<<buffer;
+    }
+
+    if( options.benchmark_runs>0 ) {
+        Run best = run;
+        size_t total_cycles = 0;
+        std::chrono::microseconds total_elapsed{0};
+
+        for( unsigned i=0; i<options.benchmark_runs; ++i ) {
+            Run timed = ::run(options.backend, options, image, script);
+            total_cycles += timed.cycles;
+            total_elapsed += timed.elapsed;
+            if( timed.elapsed<best.elapsed )
+                best = std::move(timed);
+        }
+
+        report( (std::string(options.backend) + " best").c_str(), best );
+        report( (std::string(options.backend) + " total").c_str(), Run{ .cycles = total_cycles, .elapsed = total_elapsed, .finished = run.finished });
+    }
+
+    if( !options.compare )
+        return run.finished ? 0 : 1;
+
+    Run netlist = ::run("netlist", options, image, script);
+    report("perfect6502", netlist);
+
+    if( netlist.output==run.output ) {
+        std::cerr<<"Output matches perfect6502\n";
+        // Up to where they stopped, which for a run cut short isn't the whole script
+        return run.finished && netlist.finished ? 0 : 1;
+    }
+
+    auto difference = std::mismatch( run.output.begin(), run.output.end(), netlist.output.begin(), netlist.output.end() );
+    std::cerr<<"Output differs from perfect6502 at offset "<<( difference.first - run.output.begin() )<<"\n"
+            "perfect6502 output:\n"<<netlist.output;
+    return 1;
+}
@@ -0,0 +1,135 @@
+// Assembles a program in vasm's oldstyle syntax into a .mem file, laid out as parse_lst lays out vasm's
+// listing: one row per source line, with the line it came from.
+
+#include "assembler.h"
+
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+struct Options {
+    Assembler::Variant variant = Assembler::Variant::Nmos;
+    std::vector< std::pair<std::string, int32_t> > defines;
+    const char *output = nullptr;
+};
+
+static void usage(const char *name) {
+    std::cerr<<"Usage: "<<name<<" [-c] [-D name[=value]]... [-o out.mem] source.s\n"
+            "  -c    Assemble for the 65C02, with the WDC additions\n"
+            "  -D    Define a symbol, as 1 if no value is given\n"
+            "  -o    Where to write the memory image (default: stdout)\n";
+    exit(2);
+}
+
+static std::vector<std::string_view> split_lines(std::string_view source) {
+    std::vector<std::string_view> lines;
+
+    while( !source.empty() ) {
+        size_t end = source.find('\n');
+        std::string_view line = source.substr(0, end);
+        if( !line.empty() && line.back()=='\r' )
+            line.remove_suffix(1);
+        lines.push_back(line);
+
+        source.remove_prefix( end==std::string_view::npos ? source.size() : end+1 );
+    }
+
+    return lines;
+}
+
+static void write_mem(std::ostream &out, const Program &program, const char *source_name,
+        const std::vector<std::string_view> &source_lines)
+{
+    static constexpr unsigned BytesPerRow = 16;
+    char buffer[8];
+
+    for( const Program::Line &line : program.lines ) {
+        for( unsigned offset = 0; offset<line.size; offset += BytesPerRow ) {
+            std::string row;
+            snprintf(buffer, sizeof(buffer), "@%04x", unsigned(line.address + offset));
+            row += buffer;
+            for( unsigned i = offset; i<line.size && i<offset+BytesPerRow; ++i ) {
+                snprintf(buffer, sizeof(buffer), " %02x", program.memory[ Addr(line.address + i) ]);
+                row += buffer;
+            }
+
+            if( offset==0 ) {
+                if( row.size()<40 )
+                    row.resize(40, ' ');
+                row += "// ";
+                row += source_name;
+                row += ":" + std::to_string(line.line) + " ";
+                row += source_lines[line.line - 1];
+            }
+
+            out<<row<<"\n";
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    Options options;
+
+    int opt;
+    while( (opt = getopt(argc, argv, "cD:o:")) != -1 ) {
+        switch( opt ) {
+        case 'c': options.variant = Assembler::Variant::Cmos; break;
+        case 'D': {
+            const char *equals = strchr(optarg, '=');
+            if( equals )
+                options.defines.emplace_back( std::string(optarg, equals-optarg), strtol(equals+1, nullptr, 0) );
+            else
+                options.defines.emplace_back( optarg, 1 );
+            break;
+        }
+        case 'o': options.output = optarg; break;
+        default: usage(argv[0]);
+        }
+    }
+
+    if( argc-optind != 1 )
+        usage(argv[0]);
+    const char *source_name = argv[optind];
+
+    std::ifstream file(source_name);
+    if( !file ) {
+        std::cerr<<"Failed opening "<<source_name<<"\n";
+        return 2;
+    }
+    std::string source( std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>{} );
+
+    Assembler assembler(options.variant);
+    for( const auto &[name, value] : options.defines )
+        assembler.define(name, value);
+
+    Program program;
+    try {
+        assembler.assemble(source, program);
+    } catch( AssemblyError &ex ) {
+        std::cerr<<source_name<<":"<<ex.line()<<": "<<ex.what()<<"\n";
+        return 1;
+    }
+
+    // Written whole or not at all, so a failed run doesn't leave a truncated image for make to trust
+    std::ostringstream mem;
+    write_mem(mem, program, source_name, split_lines(source));
+
+    if( options.output ) {
+        std::ofstream out(options.output);
+        out<<mem.str();
+        if( !out.flush() ) {
+            std::cerr<<"Failed writing "<<options.output<<"\n";
+            return 2;
+        }
+    } else {
+        std::cout<<mem.str();
+    }
+
+    return 0;
+}
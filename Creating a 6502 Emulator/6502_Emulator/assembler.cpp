@@ -0,0 +1,835 @@
+#include "assembler.h"
+
+#include <algorithm>
+
+#include <ctype.h>
+
+static constexpr unsigned MaxPasses = 16;
+
+namespace {
+
+enum UnaryOp : uint8_t { Negate, Complement, LogicalNot, LowByte, HighByte };
+
+enum BinaryOp : uint8_t {
+    Multiply, Divide, Modulo, Add, Subtract, ShiftLeft, ShiftRight, Less, Greater, LessEqual, GreaterEqual,
+    Equal, NotEqual, BitAnd, BitXor, BitOr, LogicalAnd, LogicalOr,
+};
+
+// Longer operators first, so they aren't taken for their prefixes
+constexpr struct {
+    std::string_view text;
+    BinaryOp op;
+    int precedence;
+} BinaryOps[] = {
+    { "<<", ShiftLeft, 8 }, { ">>", ShiftRight, 8 }, { "<=", LessEqual, 7 }, { ">=", GreaterEqual, 7 },
+    { "==", Equal, 6 }, { "!=", NotEqual, 6 }, { "<>", NotEqual, 6 }, { "&&", LogicalAnd, 2 }, { "||", LogicalOr, 1 },
+    { "*", Multiply, 10 }, { "/", Divide, 10 }, { "%", Modulo, 10 }, { "+", Add, 9 }, { "-", Subtract, 9 },
+    { "<", Less, 7 }, { ">", Greater, 7 }, { "=", Equal, 6 }, { "&", BitAnd, 5 }, { "^", BitXor, 4 }, { "|", BitOr, 3 },
+};
+
+bool is_identifier_start(char ch) {
+    return isalpha((unsigned char)ch) || ch=='_' || ch=='.';
+}
+
+bool is_identifier(char ch) {
+    return isalnum((unsigned char)ch) || ch=='_' || ch=='.';
+}
+
+void skip_space(std::string_view &text) {
+    while( !text.empty() && isspace((unsigned char)text[0]) )
+        text.remove_prefix(1);
+}
+
+std::string_view trim(std::string_view text) {
+    skip_space(text);
+    while( !text.empty() && isspace((unsigned char)text.back()) )
+        text.remove_suffix(1);
+
+    return text;
+}
+
+std::string lower(std::string_view text) {
+    std::string result(text);
+    for( char &ch : result )
+        ch = tolower((unsigned char)ch);
+
+    return result;
+}
+
+std::string_view take_identifier(std::string_view &text) {
+    size_t length = 0;
+    while( length<text.size() && is_identifier(text[length]) )
+        length++;
+
+    std::string_view identifier = text.substr(0, length);
+    text.remove_prefix(length);
+    return identifier;
+}
+
+// Where the quote that starts text ends, or npos
+size_t quote_end(std::string_view text) {
+    for( size_t i = 1; i<text.size(); ++i ) {
+        if( text[i]==text[0] )
+            return i;
+    }
+
+    return std::string_view::npos;
+}
+
+// Splits on the commas outside of parentheses and quotes
+std::vector<std::string_view> split_args(std::string_view text) {
+    std::vector<std::string_view> args;
+    int depth = 0;
+    size_t start = 0;
+
+    for( size_t i = 0; i<text.size(); ++i ) {
+        char ch = text[i];
+        if( ch=='"' || (ch=='\'' && i+2<text.size() && text[i+2]=='\'') ) {
+            size_t end = quote_end(text.substr(i));
+            if( end!=std::string_view::npos )
+                i += end;
+        } else if( ch=='(' ) {
+            depth++;
+        } else if( ch==')' ) {
+            depth--;
+        } else if( ch==',' && depth==0 ) {
+            args.push_back( trim(text.substr(start, i-start)) );
+            start = i+1;
+        }
+    }
+    args.push_back( trim(text.substr(start)) );
+
+    return args;
+}
+
+std::string_view strip_comment(std::string_view line) {
+    for( size_t i = 0; i<line.size(); ++i ) {
+        if( line[i]==';' )
+            return line.substr(0, i);
+        if( line[i]=='"' || (line[i]=='\'' && i+2<line.size() && line[i+2]=='\'') ) {
+            size_t end = quote_end(line.substr(i));
+            if( end==std::string_view::npos )
+                break;
+            i += end;
+        }
+    }
+
+    return line;
+}
+
+const std::unordered_map<std::string, Operation> &operation_names() {
+    static const std::unordered_map<std::string, Operation> names = [] {
+        std::unordered_map<std::string, Operation> result;
+        for( size_t op = 1; op<=size_t(Operation::Op_WAI); ++op )
+            result[ lower(OperationNames[op]) ] = Operation(op);
+
+        return result;
+    }();
+
+    return names;
+}
+
+} // namespace
+
+Assembler::Assembler(Variant variant) : variant_(variant) {
+    for( auto &modes : opcodes_ )
+        modes.fill(-1);
+
+    // RMB, SMB, BBR and BBS have one opcode per bit; the first is kept, and the bit added to it
+    for( unsigned opcode = 0; opcode<256; ++opcode ) {
+        bool supported = variant==Variant::Nmos ? Opcodes::isNmos(opcode) : Opcodes::isCmos(opcode);
+        int16_t &entry = opcodes_[ size_t(Opcodes::operation(opcode)) ][ size_t(Opcodes::mode(opcode)) ];
+        if( supported && entry<0 )
+            entry = opcode;
+    }
+}
+
+void Assembler::define(const std::string &name, int32_t value) {
+    defines_.emplace_back(name, value);
+}
+
+void Assembler::assemble(std::string_view source, Program &program) {
+    nodes_.clear();
+    symbols_.clear();
+    symbol_index_.clear();
+    statements_.clear();
+    scope_.clear();
+    line_ = 0;
+
+    for( const auto &[name, value] : defines_ )
+        defineSymbol( symbol(name), value );
+
+    std::vector<bool> conditions;
+    while( !source.empty() ) {
+        size_t end = source.find('\n');
+        std::string_view line = source.substr(0, end);
+        source.remove_prefix( end==std::string_view::npos ? source.size() : end+1 );
+
+        line_++;
+        parseLine(line, conditions);
+    }
+    if( !conditions.empty() )
+        error(".if without .endif");
+
+    for( unsigned pass = 0; layout(); ++pass ) {
+        if( pass==MaxPasses )
+            error("The layout doesn't settle, as zero page operands keep moving labels across $100");
+    }
+
+    program.memory.fill(0);
+    program.written.reset();
+    program.lines.clear();
+    program.symbols.clear();
+
+    emit(program);
+
+    for( const Symbol &symbol : symbols_ ) {
+        if( symbol.value )
+            program.symbols[symbol.name] = *symbol.value;
+    }
+}
+
+void Assembler::parseLine(std::string_view line, std::vector<bool> &conditions) {
+    std::string_view rest = strip_comment(line);
+    if( !rest.empty() && rest.back()=='\r' )
+        rest.remove_suffix(1);
+
+    std::string_view label;
+    if( !rest.empty() && !isspace((unsigned char)rest[0]) ) {
+        label = take_identifier(rest);
+        if( label.empty() )
+            error("Expected a label at the start of the line");
+        if( !rest.empty() && rest[0]==':' )
+            rest.remove_prefix(1);
+    }
+
+    skip_space(rest);
+    std::string_view word;
+    if( !rest.empty() && rest[0]=='=' ) {
+        word = rest.substr(0, 1);
+        rest.remove_prefix(1);
+    } else {
+        word = take_identifier(rest);
+        // An indented label, which needs its colon
+        if( label.empty() && !word.empty() && !rest.empty() && rest[0]==':' ) {
+            label = word;
+            rest.remove_prefix(1);
+            skip_space(rest);
+            word = take_identifier(rest);
+        }
+    }
+    std::string directive = lower(word);
+    std::string_view operand = trim(rest);
+
+    // Conditionals are followed even where they're being skipped, to find where that ends
+    bool active = std::find( conditions.begin(), conditions.end(), false )==conditions.end();
+    if( directive==".if" ) {
+        if( !active ) {
+            conditions.push_back(false);
+            return;
+        }
+
+        std::string_view condition = operand;
+        uint32_t node = parseExpression(condition);
+        if( !trim(condition).empty() )
+            error("Unexpected text after the expression");
+        pc_ = 0;
+        conditions.push_back( require(node)!=0 );
+        return;
+    }
+    if( directive==".else" ) {
+        if( conditions.empty() )
+            error(".else without .if");
+        conditions.back() = !conditions.back();
+        return;
+    }
+    if( directive==".endif" ) {
+        if( conditions.empty() )
+            error(".endif without .if");
+        conditions.pop_back();
+        return;
+    }
+    if( !active )
+        return;
+
+    if( !label.empty() ) {
+        if( label[0]!='.' )
+            scope_ = label;
+
+        int index = symbol(label);
+        if( symbols_[index].line!=0 )
+            error( std::string(label) + " is already defined on line " + std::to_string(symbols_[index].line) );
+        symbols_[index].line = line_;
+
+        if( directive=="=" || directive=="equ" || directive==".equ" ) {
+            std::string_view text = operand;
+            uint32_t node = parseExpression(text);
+            if( !trim(text).empty() )
+                error("Unexpected text after the expression");
+
+            // Known straight away if it can be, for .if
+            pc_ = 0;
+            if( auto value = evaluate(node) )
+                symbols_[index].value = value;
+
+            statements_.push_back( Statement{ .kind = Statement::Kind::Assign, .line = line_, .symbol = index,
+                    .args = { node } } );
+            return;
+        }
+
+        statements_.push_back( Statement{ .kind = Statement::Kind::Label, .line = line_, .symbol = index } );
+    }
+
+    if( word.empty() ) {
+        if( !operand.empty() )
+            error("Expected an instruction or directive");
+        return;
+    }
+
+    if( directive==".org" ) {
+        statements_.push_back( Statement{ .kind = Statement::Kind::Org, .line = line_, .args = parseList(operand, false) } );
+        if( statements_.back().args.size()!=1 )
+            error(".org takes one address");
+    } else if( directive==".byte" || directive==".db" || directive==".data" ) {
+        statements_.push_back( Statement{ .kind = Statement::Kind::Bytes, .line = line_, .args = parseList(operand, true) } );
+    } else if( directive==".word" || directive==".dw" ) {
+        statements_.push_back( Statement{ .kind = Statement::Kind::Words, .line = line_, .args = parseList(operand, false) } );
+    } else if( directive==".dc" || directive==".ds" || directive==".dsb" || directive==".blk" ) {
+        statements_.push_back( Statement{ .kind = Statement::Kind::Fill, .line = line_, .args = parseList(operand, false) } );
+        if( statements_.back().args.size()>2 )
+            error( directive + " takes a count and a fill value" );
+    } else if( directive[0]=='.' || directive=="=" ) {
+        error( "Unknown directive " + std::string(word) );
+    } else {
+        auto op = operation_names().find(directive);
+        if( op==operation_names().end() )
+            error( "Unknown instruction " + std::string(word) );
+
+        parseInstruction(op->second, operand);
+    }
+}
+
+void Assembler::parseInstruction(Operation op, std::string_view operand) {
+    Statement statement{ .kind = Statement::Kind::Instruction, .line = line_, .op = op };
+
+    auto expression = [this](std::string_view text) {
+        uint32_t node = parseExpression(text);
+        if( !trim(text).empty() )
+            error("Unexpected text in the operand");
+        return node;
+    };
+    auto is_register = [](std::string_view text, char reg) {
+        text = trim(text);
+        return text.size()==1 && tolower((unsigned char)text[0])==reg;
+    };
+
+    if( operand.empty() ) {
+        statement.form = Form::Implied;
+    } else if( is_register(operand, 'a') ) {
+        statement.form = Form::Accumulator;
+    } else if( operand[0]=='#' ) {
+        statement.form = Form::Immediate;
+        statement.args = { expression(operand.substr(1)) };
+    } else if( op==Operation::Op_RMB || op==Operation::Op_SMB || op==Operation::Op_BBR || op==Operation::Op_BBS ) {
+        bool branch = op==Operation::Op_BBR || op==Operation::Op_BBS;
+        statement.form = branch ? Form::BitBranch : Form::Bit;
+        statement.args = parseList(operand, false);
+        if( statement.args.size()!=(branch ? 3 : 2) )
+            error( std::string(OperationNames[size_t(op)]) + (branch ? " takes bit,zp,target" : " takes bit,zp") );
+    } else {
+        // A parenthesised operand is indirect, unless the parentheses are only part of an expression
+        if( operand[0]=='(' ) {
+            int depth = 0;
+            size_t close = 0;
+            for( size_t i = 0; i<operand.size(); ++i ) {
+                if( operand[i]=='(' ) {
+                    depth++;
+                } else if( operand[i]==')' && --depth==0 ) {
+                    close = i;
+                    break;
+                }
+            }
+
+            std::string_view inner = operand.substr(1, close-1), after = trim(operand.substr(close+1));
+            if( close!=0 && after.empty() ) {
+                auto parts = split_args(inner);
+                if( parts.size()==2 && is_register(parts[1], 'x') ) {
+                    statement.form = Form::IndirectX;
+                    statement.args = { expression(parts[0]) };
+                } else if( parts.size()==1 ) {
+                    statement.form = Form::Indirect;
+                    statement.args = { expression(inner) };
+                } else {
+                    error("Bad indirect operand");
+                }
+                statements_.push_back( std::move(statement) );
+                return;
+            }
+            if( close!=0 && after[0]==',' && is_register(after.substr(1), 'y') ) {
+                statement.form = Form::IndirectY;
+                statement.args = { expression(inner) };
+                statements_.push_back( std::move(statement) );
+                return;
+            }
+        }
+
+        auto parts = split_args(operand);
+        if( parts.size()==1 ) {
+            statement.form = Form::Direct;
+        } else if( parts.size()==2 && is_register(parts[1], 'x') ) {
+            statement.form = Form::DirectX;
+        } else if( parts.size()==2 && is_register(parts[1], 'y') ) {
+            statement.form = Form::DirectY;
+        } else {
+            error("Bad operand");
+        }
+        statement.args = { expression(parts[0]) };
+    }
+
+    statements_.push_back( std::move(statement) );
+}
+
+std::vector<uint32_t> Assembler::parseList(std::string_view text, bool strings) {
+    std::vector<uint32_t> nodes;
+    if( text.empty() )
+        error("Expected a value");
+
+    for( std::string_view item : split_args(text) ) {
+        if( strings && !item.empty() && item[0]=='"' ) {
+            size_t end = quote_end(item);
+            if( end==std::string_view::npos || end+1!=item.size() )
+                error("Bad string");
+            for( char ch : item.substr(1, end-1) )
+                nodes.push_back( addNode( Node{ .kind = Node::Kind::Number, .value = (unsigned char)ch } ) );
+            continue;
+        }
+
+        nodes.push_back( parseExpression(item) );
+        if( !trim(item).empty() )
+            error("Unexpected text after the expression");
+    }
+
+    return nodes;
+}
+
+uint32_t Assembler::parseExpression(std::string_view &text, int min_precedence) {
+    uint32_t left = parsePrimary(text);
+
+    while( true ) {
+        skip_space(text);
+
+        auto op = std::find_if( std::begin(BinaryOps), std::end(BinaryOps),
+                [&](const auto &candidate) { return text.starts_with(candidate.text); } );
+        if( op==std::end(BinaryOps) || op->precedence<min_precedence )
+            return left;
+
+        text.remove_prefix( op->text.size() );
+        uint32_t right = parseExpression(text, op->precedence+1);
+        left = addNode( Node{ .kind = Node::Kind::Binary, .op = op->op, .left = left, .right = right } );
+    }
+}
+
+uint32_t Assembler::parsePrimary(std::string_view &text) {
+    skip_space(text);
+    if( text.empty() )
+        error("Expected an expression");
+
+    auto digits = [&](int base, const char *kind) {
+        int64_t value = 0;
+        size_t count = 0;
+        while( count<text.size() && isxdigit((unsigned char)text[count]) ) {
+            int digit = isdigit((unsigned char)text[count]) ? text[count]-'0' : tolower(text[count])-'a'+10;
+            if( digit>=base )
+                break;
+            value = value*base + digit;
+            if( value>UINT32_MAX )
+                error("Number too big");
+            count++;
+        }
+        if( count==0 )
+            error( std::string("Expected ") + kind + " digits" );
+
+        text.remove_prefix(count);
+        return addNode( Node{ .kind = Node::Kind::Number, .value = int32_t(value) } );
+    };
+    auto unary = [&](UnaryOp op) {
+        text.remove_prefix(1);
+        uint32_t operand = parsePrimary(text);
+        return addNode( Node{ .kind = Node::Kind::Unary, .op = op, .left = operand } );
+    };
+
+    char ch = text[0];
+    switch( ch ) {
+    case '(': {
+        text.remove_prefix(1);
+        uint32_t node = parseExpression(text);
+        skip_space(text);
+        if( text.empty() || text[0]!=')' )
+            error("Missing )");
+        text.remove_prefix(1);
+        return node;
+    }
+    case '-': return unary(Negate);
+    case '~': return unary(Complement);
+    case '!': return unary(LogicalNot);
+    case '<': return unary(LowByte);
+    case '>': return unary(HighByte);
+    case '+':
+        text.remove_prefix(1);
+        return parsePrimary(text);
+    case '*':
+        text.remove_prefix(1);
+        return addNode( Node{ .kind = Node::Kind::Pc } );
+    case '$':
+        text.remove_prefix(1);
+        return digits(16, "hex");
+    case '%':
+        text.remove_prefix(1);
+        return digits(2, "binary");
+    case '\'':
+        if( text.size()<3 || text[2]!='\'' )
+            error("Bad character constant");
+        ch = text[1];
+        text.remove_prefix(3);
+        return addNode( Node{ .kind = Node::Kind::Number, .value = (unsigned char)ch } );
+    }
+
+    if( text.starts_with("0x") || text.starts_with("0X") ) {
+        text.remove_prefix(2);
+        return digits(16, "hex");
+    }
+    if( isdigit((unsigned char)ch) )
+        return digits(10, "decimal");
+
+    if( is_identifier_start(ch) ) {
+        std::string_view name = take_identifier(text);
+        return addNode( Node{ .kind = Node::Kind::Symbol, .value = symbol(name) } );
+    }
+
+    error( std::string("Unexpected ") + ch + " in expression" );
+}
+
+uint32_t Assembler::addNode(Node node) {
+    nodes_.push_back(node);
+    return nodes_.size()-1;
+}
+
+int Assembler::symbol(std::string_view name) {
+    std::string key = name[0]=='.' ? scope_ + std::string(name) : std::string(name);
+
+    auto [iter, added] = symbol_index_.try_emplace( key, int(symbols_.size()) );
+    if( added )
+        symbols_.push_back( Symbol{ .name = std::move(key) } );
+
+    return iter->second;
+}
+
+void Assembler::defineSymbol(int index, int32_t value) {
+    symbols_[index].value = value;
+}
+
+std::optional<int32_t> Assembler::evaluate(uint32_t index, bool strict) {
+    const Node &node = nodes_[index];
+
+    switch( node.kind ) {
+    case Node::Kind::Number:
+        return node.value;
+    case Node::Kind::Pc:
+        return pc_;
+    case Node::Kind::Symbol: {
+        const Symbol &symbol = symbols_[node.value];
+        if( !symbol.value && strict )
+            error("Undefined symbol " + symbol.name);
+        return symbol.value;
+    }
+    case Node::Kind::Unary: {
+        auto operand = evaluate(node.left, strict);
+        if( !operand )
+            return std::nullopt;
+
+        switch( UnaryOp(node.op) ) {
+        case Negate: return -*operand;
+        case Complement: return ~*operand;
+        case LogicalNot: return !*operand;
+        case LowByte: return *operand & 0xff;
+        case HighByte: return (*operand>>8) & 0xff;
+        }
+        break;
+    }
+    case Node::Kind::Binary: {
+        auto left = evaluate(node.left, strict), right = evaluate(node.right, strict);
+        if( !left || !right )
+            return std::nullopt;
+
+        int64_t l = *left, r = *right;
+        switch( BinaryOp(node.op) ) {
+        case Multiply: return int32_t( l*r );
+        case Divide:
+            if( r==0 )
+                error("Division by zero");
+            return int32_t( l/r );
+        case Modulo:
+            if( r==0 )
+                error("Division by zero");
+            return int32_t( l%r );
+        case Add: return int32_t( l+r );
+        case Subtract: return int32_t( l-r );
+        case ShiftLeft: return int32_t( l<<(r & 31) );
+        case ShiftRight: return int32_t( l>>(r & 31) );
+        case Less: return l<r;
+        case Greater: return l>r;
+        case LessEqual: return l<=r;
+        case GreaterEqual: return l>=r;
+        case Equal: return l==r;
+        case NotEqual: return l!=r;
+        case BitAnd: return int32_t( l&r );
+        case BitXor: return int32_t( l^r );
+        case BitOr: return int32_t( l|r );
+        case LogicalAnd: return l && r;
+        case LogicalOr: return l || r;
+        }
+        break;
+    }
+    }
+
+    return std::nullopt;
+}
+
+int32_t Assembler::require(uint32_t node) {
+    return *evaluate(node, true);
+}
+
+// Places every statement with the values the last layout found, and says whether anything moved
+bool Assembler::layout() {
+    bool changed = false;
+    uint32_t pc = 0;
+
+    auto set = [&](int index, std::optional<int32_t> value) {
+        if( value && symbols_[index].value!=value ) {
+            symbols_[index].value = value;
+            changed = true;
+        }
+    };
+
+    for( Statement &statement : statements_ ) {
+        line_ = statement.line;
+        pc_ = pc;
+
+        switch( statement.kind ) {
+        case Statement::Kind::Label:
+            set(statement.symbol, pc);
+            break;
+        case Statement::Kind::Assign:
+            set(statement.symbol, evaluate(statement.args[0]));
+            break;
+        case Statement::Kind::Org:
+            pc = require(statement.args[0]);
+            if( pc>0xffff )
+                error(".org address out of range");
+            break;
+        case Statement::Kind::Bytes:
+            pc += statement.args.size();
+            break;
+        case Statement::Kind::Words:
+            pc += 2*statement.args.size();
+            break;
+        case Statement::Kind::Fill:
+            pc += require(statement.args[0]);
+            break;
+        case Statement::Kind::Instruction: {
+            auto [mode, size] = std::pair(statement.mode, statement.size);
+            choose(statement);
+            if( statement.mode!=mode || statement.size!=size )
+                changed = true;
+            pc += statement.size;
+            break;
+        }
+        }
+
+        if( pc>0x10000 )
+            error("Past the end of memory");
+    }
+
+    return changed;
+}
+
+// Picks the addressing mode from the operand's form, and its value where that decides between zero page
+// and absolute
+void Assembler::choose(Statement &statement) {
+    Operation op = statement.op;
+
+    auto pick = [&](AddressingMode mode, uint8_t size) {
+        statement.mode = mode;
+        statement.size = size;
+    };
+    auto fits_zp = [&] {
+        auto value = evaluate(statement.args[0]);
+        return value && *value>=0 && *value<=0xff;
+    };
+    auto zp_or_abs = [&](AddressingMode zp, AddressingMode abs) {
+        if( has(op, zp) && (fits_zp() || !has(op, abs)) )
+            pick(zp, 2);
+        else if( has(op, abs) )
+            pick(abs, 3);
+    };
+
+    statement.mode = AddressingMode::Unknown;
+
+    switch( statement.form ) {
+    case Form::Implied:
+        for( AddressingMode mode : { AddressingMode::Implied, AddressingMode::Stack, AddressingMode::Accumulator } ) {
+            if( has(op, mode) ) {
+                pick(mode, 1);
+                break;
+            }
+        }
+        break;
+    case Form::Accumulator:
+        if( has(op, AddressingMode::Accumulator) )
+            pick(AddressingMode::Accumulator, 1);
+        break;
+    case Form::Immediate:
+        // BRK's signature byte
+        if( op==Operation::Op_BRK )
+            pick(AddressingMode::Stack, 2);
+        else if( has(op, AddressingMode::Immediate) )
+            pick(AddressingMode::Immediate, 2);
+        break;
+    case Form::Direct:
+        if( has(op, AddressingMode::Pc_rel) )
+            pick(AddressingMode::Pc_rel, 2);
+        else if( op==Operation::Op_BRK )
+            pick(AddressingMode::Stack, 2);
+        else
+            zp_or_abs(AddressingMode::Zp, AddressingMode::Abs);
+        break;
+    case Form::DirectX:
+        zp_or_abs(AddressingMode::Zp_x, AddressingMode::Abs_x);
+        break;
+    case Form::DirectY:
+        zp_or_abs(AddressingMode::Zp_y, AddressingMode::Abs_y);
+        break;
+    case Form::Indirect:
+        if( has(op, AddressingMode::Abs_ind) )
+            pick(AddressingMode::Abs_ind, 3);
+        else if( has(op, AddressingMode::Zp_ind) )
+            pick(AddressingMode::Zp_ind, 2);
+        break;
+    case Form::IndirectX:
+        if( has(op, AddressingMode::Abs_x_ind) )
+            pick(AddressingMode::Abs_x_ind, 3);
+        else if( has(op, AddressingMode::Zp_x_ind) )
+            pick(AddressingMode::Zp_x_ind, 2);
+        break;
+    case Form::IndirectY:
+        if( has(op, AddressingMode::Zp_ind_y) )
+            pick(AddressingMode::Zp_ind_y, 2);
+        break;
+    case Form::Bit:
+        if( has(op, AddressingMode::Zp) )
+            pick(AddressingMode::Zp, 2);
+        break;
+    case Form::BitBranch:
+        if( has(op, AddressingMode::Pc_rel) )
+            pick(AddressingMode::Pc_rel, 3);
+        break;
+    }
+
+    if( statement.mode==AddressingMode::Unknown ) {
+        error( std::string("Addressing mode not available for ") + OperationNames[size_t(op)] +
+                (variant_==Variant::Nmos ? " on the NMOS 6502" : "") );
+    }
+}
+
+void Assembler::emit(Program &program) {
+    uint32_t pc = 0;
+
+    auto put = [&](int32_t value) {
+        if( pc>0xffff )
+            error("Past the end of memory");
+        program.memory[pc] = value;
+        program.written.set(pc);
+        pc++;
+    };
+    auto checked = [&](uint32_t node, int32_t min, int32_t max, const char *what) {
+        int32_t value = require(node);
+        if( value<min || value>max )
+            error( std::string(what) + " out of range: " + std::to_string(value) );
+        return value;
+    };
+    auto put_word = [&](int32_t value) {
+        put(value & 0xff);
+        put((value>>8) & 0xff);
+    };
+    auto branch_offset = [&](uint32_t node, uint32_t next) {
+        int32_t offset = require(node) - int32_t(next);
+        if( offset<-128 || offset>127 )
+            error( "Branch out of range by " + std::to_string( offset<0 ? -128-offset : offset-127 ) + " bytes" );
+        return offset;
+    };
+
+    for( const Statement &statement : statements_ ) {
+        line_ = statement.line;
+        pc_ = pc;
+        Addr start = pc;
+
+        switch( statement.kind ) {
+        case Statement::Kind::Label:
+            break;
+        case Statement::Kind::Assign:
+            require(statement.args[0]);
+            break;
+        case Statement::Kind::Org:
+            pc = require(statement.args[0]);
+            start = pc;
+            break;
+        case Statement::Kind::Bytes:
+            for( uint32_t node : statement.args )
+                put( checked(node, -128, 255, "Byte") );
+            break;
+        case Statement::Kind::Words:
+            for( uint32_t node : statement.args )
+                put_word( checked(node, -32768, 65535, "Word") );
+            break;
+        case Statement::Kind::Fill: {
+            int32_t count = checked(statement.args[0], 0, 65536, "Count");
+            int32_t fill = statement.args.size()>1 ? checked(statement.args[1], -128, 255, "Fill value") : 0;
+            for( int32_t i = 0; i<count; ++i )
+                put(fill);
+            break;
+        }
+        case Statement::Kind::Instruction: {
+            uint8_t opcode = this->opcode(statement.op, statement.mode);
+
+            if( statement.form==Form::Bit || statement.form==Form::BitBranch ) {
+                put( opcode + (checked(statement.args[0], 0, 7, "Bit number")<<4) );
+                put( checked(statement.args[1], 0, 0xff, "Zero page address") );
+                if( statement.form==Form::BitBranch )
+                    put( branch_offset(statement.args[2], pc+1) );
+            } else if( statement.size==1 ) {
+                put(opcode);
+            } else if( statement.mode==AddressingMode::Pc_rel ) {
+                put(opcode);
+                put( branch_offset(statement.args[0], pc+1) );
+            } else if( statement.size==2 ) {
+                put(opcode);
+                if( statement.mode==AddressingMode::Immediate || statement.mode==AddressingMode::Stack )
+                    put( checked(statement.args[0], -128, 255, "Immediate value") );
+                else
+                    put( checked(statement.args[0], 0, 0xff, "Zero page address") );
+            } else {
+                put(opcode);
+                put_word( checked(statement.args[0], -32768, 65535, "Address") );
+            }
+            break;
+        }
+        }
+
+        if( pc!=start && statement.kind!=Statement::Kind::Org )
+            program.lines.push_back( Program::Line{ .address = start, .size = unsigned(pc-start), .line = statement.line } );
+    }
+}
+
+void Assembler::error(const std::string &message) const {
+    throw AssemblyError(line_, message);
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include "Bus.h"
+#include "opcodes.h"
+
+#include <array>
+#include <bitset>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <stdint.h>
+
+// Assembles the vasm oldstyle syntax test_program.s is written in (vasm's -dotdir) straight into a memory
+// image, so tools that generate programs don't have to run vasm and parse_lst on each one.
+//
+// It understands:
+//  - labels at the start of a line, with or without a colon. Local labels start with a dot, and belong
+//    to the last label that doesn't;
+//  - NAME = expression (or equ), .org, .byte/.db/.data, .word/.dw, .dc/.ds/.dsb/.blk count[,fill], and
+//    .if/.else/.endif on symbols defined above them;
+//  - expressions with C's operators, $hex, %binary, 'c', * for the current address, and unary < and >
+//    for the low and high byte.
+//
+// Zero page addressing is used whenever the operand fits, forward references included, as the layout is
+// repeated until it settles.
+
+class AssemblyError : public std::runtime_error {
+    size_t line_;
+
+public:
+    AssemblyError(size_t line, const std::string &message) : std::runtime_error(message), line_(line) {}
+
+    // In the source, 1 based
+    size_t line() const { return line_; }
+};
+
+struct Program {
+    struct Line {
+        Addr address;
+        unsigned size;
+        // In the source, 1 based
+        size_t line;
+    };
+
+    std::array<uint8_t, 65536> memory{};
+    std::bitset<65536> written;
+    // Source lines that produced bytes, in source order
+    std::vector<Line> lines;
+    // Every label and constant. Local labels are named global.local
+    std::map<std::string, int32_t> symbols;
+};
+
+class Assembler {
+public:
+    enum class Variant { Nmos, Cmos };
+
+private:
+    static constexpr size_t NumOperations = size_t(Operation::Op_WAI) + 1;
+    static constexpr size_t NumModes = size_t(AddressingMode::Zp_ind_y) + 1;
+
+    // How an operand is written, before the layout picks zero page or absolute addressing
+    enum class Form : uint8_t {
+        Implied, Accumulator, Immediate, Direct, DirectX, DirectY, Indirect, IndirectX, IndirectY,
+        // RMB and SMB: bit,zp
+        Bit,
+        // BBR and BBS: bit,zp,target
+        BitBranch,
+    };
+
+    struct Node {
+        enum class Kind : uint8_t { Number, Symbol, Pc, Unary, Binary };
+
+        Kind kind;
+        uint8_t op;
+        // The number, or the symbol's index
+        int32_t value;
+        uint32_t left, right;
+    };
+
+    struct Symbol {
+        std::string name;
+        std::optional<int32_t> value;
+        // Where it is defined, 0 if it isn't yet
+        size_t line = 0;
+    };
+
+    struct Statement {
+        enum class Kind : uint8_t { Label, Assign, Org, Bytes, Words, Fill, Instruction };
+
+        Kind kind;
+        size_t line;
+        int symbol = -1;
+        Operation op = Operation::Op_Unknown;
+        Form form = Form::Implied;
+        // As the last layout chose them
+        AddressingMode mode = AddressingMode::Unknown;
+        uint8_t size = 0;
+        // Roots of the operand expressions
+        std::vector<uint32_t> args;
+    };
+
+    Variant variant_;
+    std::array< std::array<int16_t, NumModes>, NumOperations > opcodes_;
+    std::vector< std::pair<std::string, int32_t> > defines_;
+
+    // Kept between runs, so assembling many programs doesn't allocate much
+    std::vector<Node> nodes_;
+    std::vector<Symbol> symbols_;
+    std::unordered_map<std::string, int> symbol_index_;
+    std::vector<Statement> statements_;
+    std::string scope_;
+    size_t line_ = 0;
+    uint32_t pc_ = 0;
+
+public:
+    explicit Assembler(Variant variant = Variant::Nmos);
+
+    // Like vasm's -D, for every program assembled from now on
+    void define(const std::string &name, int32_t value);
+
+    // Throws AssemblyError
+    void assemble(std::string_view source, Program &program);
+    Program assemble(std::string_view source) {
+        Program program;
+        assemble(source, program);
+        return program;
+    }
+
+private:
+    void parseLine(std::string_view line, std::vector<bool> &conditions);
+    void parseInstruction(Operation op, std::string_view operand);
+    std::vector<uint32_t> parseList(std::string_view text, bool strings);
+
+    uint32_t parseExpression(std::string_view &text, int min_precedence = 0);
+    uint32_t parsePrimary(std::string_view &text);
+    uint32_t addNode(Node node);
+    int symbol(std::string_view name);
+    void defineSymbol(int index, int32_t value);
+
+    std::optional<int32_t> evaluate(uint32_t node, bool strict = false);
+    int32_t require(uint32_t node);
+
+    bool layout();
+    void choose(Statement &statement);
+    void emit(Program &program);
+
+    int16_t opcode(Operation op, AddressingMode mode) const { return opcodes_[size_t(op)][size_t(mode)]; }
+    bool has(Operation op, AddressingMode mode) const { return opcode(op, mode)>=0; }
+    [[noreturn]] void error(const std::string &message) const;
+};
@@ -0,0 +1,259 @@
+// Runs a routine once for every possible value of an input byte, 32 inputs at a time on c6502Lanes, and
+// prints the resulting registers. With -v every input is rerun on c6502 and the results compared.
+
+#include "readmem.h"
+
+#include "Bus.h"
+#include "c6502.h"
+#include "c6502_lanes.h"
+
+#include <chrono>
+#include <iostream>
+#include <optional>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+using Image = std::array<uint8_t, 65536>;
+
+// The routine is entered as if called with JSR from just below here, so its RTS lands on it
+static constexpr Addr StopAddress = 0xfff0;
+static constexpr uint8_t InitialStatus = 0x34;
+
+struct Options {
+    // Register name or memory address receiving the swept value
+    char input_register = 'a';
+    Addr input_address = 0;
+    std::vector<Addr> outputs;
+    uint32_t max_instructions = 100000;
+    bool verify = false;
+
+    Addr routine;
+};
+
+struct Result {
+    c6502Lanes::Registers registers;
+    std::vector<uint8_t> outputs;
+    c6502Lanes::LaneStatus status;
+    uint32_t instructions;
+};
+
+class RoutineDone {};
+class RoutineTimeout {};
+
+class ReferenceBus : public Bus {
+    Image               &memory;
+    size_t              cycles_left;
+
+public:
+    ReferenceBus(Image &memory, size_t max_cycles) : memory(memory), cycles_left(max_cycles) {}
+
+    virtual uint8_t read( c6502 *cpu, Addr address, bool sync = false ) override {
+        tick();
+
+        if( sync && address==StopAddress )
+            throw RoutineDone();
+
+        return memory[address];
+    }
+
+    virtual void write( c6502 *cpu, Addr address, uint8_t value ) override {
+        tick();
+
+        memory[address] = value;
+    }
+
+private:
+    void tick() {
+        if( cycles_left--==0 )
+            throw RoutineTimeout();
+    }
+};
+
+static void set_input(const Options &options, c6502Lanes::Registers &registers, uint8_t value) {
+    switch( options.input_register ) {
+    case 'a': registers.regA = value; break;
+    case 'x': registers.regX = value; break;
+    case 'y': registers.regY = value; break;
+    }
+}
+
+static c6502Lanes::Registers initial_registers(const Options &options, uint8_t input) {
+    c6502Lanes::Registers registers{ .regA = 0, .regX = 0, .regY = 0, .regSp = 0xfd, .regStatus = InitialStatus,
+            .pc = options.routine };
+    set_input(options, registers, input);
+
+    return registers;
+}
+
+static void push_return_address(Image &memory) {
+    memory[0x1ff] = (StopAddress-1) >> 8;
+    memory[0x1fe] = (StopAddress-1) & 0xff;
+}
+
+static std::vector<Result> run_lanes(const Options &options, const Image &image) {
+    std::vector<Result> results;
+    c6502Lanes cpu;
+
+    Image initial = image;
+    push_return_address(initial);
+
+    for( unsigned base = 0; base<256; base += c6502Lanes::Lanes ) {
+        cpu.load(0, initial.data(), initial.size());
+
+        for( size_t lane = 0; lane<c6502Lanes::Lanes; ++lane ) {
+            uint8_t input = base + lane;
+
+            if( options.input_register=='m' )
+                cpu.mem(lane, options.input_address) = input;
+
+            cpu.setRegisters(lane, initial_registers(options, input));
+        }
+
+        cpu.run(StopAddress, options.max_instructions);
+
+        for( size_t lane = 0; lane<c6502Lanes::Lanes; ++lane ) {
+            Result result{ .registers = cpu.getRegisters(lane), .status = cpu.status(lane),
+                    .instructions = cpu.instructions(lane) };
+            for( Addr address : options.outputs )
+                result.outputs.push_back( cpu.mem(lane, address) );
+
+            results.push_back( std::move(result) );
+        }
+    }
+
+    return results;
+}
+
+// Returns a description of the first difference, or nothing if c6502 agrees
+static std::optional<std::string> verify(const Options &options, const Image &image, uint8_t input, const Result &result) {
+    Image memory = image;
+    push_return_address(memory);
+    if( options.input_register=='m' )
+        memory[options.input_address] = input;
+
+    ReferenceBus bus(memory, size_t(options.max_instructions) * 8);
+    c6502 cpu(bus);
+    cpu.setSignalLogging(false);
+
+    auto registers = initial_registers(options, input);
+    cpu.setState( c6502::State{ .regA = registers.regA, .regX = registers.regX, .regY = registers.regY,
+            .regSp = registers.regSp, .regStatus = registers.regStatus, .pc = registers.pc } );
+
+    try {
+        cpu.runCpu();
+    } catch( RoutineDone ex ) {
+    } catch( RoutineTimeout ex ) {
+        return "c6502 did not return";
+    }
+
+    auto state = cpu.getState();
+    char buffer[128];
+    if( state.regA!=result.registers.regA || state.regX!=result.registers.regX || state.regY!=result.registers.regY ||
+            state.regSp!=result.registers.regSp || state.regStatus!=result.registers.regStatus )
+    {
+        snprintf(buffer, sizeof(buffer), "c6502 A=%02x X=%02x Y=%02x S=%02x P=%02x", state.regA, state.regX, state.regY,
+                state.regSp, state.regStatus);
+        return buffer;
+    }
+
+    for( size_t i=0; i<options.outputs.size(); ++i ) {
+        if( memory[options.outputs[i]]!=result.outputs[i] ) {
+            snprintf(buffer, sizeof(buffer), "c6502 [%04x]=%02x", options.outputs[i], memory[options.outputs[i]]);
+            return buffer;
+        }
+    }
+
+    return std::nullopt;
+}
+
+static void usage(const char *name) {
+    std::cerr<<"Usage: "<<name<<" [-i input] [-m address]... [-n max_instructions] [-v] program.mem routine_address\n"
+            "  -i    Where the swept value goes: a, x, y or a hex memory address (default a)\n"
+            "  -m    Also print the byte at this hex address once the routine returns\n"
+            "  -v    Rerun every input on c6502 and report differences\n";
+    exit(2);
+}
+
+int main(int argc, char *argv[]) {
+    Options options;
+
+    int opt;
+    while( (opt = getopt(argc, argv, "i:m:n:v")) != -1 ) {
+        switch( opt ) {
+        case 'i':
+            if( strcmp(optarg, "a")==0 || strcmp(optarg, "x")==0 || strcmp(optarg, "y")==0 ) {
+                options.input_register = optarg[0];
+            } else {
+                options.input_register = 'm';
+                options.input_address = strtoul(optarg, nullptr, 16);
+            }
+            break;
+        case 'm': options.outputs.push_back( strtoul(optarg, nullptr, 16) ); break;
+        case 'n': options.max_instructions = strtoul(optarg, nullptr, 0); break;
+        case 'v': options.verify = true; break;
+        default: usage(argv[0]);
+        }
+    }
+
+    if( argc-optind != 2 )
+        usage(argv[0]);
+
+    Image image{};
+    ReadMem<8> memory_image(argv[optind]);
+    while( memory_image.read_line() ) {
+        image[memory_image.address()] = memory_image[0];
+    }
+
+    options.routine = strtoul(argv[optind+1], nullptr, 16);
+
+    auto start = std::chrono::steady_clock::now();
+    auto results = run_lanes(options, image);
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - start );
+
+    static constexpr const char *StatusNames[] = { "running", "returned", "unsupported opcode", "timed out" };
+    size_t mismatches = 0;
+    uint64_t total_instructions = 0;
+
+    std::cout<<"in   A  X  Y  S  P ";
+    for( Addr address : options.outputs ) {
+        char buffer[16];
+        snprintf(buffer, sizeof(buffer), " %04x", address);
+        std::cout<<buffer;
+    }
+    std::cout<<"  instructions\n";
+
+    for( unsigned input = 0; input<256; ++input ) {
+        const auto &result = results[input];
+        total_instructions += result.instructions;
+
+        char buffer[64];
+        snprintf(buffer, sizeof(buffer), "%02x: %02x %02x %02x %02x %02x ", input, result.registers.regA, result.registers.regX,
+                result.registers.regY, result.registers.regSp, result.registers.regStatus);
+        std::cout<<buffer;
+
+        for( uint8_t value : result.outputs ) {
+            snprintf(buffer, sizeof(buffer), "   %02x", value);
+            std::cout<<buffer;
+        }
+        std::cout<<"  "<<result.instructions<<" "<<StatusNames[ size_t(result.status) ];
+
+        if( options.verify && result.status==c6502Lanes::LaneStatus::Stopped ) {
+            if( auto difference = verify(options, image, input, result) ) {
+                std::cout<<"  MISMATCH "<<*difference;
+                mismatches++;
+            }
+        }
+
+        std::cout<<"\n";
+    }
+
+    std::cout<<total_instructions<<" instructions in "<<elapsed.count()<<"us\n";
+    if( options.verify )
+        std::cout<<mismatches<<" mismatches against c6502\n";
+
+    return mismatches==0 ? 0 : 1;
+}
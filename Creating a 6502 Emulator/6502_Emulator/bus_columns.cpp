@@ -0,0 +1,126 @@
+#include "bus_columns.h"
+
+#include <algorithm>
+
+#include <string.h>
+
+namespace {
+
+#define COLUMNS_INLINE inline __attribute__(( always_inline ))
+
+// Cycles compared before checking whether any of them differed. Only a batch that does is scanned again
+// a cycle at a time, to find which.
+static constexpr size_t BatchCycles = 4096;
+
+// GCC vector extensions. The vector size has to be spelled out, as GCC ignores it when it depends on a
+// template parameter.
+template<size_t Width> struct VectorTypes;
+
+template<> struct VectorTypes<16> {
+    typedef uint8_t Bytes __attribute__(( vector_size(16) ));
+    typedef uint16_t Words __attribute__(( vector_size(16) ));
+};
+
+template<> struct VectorTypes<32> {
+    typedef uint8_t Bytes __attribute__(( vector_size(32) ));
+    typedef uint16_t Words __attribute__(( vector_size(32) ));
+};
+
+COLUMNS_INLINE bool cycle_differs(const BusColumns &log, const BusColumns &plan, size_t cycle) {
+    return log.address[cycle]!=plan.address[cycle] || log.data[cycle]!=plan.data[cycle] ||
+            ( (log.flags[cycle] ^ plan.flags[cycle]) & BusColumns::Read );
+}
+
+// Width is the native vector size of the target it is instantiated for, in bytes
+template<size_t Width>
+struct Comparer {
+    using Bytes = typename VectorTypes<Width>::Bytes;
+    using Words = typename VectorTypes<Width>::Words;
+
+    template<typename Vec, typename T>
+    static COLUMNS_INLINE Vec load(const T *column) {
+        Vec result;
+        memcpy(&result, column, sizeof(result));
+
+        return result;
+    }
+
+    static COLUMNS_INLINE bool any(Bytes vec) {
+        uint64_t words[sizeof(vec)/8];
+        memcpy(words, &vec, sizeof(vec));
+
+        uint64_t result = 0;
+        for( uint64_t word : words )
+            result |= word;
+
+        return result!=0;
+    }
+
+    // Whether any cycle in [first, end) differs
+    static COLUMNS_INLINE bool batch_differs(const BusColumns &log, const BusColumns &plan, size_t first, size_t end) {
+        Bytes diff{};
+        const Bytes read_mask = Bytes{} + BusColumns::Read;
+
+        size_t cycle = first;
+        for( ; cycle+Width<=end; cycle += Width ) {
+            diff |= load<Bytes>(&log.data[cycle]) ^ load<Bytes>(&plan.data[cycle]);
+            diff |= ( load<Bytes>(&log.flags[cycle]) ^ load<Bytes>(&plan.flags[cycle]) ) & read_mask;
+
+            // Width bytes of cycles take two vectors of addresses
+            Words addresses = ( load<Words>(&log.address[cycle]) ^ load<Words>(&plan.address[cycle]) ) |
+                    ( load<Words>(&log.address[cycle + Width/2]) ^ load<Words>(&plan.address[cycle + Width/2]) );
+            diff |= (Bytes)addresses;
+        }
+
+        if( any(diff) )
+            return true;
+
+        for( ; cycle<end; ++cycle ) {
+            if( cycle_differs(log, plan, cycle) )
+                return true;
+        }
+
+        return false;
+    }
+
+    static COLUMNS_INLINE size_t first_mismatch(const BusColumns &log, const BusColumns &plan, size_t first, size_t end) {
+        for( size_t batch = first; batch<end; batch += BatchCycles ) {
+            size_t batch_end = std::min( batch+BatchCycles, end );
+            if( !batch_differs(log, plan, batch, batch_end) )
+                continue;
+
+            for( size_t cycle = batch; cycle<batch_end; ++cycle ) {
+                if( cycle_differs(log, plan, cycle) )
+                    return cycle;
+            }
+        }
+
+        return end;
+    }
+};
+
+} // namespace
+
+// One entry point per instruction set, so that each instantiation is compiled with its vector width
+// natively supported
+__attribute__(( target("avx2") ))
+static size_t first_mismatch_avx2(const BusColumns &log, const BusColumns &plan, size_t first, size_t end) {
+    return Comparer<32>::first_mismatch(log, plan, first, end);
+}
+
+static size_t first_mismatch_baseline(const BusColumns &log, const BusColumns &plan, size_t first, size_t end) {
+    return Comparer<16>::first_mismatch(log, plan, first, end);
+}
+
+size_t firstMismatch(const BusColumns &log, const BusColumns &plan, size_t first) {
+    size_t end = std::min( log.size(), plan.size() );
+    if( first>=end )
+        return end;
+
+#if defined(__x86_64__) || defined(__i386__)
+    if( __builtin_cpu_supports("avx2") )
+        return first_mismatch_avx2(log, plan, first, end);
+#endif
+
+    return first_mismatch_baseline(log, plan, first, end);
+}
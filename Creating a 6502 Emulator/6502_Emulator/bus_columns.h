@@ -0,0 +1,43 @@
+#pragma once
+
+#include "Bus.h"
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Bus cycles stored a column per field, so that a run and the plan it is checked against can be compared
+// with vector instructions, many cycles at a time.
+struct BusColumns {
+    // Flags bits. Plans have SYNC in bit 1 as well; Incompatible is only recorded in logs, for cycles the
+    // backend knows don't match the real chip
+    static constexpr uint8_t Read = 0x01, Sync = 0x02, Incompatible = 0x80;
+
+    std::vector<uint16_t> address;
+    std::vector<uint8_t> data, flags;
+
+    size_t size() const { return address.size(); }
+
+    void clear() {
+        address.clear();
+        data.clear();
+        flags.clear();
+    }
+
+    void reserve(size_t cycles) {
+        address.reserve(cycles);
+        data.reserve(cycles);
+        flags.reserve(cycles);
+    }
+
+    void push_back(Addr cycle_address, uint8_t cycle_data, uint8_t cycle_flags) {
+        address.push_back(cycle_address);
+        data.push_back(cycle_data);
+        flags.push_back(cycle_flags);
+    }
+};
+
+// The first cycle from first on where log and plan differ in address, data or direction, or the end of
+// the shorter of the two if they don't
+size_t firstMismatch(const BusColumns &log, const BusColumns &plan, size_t first = 0);
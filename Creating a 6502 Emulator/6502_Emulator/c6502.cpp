@@ -1,5 +1,7 @@
 #include "c6502.h"
 
+#include "opcodes.h"
+
 #include <assert.h>
 
 #include <iostream>
@@ -25,30 +27,84 @@ void c6502::setReset(bool state) {
     if( state )
         reset_pending = true;
 
-    std::cout<<"CPU reset "<<state<<"\n";
+    if( log_signals )
+        std::cout<<"CPU reset "<<state<<"\n";
 }
 void c6502::setIrq(bool state) {
     irq = state;
-    std::cout<<"CPU IRQ "<<state<<"\n";
+    if( log_signals )
+        std::cout<<"CPU IRQ "<<state<<"\n";
 }
 void c6502::setNmi(bool state) {
     if( !nmi && state )
         nmi_pending = true;
 
     nmi = state;
-    std::cout<<"CPU NMI "<<state<<"\n";
+    if( log_signals )
+        std::cout<<"CPU NMI "<<state<<"\n";
 }
 void c6502::setReady(bool state) {
     ready = state;
-    std::cout<<"CPU ready "<<state<<"\n";
+    if( log_signals )
+        std::cout<<"CPU ready "<<state<<"\n";
 }
 void c6502::setSo(bool state) {
     if( !so && state )
         ccSet( CC::oVerflow, true );
     so = state;
-    std::cout<<"CPU SO "<<state<<"\n";
+    if( log_signals )
+        std::cout<<"CPU SO "<<state<<"\n";
+}
+
+c6502::State c6502::getState() const {
+    return State{
+        .regA = regA, .regX = regX, .regY = regY, .regSp = regSp, .regStatus = regStatus,
+        .pc = pc(),
+        .irq = irq, .nmi = nmi, .ready = ready, .so = so,
+        .nmi_pending = nmi_pending, .delayed_ops = delayed_ops
+    };
 }
 
+void c6502::setState(const State &state) {
+    regA = state.regA;
+    regX = state.regX;
+    regY = state.regY;
+    regSp = state.regSp;
+    regStatus = state.regStatus;
+    regPcL = state.pc & 0xff;
+    regPcH = state.pc >> 8;
+
+    irq = state.irq;
+    nmi = state.nmi;
+    ready = state.ready;
+    so = state.so;
+    nmi_pending = state.nmi_pending;
+
+    delayed_ops = state.delayed_ops;
+
+    reset = reset_pending = false;
+}
+
+void c6502::setHook(Addr address, Hook hook) {
+    hooked.set(address);
+    hooks[address] = std::move(hook);
+}
+
+void c6502::clearHook(Addr address) {
+    hooked.reset(address);
+    hooks.erase(address);
+}
+
+void c6502::runHook() {
+    State state = getState();
+    hooks[ pc() ](state);
+
+    regA = state.regA;
+    regX = state.regX;
+    regY = state.regY;
+    regSp = state.regSp;
+    regStatus = state.regStatus | 0x30;
+}
 
 void c6502::handleInstruction() {
     if( nmi_pending ) {
@@ -65,7 +121,14 @@ void c6502::handleInstruction() {
         delayed_ops = DelayedOps::None;
     }
 
-    current_opcode = read( pc(), true );
+    if( hooked.test( pc() ) ) {
+        runHook();
+
+        // Return to the caller as if the routine's first instruction had been an RTS
+        current_opcode = 0x60;
+    } else {
+        current_opcode = read( pc(), true );
+    }
 
     advance_pc();
 
@@ -128,7 +191,7 @@ void c6502::handleInstruction() {
     case 0x58: op_cli( addrmode_implicit() );                   break;
     case 0x59: op_eor( addrmode_abs_y() );                      break;
     case 0x5d: op_eor( addrmode_abs_x() );                      break;
-    case 0x5e: op_lsr( addrmode_abs_x() );                      break;
+    case 0x5e: op_lsr( addrmode_abs_x(true) );                  break;
     case 0x60: op_rts( addrmode_stack() );                      break;
     case 0x61: op_adc( addrmode_zp_x_ind() );                   break;
     case 0x65: op_adc( addrmode_zp() );                         break;
@@ -168,6 +231,7 @@ void c6502::handleInstruction() {
     case 0x9a: op_txs();                                        break;
     case 0x9d: op_sta( addrmode_abs_x(true) );                  break;
     case 0xa0: op_ldy( addrmode_immediate() );                  break;
+    case 0xa1: op_lda( addrmode_zp_x_ind() );                   break;
     case 0xa2: op_ldx( addrmode_immediate() );                  break;
     case 0xa4: op_ldy( addrmode_zp() );                         break;
     case 0xa5: op_lda( addrmode_zp() );                         break;
@@ -208,7 +272,7 @@ void c6502::handleInstruction() {
     case 0xd8: op_cld( addrmode_implicit() );                   break;
     case 0xd9: op_cmp( addrmode_abs_y() );                      break;
     case 0xdd: op_cmp( addrmode_abs_x() );                      break;
-    case 0xde: op_dec( addrmode_abs_x() );                      break;
+    case 0xde: op_dec( addrmode_abs_x(true) );                  break;
     case 0xe0: op_cpx( addrmode_immediate() );                  break;
     case 0xe1: op_sbc( addrmode_zp_x_ind() );                   break;
     case 0xe4: op_cpx( addrmode_zp() );                         break;
@@ -227,8 +291,8 @@ void c6502::handleInstruction() {
     case 0xf8: op_sed( addrmode_implicit() );                   break;
     case 0xf9: op_sbc( addrmode_abs_y() );                      break;
     case 0xfd: op_sbc( addrmode_abs_x() );                      break;
-    case 0xfe: op_inc( addrmode_abs_x() );                      break;
-    default: std::cerr<<"Unknown command "<<std::hex<<int(current_opcode)<<" at "<<(pc()-1)<<"\n"; abort();
+    case 0xfe: op_inc( addrmode_abs_x(true) );                  break;
+    default: std::cerr<<"Unknown command "<<std::hex<<int(current_opcode)<<" ("<<Opcodes::name(current_opcode)<<") at "<<(pc()-1)<<"\n"; abort();
     }
 }
 
@@ -576,7 +640,7 @@ void c6502::op_beq(Addr addr) {
 
 void c6502::op_bit(Addr addr) {
     uint8_t mem = read(addr);
-    uint8_t result = regA ^ mem;
+    uint8_t result = regA & mem;
 
     ccSet( CC::Negative, mem & 0x80 );
     ccSet( CC::oVerflow, mem & 0x40 );
@@ -2,12 +2,21 @@
 
 #include "Bus.h"
 
+#include <bitset>
+#include <functional>
+#include <unordered_map>
+
 #include <stdint.h>
 
 class c6502 {
+public:
+    // A change to the I flag that CLI or SEI made, which only lands after the next interrupt check
+    enum class DelayedOps { None, SEI, CLI };
+
+private:
     class CpuReset {};
 
-    enum class DelayedOps { None, SEI, CLI } delayed_ops = DelayedOps::None;
+    DelayedOps delayed_ops = DelayedOps::None;
 
     Bus &bus_;
 
@@ -21,6 +30,7 @@ class c6502 {
     bool reset = false, irq = false, nmi = false, ready = false, so = false;
     bool reset_pending = false, nmi_pending = false;
     bool incompatible = false;
+    bool log_signals = true;
 
     enum class CC {
         Carry,
@@ -34,6 +44,19 @@ class c6502 {
     };
 
 public:
+    // Registers and input lines. Only meaningful at an instruction boundary.
+    struct State {
+        uint8_t regA, regX, regY, regSp, regStatus;
+        Addr pc;
+        bool irq, nmi, ready, so;
+        bool nmi_pending;
+        DelayedOps delayed_ops = DelayedOps::None;
+    };
+
+    // High level emulation handler. Runs natively in place of the guest routine, and may change the
+    // registers in the state it is given. Only the registers are written back; the PC is ignored.
+    using Hook = std::function<void (State &state)>;
+
     explicit c6502(Bus &bus) : bus_(bus) {}
 
     void runCpu();
@@ -43,11 +66,27 @@ public:
     void setReady(bool state);
     void setSo(bool state);
 
+    // Signal changes are echoed to stdout unless disabled here
+    void setSignalLogging(bool enable) { log_signals = enable; }
+
+    State getState() const;
+    void setState(const State &state);
+
+    // Runs hook instead of the routine at address, then returns from it with a simulated RTS. Hooks
+    // take effect when the CPU is about to fetch an opcode from address.
+    void setHook(Addr address, Hook hook);
+    void clearHook(Addr address);
+
     // Returns true if this cycle is knowningly incompatible
     bool isIncompatible() const { return incompatible; }
 
 private:
+    // Tested on every opcode fetch, so the map is only consulted for hooked addresses
+    std::bitset<65536> hooked;
+    std::unordered_map<Addr, Hook> hooks;
+
     void handleInstruction();
+    void runHook();
     void resetSequence();
     void advance_pc();
 
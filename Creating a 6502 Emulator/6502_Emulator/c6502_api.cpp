@@ -0,0 +1,268 @@
+#include "c6502_api.h"
+
+#include "cpu_backend.h"
+
+#include <array>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <variant>
+#include <vector>
+
+#include <string.h>
+
+namespace {
+
+// Stops a run at the next opcode fetch, before it's made
+class AtInstruction {};
+
+} // namespace
+
+struct C6502Machine : public Bus {
+    std::string backend_name;
+    std::unique_ptr<CpuBackend> backend;
+    std::array<uint8_t, 65536> memory{};
+
+    uint64_t cycles = 0;
+    C6502BusCycle last{};
+    bool reset = false;
+    // Signal changes not yet made, as (signal, asserted)
+    std::vector< std::pair<int, bool> > pending_signals;
+    bool stop_at_instruction = false, at_instruction = false;
+    std::string error;
+
+    Addr io_mask = 0, io_match = 0;
+    C6502ReadCallback io_read = nullptr;
+    C6502WriteCallback io_write = nullptr;
+    void *io_context = nullptr;
+
+    uint8_t read( c6502 *cpu, Addr address, bool sync = false ) override {
+        if( sync && stop_at_instruction )
+            throw AtInstruction();
+        applySignals();
+
+        uint8_t value = io_read && (address & io_mask)==io_match ? io_read(io_context, address, sync) : memory[address];
+        last = C6502BusCycle{ .address = address, .data = value, .read = 1, .sync = sync };
+        cycles++;
+
+        return value;
+    }
+
+    void write( c6502 *cpu, Addr address, uint8_t value ) override {
+        applySignals();
+        if( io_write && (address & io_mask)==io_match )
+            io_write(io_context, address, value);
+        else
+            memory[address] = value;
+        last = C6502BusCycle{ .address = address, .data = value, .read = 0, .sync = 0 };
+        cycles++;
+    }
+
+    void cycleStart() override {
+        applySignals();
+    }
+
+    // Signals change when the next cycle starts, the netlist's, or at the start of the next access,
+    // c6502's, as they do on TestBus
+    void applySignals() {
+        for( auto [signal, asserted] : pending_signals )
+            setSignal(signal, asserted);
+        pending_signals.clear();
+    }
+
+    void setSignal(int signal, bool asserted) {
+        switch( signal ) {
+        case C6502_RESET: backend->setReset(asserted); reset = asserted; break;
+        case C6502_IRQ: backend->setIrq(asserted); break;
+        case C6502_NMI: backend->setNmi(asserted); break;
+        case C6502_READY: backend->setReady(asserted); break;
+        case C6502_SO: backend->setSo(asserted); break;
+        }
+    }
+
+    // Runs body, turning whatever it throws into a -1 and an error message
+    template<class Body>
+    int guard(Body body) {
+        try {
+            body();
+            return 0;
+        } catch( const std::exception &ex ) {
+            error = ex.what();
+        } catch( TraceBackend::TraceEnded ex ) {
+            error = "The trace ended";
+        } catch( ... ) {
+            error = "Unknown exception from the CPU";
+        }
+
+        return -1;
+    }
+};
+
+struct C6502State {
+    std::string backend_name;
+    std::array<uint8_t, 65536> memory;
+    uint64_t cycles;
+    C6502BusCycle last;
+    std::variant<c6502::State, NetlistCpu::Snapshot> cpu;
+};
+
+int c6502_api_version(void) {
+    return C6502_API_VERSION;
+}
+
+C6502Machine *c6502_create(const char *backend) {
+    try {
+        auto machine = std::make_unique<C6502Machine>();
+        machine->backend = makeCpuBackend(backend, *machine);
+        if( !machine->backend )
+            return nullptr;
+        machine->backend_name = backend;
+
+        return machine.release();
+    } catch( ... ) {
+        return nullptr;
+    }
+}
+
+void c6502_destroy(C6502Machine *machine) {
+    delete machine;
+}
+
+const char *c6502_error(const C6502Machine *machine) {
+    return machine->error.c_str();
+}
+
+void c6502_load(C6502Machine *machine, uint16_t address, const uint8_t *data, size_t size) {
+    for( size_t i = 0; i<size; ++i )
+        machine->memory[ Addr(address + i) ] = data[i];
+}
+
+void c6502_dump(const C6502Machine *machine, uint16_t address, uint8_t *data, size_t size) {
+    for( size_t i = 0; i<size; ++i )
+        data[i] = machine->memory[ Addr(address + i) ];
+}
+
+void c6502_set_io(C6502Machine *machine, uint16_t mask, uint16_t match, C6502ReadCallback read,
+        C6502WriteCallback write, void *context)
+{
+    machine->io_mask = mask;
+    machine->io_match = match;
+    machine->io_read = read;
+    machine->io_write = write;
+    machine->io_context = context;
+}
+
+void c6502_set_signal(C6502Machine *machine, int signal, int asserted) {
+    // c6502 checks READY once an access is done, so between steps is already the next cycle's
+    if( signal==C6502_READY )
+        machine->setSignal(signal, asserted);
+    else
+        machine->pending_signals.emplace_back(signal, asserted);
+}
+
+int c6502_run(C6502Machine *machine, uint64_t cycles) {
+    machine->at_instruction = false;
+    return machine->guard([&] { machine->backend->run(cycles); });
+}
+
+int c6502_step(C6502Machine *machine, C6502BusCycle *cycle) {
+    machine->at_instruction = false;
+    int result = machine->guard([&] { machine->backend->run(1); });
+    if( cycle )
+        *cycle = machine->last;
+
+    return result;
+}
+
+int c6502_run_to_instruction(C6502Machine *machine, uint64_t max_cycles) {
+    // The netlist can't be stopped inside a cycle, so it has to be told by its SYNC output instead
+    if( machine->backend_name!="c6502" ) {
+        machine->error = "Only the c6502 backend can stop between instructions";
+        return -1;
+    }
+
+    machine->stop_at_instruction = true;
+    uint64_t end = machine->cycles + max_cycles;
+    int result = machine->guard([&] {
+        try {
+            while( machine->cycles<end )
+                machine->backend->run(1);
+        } catch( AtInstruction ex ) {
+            machine->at_instruction = true;
+            return;
+        }
+
+        throw std::runtime_error("No instruction started within the cycle limit");
+    });
+    machine->stop_at_instruction = false;
+
+    return result;
+}
+
+uint64_t c6502_cycles(const C6502Machine *machine) {
+    return machine->cycles;
+}
+
+int c6502_registers(const C6502Machine *machine, C6502Registers *registers) {
+    auto backend_registers = machine->backend->registers();
+    if( !backend_registers )
+        return -1;
+
+    *registers = C6502Registers{ .a = backend_registers->regA, .x = backend_registers->regX, .y = backend_registers->regY,
+            .sp = backend_registers->regSp, .status = backend_registers->regStatus, .pc = backend_registers->pc };
+    return 0;
+}
+
+C6502State *c6502_save_state(C6502Machine *machine) {
+    auto state = std::make_unique<C6502State>();
+    state->backend_name = machine->backend_name;
+    state->memory = machine->memory;
+    state->cycles = machine->cycles;
+    state->last = machine->last;
+
+    if( auto c6502_backend = dynamic_cast<C6502Backend *>( machine->backend.get() ) ) {
+        if( !machine->at_instruction || machine->reset ) {
+            machine->error = "c6502 can only be saved straight after c6502_run_to_instruction, and out of reset";
+            return nullptr;
+        }
+        state->cpu = c6502_backend->cpu().getState();
+    } else if( auto netlist_backend = dynamic_cast<NetlistBackend *>( machine->backend.get() ) ) {
+        NetlistCpu::Snapshot snapshot;
+        netlist_backend->cpu().save(snapshot, false);
+        state->cpu = std::move(snapshot);
+    } else {
+        machine->error = "The " + machine->backend_name + " backend has no state to save";
+        return nullptr;
+    }
+
+    return state.release();
+}
+
+int c6502_restore_state(C6502Machine *machine, const C6502State *state) {
+    if( state->backend_name!=machine->backend_name ) {
+        machine->error = "The state was saved from the " + state->backend_name + " backend, not " + machine->backend_name;
+        return -1;
+    }
+
+    return machine->guard([&] {
+        if( auto cpu_state = std::get_if<c6502::State>(&state->cpu) ) {
+            // c6502 can't be rewound in the middle of its run, so it starts over from the saved registers
+            auto backend = std::make_unique<C6502Backend>(*machine);
+            backend->cpu().setState(*cpu_state);
+            machine->backend = std::move(backend);
+            machine->at_instruction = true;
+            machine->reset = false;
+        } else {
+            dynamic_cast<NetlistBackend &>(*machine->backend).cpu().restore( std::get<NetlistCpu::Snapshot>(state->cpu), false );
+        }
+
+        machine->memory = state->memory;
+        machine->cycles = state->cycles;
+        machine->last = state->last;
+    });
+}
+
+void c6502_free_state(C6502State *state) {
+    delete state;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+/*
+ * C ABI of libc6502.so, for embedding the CPU backends in other programs and languages (the host
+ * tools load it with ctypes).
+ *
+ * A machine is a CPU backend, "c6502" or "netlist", on a bus with 64K of RAM. Accesses to an optional
+ * I/O range go to callbacks instead. Every call is cheap enough to step a cycle at a time.
+ *
+ * Calls that can fail return 0 on success and -1 on failure, and c6502_error() says why. The structs
+ * and signatures here only ever grow; C6502_API_VERSION changes when they do.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define C6502_API_VERSION 1
+
+#if defined(__GNUC__)
+#define C6502_API __attribute__((visibility("default")))
+#else
+#define C6502_API
+#endif
+
+typedef struct C6502Machine C6502Machine;
+typedef struct C6502State C6502State;
+
+typedef struct C6502BusCycle {
+    uint16_t address;
+    uint8_t data;
+    uint8_t read;
+    uint8_t sync;
+} C6502BusCycle;
+
+typedef struct C6502Registers {
+    uint8_t a, x, y, sp, status;
+    uint16_t pc;
+} C6502Registers;
+
+/* Signals are active when asserted, whatever the pin's polarity */
+enum C6502Signal {
+    C6502_RESET,
+    C6502_IRQ,
+    C6502_NMI,
+    C6502_READY,
+    C6502_SO,
+};
+
+typedef uint8_t (*C6502ReadCallback)(void *context, uint16_t address, int sync);
+typedef void (*C6502WriteCallback)(void *context, uint16_t address, uint8_t value);
+
+C6502_API int c6502_api_version(void);
+
+/* NULL if the backend is unknown */
+C6502_API C6502Machine *c6502_create(const char *backend);
+C6502_API void c6502_destroy(C6502Machine *machine);
+C6502_API const char *c6502_error(const C6502Machine *machine);
+
+/* Direct access to RAM, which wraps at 64K and bypasses the I/O callbacks */
+C6502_API void c6502_load(C6502Machine *machine, uint16_t address, const uint8_t *data, size_t size);
+C6502_API void c6502_dump(const C6502Machine *machine, uint16_t address, uint8_t *data, size_t size);
+
+/* Accesses where (address & mask)==match go to the callbacks; NULL callbacks leave them to RAM */
+C6502_API void c6502_set_io(C6502Machine *machine, uint16_t mask, uint16_t match, C6502ReadCallback read,
+        C6502WriteCallback write, void *context);
+
+/* Takes effect from the next cycle on, at the point verify_cpu's test bus changes signals */
+C6502_API void c6502_set_signal(C6502Machine *machine, int signal, int asserted);
+
+C6502_API int c6502_run(C6502Machine *machine, uint64_t cycles);
+/* Runs one cycle, and reports it if cycle isn't NULL */
+C6502_API int c6502_step(C6502Machine *machine, C6502BusCycle *cycle);
+/* Runs until the next opcode fetch is due, without making it. Fails after max_cycles. */
+C6502_API int c6502_run_to_instruction(C6502Machine *machine, uint64_t max_cycles);
+C6502_API uint64_t c6502_cycles(const C6502Machine *machine);
+
+C6502_API int c6502_registers(const C6502Machine *machine, C6502Registers *registers);
+
+/*
+ * CPU, RAM and cycle count. The netlist can be saved between any two cycles. c6502 only has a state
+ * between instructions, so it has to be saved straight after c6502_run_to_instruction. States restore
+ * into any machine with the same backend, and have to be freed.
+ */
+C6502_API C6502State *c6502_save_state(C6502Machine *machine);
+C6502_API int c6502_restore_state(C6502Machine *machine, const C6502State *state);
+C6502_API void c6502_free_state(C6502State *state);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,675 @@
+#include "c6502_lanes.h"
+
+#include <string.h>
+
+namespace {
+
+static constexpr size_t Lanes = c6502Lanes::Lanes;
+
+using Row = std::array<uint8_t, Lanes>;
+
+#define LANES_INLINE inline __attribute__(( always_inline ))
+
+// Status register bits
+static constexpr uint8_t
+        Carry = 0x01,
+        Zero = 0x02,
+        IntMask = 0x04,
+        Decimal = 0x08,
+        Break = 0x10,
+        Unused = 0x20,
+        oVerflow = 0x40,
+        Negative = 0x80;
+
+enum class Modify { Asl, Lsr, Rol, Ror, Inc, Dec };
+
+LANES_INLINE Addr compose(uint8_t high, uint8_t low) {
+    return high<<8 | low;
+}
+
+// The lane arrays of a c6502Lanes, plus the arguments to run()
+struct LaneState {
+    std::vector<Row> &memory;
+    Row &regA, &regX, &regY, &regSp, &regStatus;
+    std::array<Addr, Lanes> &pcs;
+    std::array<uint32_t, Lanes> &instructions;
+    std::array<c6502Lanes::LaneStatus, Lanes> &status;
+
+    Addr stop_pc;
+    uint32_t max_instructions;
+};
+
+// GCC vector extensions. The vector size has to be spelled out, as GCC ignores it when it depends on a
+// template parameter.
+template<size_t Width> struct VectorTypes;
+
+template<> struct VectorTypes<16> {
+    typedef uint8_t Vec __attribute__(( vector_size(16) ));
+    typedef int8_t Mask __attribute__(( vector_size(16) ));
+};
+
+template<> struct VectorTypes<32> {
+    typedef uint8_t Vec __attribute__(( vector_size(32) ));
+    typedef int8_t Mask __attribute__(( vector_size(32) ));
+};
+
+// Runs a group of Width lanes, starting at lane first, until none of them is running. Each instruction
+// is executed for all lanes of the group that share the PC being executed.
+//
+// Width is the native vector size of the target the executor is instantiated for, so the vector
+// operations map directly to single instructions.
+template<size_t Width>
+struct Executor {
+    using Vec = typename VectorTypes<Width>::Vec;
+    using Mask = typename VectorTypes<Width>::Mask;
+
+    // A per lane address
+    struct Ea {
+        Vec lo, hi;
+    };
+
+    LaneState &state;
+    const size_t first;
+
+    Vec a, x, y, sp, p;
+
+    Mask active;
+    size_t lead;
+    Addr next;
+    bool jumped;
+
+    Executor(LaneState &state, size_t first) : state(state), first(first) {}
+
+    static LANES_INLINE Vec splat(uint8_t value) {
+        return Vec{} + value;
+    }
+
+    static LANES_INLINE Vec select(Mask mask, Vec if_set, Vec if_clear) {
+        return ( Vec(mask) & if_set ) | ( ~Vec(mask) & if_clear );
+    }
+
+    static LANES_INLINE bool any(Mask mask) {
+        uint64_t words[sizeof(mask)/8];
+        memcpy(words, &mask, sizeof(mask));
+
+        uint64_t result = 0;
+        for( uint64_t word : words )
+            result |= word;
+
+        return result!=0;
+    }
+
+    LANES_INLINE Vec load_row(const Row &row) const {
+        Vec result;
+        memcpy(&result, row.data() + first, sizeof(result));
+
+        return result;
+    }
+
+    LANES_INLINE void store_row(Row &row, Vec value) const {
+        memcpy(row.data() + first, &value, sizeof(value));
+    }
+
+    // Lanes all access the same address unless the index registers or pointers differ, in which case
+    // we fall back to one lane at a time
+    LANES_INLINE Vec read(Vec lo, Vec hi) {
+        if( uniform(lo, hi) )
+            return load_row( state.memory[ compose(hi[lead], lo[lead]) ] );
+
+        Vec result;
+        gather(lo, hi, result);
+
+        return result;
+    }
+
+    LANES_INLINE Vec read(Ea ea) {
+        return read(ea.lo, ea.hi);
+    }
+
+    LANES_INLINE void write(Vec lo, Vec hi, Vec value) {
+        if( uniform(lo, hi) ) {
+            Row &row = state.memory[ compose(hi[lead], lo[lead]) ];
+            store_row( row, select(active, value, load_row(row)) );
+        } else {
+            scatter(lo, hi, value);
+        }
+    }
+
+    LANES_INLINE bool uniform(Vec lo, Vec hi) {
+        return !any( ( (lo != splat(lo[lead])) | (hi != splat(hi[lead])) ) & active );
+    }
+
+    // The slow paths are kept out of line, taking vectors by reference so they don't depend on the
+    // vector calling convention of whichever clone calls them
+    __attribute__(( noinline )) void gather(const Vec &lo, const Vec &hi, Vec &result) {
+        result = Vec{};
+        for( size_t lane = 0; lane<Width; ++lane ) {
+            if( active[lane] )
+                result[lane] = state.memory[ compose(hi[lane], lo[lane]) ][first + lane];
+        }
+    }
+
+    __attribute__(( noinline )) void scatter(const Vec &lo, const Vec &hi, const Vec &value) {
+        for( size_t lane = 0; lane<Width; ++lane ) {
+            if( active[lane] )
+                state.memory[ compose(hi[lane], lo[lane]) ][first + lane] = value[lane];
+        }
+    }
+
+    __attribute__(( noinline )) void setPc(const Vec &lo, const Vec &hi) {
+        for( size_t lane = 0; lane<Width; ++lane ) {
+            if( active[lane] )
+                state.pcs[first + lane] = compose( hi[lane], lo[lane] );
+        }
+
+        jumped = true;
+    }
+
+    LANES_INLINE void write(Ea ea, Vec value) {
+        write(ea.lo, ea.hi, value);
+    }
+
+    // Code bytes. Active lanes share the PC, so this is always a single row.
+    LANES_INLINE Vec operand() {
+        return load_row( state.memory[next++] );
+    }
+
+    LANES_INLINE void assign(Vec &reg, Vec value) {
+        reg = select(active, value, reg);
+    }
+
+    LANES_INLINE void setFlag(uint8_t flag, Mask value) {
+        assign( p, ( p & splat( uint8_t(~flag) ) ) | ( Vec(value) & flag ) );
+    }
+
+    LANES_INLINE void updateNZ(Vec value) {
+        assign( p, ( p & splat( uint8_t(~(Negative|Zero)) ) ) | ( value & Negative ) | ( Vec(value==0) & Zero ) );
+    }
+
+    LANES_INLINE void push(Vec value) {
+        write( sp, splat(0x01), value );
+        assign( sp, sp - 1 );
+    }
+
+    LANES_INLINE Vec pull() {
+        assign( sp, sp + 1 );
+
+        return read( sp, splat(0x01) );
+    }
+
+    LANES_INLINE void jump(Ea target) {
+        setPc(target.lo, target.hi);
+    }
+
+    // Address modes
+    LANES_INLINE Ea indexed(Ea base, Vec index) {
+        Vec lo = base.lo + index;
+
+        return Ea{ lo, base.hi - Vec(lo < base.lo) };
+    }
+
+    LANES_INLINE Ea addrmode_abs() {
+        Vec lo = operand();
+        Vec hi = operand();
+
+        return Ea{ lo, hi };
+    }
+
+    LANES_INLINE Ea addrmode_abs_ind() {
+        Ea pointer = addrmode_abs();
+
+        // The pointer's high byte is read from the same page
+        return Ea{ read(pointer), read(pointer.lo + 1, pointer.hi) };
+    }
+
+    LANES_INLINE Ea addrmode_abs_x() {
+        return indexed( addrmode_abs(), x );
+    }
+
+    LANES_INLINE Ea addrmode_abs_y() {
+        return indexed( addrmode_abs(), y );
+    }
+
+    LANES_INLINE Ea addrmode_immediate() {
+        Ea ea{ splat(next & 0xff), splat(next >> 8) };
+        next++;
+
+        return ea;
+    }
+
+    LANES_INLINE Ea addrmode_zp() {
+        return Ea{ operand(), splat(0) };
+    }
+
+    LANES_INLINE Ea addrmode_zp_ind_y() {
+        Vec zp = operand();
+
+        return indexed( Ea{ read(zp, splat(0)), read(zp + 1, splat(0)) }, y );
+    }
+
+    LANES_INLINE Ea addrmode_zp_x() {
+        return Ea{ operand() + x, splat(0) };
+    }
+
+    LANES_INLINE Ea addrmode_zp_x_ind() {
+        Vec zp = operand() + x;
+
+        return Ea{ read(zp, splat(0)), read(zp + 1, splat(0)) };
+    }
+
+    LANES_INLINE Ea addrmode_zp_y() {
+        return Ea{ operand() + y, splat(0) };
+    }
+
+    // Operations
+    LANES_INLINE void op_adc(Vec value) {
+        Vec carry_in = p & Carry;
+        Vec sum = a + value + carry_in;
+
+        setFlag( Carry, (sum < a) | ( (sum == a) & (carry_in != 0) ) );
+        setFlag( oVerflow, ( ~(a ^ value) & (a ^ sum) & 0x80 ) != 0 );
+        assign( a, sum );
+        updateNZ( sum );
+    }
+
+    LANES_INLINE void op_compare(Vec reg, Ea ea) {
+        Vec value = read(ea);
+
+        setFlag( Carry, reg >= value );
+        updateNZ( reg - value );
+    }
+
+    LANES_INLINE void op_load(Vec &reg, Ea ea) {
+        Vec value = read(ea);
+
+        assign( reg, value );
+        updateNZ( value );
+    }
+
+    LANES_INLINE void op_transfer(Vec &reg, Vec value) {
+        assign( reg, value );
+        updateNZ( value );
+    }
+
+    LANES_INLINE void op_branch(Ea ea, uint8_t flag, bool state) {
+        Vec offset = read(ea);
+        Mask taken = (p & flag) != 0;
+        if( !state )
+            taken = ~taken;
+
+        Vec offset_taken = select(taken, offset, splat(0));
+        Vec lo = splat(next & 0xff) + offset_taken;
+        Vec hi = splat(next >> 8) - Vec(lo < splat(next & 0xff)) + Vec(Mask(offset_taken) < 0);
+
+        jump( Ea{ lo, hi } );
+    }
+
+    LANES_INLINE void op_bit(Ea ea) {
+        Vec value = read(ea);
+
+        assign( p, ( p & splat( uint8_t(~(Negative|oVerflow|Zero)) ) ) | ( value & uint8_t(Negative|oVerflow) ) | ( Vec((a & value)==0) & Zero ) );
+    }
+
+    LANES_INLINE void op_brk() {
+        addrmode_immediate();
+
+        push( splat(next >> 8) );
+        push( splat(next & 0xff) );
+        push( p | uint8_t(Break|Unused) );
+        setFlag( IntMask, Mask{} - 1 );
+
+        jump( Ea{ read(splat(0xfe), splat(0xff)), read(splat(0xff), splat(0xff)) } );
+    }
+
+    LANES_INLINE void op_jsr() {
+        Ea target = addrmode_abs();
+        Addr ret = next - 1;
+
+        push( splat(ret >> 8) );
+        push( splat(ret & 0xff) );
+
+        jump( target );
+    }
+
+    LANES_INLINE void op_rti() {
+        assign( p, pull() | uint8_t(Break|Unused) );
+        Vec lo = pull();
+        Vec hi = pull();
+
+        jump( Ea{ lo, hi } );
+    }
+
+    LANES_INLINE void op_rts() {
+        Vec lo = pull();
+        Vec hi = pull();
+
+        jump( indexed( Ea{ lo, hi }, splat(1) ) );
+    }
+
+    LANES_INLINE Vec modify(Modify op, Vec value) {
+        Vec carry_in = p & Carry;
+
+        switch( op ) {
+        case Modify::Asl:
+            setFlag( Carry, (value & 0x80) != 0 );
+            return value << 1;
+        case Modify::Lsr:
+            setFlag( Carry, (value & 0x01) != 0 );
+            return value >> 1;
+        case Modify::Rol:
+            setFlag( Carry, (value & 0x80) != 0 );
+            return (value << 1) | carry_in;
+        case Modify::Ror:
+            setFlag( Carry, (value & 0x01) != 0 );
+            return (value >> 1) | (carry_in << 7);
+        case Modify::Inc:
+            return value + 1;
+        case Modify::Dec:
+            return value - 1;
+        }
+
+        return value;
+    }
+
+    LANES_INLINE void op_modify(Ea ea, Modify op) {
+        Vec value = modify( op, read(ea) );
+
+        write( ea, value );
+        updateNZ( value );
+    }
+
+    LANES_INLINE void op_modifyA(Modify op) {
+        Vec value = modify( op, a );
+
+        assign( a, value );
+        updateNZ( value );
+    }
+
+    // Returns false for unsupported opcodes
+    LANES_INLINE bool execute(uint8_t opcode) {
+        switch( opcode ) {
+        case 0x00: op_brk();                                            break;
+        case 0x01: op_transfer( a, a | read( addrmode_zp_x_ind() ) );   break;
+        case 0x05: op_transfer( a, a | read( addrmode_zp() ) );         break;
+        case 0x06: op_modify( addrmode_zp(), Modify::Asl );                     break;
+        case 0x08: push( p | uint8_t(Break|Unused) );                          break;
+        case 0x09: op_transfer( a, a | read( addrmode_immediate() ) );  break;
+        case 0x0a: op_modifyA( Modify::Asl );                                   break;
+        case 0x0d: op_transfer( a, a | read( addrmode_abs() ) );        break;
+        case 0x0e: op_modify( addrmode_abs(), Modify::Asl );                    break;
+        case 0x10: op_branch( addrmode_immediate(), Negative, false );  break;
+        case 0x11: op_transfer( a, a | read( addrmode_zp_ind_y() ) );   break;
+        case 0x15: op_transfer( a, a | read( addrmode_zp_x() ) );       break;
+        case 0x16: op_modify( addrmode_zp_x(), Modify::Asl );                   break;
+        case 0x18: setFlag( Carry, Mask{} );                            break;
+        case 0x19: op_transfer( a, a | read( addrmode_abs_y() ) );      break;
+        case 0x1d: op_transfer( a, a | read( addrmode_abs_x() ) );      break;
+        case 0x1e: op_modify( addrmode_abs_x(), Modify::Asl );                  break;
+        case 0x20: op_jsr();                                            break;
+        case 0x21: op_transfer( a, a & read( addrmode_zp_x_ind() ) );   break;
+        case 0x24: op_bit( addrmode_zp() );                             break;
+        case 0x25: op_transfer( a, a & read( addrmode_zp() ) );         break;
+        case 0x26: op_modify( addrmode_zp(), Modify::Rol );                     break;
+        case 0x28: assign( p, pull() | uint8_t(Break|Unused) );                break;
+        case 0x29: op_transfer( a, a & read( addrmode_immediate() ) );  break;
+        case 0x2a: op_modifyA( Modify::Rol );                                   break;
+        case 0x2c: op_bit( addrmode_abs() );                            break;
+        case 0x2d: op_transfer( a, a & read( addrmode_abs() ) );        break;
+        case 0x2e: op_modify( addrmode_abs(), Modify::Rol );                    break;
+        case 0x30: op_branch( addrmode_immediate(), Negative, true );   break;
+        case 0x31: op_transfer( a, a & read( addrmode_zp_ind_y() ) );   break;
+        case 0x35: op_transfer( a, a & read( addrmode_zp_x() ) );       break;
+        case 0x36: op_modify( addrmode_zp_x(), Modify::Rol );                   break;
+        case 0x38: setFlag( Carry, Mask{} - 1 );                        break;
+        case 0x39: op_transfer( a, a & read( addrmode_abs_y() ) );      break;
+        case 0x3d: op_transfer( a, a & read( addrmode_abs_x() ) );      break;
+        case 0x3e: op_modify( addrmode_abs_x(), Modify::Rol );                  break;
+        case 0x40: op_rti();                                            break;
+        case 0x41: op_transfer( a, a ^ read( addrmode_zp_x_ind() ) );   break;
+        case 0x45: op_transfer( a, a ^ read( addrmode_zp() ) );         break;
+        case 0x46: op_modify( addrmode_zp(), Modify::Lsr );                     break;
+        case 0x48: push( a );                                           break;
+        case 0x49: op_transfer( a, a ^ read( addrmode_immediate() ) );  break;
+        case 0x4a: op_modifyA( Modify::Lsr );                                   break;
+        case 0x4c: jump( addrmode_abs() );                              break;
+        case 0x4d: op_transfer( a, a ^ read( addrmode_abs() ) );        break;
+        case 0x4e: op_modify( addrmode_abs(), Modify::Lsr );                    break;
+        case 0x50: op_branch( addrmode_immediate(), oVerflow, false );  break;
+        case 0x51: op_transfer( a, a ^ read( addrmode_zp_ind_y() ) );   break;
+        case 0x55: op_transfer( a, a ^ read( addrmode_zp_x() ) );       break;
+        case 0x56: op_modify( addrmode_zp_x(), Modify::Lsr );                   break;
+        case 0x58: setFlag( IntMask, Mask{} );                          break;
+        case 0x59: op_transfer( a, a ^ read( addrmode_abs_y() ) );      break;
+        case 0x5d: op_transfer( a, a ^ read( addrmode_abs_x() ) );      break;
+        case 0x5e: op_modify( addrmode_abs_x(), Modify::Lsr );                  break;
+        case 0x60: op_rts();                                            break;
+        case 0x61: op_adc( read( addrmode_zp_x_ind() ) );               break;
+        case 0x65: op_adc( read( addrmode_zp() ) );                     break;
+        case 0x66: op_modify( addrmode_zp(), Modify::Ror );                     break;
+        case 0x68: op_transfer( a, pull() );                            break;
+        case 0x69: op_adc( read( addrmode_immediate() ) );              break;
+        case 0x6a: op_modifyA( Modify::Ror );                                   break;
+        case 0x6c: jump( addrmode_abs_ind() );                          break;
+        case 0x6d: op_adc( read( addrmode_abs() ) );                    break;
+        case 0x6e: op_modify( addrmode_abs(), Modify::Ror );                    break;
+        case 0x70: op_branch( addrmode_immediate(), oVerflow, true );   break;
+        case 0x71: op_adc( read( addrmode_zp_ind_y() ) );               break;
+        case 0x75: op_adc( read( addrmode_zp_x() ) );                   break;
+        case 0x76: op_modify( addrmode_zp_x(), Modify::Ror );                   break;
+        case 0x78: setFlag( IntMask, Mask{} - 1 );                      break;
+        case 0x79: op_adc( read( addrmode_abs_y() ) );                  break;
+        case 0x7d: op_adc( read( addrmode_abs_x() ) );                  break;
+        case 0x7e: op_modify( addrmode_abs_x(), Modify::Ror );                  break;
+        case 0x81: write( addrmode_zp_x_ind(), a );                     break;
+        case 0x84: write( addrmode_zp(), y );                           break;
+        case 0x85: write( addrmode_zp(), a );                           break;
+        case 0x86: write( addrmode_zp(), x );                           break;
+        case 0x88: op_transfer( y, y - 1 );                             break;
+        case 0x8a: op_transfer( a, x );                                 break;
+        case 0x8c: write( addrmode_abs(), y );                          break;
+        case 0x8d: write( addrmode_abs(), a );                          break;
+        case 0x8e: write( addrmode_abs(), x );                          break;
+        case 0x90: op_branch( addrmode_immediate(), Carry, false );     break;
+        case 0x91: write( addrmode_zp_ind_y(), a );                     break;
+        case 0x94: write( addrmode_zp_x(), y );                         break;
+        case 0x95: write( addrmode_zp_x(), a );                         break;
+        case 0x96: write( addrmode_zp_y(), x );                         break;
+        case 0x98: op_transfer( a, y );                                 break;
+        case 0x99: write( addrmode_abs_y(), a );                        break;
+        case 0x9a: assign( sp, x );                                     break;
+        case 0x9d: write( addrmode_abs_x(), a );                        break;
+        case 0xa0: op_load( y, addrmode_immediate() );                  break;
+        case 0xa1: op_load( a, addrmode_zp_x_ind() );                   break;
+        case 0xa2: op_load( x, addrmode_immediate() );                  break;
+        case 0xa4: op_load( y, addrmode_zp() );                         break;
+        case 0xa5: op_load( a, addrmode_zp() );                         break;
+        case 0xa6: op_load( x, addrmode_zp() );                         break;
+        case 0xa8: op_transfer( y, a );                                 break;
+        case 0xa9: op_load( a, addrmode_immediate() );                  break;
+        case 0xaa: op_transfer( x, a );                                 break;
+        case 0xac: op_load( y, addrmode_abs() );                        break;
+        case 0xad: op_load( a, addrmode_abs() );                        break;
+        case 0xae: op_load( x, addrmode_abs() );                        break;
+        case 0xb0: op_branch( addrmode_immediate(), Carry, true );      break;
+        case 0xb1: op_load( a, addrmode_zp_ind_y() );                   break;
+        case 0xb4: op_load( y, addrmode_zp_x() );                       break;
+        case 0xb5: op_load( a, addrmode_zp_x() );                       break;
+        case 0xb6: op_load( x, addrmode_zp_y() );                       break;
+        case 0xb8: setFlag( oVerflow, Mask{} );                         break;
+        case 0xb9: op_load( a, addrmode_abs_y() );                      break;
+        case 0xba: op_transfer( x, sp );                                break;
+        case 0xbc: op_load( y, addrmode_abs_x() );                      break;
+        case 0xbd: op_load( a, addrmode_abs_x() );                      break;
+        case 0xbe: op_load( x, addrmode_abs_y() );                      break;
+        case 0xc0: op_compare( y, addrmode_immediate() );               break;
+        case 0xc1: op_compare( a, addrmode_zp_x_ind() );                break;
+        case 0xc4: op_compare( y, addrmode_zp() );                      break;
+        case 0xc5: op_compare( a, addrmode_zp() );                      break;
+        case 0xc6: op_modify( addrmode_zp(), Modify::Dec );                     break;
+        case 0xc8: op_transfer( y, y + 1 );                             break;
+        case 0xc9: op_compare( a, addrmode_immediate() );               break;
+        case 0xca: op_transfer( x, x - 1 );                             break;
+        case 0xcc: op_compare( y, addrmode_abs() );                     break;
+        case 0xcd: op_compare( a, addrmode_abs() );                     break;
+        case 0xce: op_modify( addrmode_abs(), Modify::Dec );                    break;
+        case 0xd0: op_branch( addrmode_immediate(), Zero, false );      break;
+        case 0xd1: op_compare( a, addrmode_zp_ind_y() );                break;
+        case 0xd5: op_compare( a, addrmode_zp_x() );                    break;
+        case 0xd6: op_modify( addrmode_zp_x(), Modify::Dec );                   break;
+        case 0xd8: setFlag( Decimal, Mask{} );                          break;
+        case 0xd9: op_compare( a, addrmode_abs_y() );                   break;
+        case 0xdd: op_compare( a, addrmode_abs_x() );                   break;
+        case 0xde: op_modify( addrmode_abs_x(), Modify::Dec );                  break;
+        case 0xe0: op_compare( x, addrmode_immediate() );               break;
+        case 0xe1: op_adc( ~read( addrmode_zp_x_ind() ) );              break;
+        case 0xe4: op_compare( x, addrmode_zp() );                      break;
+        case 0xe5: op_adc( ~read( addrmode_zp() ) );                    break;
+        case 0xe6: op_modify( addrmode_zp(), Modify::Inc );                     break;
+        case 0xe8: op_transfer( x, x + 1 );                             break;
+        case 0xe9: op_adc( ~read( addrmode_immediate() ) );             break;
+        case 0xea:                                                      break;
+        case 0xec: op_compare( x, addrmode_abs() );                     break;
+        case 0xed: op_adc( ~read( addrmode_abs() ) );                   break;
+        case 0xee: op_modify( addrmode_abs(), Modify::Inc );                    break;
+        case 0xf0: op_branch( addrmode_immediate(), Zero, true );       break;
+        case 0xf1: op_adc( ~read( addrmode_zp_ind_y() ) );              break;
+        case 0xf5: op_adc( ~read( addrmode_zp_x() ) );                  break;
+        case 0xf6: op_modify( addrmode_zp_x(), Modify::Inc );                   break;
+        case 0xf8: setFlag( Decimal, Mask{} - 1 );                      break;
+        case 0xf9: op_adc( ~read( addrmode_abs_y() ) );                 break;
+        case 0xfd: op_adc( ~read( addrmode_abs_x() ) );                 break;
+        case 0xfe: op_modify( addrmode_abs_x(), Modify::Inc );                  break;
+        default: return false;
+        }
+
+        return true;
+    }
+
+    LANES_INLINE void run() {
+        a = load_row(state.regA);
+        x = load_row(state.regX);
+        y = load_row(state.regY);
+        sp = load_row(state.regSp);
+        p = load_row(state.regStatus);
+
+        while( true ) {
+            // Lanes that branched apart reconverge soonest if the lowest PC always goes first
+            lead = Width;
+            for( size_t lane = 0; lane<Width; ++lane ) {
+                auto &status = state.status[first + lane];
+                Addr pc = state.pcs[first + lane];
+
+                if( status!=c6502Lanes::LaneStatus::Running )
+                    continue;
+
+                if( pc==state.stop_pc ) {
+                    status = c6502Lanes::LaneStatus::Stopped;
+                } else if( state.instructions[first + lane]>=state.max_instructions ) {
+                    status = c6502Lanes::LaneStatus::TimedOut;
+                } else if( lead==Width || pc<state.pcs[first + lead] ) {
+                    lead = lane;
+                }
+            }
+
+            if( lead==Width )
+                break;
+
+            Addr pc = state.pcs[first + lead];
+            const Row &code = state.memory[pc];
+            uint8_t opcode = code[first + lead];
+
+            active = Mask{};
+            for( size_t lane = 0; lane<Width; ++lane ) {
+                if( state.status[first + lane]==c6502Lanes::LaneStatus::Running && state.pcs[first + lane]==pc &&
+                        code[first + lane]==opcode )
+                    active[lane] = -1;
+            }
+
+            next = pc + 1;
+            jumped = false;
+
+            bool supported = execute(opcode);
+
+            for( size_t lane = 0; lane<Width; ++lane ) {
+                if( !active[lane] )
+                    continue;
+
+                if( !supported ) {
+                    state.status[first + lane] = c6502Lanes::LaneStatus::Faulted;
+                    continue;
+                }
+
+                if( !jumped )
+                    state.pcs[first + lane] = next;
+                state.instructions[first + lane]++;
+            }
+        }
+
+        store_row(state.regA, a);
+        store_row(state.regX, x);
+        store_row(state.regY, y);
+        store_row(state.regSp, sp);
+        store_row(state.regStatus, p);
+    }
+};
+
+} // namespace
+
+// One entry point per instruction set, so that each instantiation is compiled with its vector width
+// natively supported. The baseline covers the 32 lanes in groups of 16, which is what SSE2 holds.
+__attribute__(( target("avx512bw,avx512vl") ))
+static void run_avx512(LaneState &state) {
+    Executor<32>(state, 0).run();
+}
+
+__attribute__(( target("avx2") ))
+static void run_avx2(LaneState &state) {
+    Executor<32>(state, 0).run();
+}
+
+static void run_baseline(LaneState &state) {
+    for( size_t first = 0; first<Lanes; first += 16 )
+        Executor<16>(state, first).run();
+}
+
+c6502Lanes::c6502Lanes() : memory_(65536) {
+    status_.fill(LaneStatus::Stopped);
+}
+
+void c6502Lanes::load(Addr address, const uint8_t *data, size_t size) {
+    for( size_t i=0; i<size; ++i )
+        memory_[ Addr(address+i) ].fill( data[i] );
+}
+
+c6502Lanes::Registers c6502Lanes::getRegisters(size_t lane) const {
+    return Registers{
+        .regA = regA_[lane], .regX = regX_[lane], .regY = regY_[lane], .regSp = regSp_[lane],
+        .regStatus = regStatus_[lane],
+        .pc = pc_[lane]
+    };
+}
+
+void c6502Lanes::setRegisters(size_t lane, const Registers &registers) {
+    regA_[lane] = registers.regA;
+    regX_[lane] = registers.regX;
+    regY_[lane] = registers.regY;
+    regSp_[lane] = registers.regSp;
+    regStatus_[lane] = registers.regStatus | (Break|Unused);
+    pc_[lane] = registers.pc;
+
+    instructions_[lane] = 0;
+    status_[lane] = LaneStatus::Running;
+}
+
+void c6502Lanes::run(Addr stop_pc, uint32_t max_instructions) {
+    LaneState state{ memory_, regA_, regX_, regY_, regSp_, regStatus_, pc_, instructions_, status_, stop_pc, max_instructions };
+
+#if defined(__x86_64__) || defined(__i386__)
+    if( __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vl") )
+        return run_avx512(state);
+    if( __builtin_cpu_supports("avx2") )
+        return run_avx2(state);
+#endif
+
+    run_baseline(state);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "Bus.h"
+
+#include <array>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A batch of independent 6502s running the same code on different data, one CPU per SIMD lane.
+//
+// Meant for sweeps such as running a routine once for every possible input byte. Execution is per
+// instruction rather than per cycle and there is no bus: each lane has its own 64K of memory, stored
+// interleaved so that lanes accessing the same address share a single vector load or store. Lanes whose
+// PC differs from the instruction being executed are masked off and catch up later.
+//
+// Only the documented NMOS opcodes are supported. Like c6502, there is no decimal mode.
+class c6502Lanes {
+public:
+    static constexpr size_t Lanes = 32;
+
+    struct Registers {
+        uint8_t regA, regX, regY, regSp, regStatus;
+        Addr pc;
+    };
+
+    enum class LaneStatus : uint8_t { Running, Stopped, Faulted, TimedOut };
+
+private:
+    using Row = std::array<uint8_t, Lanes>;
+
+    std::vector<Row> memory_;
+
+    alignas(Lanes) Row regA_{}, regX_{}, regY_{}, regSp_{}, regStatus_{};
+    std::array<Addr, Lanes> pc_{};
+    std::array<uint32_t, Lanes> instructions_{};
+    std::array<LaneStatus, Lanes> status_{};
+
+public:
+    c6502Lanes();
+
+    // Copies the same data into the memory of every lane
+    void load(Addr address, const uint8_t *data, size_t size);
+
+    uint8_t &mem(size_t lane, Addr address) { return memory_[address][lane]; }
+    uint8_t mem(size_t lane, Addr address) const { return memory_[address][lane]; }
+
+    // Setting the registers also marks the lane as running and clears its instruction count
+    Registers getRegisters(size_t lane) const;
+    void setRegisters(size_t lane, const Registers &registers);
+
+    // Runs until every lane has either reached stop_pc, executed an unsupported opcode, or executed
+    // max_instructions instructions
+    void run(Addr stop_pc, uint32_t max_instructions);
+
+    LaneStatus status(size_t lane) const { return status_[lane]; }
+    uint32_t instructions(size_t lane) const { return instructions_[lane]; }
+};
@@ -0,0 +1,235 @@
+// Checks c6502 and c6502Lanes against a golden ALU table from gen_alu. Each op is executed for every
+// input in the table, one at a time on c6502 and 32 at a time on c6502Lanes, and A and the status
+// register are compared against the netlist's.
+
+#include "alu_table.h"
+#include "c6502.h"
+#include "c6502_lanes.h"
+#include "netlist_cpu.h"
+
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static constexpr Addr OpAddress = 0x0400;
+static constexpr size_t MaxReported = 5;
+
+struct Input {
+    uint8_t a, m;
+    unsigned flags;
+};
+
+class InstructionDone {};
+
+// Serves the single instruction under test, and stops c6502 when it fetches the next one
+class AluBus : public Bus {
+public:
+    std::array<uint8_t, 65536> memory{};
+    Addr stop;
+
+    virtual uint8_t read( c6502 *cpu, Addr address, bool sync = false ) override {
+        if( sync && address==stop )
+            throw InstructionDone();
+
+        return memory[address];
+    }
+
+    virtual void write( c6502 *cpu, Addr address, uint8_t value ) override {
+        memory[address] = value;
+    }
+};
+
+// The instruction under test, placed at OpAddress
+struct OpLayout {
+    uint8_t bytes[2];
+    size_t length;
+    // Where M goes
+    Addr operand;
+
+    Addr end() const { return OpAddress + length; }
+};
+
+static OpLayout layout_op(const AluTable::Op &op) {
+    if( op.opcode==0x24 )
+        return OpLayout{ { op.opcode, AluTable::BitOperand }, 2, AluTable::BitOperand };
+    if( op.has_operand )
+        return OpLayout{ { op.opcode, 0x00 }, 2, Addr(OpAddress + 1) };
+
+    return OpLayout{ { op.opcode, 0x00 }, 1, 0 };
+}
+
+static void check_c6502(const AluTable::Op &op, const std::vector<Input> &inputs, std::vector<AluTable::Result> &results) {
+    OpLayout layout = layout_op(op);
+    AluBus bus;
+    memcpy(&bus.memory[OpAddress], layout.bytes, layout.length);
+    bus.stop = layout.end();
+
+    c6502 cpu(bus);
+    cpu.setSignalLogging(false);
+
+    for( const auto &input : inputs ) {
+        if( op.has_operand )
+            bus.memory[layout.operand] = input.m;
+
+        cpu.setState( c6502::State{ .regA = input.a, .regX = 0, .regY = 0, .regSp = 0xfe,
+                .regStatus = AluTable::status(input.flags), .pc = OpAddress } );
+
+        try {
+            cpu.runCpu();
+        } catch( InstructionDone ex ) {
+        }
+
+        auto state = cpu.getState();
+        results.push_back( AluTable::Result{ .regA = state.regA, .regStatus = state.regStatus } );
+    }
+}
+
+static void check_lanes(const AluTable::Op &op, const std::vector<Input> &inputs, std::vector<AluTable::Result> &results) {
+    OpLayout layout = layout_op(op);
+    c6502Lanes cpu;
+    cpu.load(OpAddress, layout.bytes, layout.length);
+
+    for( size_t base = 0; base<inputs.size(); base += c6502Lanes::Lanes ) {
+        size_t count = std::min( c6502Lanes::Lanes, inputs.size() - base );
+
+        for( size_t lane = 0; lane<count; ++lane ) {
+            const auto &input = inputs[base + lane];
+
+            if( op.has_operand )
+                cpu.mem(lane, layout.operand) = input.m;
+            cpu.setRegisters( lane, c6502Lanes::Registers{ .regA = input.a, .regX = 0, .regY = 0, .regSp = 0xfe,
+                    .regStatus = AluTable::status(input.flags), .pc = OpAddress } );
+        }
+
+        cpu.run(layout.end(), 1);
+
+        for( size_t lane = 0; lane<count; ++lane ) {
+            auto registers = cpu.getRegisters(lane);
+            results.push_back( AluTable::Result{ .regA = registers.regA, .regStatus = registers.regStatus } );
+        }
+    }
+}
+
+// Returns the number of mismatches
+static size_t compare(const char *core, const AluTable::Op &op, const std::vector<Input> &inputs,
+        const AluTable::Result *expected, const std::vector<AluTable::Result> &actual)
+{
+    size_t mismatches = 0, decimal_mismatches = 0;
+
+    for( size_t i=0; i<inputs.size(); ++i ) {
+        // The pushed status always has B and the unused bit set
+        if( expected[i].regA==actual[i].regA && expected[i].regStatus==(actual[i].regStatus | 0x30) )
+            continue;
+
+        if( inputs[i].flags & AluTable::FlagD )
+            decimal_mismatches++;
+
+        if( mismatches++ < MaxReported ) {
+            char buffer[128];
+            snprintf(buffer, sizeof(buffer), "  %s A=%02x M=%02x P=%02x: expected A=%02x P=%02x, got A=%02x P=%02x\n",
+                    op.name, inputs[i].a, inputs[i].m, AluTable::status(inputs[i].flags), expected[i].regA,
+                    expected[i].regStatus, actual[i].regA, actual[i].regStatus | 0x30);
+            std::cout<<buffer;
+        }
+    }
+
+    std::cout<<op.name<<" "<<core<<": "<<inputs.size()<<" inputs, "<<mismatches<<" mismatches";
+    if( mismatches>0 )
+        std::cout<<" ("<<decimal_mismatches<<" with D set)";
+    std::cout<<"\n";
+
+    return mismatches;
+}
+
+static void usage(const char *name) {
+    std::cerr<<"Usage: "<<name<<" [-b] table.bin\n"
+            "  -b    Binary mode only: skip inputs with D set, as neither core implements decimal mode\n";
+    exit(2);
+}
+
+int main(int argc, char *argv[]) {
+    bool skip_decimal = false;
+
+    int opt;
+    while( (opt = getopt(argc, argv, "b")) != -1 ) {
+        switch( opt ) {
+        case 'b': skip_decimal = true; break;
+        default: usage(argv[0]);
+        }
+    }
+
+    if( argc-optind != 1 )
+        usage(argv[0]);
+
+    std::ifstream in(argv[optind], std::ios::binary);
+    AluTable::Header header;
+    if( !in.read( reinterpret_cast<char *>(&header), sizeof(header) ) || memcmp(header.magic, AluTable::Magic, sizeof(header.magic))!=0 ) {
+        std::cerr<<argv[optind]<<" is not an ALU table\n";
+        return 2;
+    }
+
+    if( header.version!=AluTable::Version ) {
+        std::cerr<<"ALU table version "<<header.version<<" is not supported (expected "<<AluTable::Version<<")\n";
+        return 2;
+    }
+
+    header.variant[sizeof(header.variant)-1] = '\0';
+    std::cout<<"Table variant "<<header.variant<<", netlist checksum "<<std::hex<<header.netlist_checksum<<std::dec<<"\n";
+    if( header.netlist_checksum!=NetlistCpu::netlistChecksum() )
+        std::cout<<"Warning: the table was generated from a different netlist than the one linked in\n";
+
+    size_t mismatches = 0;
+    for( uint32_t section_num = 0; section_num<header.num_sections; ++section_num ) {
+        AluTable::Section section;
+        if( !in.read( reinterpret_cast<char *>(&section), sizeof(section) ) ) {
+            std::cerr<<"Truncated table\n";
+            return 2;
+        }
+
+        const AluTable::Op *op = nullptr;
+        for( const auto &candidate : AluTable::Ops ) {
+            if( candidate.opcode==section.opcode && bool(section.has_operand)==candidate.has_operand )
+                op = &candidate;
+        }
+
+        std::vector<AluTable::Result> table(section.num_results);
+        if( !in.read( reinterpret_cast<char *>(table.data()), table.size()*sizeof(AluTable::Result) ) ) {
+            std::cerr<<"Truncated table\n";
+            return 2;
+        }
+
+        if( op==nullptr || section.num_results!=section.num_a*AluTable::resultsPerA(*op) ) {
+            std::cerr<<"Skipping unknown section for opcode "<<std::hex<<int(section.opcode)<<std::dec<<"\n";
+            continue;
+        }
+
+        std::vector<Input> inputs;
+        std::vector<AluTable::Result> expected;
+        for( unsigned a = 0; a<section.num_a; ++a ) {
+            for( unsigned m = 0; m<(op->has_operand ? 256 : 1); ++m ) {
+                for( unsigned flags = 0; flags<AluTable::NumFlagCombinations; ++flags ) {
+                    if( skip_decimal && (flags & AluTable::FlagD) )
+                        continue;
+
+                    inputs.push_back( Input{ uint8_t(a), uint8_t(m), flags } );
+                    expected.push_back( table[ AluTable::index(*op, a, m, flags) ] );
+                }
+            }
+        }
+
+        std::vector<AluTable::Result> results;
+        check_c6502(*op, inputs, results);
+        mismatches += compare("c6502", *op, inputs, expected.data(), results);
+
+        results.clear();
+        check_lanes(*op, inputs, results);
+        mismatches += compare("c6502Lanes", *op, inputs, expected.data(), results);
+    }
+
+    return mismatches==0 ? 0 : 1;
+}
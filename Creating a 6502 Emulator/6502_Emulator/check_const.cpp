@@ -0,0 +1,319 @@
+// Checks ConstCpu, the 6502 that runs at compile time, with a CRC-32 table generator and checksum
+// routine for the 6502, and a routine that tallies what BIT makes of each byte. The static_asserts
+// below hold the compile time results against native code, so this doesn't build unless ConstCpu gets
+// them right; at run time the same routines run again on ConstCpu and on c6502, and have to agree with
+// what was computed at build time.
+
+#include "c6502.h"
+#include "const_cpu.h"
+
+#include <iostream>
+#include <string_view>
+#include <tuple>
+
+#include <stdio.h>
+
+static constexpr Addr MakeTableAddress = 0x0300, CrcAddress = 0x0350, UpdateAddress = 0x0380, TallyAddress = 0x03c0;
+// The table takes a page per byte of each entry, low byte first
+static constexpr Addr TableAddress = 0x0400, DataAddress = 0x0800;
+// CRC is four bytes of zero page, low byte first, and LENGTH the number of bytes at DataAddress
+static constexpr Addr CrcResult = 0x0000, LengthAddress = 0x0010;
+// The mask Tally tests the bytes against
+static constexpr Addr MaskAddress = 0x0011;
+// What c6502 returns to
+static constexpr Addr ReturnAddress = 0x0200;
+
+// Builds the CRC-32 lookup table, one bit at a time
+static constexpr uint8_t MakeTable[] = {
+    0xa2, 0x00,             // LDX #0
+    0xa9, 0x00,             // BYTELOOP: LDA #0         A holds the CRC's high byte
+    0x85, 0x02,             // STA CRC+2
+    0x85, 0x01,             // STA CRC+1
+    0x86, 0x00,             // STX CRC
+    0xa0, 0x08,             // LDY #8
+    0x4a,                   // BITLOOP: LSR A
+    0x66, 0x02,             // ROR CRC+2
+    0x66, 0x01,             // ROR CRC+1
+    0x66, 0x00,             // ROR CRC
+    0x90, 0x16,             // BCC NOADD
+    0x49, 0xed,             // EOR #$ED                 The polynomial, $EDB88320
+    0x48,                   // PHA
+    0xa5, 0x02,             // LDA CRC+2
+    0x49, 0xb8,             // EOR #$B8
+    0x85, 0x02,             // STA CRC+2
+    0xa5, 0x01,             // LDA CRC+1
+    0x49, 0x83,             // EOR #$83
+    0x85, 0x01,             // STA CRC+1
+    0xa5, 0x00,             // LDA CRC
+    0x49, 0x20,             // EOR #$20
+    0x85, 0x00,             // STA CRC
+    0x68,                   // PLA
+    0x88,                   // NOADD: DEY
+    0xd0, 0xde,             // BNE BITLOOP
+    0x9d, 0x00, 0x07,       // STA TABLE+$300,X
+    0xa5, 0x02,             // LDA CRC+2
+    0x9d, 0x00, 0x06,       // STA TABLE+$200,X
+    0xa5, 0x01,             // LDA CRC+1
+    0x9d, 0x00, 0x05,       // STA TABLE+$100,X
+    0xa5, 0x00,             // LDA CRC
+    0x9d, 0x00, 0x04,       // STA TABLE,X
+    0xe8,                   // INX
+    0xd0, 0xbf,             // BNE BYTELOOP
+    0x60,                   // RTS
+};
+
+// CRC-32 of LENGTH bytes at DataAddress, into CRC
+static constexpr uint8_t Crc[] = {
+    0xa9, 0xff,             // LDA #$FF
+    0x85, 0x00,             // STA CRC
+    0x85, 0x01,             // STA CRC+1
+    0x85, 0x02,             // STA CRC+2
+    0x85, 0x03,             // STA CRC+3
+    0xa0, 0x00,             // LDY #0
+    0xc4, 0x10,             // LOOP: CPY LENGTH
+    0xf0, 0x09,             // BEQ DONE
+    0xb9, 0x00, 0x08,       // LDA DATA,Y
+    0x20, 0x80, 0x03,       // JSR UPDATE
+    0xc8,                   // INY
+    0xd0, 0xf3,             // BNE LOOP
+    0xa2, 0x03,             // DONE: LDX #3
+    0xb5, 0x00,             // INVERT: LDA CRC,X
+    0x49, 0xff,             // EOR #$FF
+    0x95, 0x00,             // STA CRC,X
+    0xca,                   // DEX
+    0x10, 0xf7,             // BPL INVERT
+    0x60,                   // RTS
+};
+
+// Adds the byte in A to CRC
+static constexpr uint8_t Update[] = {
+    0x45, 0x00,             // EOR CRC
+    0xaa,                   // TAX
+    0xa5, 0x01,             // LDA CRC+1
+    0x5d, 0x00, 0x04,       // EOR TABLE,X
+    0x85, 0x00,             // STA CRC
+    0xa5, 0x02,             // LDA CRC+2
+    0x5d, 0x00, 0x05,       // EOR TABLE+$100,X
+    0x85, 0x01,             // STA CRC+1
+    0xa5, 0x03,             // LDA CRC+3
+    0x5d, 0x00, 0x06,       // EOR TABLE+$200,X
+    0x85, 0x02,             // STA CRC+2
+    0xbd, 0x00, 0x07,       // LDA TABLE+$300,X
+    0x85, 0x03,             // STA CRC+3
+    0x60,                   // RTS
+};
+
+// Counts, of the LENGTH bytes at DataAddress, those sharing a bit with MASK, those with bit 7 set and those
+// with bit 6 set, into CRC, CRC+1 and CRC+2
+static constexpr uint8_t Tally[] = {
+    0xa9, 0x00,             // LDA #0
+    0x85, 0x00,             // STA CRC
+    0x85, 0x01,             // STA CRC+1
+    0x85, 0x02,             // STA CRC+2
+    0x85, 0x03,             // STA CRC+3
+    0xa0, 0x00,             // LDY #0
+    0xc4, 0x10,             // LOOP: CPY LENGTH
+    0xf0, 0x18,             // BEQ DONE
+    0xb9, 0x00, 0x08,       // LDA DATA,Y
+    0x85, 0x12,             // STA TEMP                 BIT has no indexed modes
+    0xa5, 0x11,             // LDA MASK
+    0x24, 0x12,             // BIT TEMP
+    0xf0, 0x02,             // BEQ DISJOINT
+    0xe6, 0x00,             // INC CRC
+    0x10, 0x02,             // DISJOINT: BPL CLEAR7
+    0xe6, 0x01,             // INC CRC+1
+    0x50, 0x02,             // CLEAR7: BVC CLEAR6
+    0xe6, 0x02,             // INC CRC+2
+    0xc8,                   // CLEAR6: INY
+    0xd0, 0xe4,             // BNE LOOP
+    0x60,                   // DONE: RTS
+};
+
+using CrcTable = std::array<uint32_t, 256>;
+
+static constexpr ConstCpu with_routines() {
+    ConstCpu cpu;
+    cpu.load(MakeTableAddress, MakeTable);
+    cpu.load(CrcAddress, Crc);
+    cpu.load(UpdateAddress, Update);
+    cpu.load(TallyAddress, Tally);
+
+    return cpu;
+}
+
+static constexpr uint32_t read32(const std::array<uint8_t, 65536> &memory, Addr address, unsigned stride = 1) {
+    uint32_t result = 0;
+    for( unsigned i = 0; i<4; ++i )
+        result |= uint32_t( memory[address + i*stride] ) << i*8;
+
+    return result;
+}
+
+static constexpr CrcTable table_from(const std::array<uint8_t, 65536> &memory) {
+    CrcTable table{};
+    for( unsigned i = 0; i<table.size(); ++i )
+        table[i] = read32(memory, TableAddress + i, 0x100);
+
+    return table;
+}
+
+static constexpr CrcTable const_cpu_table() {
+    ConstCpu cpu = with_routines();
+    cpu.call(MakeTableAddress);
+
+    return table_from(cpu.memory);
+}
+
+static constexpr uint32_t const_cpu_crc(std::string_view data) {
+    ConstCpu cpu = with_routines();
+    cpu.call(MakeTableAddress);
+    cpu.load(DataAddress, data);
+    cpu.memory[LengthAddress] = data.size();
+    cpu.call(CrcAddress);
+
+    return read32(cpu.memory, CrcResult);
+}
+
+static constexpr uint32_t const_cpu_tally(std::string_view data, uint8_t mask) {
+    ConstCpu cpu = with_routines();
+    cpu.load(DataAddress, data);
+    cpu.memory[LengthAddress] = data.size();
+    cpu.memory[MaskAddress] = mask;
+    cpu.call(TallyAddress);
+
+    return read32(cpu.memory, CrcResult);
+}
+
+static constexpr CrcTable native_table() {
+    CrcTable table{};
+    for( uint32_t i = 0; i<table.size(); ++i ) {
+        uint32_t crc = i;
+        for( unsigned bit = 0; bit<8; ++bit )
+            crc = crc & 1 ? crc>>1 ^ 0xedb88320 : crc>>1;
+        table[i] = crc;
+    }
+
+    return table;
+}
+
+static constexpr uint32_t native_crc(std::string_view data) {
+    CrcTable table = native_table();
+    uint32_t crc = 0xffffffff;
+    for( char c : data )
+        crc = table[ (crc ^ uint8_t(c)) & 0xff ] ^ crc>>8;
+
+    return ~crc;
+}
+
+static constexpr uint32_t native_tally(std::string_view data, uint8_t mask) {
+    uint32_t shared = 0, bit7 = 0, bit6 = 0;
+    for( char c : data ) {
+        uint8_t byte = c;
+        shared += (byte & mask)!=0;
+        bit7 += (byte & 0x80)!=0;
+        bit6 += (byte & 0x40)!=0;
+    }
+
+    return shared | bit7<<8 | bit6<<16;
+}
+
+static constexpr std::string_view CheckString = "123456789";
+static constexpr std::string_view FoxString = "The quick brown fox jumps over the lazy dog";
+
+// Computed at build time, and part of the binary as data
+static constexpr CrcTable BuildTable = const_cpu_table();
+static constexpr uint32_t BuildCheck = const_cpu_crc(CheckString), BuildFox = const_cpu_crc(FoxString);
+static constexpr uint8_t TallyMask = 0x21;
+static constexpr uint32_t BuildTally = const_cpu_tally(FoxString, TallyMask);
+
+static_assert( BuildTable==native_table() );
+static_assert( BuildCheck==0xcbf43926 );
+static_assert( BuildFox==native_crc(FoxString) );
+static_assert( const_cpu_crc("")==0 );
+static_assert( BuildTally==native_tally(FoxString, TallyMask) );
+
+class RoutineDone {};
+
+// Stops c6502 when the routine returns to ReturnAddress
+class RoutineBus : public Bus {
+public:
+    std::array<uint8_t, 65536> memory;
+
+    explicit RoutineBus(const std::array<uint8_t, 65536> &image) : memory(image) {}
+
+    virtual uint8_t read( c6502 *cpu, Addr address, bool sync = false ) override {
+        if( sync && address==ReturnAddress )
+            throw RoutineDone();
+
+        return memory[address];
+    }
+
+    virtual void write( c6502 *cpu, Addr address, uint8_t value ) override {
+        memory[address] = value;
+    }
+};
+
+// Runs the routine at address on c6502, as if called from just before ReturnAddress
+static void call_c6502(RoutineBus &bus, Addr address) {
+    c6502 cpu(bus);
+    cpu.setSignalLogging(false);
+
+    bus.memory[0x1ff] = (ReturnAddress - 1) >> 8;
+    bus.memory[0x1fe] = (ReturnAddress - 1) & 0xff;
+    cpu.setState( c6502::State{ .regA = 0, .regX = 0, .regY = 0, .regSp = 0xfd, .regStatus = 0x34, .pc = address } );
+
+    try {
+        cpu.runCpu();
+    } catch( RoutineDone ex ) {
+    }
+}
+
+static bool report(const char *what, uint32_t build, uint32_t const_cpu, uint32_t c6502) {
+    char buffer[128];
+    snprintf(buffer, sizeof(buffer), "%-12s build %08x, ConstCpu %08x, c6502 %08x%s\n", what, build, const_cpu, c6502,
+            build==const_cpu && build==c6502 ? "" : "  MISMATCH");
+    std::cout<<buffer;
+
+    return build==const_cpu && build==c6502;
+}
+
+int main() {
+    bool good = true;
+
+    RoutineBus bus( with_routines().memory );
+    call_c6502(bus, MakeTableAddress);
+    CrcTable c6502_table = table_from(bus.memory);
+    CrcTable runtime_table = const_cpu_table();
+
+    size_t table_mismatches = 0;
+    for( unsigned i = 0; i<BuildTable.size(); ++i ) {
+        if( c6502_table[i]!=BuildTable[i] || runtime_table[i]!=BuildTable[i] ) {
+            char name[16];
+            snprintf(name, sizeof(name), "Table[%02x]", i);
+            good = report(name, BuildTable[i], runtime_table[i], c6502_table[i]) && good;
+            table_mismatches++;
+        }
+    }
+    std::cout<<"Table        "<<BuildTable.size()-table_mismatches<<" of "<<BuildTable.size()<<" entries agree\n";
+
+    for( auto [name, data, build] : { std::tuple{ "CRC check", CheckString, BuildCheck }, std::tuple{ "CRC fox", FoxString, BuildFox } } ) {
+        RoutineBus data_bus(bus.memory);
+        for( size_t i = 0; i<data.size(); ++i )
+            data_bus.memory[DataAddress + i] = data[i];
+        data_bus.memory[LengthAddress] = data.size();
+        call_c6502(data_bus, CrcAddress);
+
+        good = report(name, build, const_cpu_crc(data), read32(data_bus.memory, CrcResult)) && good;
+    }
+
+    RoutineBus tally_bus(bus.memory);
+    for( size_t i = 0; i<FoxString.size(); ++i )
+        tally_bus.memory[DataAddress + i] = FoxString[i];
+    tally_bus.memory[LengthAddress] = FoxString.size();
+    tally_bus.memory[MaskAddress] = TallyMask;
+    call_c6502(tally_bus, TallyAddress);
+
+    good = report("BIT tally", BuildTally, const_cpu_tally(FoxString, TallyMask), read32(tally_bus.memory, CrcResult)) && good;
+
+    return good ? 0 : 1;
+}
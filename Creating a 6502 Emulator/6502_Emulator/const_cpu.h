@@ -0,0 +1,152 @@
+#pragma once
+
+#include "Bus.h"
+#include "core6502.h"
+#include "opcodes.h"
+
+#include <array>
+#include <stdexcept>
+
+#include <stdint.h>
+
+// An NMOS 6502 with its own 64K of memory and nothing else, which runs in constant expressions. Small
+// self contained routines, such as table generators and checksums, can run on it at build time and
+// leave their results in the binary as constant data:
+//
+//     constexpr auto table = [] { ConstCpu cpu; cpu.load(0x0300, routine); cpu.call(0x0300); ... }();
+//
+// It works an instruction at a time, with Core6502's semantics. Whatever it can't run, an opcode the
+// NMOS part lacks or a routine that doesn't return, throws, which at compile time is a build error.
+class ConstCpu : public Core6502<ConstCpu> {
+public:
+    static constexpr uint64_t MaxInstructions = 200000;
+
+    std::array<uint8_t, 65536> memory{};
+    Addr pc = 0;
+
+    constexpr uint8_t read(Addr address) const { return memory[address]; }
+    constexpr void write(Addr address, uint8_t value) { memory[address] = value; }
+
+    template<class Bytes>
+    constexpr void load(Addr address, const Bytes &bytes) {
+        for( uint8_t byte : bytes )
+            memory[address++] = byte;
+    }
+
+    // Runs one instruction, and says which it was
+    constexpr Operation step() {
+        Addr address = pc;
+        uint8_t opcode = memory[address];
+        if( !Opcodes::isNmos(opcode) )
+            throw std::runtime_error("ConstCpu ran into an opcode the NMOS 6502 doesn't have");
+
+        unsigned length = Opcodes::length(opcode);
+        Addr operand = length>=2 ? memory[ Addr(address+1) ] : 0;
+        if( length==3 )
+            operand |= memory[ Addr(address+2) ]<<8;
+        pc = address + length;
+
+        Addr ea = 0;
+        switch( Opcodes::mode(opcode) ) {
+        case AddressingMode::Abs:       ea = operand; break;
+        case AddressingMode::Abs_x:     ea = operand + x; break;
+        case AddressingMode::Abs_y:     ea = operand + y; break;
+        case AddressingMode::Abs_ind:   ea = read16page(operand); break;
+        case AddressingMode::Immediate: ea = address + 1; break;
+        case AddressingMode::Pc_rel:    ea = pc + int8_t(operand); break;
+        case AddressingMode::Zp:        ea = operand; break;
+        case AddressingMode::Zp_x:      ea = uint8_t(operand + x); break;
+        case AddressingMode::Zp_y:      ea = uint8_t(operand + y); break;
+        case AddressingMode::Zp_x_ind:  ea = read16zp(operand + x); break;
+        case AddressingMode::Zp_ind_y:  ea = read16zp(operand) + y; break;
+        default:                        break;
+        }
+
+        bool accumulator = Opcodes::mode(opcode)==AddressingMode::Accumulator;
+        Operation op = Opcodes::operation(opcode);
+        switch( op ) {
+        case Operation::Op_LDA: a = nz( read(ea) ); break;
+        case Operation::Op_LDX: x = nz( read(ea) ); break;
+        case Operation::Op_LDY: y = nz( read(ea) ); break;
+        case Operation::Op_STA: write(ea, a); break;
+        case Operation::Op_STX: write(ea, x); break;
+        case Operation::Op_STY: write(ea, y); break;
+
+        case Operation::Op_ADC: adc( read(ea) ); break;
+        case Operation::Op_SBC: sbc( read(ea) ); break;
+        case Operation::Op_AND: a = nz( a & read(ea) ); break;
+        case Operation::Op_ORA: a = nz( a | read(ea) ); break;
+        case Operation::Op_EOR: a = nz( a ^ read(ea) ); break;
+        case Operation::Op_CMP: compare( a, read(ea) ); break;
+        case Operation::Op_CPX: compare( x, read(ea) ); break;
+        case Operation::Op_CPY: compare( y, read(ea) ); break;
+        case Operation::Op_BIT: bit( read(ea) ); break;
+
+        case Operation::Op_ASL: if( accumulator ) a = asl(a); else write( ea, asl( read(ea) ) ); break;
+        case Operation::Op_LSR: if( accumulator ) a = lsr(a); else write( ea, lsr( read(ea) ) ); break;
+        case Operation::Op_ROL: if( accumulator ) a = rol(a); else write( ea, rol( read(ea) ) ); break;
+        case Operation::Op_ROR: if( accumulator ) a = ror(a); else write( ea, ror( read(ea) ) ); break;
+        case Operation::Op_INC: write( ea, nz( read(ea) + 1 ) ); break;
+        case Operation::Op_DEC: write( ea, nz( read(ea) - 1 ) ); break;
+        case Operation::Op_INX: x = nz(x + 1); break;
+        case Operation::Op_INY: y = nz(y + 1); break;
+        case Operation::Op_DEX: x = nz(x - 1); break;
+        case Operation::Op_DEY: y = nz(y - 1); break;
+
+        case Operation::Op_TAX: x = nz(a); break;
+        case Operation::Op_TAY: y = nz(a); break;
+        case Operation::Op_TXA: a = nz(x); break;
+        case Operation::Op_TYA: a = nz(y); break;
+        case Operation::Op_TSX: x = nz(s); break;
+        case Operation::Op_TXS: s = x; break;
+        case Operation::Op_PHA: push(a); break;
+        case Operation::Op_PHP: push(p | 0x30); break;
+        case Operation::Op_PLA: a = nz( pull() ); break;
+        case Operation::Op_PLP: p = pull() | 0x30; break;
+
+        case Operation::Op_CLC: flag(C, false); break;
+        case Operation::Op_SEC: flag(C, true); break;
+        case Operation::Op_CLI: flag(I, false); break;
+        case Operation::Op_SEI: flag(I, true); break;
+        case Operation::Op_CLV: flag(V, false); break;
+        case Operation::Op_CLD: flag(D, false); break;
+        case Operation::Op_SED: flag(D, true); break;
+
+        case Operation::Op_BCC: if( !flag(C) ) pc = ea; break;
+        case Operation::Op_BCS: if( flag(C) ) pc = ea; break;
+        case Operation::Op_BNE: if( !flag(Z) ) pc = ea; break;
+        case Operation::Op_BEQ: if( flag(Z) ) pc = ea; break;
+        case Operation::Op_BPL: if( !flag(N) ) pc = ea; break;
+        case Operation::Op_BMI: if( flag(N) ) pc = ea; break;
+        case Operation::Op_BVC: if( !flag(V) ) pc = ea; break;
+        case Operation::Op_BVS: if( flag(V) ) pc = ea; break;
+
+        case Operation::Op_JMP: pc = ea; break;
+        case Operation::Op_JSR: push16( Addr(pc - 1) ); pc = ea; break;
+        case Operation::Op_RTS: pc = pull16() + 1; break;
+        case Operation::Op_RTI: p = pull() | 0x30; pc = pull16(); break;
+        case Operation::Op_BRK: pc = interrupt(pc, 0xfffe, true); break;
+        case Operation::Op_NOP: break;
+
+        default:
+            throw std::logic_error("ConstCpu has no implementation for an NMOS opcode");
+        }
+
+        return op;
+    }
+
+    // Calls the routine at address, as JSR would, and runs it until it returns. Returns the number of
+    // instructions that took.
+    constexpr uint64_t call(Addr address, uint64_t max_instructions = MaxInstructions) {
+        uint8_t caller_s = s;
+        push16( Addr(pc - 1) );
+        pc = address;
+
+        for( uint64_t count = 1; count<=max_instructions; ++count ) {
+            if( step()==Operation::Op_RTS && s==caller_s )
+                return count;
+        }
+
+        throw std::runtime_error("ConstCpu routine didn't return within its instruction limit");
+    }
+};
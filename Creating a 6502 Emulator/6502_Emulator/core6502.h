@@ -0,0 +1,75 @@
+#pragma once
+
+#include "Bus.h"
+
+#include <stdint.h>
+
+// NMOS 6502 registers and instruction semantics, a whole instruction at a time rather than a bus cycle
+// at a time. Shared by the code recompile generates (aot.h) and by ConstCpu (const_cpu.h).
+//
+// Memory is Derived's: it provides read(Addr) and write(Addr, uint8_t). Everything here is constexpr,
+// so it runs at compile time when Derived's memory can. Like c6502 there is no decimal mode, but BIT
+// sets Z from A & M as the hardware does.
+template<class Derived>
+class Core6502 {
+public:
+    static constexpr uint8_t C = 0x01, Z = 0x02, I = 0x04, D = 0x08, B = 0x10, V = 0x40, N = 0x80;
+
+    uint8_t a = 0, x = 0, y = 0, s = 0xfd, p = 0x34;
+
+    constexpr Addr read16(Addr address) { return load(address) | load( Addr(address+1) )<<8; }
+    // Zero page pointers wrap within the zero page
+    constexpr Addr read16zp(uint8_t address) { return load(address) | load( uint8_t(address+1) )<<8; }
+    // JMP (abs) doesn't carry into the high byte of the pointer
+    constexpr Addr read16page(Addr address) { return load(address) | load( (address & 0xff00) | uint8_t(address+1) )<<8; }
+
+    constexpr void push(uint8_t value) { store( 0x100 | s--, value ); }
+    constexpr uint8_t pull() { return load( 0x100 | ++s ); }
+    constexpr void push16(Addr value) { push(value >> 8); push(value & 0xff); }
+    constexpr Addr pull16() { uint8_t low = pull(); return low | pull()<<8; }
+
+    constexpr void flag(uint8_t mask, bool set) { p = set ? p | mask : p & ~mask; }
+    constexpr bool flag(uint8_t mask) const { return p & mask; }
+
+    constexpr uint8_t nz(uint8_t value) {
+        flag(Z, value==0);
+        flag(N, value & 0x80);
+        return value;
+    }
+
+    constexpr void adc(uint8_t value) {
+        unsigned sum = a + value + flag(C);
+        flag(V, ~(a ^ value) & (a ^ sum) & 0x80);
+        flag(C, sum & 0x100);
+        a = nz(sum);
+    }
+    constexpr void sbc(uint8_t value) { adc(~value); }
+
+    constexpr void compare(uint8_t reg, uint8_t value) {
+        flag(C, reg>=value);
+        nz(reg - value);
+    }
+
+    constexpr void bit(uint8_t value) {
+        flag(Z, (a & value)==0);
+        flag(V, value & 0x40);
+        flag(N, value & 0x80);
+    }
+
+    constexpr uint8_t asl(uint8_t value) { flag(C, value & 0x80); return nz(value << 1); }
+    constexpr uint8_t lsr(uint8_t value) { flag(C, value & 0x01); return nz(value >> 1); }
+    constexpr uint8_t rol(uint8_t value) { bool carry = flag(C); flag(C, value & 0x80); return nz(value<<1 | carry); }
+    constexpr uint8_t ror(uint8_t value) { bool carry = flag(C); flag(C, value & 0x01); return nz(value>>1 | carry<<7); }
+
+    // BRK, and interrupts with brk false
+    constexpr Addr interrupt(Addr return_address, Addr vector, bool brk) {
+        push16(return_address);
+        push( brk ? p | B | 0x20 : (p & ~B) | 0x20 );
+        flag(I, true);
+        return read16(vector);
+    }
+
+private:
+    constexpr uint8_t load(Addr address) { return static_cast<Derived &>(*this).read(address); }
+    constexpr void store(Addr address, uint8_t value) { static_cast<Derived &>(*this).write(address, value); }
+};
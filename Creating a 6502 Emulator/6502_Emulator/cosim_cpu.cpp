@@ -0,0 +1,285 @@
+// Hybrid co-simulation: runs a program on c6502 at full speed, and every so often loads c6502's state
+// into the perfect6502 netlist and runs the two in lockstep over a verification window, reporting any
+// cycle on which their buses diverge. Gives most of c6502's throughput with netlist level checking at
+// the sampled points.
+//
+// The program is a memory image in verify_cpu's format, started from its reset vector. It ends when it
+// writes to 0x0200, the test harness' "finished" trigger. The other $02xx registers, which verify_cpu
+// turns into READY, SO, NMI, RESET and IRQ changes, aren't driven here: a program that writes one of them
+// is stopped and reported as a failure, and needs verify_cpu instead. So does one that runs out of cycles.
+
+#include "Bus.h"
+#include "c6502.h"
+#include "netlist_cpu.h"
+#include "readmem.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+using Image = std::array<uint8_t, 65536>;
+
+static constexpr Addr DoneAddress = 0x0200;
+static constexpr size_t MaxLoadCycles = 100;
+// Writing these has verify_cpu schedule a signal change
+static constexpr Addr SignalRegisters[] = { 0x0281, 0x0283, 0x02fb, 0x02fd, 0x02ff };
+
+struct Options {
+    uint64_t max_cycles = 100000000;
+    size_t window = 1000;
+    uint64_t every = 1000000;
+    size_t max_windows = 100;
+    uint64_t seed = 1;
+    std::vector<Addr> addresses;
+    bool verbose = false;
+};
+
+class WindowStart {};
+class ProgramDone {};
+class CycleLimit {};
+struct SignalWrite {
+    Addr address;
+};
+
+static std::ostream &operator<<(std::ostream &out, const NetlistCpu::BusCycle &bus) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%c %04x %02x%s", bus.read ? 'R' : 'W', bus.address, bus.data, bus.sync ? " sync" : "");
+
+    return out<<buffer;
+}
+
+class CosimBus : public Bus {
+    Image           memory;
+    NetlistCpu      &reference;
+    const Options   &options;
+    std::mt19937_64 rng;
+
+    uint64_t        next_window;
+    // Cycles left in the current verification window; 0 while fast forwarding
+    size_t          window_left = 0;
+    uint64_t        window_start = 0;
+    std::optional<NetlistCpu::BusCycle> primed;
+
+public:
+    uint64_t cycles = 0;
+    size_t windows = 0, divergences = 0;
+    uint64_t checked_cycles = 0;
+
+    CosimBus(const Image &image, NetlistCpu &reference, const Options &options) :
+        memory(image), reference(reference), options(options), rng(options.seed)
+    {
+        next_window = gap();
+    }
+
+    virtual uint8_t read( c6502 *cpu, Addr address, bool sync = false ) override {
+        // Windows open on an instruction boundary, before the cycle is counted, so c6502 can redo the
+        // fetch once the netlist has caught up. Not straight after CLI or SEI, as the loader stub can't
+        // leave the netlist with the I change still to come.
+        if( sync && window_left==0 && windowDue(address) && cpu->getState().delayed_ops==c6502::DelayedOps::None )
+            throw WindowStart();
+
+        tick();
+
+        uint8_t value = memory[address];
+        if( window_left>0 )
+            compare( cpu, NetlistCpu::BusCycle{ .address = address, .data = value, .read = true, .sync = sync } );
+
+        return value;
+    }
+
+    virtual void write( c6502 *cpu, Addr address, uint8_t value ) override {
+        tick();
+
+        if( window_left>0 )
+            compare( cpu, NetlistCpu::BusCycle{ .address = address, .data = value, .read = false, .sync = false } );
+
+        memory[address] = value;
+        if( address==DoneAddress )
+            throw ProgramDone();
+        if( std::find( std::begin(SignalRegisters), std::end(SignalRegisters), address )!=std::end(SignalRegisters) )
+            throw SignalWrite{ address };
+    }
+
+    // Brings the netlist to the architectural state c6502 is in, about to fetch the opcode at state.pc
+    void startWindow(const c6502::State &state) {
+        // A loader stub, same idea as perfect6502's compare.c, put well away from the code it loads for
+        Addr stub = (state.pc + 0x8000) & 0xff00;
+        Image image = memory;
+        Addr addr = stub;
+        for( uint8_t byte : {
+                uint8_t(0xa2), state.regSp,                             // LDX #S
+                uint8_t(0x9a),                                          // TXS
+                uint8_t(0xa9), state.regStatus,                         // LDA #P
+                uint8_t(0x48),                                          // PHA
+                uint8_t(0xa9), state.regA,                              // LDA #A
+                uint8_t(0xa2), state.regX,                              // LDX #X
+                uint8_t(0xa0), state.regY,                              // LDY #Y
+                uint8_t(0x28),                                          // PLP
+                uint8_t(0x4c), uint8_t(state.pc & 0xff), uint8_t(state.pc >> 8) } )    // JMP pc
+        {
+            image[addr++] = byte;
+        }
+        image[0xfffc] = stub & 0xff;
+        image[0xfffd] = stub >> 8;
+
+        reference.memory = image;
+        if( !reference.reset() )
+            throw std::runtime_error("Netlist failed to read the reset vector");
+
+        std::optional<NetlistCpu::BusCycle> fetch;
+        for( size_t i = 0; i<MaxLoadCycles && !fetch; ++i ) {
+            auto bus = reference.cycle();
+            if( bus.sync && bus.address==state.pc )
+                fetch = bus;
+        }
+        if( !fetch )
+            throw std::runtime_error("Netlist didn't reach the window start");
+
+        // Undoes the stub, the vector and the stack byte PHA left behind
+        reference.memory = memory;
+        primed = fetch;
+
+        window_left = options.window;
+        window_start = cycles;
+        windows++;
+
+        if( options.verbose ) {
+            char buffer[64];
+            snprintf(buffer, sizeof(buffer), "Window %zu at cycle %llu, pc %04x\n", windows, (unsigned long long)cycles, state.pc);
+            std::cout<<buffer;
+        }
+    }
+
+private:
+    void tick() {
+        if( cycles++==options.max_cycles )
+            throw CycleLimit();
+    }
+
+    uint64_t gap() {
+        return options.every==0 ? 0 : 1 + rng() % (2*options.every);
+    }
+
+    bool windowDue(Addr address) const {
+        if( cycles<next_window || windows>=options.max_windows )
+            return false;
+
+        return options.addresses.empty() ||
+                std::find( options.addresses.begin(), options.addresses.end(), address )!=options.addresses.end();
+    }
+
+    void compare( const c6502 *cpu, NetlistCpu::BusCycle actual ) {
+        NetlistCpu::BusCycle expected;
+        if( primed ) {
+            expected = *primed;
+            primed.reset();
+        } else {
+            expected = reference.cycle();
+        }
+
+        checked_cycles++;
+
+        if( expected!=actual && !cpu->isIncompatible() ) {
+            divergences++;
+            std::cout<<"Divergence at cycle "<<cycles<<", "<<( cycles - window_start )<<" into window "<<windows<<
+                    ": netlist "<<expected<<", c6502 "<<actual<<"\n";
+            endWindow();
+            return;
+        }
+
+        if( --window_left==0 )
+            endWindow();
+    }
+
+    void endWindow() {
+        window_left = 0;
+        next_window = cycles + gap();
+    }
+};
+
+static void usage(const char *name) {
+    std::cerr<<"Usage: "<<name<<" [-n max_cycles] [-w window] [-e every] [-m max_windows] [-s seed] [-a address]... [-v] memory_image\n"
+            "  -w    Cycles in each lockstep window (default 1000)\n"
+            "  -e    Mean c6502 cycles between windows, chosen at random (default 1000000)\n"
+            "  -m    Most windows to run (default 100)\n"
+            "  -a    Only open windows on fetching an instruction at this address; may be repeated\n"
+            "  -v    Report every window\n";
+    exit(2);
+}
+
+int main(int argc, char *argv[]) {
+    Options options;
+
+    int opt;
+    while( (opt = getopt(argc, argv, "n:w:e:m:s:a:v")) != -1 ) {
+        switch( opt ) {
+        case 'n': options.max_cycles = strtoull(optarg, nullptr, 0); break;
+        case 'w': options.window = strtoul(optarg, nullptr, 0); break;
+        case 'e': options.every = strtoull(optarg, nullptr, 0); break;
+        case 'm': options.max_windows = strtoul(optarg, nullptr, 0); break;
+        case 's': options.seed = strtoull(optarg, nullptr, 0); break;
+        case 'a': options.addresses.push_back( strtoul(optarg, nullptr, 16) ); break;
+        case 'v': options.verbose = true; break;
+        default: usage(argv[0]);
+        }
+    }
+
+    if( argc-optind != 1 || options.window==0 )
+        usage(argv[0]);
+
+    Image image{};
+    ReadMem<8> memory_image(argv[optind]);
+    while( memory_image.read_line() ) {
+        image[memory_image.address()] = memory_image[0];
+    }
+
+    NetlistCpu reference;
+    CosimBus bus(image, reference, options);
+    c6502 cpu(bus);
+    cpu.setSignalLogging(false);
+    cpu.setState( c6502::State{ .regA = 0, .regX = 0, .regY = 0, .regSp = 0xfd, .regStatus = 0x34,
+            .pc = Addr( image[0xfffc] | image[0xfffd]<<8 ) } );
+
+    bool finished = true;
+    std::optional<Addr> signal_write;
+    auto start = std::chrono::steady_clock::now();
+    while( true ) {
+        try {
+            cpu.runCpu();
+        } catch( WindowStart ex ) {
+            auto state = cpu.getState();
+            bus.startWindow(state);
+            cpu.setState(state);
+            continue;
+        } catch( ProgramDone ex ) {
+        } catch( CycleLimit ex ) {
+            finished = false;
+        } catch( SignalWrite ex ) {
+            finished = false;
+            signal_write = ex.address;
+        }
+        break;
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - start );
+
+    char buffer[256];
+    if( signal_write ) {
+        snprintf(buffer, sizeof(buffer), "The program wrote the signal register at %04x, which only verify_cpu drives\n", *signal_write);
+        std::cout<<buffer;
+    }
+    snprintf(buffer, sizeof(buffer), "%llu cycles%s in %.3fs (%.3f MHz), %zu windows checked %llu cycles on the netlist, %zu divergences\n",
+            (unsigned long long)bus.cycles, finished ? "" : signal_write ? " (stopped)" : " (cycle limit reached)", elapsed.count() / 1e6,
+            double(bus.cycles) / std::max<int64_t>(elapsed.count(), 1), bus.windows, (unsigned long long)bus.checked_cycles,
+            bus.divergences);
+    std::cout<<buffer;
+
+    return finished && bus.divergences==0 ? 0 : 1;
+}
@@ -0,0 +1,145 @@
+#include "cpu_backend.h"
+
+#include "readmem.h"
+
+#include <string.h>
+
+static constexpr size_t StackSize = 256 * 1024;
+
+std::unique_ptr<CpuBackend> makeCpuBackend(const char *name, Bus &bus) {
+    if( strcmp(name, "c6502")==0 )
+        return std::make_unique<C6502Backend>(bus);
+    if( strcmp(name, "netlist")==0 )
+        return std::make_unique<NetlistBackend>(bus);
+    if( strncmp(name, "trace:", 6)==0 )
+        return std::make_unique<TraceBackend>(bus, name + 6);
+
+    return nullptr;
+}
+
+C6502Backend::C6502Backend(Bus &bus) : bus_(bus), cpu_(*this), stack_(StackSize) {
+    cpu_.setSignalLogging(false);
+}
+
+void C6502Backend::run(uint64_t cycles) {
+    if( cycles==0 )
+        return;
+
+    cycles_left_ = cycles;
+
+    if( !started_ ) {
+        getcontext(&context_);
+        context_.uc_stack.ss_sp = stack_.data();
+        context_.uc_stack.ss_size = stack_.size();
+        context_.uc_link = &caller_;
+
+        // makecontext only passes ints
+        uintptr_t self = reinterpret_cast<uintptr_t>(this);
+        makecontext(&context_, reinterpret_cast<void (*)()>(&C6502Backend::entry), 2, unsigned(self >> 32), unsigned(self));
+        started_ = true;
+    }
+
+    swapcontext(&caller_, &context_);
+
+    if( exception_ ) {
+        std::exception_ptr exception = exception_;
+        exception_ = nullptr;
+        std::rethrow_exception(exception);
+    }
+}
+
+// The bus' exceptions can't unwind past the top of this stack, so they are caught here and rethrown
+// from run() on the caller's
+void C6502Backend::entry(unsigned high, unsigned low) {
+    auto self = reinterpret_cast<C6502Backend *>( uintptr_t(high)<<32 | low );
+
+    try {
+        self->cpu_.runCpu();
+    } catch( ... ) {
+        self->exception_ = std::current_exception();
+    }
+
+    // Returning resumes the caller through uc_link; the next run() starts afresh
+    self->started_ = false;
+}
+
+std::optional<CpuBackend::Registers> C6502Backend::registers() const {
+    auto state = cpu_.getState();
+    return Registers{ .regA = state.regA, .regX = state.regX, .regY = state.regY, .regSp = state.regSp,
+            .regStatus = state.regStatus, .pc = state.pc };
+}
+
+uint8_t C6502Backend::read( c6502 *cpu, Addr address, bool sync ) {
+    uint8_t value = bus_.read(cpu, address, sync);
+    endCycle();
+
+    return value;
+}
+
+void C6502Backend::write( c6502 *cpu, Addr address, uint8_t value ) {
+    bus_.write(cpu, address, value);
+    endCycle();
+}
+
+void C6502Backend::endCycle() {
+    if( --cycles_left_==0 )
+        swapcontext(&context_, &caller_);
+}
+
+NetlistBackend::NetlistBackend(Bus &bus) : bus_(bus) {
+    // Every read goes to the bus
+    cpu_.setIo(0, 0, [this](Addr address) { return bus_.read(nullptr, address, cpu_.sync()); });
+}
+
+void NetlistBackend::run(uint64_t cycles) {
+    for( uint64_t i = 0; i<cycles; ++i ) {
+        bus_.cycleStart();
+        auto bus = cpu_.cycle();
+        if( !bus.read )
+            bus_.write(nullptr, bus.address, bus.data);
+    }
+}
+
+std::optional<CpuBackend::Registers> NetlistBackend::registers() const {
+    return Registers{ .regA = cpu_.regA(), .regX = cpu_.regX(), .regY = cpu_.regY(), .regSp = cpu_.regSp(),
+            .regStatus = cpu_.regStatus(), .pc = cpu_.pc() };
+}
+
+TraceBackend::TraceBackend(Bus &bus, const char *path) : bus_(bus) {
+    ReadMem<8,8,16,4> trace(path);
+
+    while( trace.read_line() ) {
+        // Wait lines, `0_0000_00_count`, are for the hardware harness and aren't bus cycles
+        if( trace[3]==0 )
+            continue;
+
+        trace_.push_back( Cycle{ .address = Addr( trace[2] ), .data = uint8_t( trace[1] ),
+                .read = bool( trace[0] & 0x01 ), .sync = bool( trace[0] & 0x02 ) } );
+    }
+}
+
+void TraceBackend::setReset(bool state) {
+    // A reset the program asks for mid-run is in the trace already, reset cycles and all, so only the one
+    // that starts it is acted on
+    if( next_==0 )
+        reset_ = state;
+}
+
+void TraceBackend::run(uint64_t cycles) {
+    for( uint64_t i = 0; i<cycles; ++i ) {
+        if( reset_ ) {
+            bus_.read(nullptr, 0);
+            continue;
+        }
+        if( next_==trace_.size() )
+            throw TraceEnded();
+
+        const Cycle &cycle = trace_[next_++];
+        if( cycle.read ) {
+            if( bus_.read(nullptr, cycle.address, cycle.sync)!=cycle.data )
+                mismatches_++;
+        } else {
+            bus_.write(nullptr, cycle.address, cycle.data);
+        }
+    }
+}
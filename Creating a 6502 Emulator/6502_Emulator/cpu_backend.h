@@ -0,0 +1,153 @@
+#pragma once
+
+#include "Bus.h"
+#include "c6502.h"
+#include "netlist_cpu.h"
+
+#include <exception>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include <stdint.h>
+#include <ucontext.h>
+
+// A 6502 driven a bus cycle at a time, whatever implements it, so harnesses and machines can pick or
+// swap the implementation at runtime: c6502 for speed, the perfect6502 netlist for exactness, or a
+// recorded trace.
+//
+// Every backend drives a Bus. The cpu argument of its calls is the c6502 for the c6502 backend, and
+// nullptr for the others, so buses that want to change signals should go through the backend instead.
+class CpuBackend {
+public:
+    struct Registers {
+        uint8_t regA, regX, regY, regSp, regStatus;
+        Addr pc;
+    };
+
+    virtual ~CpuBackend() = default;
+
+    virtual const char *name() const = 0;
+
+    // Runs this many bus cycles. Exceptions thrown by the bus come out of here, which ends the run of
+    // the current instruction; backends pick up again from the next one.
+    virtual void run(uint64_t cycles) = 0;
+    void step() { run(1); }
+
+    virtual void setReset(bool state) = 0;
+    virtual void setIrq(bool state) = 0;
+    virtual void setNmi(bool state) = 0;
+    virtual void setReady(bool state) = 0;
+    virtual void setSo(bool state) = 0;
+
+    // Nothing for backends without registers, such as a trace
+    virtual std::optional<Registers> registers() const = 0;
+
+    // Whether the current cycle is known not to match the real chip
+    virtual bool isIncompatible() const { return false; }
+};
+
+// Builds a backend by name: "c6502", "netlist", or "trace:<file>". Returns nullptr for unknown names.
+std::unique_ptr<CpuBackend> makeCpuBackend(const char *name, Bus &bus);
+
+// c6502 runs the whole CPU inside its bus calls, so it runs here on a stack of its own, and switches
+// back to the caller once it has used up the cycles it was asked to run.
+class C6502Backend : public CpuBackend, private Bus {
+    Bus &bus_;
+    c6502 cpu_;
+
+    std::vector<char> stack_;
+    ucontext_t caller_, context_;
+    bool started_ = false;
+    uint64_t cycles_left_ = 0;
+    std::exception_ptr exception_;
+
+public:
+    explicit C6502Backend(Bus &bus);
+
+    C6502Backend(const C6502Backend &that) = delete;
+    C6502Backend &operator=(const C6502Backend &that) = delete;
+
+    // For what only c6502 has, such as hooks
+    c6502 &cpu() { return cpu_; }
+
+    const char *name() const override { return "c6502"; }
+    void run(uint64_t cycles) override;
+
+    void setReset(bool state) override { cpu_.setReset(state); }
+    void setIrq(bool state) override { cpu_.setIrq(state); }
+    void setNmi(bool state) override { cpu_.setNmi(state); }
+    void setReady(bool state) override { cpu_.setReady(state); }
+    void setSo(bool state) override { cpu_.setSo(state); }
+
+    std::optional<Registers> registers() const override;
+    bool isIncompatible() const override { return cpu_.isIncompatible(); }
+
+private:
+    uint8_t read( c6502 *cpu, Addr address, bool sync = false ) override;
+    void write( c6502 *cpu, Addr address, uint8_t value ) override;
+    void endCycle();
+
+    static void entry(unsigned high, unsigned low);
+};
+
+class NetlistBackend : public CpuBackend {
+    Bus &bus_;
+    NetlistCpu cpu_;
+
+public:
+    explicit NetlistBackend(Bus &bus);
+
+    NetlistCpu &cpu() { return cpu_; }
+
+    const char *name() const override { return "netlist"; }
+    void run(uint64_t cycles) override;
+
+    void setReset(bool state) override { cpu_.setReset(state); }
+    void setIrq(bool state) override { cpu_.setIrq(state); }
+    void setNmi(bool state) override { cpu_.setNmi(state); }
+    void setReady(bool state) override { cpu_.setReady(state); }
+    void setSo(bool state) override { cpu_.setSo(state); }
+
+    std::optional<Registers> registers() const override;
+};
+
+// Replays a bus trace in the test plan format (`1_address_data_flags`, flags bit 0 for read and bit 1
+// for SYNC), skipping wait lines. Reads still go to the bus, and are counted as mismatches if the bus
+// answers differently than the trace recorded. While reset is held before playback starts the bus only
+// sees reads of address 0. Later resets, like the other signals, are ignored, as their effect is already
+// in the trace.
+class TraceBackend : public CpuBackend {
+public:
+    // Thrown by run() once the trace has been played to the end
+    class TraceEnded {};
+
+private:
+    struct Cycle {
+        Addr address;
+        uint8_t data;
+        bool read, sync;
+    };
+
+    Bus &bus_;
+    std::vector<Cycle> trace_;
+    size_t next_ = 0;
+    size_t mismatches_ = 0;
+    bool reset_ = false;
+
+public:
+    TraceBackend(Bus &bus, const char *path);
+
+    size_t mismatches() const { return mismatches_; }
+
+    const char *name() const override { return "trace"; }
+    void run(uint64_t cycles) override;
+
+    void setReset(bool state) override;
+    void setIrq(bool state) override {}
+    void setNmi(bool state) override {}
+    void setReady(bool state) override {}
+    void setSo(bool state) override {}
+
+    std::optional<Registers> registers() const override { return std::nullopt; }
+};
@@ -0,0 +1,236 @@
+#include "d64.h"
+
+#include <array>
+#include <stdexcept>
+#include <string>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+D64Image::D64Image(const char *path) {
+    int fd = open(path, O_RDWR);
+    writable_ = fd>=0;
+    if( fd<0 && (errno==EACCES || errno==EROFS) )
+        fd = open(path, O_RDONLY);
+    if( fd<0 )
+        throw std::runtime_error( std::string("Failed opening ") + path + ": " + strerror(errno) );
+
+    struct stat st;
+    if( fstat(fd, &st)<0 ) {
+        close(fd);
+        throw std::runtime_error( std::string("Failed reading ") + path + ": " + strerror(errno) );
+    }
+
+    // With or without the trailing error bytes
+    size_ = st.st_size;
+    switch( size_ ) {
+    case 174848: case 175531: tracks_ = 35; break;
+    case 196608: case 197376: tracks_ = 40; break;
+    default:
+        close(fd);
+        throw std::runtime_error( std::string(path) + " is not a D64 image" );
+    }
+
+    void *data = mmap(nullptr, size_, PROT_READ | PROT_WRITE, writable_ ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+    close(fd);
+    if( data==MAP_FAILED )
+        throw std::runtime_error( std::string("Failed mapping ") + path + ": " + strerror(errno) );
+
+    data_ = static_cast<uint8_t *>(data);
+}
+
+D64Image::~D64Image() {
+    flush();
+    munmap(data_, size_);
+}
+
+unsigned D64Image::sectorsPerTrack(unsigned track) {
+    if( track<=17 )
+        return 21;
+    if( track<=24 )
+        return 19;
+    if( track<=30 )
+        return 18;
+    return 17;
+}
+
+uint8_t *D64Image::sector(unsigned track, unsigned sector) {
+    return const_cast<uint8_t *>( static_cast<const D64Image *>(this)->sector(track, sector) );
+}
+
+const uint8_t *D64Image::sector(unsigned track, unsigned sector) const {
+    if( track<1 || track>tracks_ || sector>=sectorsPerTrack(track) )
+        throw std::out_of_range("No such track or sector");
+
+    size_t index = sector;
+    for( unsigned t = 1; t<track; ++t )
+        index += sectorsPerTrack(t);
+
+    return data_ + index*SectorSize;
+}
+
+void D64Image::flush() {
+    if( writable_ )
+        msync(data_, size_, MS_SYNC);
+}
+
+namespace Gcr {
+
+static constexpr uint8_t Nibbles[16] = {
+    0x0a, 0x0b, 0x12, 0x13, 0x0e, 0x0f, 0x16, 0x17, 0x09, 0x19, 0x1a, 0x1b, 0x0d, 0x1d, 0x1e, 0x15
+};
+
+// The 10 bit code for every byte, so encoding takes one lookup per byte
+static constexpr auto ByteCodes = []() {
+    std::array<uint16_t, 256> codes{};
+    for( unsigned i = 0; i<256; ++i )
+        codes[i] = Nibbles[i >> 4]<<5 | Nibbles[i & 0xf];
+    return codes;
+}();
+
+// 5 bit codes back to nibbles, 0xff for codes that aren't valid GCR
+static constexpr auto Quintets = []() {
+    std::array<uint8_t, 32> nibbles{};
+    nibbles.fill(0xff);
+    for( unsigned i = 0; i<16; ++i )
+        nibbles[ Nibbles[i] ] = i;
+    return nibbles;
+}();
+
+static constexpr uint8_t Sync = 0xff, Gap = 0x55;
+static constexpr size_t SyncLength = 5, HeaderGap = 9;
+static constexpr size_t HeaderLength = 8, DataLength = 260;
+static constexpr uint8_t HeaderMark = 0x08, DataMark = 0x07;
+
+unsigned zone(unsigned track) {
+    if( track<=17 )
+        return 3;
+    if( track<=24 )
+        return 2;
+    if( track<=30 )
+        return 1;
+    return 0;
+}
+
+size_t trackLength(unsigned zone) {
+    static constexpr size_t Lengths[] = { 6250, 6666, 7142, 7692 };
+    return Lengths[zone];
+}
+
+unsigned cyclesPerByte(unsigned zone) {
+    return 32 - 2*zone;
+}
+
+void encode(const uint8_t *in, uint8_t *out) {
+    uint64_t bits = 0;
+    for( int i = 0; i<4; ++i )
+        bits = bits<<10 | ByteCodes[ in[i] ];
+
+    for( int i = 4; i>=0; --i ) {
+        out[i] = bits & 0xff;
+        bits >>= 8;
+    }
+}
+
+bool decode(const uint8_t *in, uint8_t *out) {
+    uint64_t bits = 0;
+    for( int i = 0; i<5; ++i )
+        bits = bits<<8 | in[i];
+
+    bool valid = true;
+    for( int i = 3; i>=0; --i ) {
+        uint8_t low = Quintets[ bits & 0x1f ], high = Quintets[ (bits >> 5) & 0x1f ];
+        valid = valid && low!=0xff && high!=0xff;
+        out[i] = high<<4 | (low & 0xf);
+        bits >>= 10;
+    }
+
+    return valid;
+}
+
+static void encodeBlock(const uint8_t *in, size_t length, std::vector<uint8_t> &out) {
+    for( size_t i = 0; i<length; i += 4 ) {
+        uint8_t gcr[5];
+        encode(in + i, gcr);
+        out.insert(out.end(), gcr, gcr + 5);
+    }
+}
+
+static bool decodeBlock(const uint8_t *in, size_t length, uint8_t *out) {
+    bool valid = true;
+    for( size_t i = 0; i<length; i += 4 )
+        valid = decode(in + i/4*5, out + i) && valid;
+
+    return valid;
+}
+
+std::vector<uint8_t> encodeTrack(const D64Image &image, unsigned track) {
+    unsigned sectors = D64Image::sectorsPerTrack(track);
+    size_t length = trackLength( zone(track) );
+    size_t sector_length = 2*SyncLength + HeaderLength/4*5 + HeaderGap + DataLength/4*5;
+    size_t tail_gap = (length - sectors*sector_length) / sectors;
+
+    std::vector<uint8_t> gcr;
+    gcr.reserve(length);
+
+    for( unsigned sector = 0; sector<sectors; ++sector ) {
+        uint8_t header[HeaderLength] = { HeaderMark, 0, uint8_t(sector), uint8_t(track), image.id2(), image.id1(), 0x0f, 0x0f };
+        header[1] = header[2] ^ header[3] ^ header[4] ^ header[5];
+
+        gcr.insert(gcr.end(), SyncLength, Sync);
+        encodeBlock(header, HeaderLength, gcr);
+        gcr.insert(gcr.end(), HeaderGap, Gap);
+
+        uint8_t data[DataLength] = { DataMark };
+        memcpy(data + 1, image.sector(track, sector), D64Image::SectorSize);
+        for( size_t i = 1; i<=D64Image::SectorSize; ++i )
+            data[257] ^= data[i];
+
+        gcr.insert(gcr.end(), SyncLength, Sync);
+        encodeBlock(data, DataLength, gcr);
+        gcr.insert(gcr.end(), tail_gap, Gap);
+    }
+
+    gcr.resize(length, Gap);
+
+    return gcr;
+}
+
+size_t decodeTrack(const std::vector<uint8_t> &gcr, unsigned track, D64Image &image) {
+    // Two revolutions, so blocks that straddle the index hole decode in one piece
+    std::vector<uint8_t> revolutions(gcr);
+    revolutions.insert(revolutions.end(), gcr.begin(), gcr.end());
+
+    size_t written = 0;
+    int header_sector = -1;
+
+    for( size_t i = 2; i<gcr.size() + 2; ++i ) {
+        // The first byte past a sync
+        if( revolutions[i-2]!=Sync || revolutions[i-1]!=Sync || revolutions[i]==Sync )
+            continue;
+
+        uint8_t block[DataLength];
+        if( decodeBlock(&revolutions[i], HeaderLength, block) && block[0]==HeaderMark ) {
+            bool valid = (block[1] ^ block[2] ^ block[3] ^ block[4] ^ block[5])==0;
+            header_sector = valid && block[3]==track && block[2]<D64Image::sectorsPerTrack(track) ? block[2] : -1;
+        } else if( header_sector>=0 && decodeBlock(&revolutions[i], DataLength, block) && block[0]==DataMark ) {
+            uint8_t checksum = 0;
+            for( size_t j = 1; j<=D64Image::SectorSize+1; ++j )
+                checksum ^= block[j];
+
+            if( checksum==0 ) {
+                memcpy(image.sector(track, header_sector), block + 1, D64Image::SectorSize);
+                written++;
+            }
+            header_sector = -1;
+        }
+    }
+
+    return written;
+}
+
+} // namespace Gcr
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A D64 disk image, mapped into memory. Sectors are read and written in place; changes reach the file
+// when flushed or when the image is closed. Images the process can't write are mapped privately, and
+// report themselves as write protected.
+class D64Image {
+    uint8_t *data_ = nullptr;
+    size_t size_ = 0;
+    unsigned tracks_ = 0;
+    bool writable_ = false;
+
+public:
+    static constexpr size_t SectorSize = 256;
+    static constexpr unsigned MaxTracks = 40;
+
+    explicit D64Image(const char *path);
+    ~D64Image();
+
+    D64Image(const D64Image &that) = delete;
+    D64Image &operator=(const D64Image &that) = delete;
+
+    unsigned tracks() const { return tracks_; }
+    bool writable() const { return writable_; }
+
+    // Tracks count from 1, sectors from 0
+    static unsigned sectorsPerTrack(unsigned track);
+    uint8_t *sector(unsigned track, unsigned sector);
+    const uint8_t *sector(unsigned track, unsigned sector) const;
+
+    // The two ID characters from the BAM, which every sector header carries
+    uint8_t id1() const { return sector(18, 0)[0xa2]; }
+    uint8_t id2() const { return sector(18, 0)[0xa3]; }
+
+    void flush();
+};
+
+// Commodore GCR, as written to disk by the 1541: every 4 bits become 5, so that no more than two zero
+// bits ever follow each other, and runs of ten or more ones are left to mark syncs.
+namespace Gcr {
+
+// Density zone a track is recorded at, 3 (the outermost tracks) to 0
+unsigned zone(unsigned track);
+// Bytes per revolution at a zone, and the CPU cycles each one takes to pass the head
+size_t trackLength(unsigned zone);
+unsigned cyclesPerByte(unsigned zone);
+
+// Encodes 4 bytes into 5
+void encode(const uint8_t *in, uint8_t *out);
+// Decodes 5 bytes into 4. Returns false if any of it wasn't valid GCR.
+bool decode(const uint8_t *in, uint8_t *out);
+
+// The whole track as it sits on disk: each sector's header and data blocks, with syncs and gaps
+std::vector<uint8_t> encodeTrack(const D64Image &image, unsigned track);
+// Writes every sector that decodes cleanly back into the image. Returns the number of sectors written.
+size_t decodeTrack(const std::vector<uint8_t> &gcr, unsigned track, D64Image &image);
+
+} // namespace Gcr
@@ -0,0 +1,314 @@
+// Golden trace regression without the golden trace: runs a memory image on a CPU backend and emits a
+// rolling hash of every K cycles of bus traffic instead of the traffic itself. Two digest streams, from
+// two builds (-r) or two backends (-B), are compared window by window, and only the first mismatching
+// window is run again at full trace detail.
+//
+// The memory image is in verify_cpu's format and starts from reset. Cycles count from the reset vector
+// read, and the program ends when it writes to 0x0200, the test harness' "finished" trigger.
+
+#include "Bus.h"
+#include "cpu_backend.h"
+#include "readmem.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+using Image = std::array<uint8_t, 65536>;
+
+static constexpr Addr DoneAddress = 0x0200;
+static constexpr size_t ResetCycles = 8;
+static constexpr uint64_t DigestSeed = 0xcbf29ce484222325;
+// Cycles shown before the first difference when comparing backends
+static constexpr size_t ContextCycles = 8;
+
+struct Options {
+    const char *backend = "c6502";
+    const char *other_backend = nullptr;
+    const char *reference = nullptr;
+    const char *output = nullptr;
+    uint64_t window = 100000;
+    uint64_t max_cycles = 1000000000;
+    std::optional<size_t> trace_window;
+};
+
+struct Access {
+    uint64_t cycle;
+    Addr address;
+    uint8_t data;
+    bool read, sync;
+
+    bool sameAs(const Access &that) const {
+        return address==that.address && data==that.data && read==that.read && sync==that.sync;
+    }
+};
+
+struct Digests {
+    std::vector<uint64_t> digests;
+    uint64_t cycles = 0;
+    bool finished = true;
+};
+
+class ProgramDone {};
+class CycleLimit {};
+class WindowTraced {};
+
+static std::ostream &operator<<(std::ostream &out, const Access &access) {
+    char buffer[48];
+    snprintf(buffer, sizeof(buffer), "%llu: %c %04x %02x%s", (unsigned long long)access.cycle, access.read ? 'R' : 'W',
+            access.address, access.data, access.sync ? " sync" : "");
+
+    return out<<buffer;
+}
+
+class DigestBus : public Bus {
+    Image           memory;
+    const Options   &options;
+    std::optional<size_t> trace_window;
+    bool            started = false;
+    uint64_t        hash = DigestSeed;
+
+public:
+    Digests result;
+    std::vector<Access> trace;
+
+    DigestBus(const Image &image, const Options &options, std::optional<size_t> trace_window) :
+        memory(image), options(options), trace_window(trace_window) {}
+
+    virtual uint8_t read( c6502 *cpu, Addr address, bool sync = false ) override {
+        uint8_t value = memory[address];
+        record( Access{ .cycle = result.cycles, .address = address, .data = value, .read = true, .sync = sync } );
+
+        return value;
+    }
+
+    virtual void write( c6502 *cpu, Addr address, uint8_t value ) override {
+        record( Access{ .cycle = result.cycles, .address = address, .data = value, .read = false, .sync = false } );
+
+        memory[address] = value;
+        if( started && address==DoneAddress )
+            throw ProgramDone();
+    }
+
+    // The digest of a window cut short by the end of the program
+    void finish() {
+        if( result.cycles % options.window != 0 )
+            result.digests.push_back(hash);
+    }
+
+private:
+    void record(const Access &access) {
+        if( !started ) {
+            if( !access.read || access.address!=0xfffc )
+                return;
+            started = true;
+        }
+
+        size_t window = result.cycles / options.window;
+        if( trace_window && window==*trace_window )
+            trace.push_back(access);
+
+        uint64_t word = uint64_t(access.address)<<16 | uint64_t(access.data)<<8 | access.read<<1 | access.sync;
+        hash = ( (hash<<5 | hash>>59) ^ word ^ access.cycle<<32 ) * 0x9e3779b97f4a7c15;
+
+        if( ++result.cycles % options.window == 0 ) {
+            result.digests.push_back(hash);
+            hash = DigestSeed;
+
+            if( trace_window && window==*trace_window )
+                throw WindowTraced();
+        }
+        if( result.cycles==options.max_cycles )
+            throw CycleLimit();
+    }
+};
+
+// Runs the image on the backend, tracing the given window in full
+static Digests run(const char *backend_name, const Options &options, const Image &image,
+        std::optional<size_t> trace_window = std::nullopt, std::vector<Access> *trace = nullptr)
+{
+    DigestBus bus(image, options, trace_window);
+    std::unique_ptr<CpuBackend> backend = makeCpuBackend(backend_name, bus);
+    if( !backend )
+        throw std::runtime_error( std::string("Unknown CPU backend ") + backend_name );
+
+    try {
+        backend->setReset(true);
+        backend->run(ResetCycles);
+        backend->setReset(false);
+
+        while( true )
+            backend->run(options.window);
+    } catch( ProgramDone ex ) {
+    } catch( WindowTraced ex ) {
+    } catch( TraceBackend::TraceEnded ex ) {
+    } catch( CycleLimit ex ) {
+        bus.result.finished = false;
+    }
+    bus.finish();
+
+    if( trace )
+        *trace = std::move(bus.trace);
+    return std::move(bus.result);
+}
+
+static void write_digests(std::ostream &out, const Options &options, const Digests &digests) {
+    out<<"# "<<options.backend<<", "<<options.window<<" cycles per digest, "<<digests.cycles<<" cycles"<<
+            ( digests.finished ? "" : " (cycle limit reached)" )<<"\n";
+
+    char buffer[48];
+    for( size_t i = 0; i<digests.digests.size(); ++i ) {
+        snprintf(buffer, sizeof(buffer), "%llu %016llx\n", (unsigned long long)(i * options.window),
+                (unsigned long long)digests.digests[i]);
+        out<<buffer;
+    }
+}
+
+static Digests read_digests(const char *path, const Options &options) {
+    std::ifstream in(path);
+    if( !in )
+        throw std::runtime_error( std::string("Can't open ") + path );
+
+    Digests result;
+    std::string line;
+    while( std::getline(in, line) ) {
+        if( line.empty() || line[0]=='#' )
+            continue;
+
+        unsigned long long cycle, digest;
+        if( sscanf(line.c_str(), "%llu %llx", &cycle, &digest)!=2 || cycle!=result.digests.size() * options.window )
+            throw std::runtime_error( std::string(path) + " isn't a digest stream with the same window size" );
+        result.digests.push_back(digest);
+    }
+
+    return result;
+}
+
+// The first window whose digest differs, or that only one side has
+static std::optional<size_t> first_mismatch(const Digests &a, const Digests &b) {
+    auto difference = std::mismatch( a.digests.begin(), a.digests.end(), b.digests.begin(), b.digests.end() );
+    if( difference.first==a.digests.end() && difference.second==b.digests.end() )
+        return std::nullopt;
+
+    return difference.first - a.digests.begin();
+}
+
+static void usage(const char *name) {
+    std::cerr<<"Usage: "<<name<<" [-b backend] [-k cycles] [-n max_cycles] [-o digests | -r digests | -B backend | -t window] memory_image\n"
+            "  -b    CPU to run: c6502 (default), netlist, or trace:<file>\n"
+            "  -k    Cycles per digest (default 100000)\n"
+            "  -o    Write the digest stream here rather than to stdout\n"
+            "  -r    Compare with a digest stream written by another build, and trace the first window that differs\n"
+            "  -B    Compare with another backend, and show the first cycle that differs\n"
+            "  -t    Trace this window in full\n";
+    exit(2);
+}
+
+int main(int argc, char *argv[]) {
+    Options options;
+
+    int opt;
+    while( (opt = getopt(argc, argv, "b:k:n:o:r:B:t:")) != -1 ) {
+        switch( opt ) {
+        case 'b': options.backend = optarg; break;
+        case 'k': options.window = strtoull(optarg, nullptr, 0); break;
+        case 'n': options.max_cycles = strtoull(optarg, nullptr, 0); break;
+        case 'o': options.output = optarg; break;
+        case 'r': options.reference = optarg; break;
+        case 'B': options.other_backend = optarg; break;
+        case 't': options.trace_window = strtoul(optarg, nullptr, 0); break;
+        default: usage(argv[0]);
+        }
+    }
+
+    if( argc-optind != 1 || options.window==0 || (options.reference && options.other_backend) )
+        usage(argv[0]);
+
+    Image image{};
+    ReadMem<8> memory_image(argv[optind]);
+    while( memory_image.read_line() ) {
+        image[memory_image.address()] = memory_image[0];
+    }
+
+    if( options.trace_window ) {
+        std::vector<Access> trace;
+        run(options.backend, options, image, options.trace_window, &trace);
+        for( const auto &access : trace )
+            std::cout<<access<<"\n";
+
+        return 0;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    Digests digests = run(options.backend, options, image);
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - start );
+
+    char buffer[160];
+    snprintf(buffer, sizeof(buffer), "%s: %llu cycles%s in %.3fs (%.3f MHz), %zu digests\n", options.backend,
+            (unsigned long long)digests.cycles, digests.finished ? "" : " (cycle limit reached)", elapsed.count() / 1e6,
+            double(digests.cycles) / std::max<int64_t>(elapsed.count(), 1), digests.digests.size());
+    std::cerr<<buffer;
+
+    if( !options.reference && !options.other_backend ) {
+        if( options.output ) {
+            std::ofstream out(options.output);
+            write_digests(out, options, digests);
+        } else {
+            write_digests(std::cout, options, digests);
+        }
+
+        return 0;
+    }
+
+    if( options.reference ) {
+        auto mismatch = first_mismatch( digests, read_digests(options.reference, options) );
+        if( !mismatch ) {
+            std::cout<<"All "<<digests.digests.size()<<" digests match "<<options.reference<<"\n";
+            return 0;
+        }
+
+        // Only this side's trace is at hand; the other build gives its own with -t
+        std::cout<<"Window "<<*mismatch<<" (from cycle "<<*mismatch * options.window<<") differs from "<<
+                options.reference<<". Trace here, compare with the other build's -t "<<*mismatch<<":\n";
+        std::vector<Access> trace;
+        run(options.backend, options, image, mismatch, &trace);
+        for( const auto &access : trace )
+            std::cout<<access<<"\n";
+
+        return 1;
+    }
+
+    auto mismatch = first_mismatch( digests, run(options.other_backend, options, image) );
+    if( !mismatch ) {
+        std::cout<<"All "<<digests.digests.size()<<" digests match "<<options.other_backend<<"\n";
+        return 0;
+    }
+
+    std::vector<Access> trace, other_trace;
+    run(options.backend, options, image, mismatch, &trace);
+    run(options.other_backend, options, image, mismatch, &other_trace);
+
+    auto difference = std::mismatch( trace.begin(), trace.end(), other_trace.begin(), other_trace.end(),
+            [](const Access &a, const Access &b) { return a.sameAs(b); } );
+    size_t index = difference.first - trace.begin();
+
+    std::cout<<"Window "<<*mismatch<<" differs between "<<options.backend<<" and "<<options.other_backend<<"\n";
+    for( size_t i = index - std::min(index, ContextCycles); i<index; ++i )
+        std::cout<<"  "<<trace[i]<<"\n";
+    if( difference.first!=trace.end() )
+        std::cout<<"  "<<options.backend<<" "<<*difference.first<<"\n";
+    if( difference.second!=other_trace.end() )
+        std::cout<<"  "<<options.other_backend<<" "<<*difference.second<<"\n";
+
+    return 1;
+}
@@ -0,0 +1,224 @@
+#include "disasm.h"
+
+#include <stdio.h>
+
+Instruction decode(const std::array<uint8_t, 65536> &memory, Addr address) {
+    Instruction result{ .address = address, .opcode = memory[address] };
+    result.length = Opcodes::length(result.opcode);
+
+    if( result.length>=2 )
+        result.operand = memory[ Addr(address+1) ];
+    if( result.length==3 )
+        result.operand |= memory[ Addr(address+2) ]<<8;
+
+    switch( result.flow() ) {
+    case Opcodes::Flow::Branch:
+    case Opcodes::Flow::Jump:
+        if( Opcodes::mode(result.opcode)==AddressingMode::Abs ) {
+            result.target = result.operand;
+        } else {
+            // The offset is the last byte, BBR and BBS having a zero page address before it
+            int8_t offset = memory[ Addr(address + result.length - 1) ];
+            result.target = Addr( address + result.length + offset );
+        }
+        break;
+    case Opcodes::Flow::Call:
+        result.target = result.operand;
+        break;
+    default:
+        break;
+    }
+
+    return result;
+}
+
+std::string format(const Instruction &instruction) {
+    uint8_t opcode = instruction.opcode;
+    Operation op = Opcodes::operation(opcode);
+    char buffer[32];
+
+    if( op==Operation::Op_Unknown ) {
+        snprintf(buffer, sizeof(buffer), ".byte $%02X", opcode);
+        return buffer;
+    }
+
+    std::string result = Opcodes::name(opcode);
+    // RMB, SMB, BBR and BBS carry their bit number in the opcode
+    bool bit_op = op==Operation::Op_RMB || op==Operation::Op_SMB || op==Operation::Op_BBR || op==Operation::Op_BBS;
+    if( bit_op )
+        result += char( '0' + (opcode>>4 & 7) );
+
+    if( op==Operation::Op_BBR || op==Operation::Op_BBS ) {
+        snprintf(buffer, sizeof(buffer), " $%02X,$%04X", instruction.operand & 0xff, *instruction.target);
+        return result + buffer;
+    }
+
+    unsigned operand = instruction.operand;
+    switch( Opcodes::mode(opcode) ) {
+    case AddressingMode::Abs:       snprintf(buffer, sizeof(buffer), " $%04X", operand); break;
+    case AddressingMode::Abs_x_ind: snprintf(buffer, sizeof(buffer), " ($%04X,X)", operand); break;
+    case AddressingMode::Abs_x:     snprintf(buffer, sizeof(buffer), " $%04X,X", operand); break;
+    case AddressingMode::Abs_y:     snprintf(buffer, sizeof(buffer), " $%04X,Y", operand); break;
+    case AddressingMode::Abs_ind:   snprintf(buffer, sizeof(buffer), " ($%04X)", operand); break;
+    case AddressingMode::Accumulator: snprintf(buffer, sizeof(buffer), " A"); break;
+    case AddressingMode::Immediate: snprintf(buffer, sizeof(buffer), " #$%02X", operand); break;
+    case AddressingMode::Pc_rel:    snprintf(buffer, sizeof(buffer), " $%04X", *instruction.target); break;
+    case AddressingMode::Zp:        snprintf(buffer, sizeof(buffer), " $%02X", operand); break;
+    case AddressingMode::Zp_x_ind:  snprintf(buffer, sizeof(buffer), " ($%02X,X)", operand); break;
+    case AddressingMode::Zp_x:      snprintf(buffer, sizeof(buffer), " $%02X,X", operand); break;
+    case AddressingMode::Zp_y:      snprintf(buffer, sizeof(buffer), " $%02X,Y", operand); break;
+    case AddressingMode::Zp_ind:    snprintf(buffer, sizeof(buffer), " ($%02X)", operand); break;
+    case AddressingMode::Zp_ind_y:  snprintf(buffer, sizeof(buffer), " ($%02X),Y", operand); break;
+    default:                        buffer[0] = '\0'; break;
+    }
+
+    return result + buffer;
+}
+
+CodeMap::CodeMap(const std::array<uint8_t, 65536> &memory, Addr first, Addr last, Variant variant) :
+    memory_(memory), first_(first), last_(last), variant_(variant)
+{}
+
+void CodeMap::addEntry(Addr address) {
+    entries_.push_back(address);
+}
+
+void CodeMap::addVectors() {
+    for( Addr vector : { 0xfffa, 0xfffc, 0xfffe } )
+        addEntry( memory_[vector] | memory_[vector+1]<<8 );
+}
+
+void CodeMap::analyse() {
+    for( Addr entry : entries_ ) {
+        leaders_.set(entry);
+        trace(entry);
+    }
+
+    blocks_.clear();
+    for( uint32_t address = first_; address<=last_; ++address ) {
+        if( leaders_.test(address) && starts_.test(address) )
+            buildBlock(address);
+    }
+}
+
+const CodeMap::Block *CodeMap::blockAt(Addr address) const {
+    auto block = blocks_.upper_bound(address);
+    if( block==blocks_.begin() )
+        return nullptr;
+
+    --block;
+    return address<block->second.end ? &block->second : nullptr;
+}
+
+std::vector<CodeMap::Region> CodeMap::regions() const {
+    std::vector<Region> result;
+
+    for( uint32_t address = first_; address<=last_; ++address ) {
+        bool code = code_.test(address);
+        if( result.empty() || result.back().code!=code )
+            result.push_back( Region{ .start = Addr(address), .end = address, .code = code } );
+        result.back().end = address + 1;
+    }
+
+    return result;
+}
+
+bool CodeMap::valid(uint8_t opcode) const {
+    return variant_==Variant::Nmos ? Opcodes::isNmos(opcode) : Opcodes::isCmos(opcode);
+}
+
+void CodeMap::trace(Addr entry) {
+    std::vector<Addr> pending{ entry };
+
+    auto follow = [&](Addr target) {
+        leaders_.set(target);
+        pending.push_back(target);
+    };
+
+    while( !pending.empty() ) {
+        Addr address = pending.back();
+        pending.pop_back();
+
+        while( true ) {
+            if( !inRange(address) ) {
+                external_.insert(address);
+                break;
+            }
+            if( starts_.test(address) || !valid(memory_[address]) )
+                break;
+
+            Instruction instruction = decode(memory_, address);
+            starts_.set(address);
+            for( unsigned i = 0; i<instruction.length; ++i )
+                code_.set( Addr(address + i) );
+
+            Addr next = address + instruction.length;
+            bool falls_through = true;
+            switch( instruction.flow() ) {
+            case Opcodes::Flow::Next:
+                break;
+            case Opcodes::Flow::Branch:
+                follow(*instruction.target);
+                leaders_.set(next);
+                break;
+            case Opcodes::Flow::Call:
+                calls_.insert(*instruction.target);
+                follow(*instruction.target);
+                leaders_.set(next);
+                break;
+            case Opcodes::Flow::Jump:
+                follow(*instruction.target);
+                falls_through = false;
+                break;
+            default:
+                falls_through = false;
+                break;
+            }
+
+            if( !falls_through )
+                break;
+            address = next;
+        }
+    }
+}
+
+void CodeMap::buildBlock(Addr start) {
+    Block block{ .start = start };
+
+    Addr address = start;
+    while( true ) {
+        Instruction instruction = decode(memory_, address);
+        block.instructions.push_back(address);
+        block.end = address + instruction.length;
+
+        Addr next = address + instruction.length;
+        switch( instruction.flow() ) {
+        case Opcodes::Flow::Next:
+            if( !starts_.test(next) || !inRange(next) )
+                break;
+            if( leaders_.test(next) ) {
+                block.successors.push_back(next);
+                break;
+            }
+            address = next;
+            continue;
+        case Opcodes::Flow::Branch:
+        case Opcodes::Flow::Call:
+            block.successors.push_back(*instruction.target);
+            block.successors.push_back(next);
+            break;
+        case Opcodes::Flow::Jump:
+            block.successors.push_back(*instruction.target);
+            break;
+        case Opcodes::Flow::Stop:
+            break;
+        default:
+            block.dynamic_exit = true;
+            break;
+        }
+
+        break;
+    }
+
+    blocks_.emplace(start, std::move(block));
+}
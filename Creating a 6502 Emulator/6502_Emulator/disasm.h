@@ -0,0 +1,99 @@
+#pragma once
+
+#include "Bus.h"
+#include "opcodes.h"
+
+#include <array>
+#include <bitset>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+struct Instruction {
+    Addr address;
+    uint8_t opcode;
+    unsigned length;
+    uint16_t operand;
+    // Where a branch, jump or call goes
+    std::optional<Addr> target;
+
+    Opcodes::Flow flow() const { return Opcodes::flow(opcode); }
+};
+
+// Decodes the instruction at address. Operands wrap around the end of memory like the CPU's fetches do.
+Instruction decode(const std::array<uint8_t, 65536> &memory, Addr address);
+
+// Assembler syntax, such as "LDA $1234,X" or "BNE $E012"
+std::string format(const Instruction &instruction);
+
+// Recursive descent disassembly of a memory image. Follows control flow from the entry points into a
+// graph of basic blocks, marking which bytes are code, and collecting the targets of JSR.
+//
+// Only the given address range is analysed; flow out of it is recorded as an external target. Computed
+// jumps, returns and BRK end a block without successors, so code only reached through them has to be
+// added as an entry.
+class CodeMap {
+public:
+    enum class Variant { Nmos, Cmos };
+
+    struct Block {
+        Addr start;
+        // One past the last instruction
+        uint32_t end;
+        std::vector<Addr> instructions;
+        std::vector<Addr> successors;
+        // Leaves through an indirect jump, a return or BRK, so its successors are only known at run time
+        bool dynamic_exit = false;
+    };
+
+    struct Region {
+        Addr start;
+        uint32_t end;
+        bool code;
+    };
+
+private:
+    const std::array<uint8_t, 65536> &memory_;
+    Addr first_, last_;
+    Variant variant_;
+
+    std::vector<Addr> entries_;
+    std::bitset<65536> starts_, code_, leaders_;
+    std::map<Addr, Block> blocks_;
+    std::set<Addr> calls_, external_;
+
+public:
+    // The memory has to stay alive for as long as the map is used
+    CodeMap(const std::array<uint8_t, 65536> &memory, Addr first = 0x0000, Addr last = 0xffff,
+            Variant variant = Variant::Nmos);
+
+    void addEntry(Addr address);
+    // The NMI, reset and IRQ vectors at 0xFFFA-0xFFFF
+    void addVectors();
+
+    // Disassembles everything reachable from the entries added so far
+    void analyse();
+
+    bool inRange(Addr address) const { return address>=first_ && address<=last_; }
+    bool isInstruction(Addr address) const { return starts_.test(address); }
+    bool isCode(Addr address) const { return code_.test(address); }
+
+    const std::map<Addr, Block> &blocks() const { return blocks_; }
+    // The block whose instructions include the one at address, if any
+    const Block *blockAt(Addr address) const;
+
+    const std::set<Addr> &callTargets() const { return calls_; }
+    const std::set<Addr> &externalTargets() const { return external_; }
+
+    // The analysed range split into runs of code and data
+    std::vector<Region> regions() const;
+
+private:
+    bool valid(uint8_t opcode) const;
+    void trace(Addr entry);
+    void buildBlock(Addr start);
+};
@@ -0,0 +1,152 @@
+// Disassembles a ROM image by following its control flow from the entry points, and prints either a
+// listing, with the bytes that were never reached as data, or the graph of basic blocks.
+
+#include "disasm.h"
+
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+using Image = std::array<uint8_t, 65536>;
+
+struct Options {
+    std::optional<Addr> load_address;
+    std::vector<Addr> entries;
+    CodeMap::Variant variant = CodeMap::Variant::Nmos;
+    bool graph = false;
+};
+
+static void print_listing(const Image &image, const CodeMap &map) {
+    char buffer[64];
+
+    for( const auto &region : map.regions() ) {
+        uint32_t address = region.start;
+
+        while( address<region.end ) {
+            if( region.code && map.isInstruction(address) ) {
+                Instruction instruction = decode(image, address);
+
+                if( map.callTargets().count(address) )
+                    std::cout<<"\n";
+                if( map.blocks().count(address) ) {
+                    snprintf(buffer, sizeof(buffer), "L%04X:\n", unsigned(address));
+                    std::cout<<buffer;
+                }
+
+                snprintf(buffer, sizeof(buffer), "    %04X  ", unsigned(address));
+                std::cout<<buffer;
+                for( unsigned i = 0; i<3; ++i ) {
+                    if( i<instruction.length )
+                        snprintf(buffer, sizeof(buffer), "%02X ", image[ Addr(address+i) ]);
+                    else
+                        snprintf(buffer, sizeof(buffer), "   ");
+                    std::cout<<buffer;
+                }
+                std::cout<<"  "<<format(instruction)<<"\n";
+
+                address += instruction.length;
+                continue;
+            }
+
+            // Data, or the tail of an instruction that was jumped into the middle of
+            snprintf(buffer, sizeof(buffer), "    %04X  .byte", unsigned(address));
+            std::cout<<buffer;
+            for( unsigned i = 0; i<8 && address<region.end && !( region.code && map.isInstruction(address) ); ++i, ++address ) {
+                snprintf(buffer, sizeof(buffer), " $%02X", image[address]);
+                std::cout<<buffer;
+            }
+            std::cout<<"\n";
+        }
+    }
+}
+
+static void print_graph(const CodeMap &map) {
+    char buffer[32];
+
+    for( const auto &[start, block] : map.blocks() ) {
+        snprintf(buffer, sizeof(buffer), "%04X-%04X %3zu ->", start, unsigned(block.end - 1), block.instructions.size());
+        std::cout<<buffer;
+
+        for( Addr successor : block.successors ) {
+            snprintf(buffer, sizeof(buffer), " %04X%s", successor, map.inRange(successor) ? "" : "(ext)");
+            std::cout<<buffer;
+        }
+        if( block.dynamic_exit )
+            std::cout<<" dynamic";
+        if( map.callTargets().count(start) )
+            std::cout<<"  ; subroutine";
+        std::cout<<"\n";
+    }
+}
+
+static void usage(const char *name) {
+    std::cerr<<"Usage: "<<name<<" [-l load_address] [-e entry]... [-c] [-g] rom.bin\n"
+            "  -l    Where the image goes in memory, in hex (default: so that it ends at FFFF)\n"
+            "  -e    Entry point, in hex; may be repeated. Defaults to the vectors at FFFA-FFFF\n"
+            "  -c    Decode 65C02 opcodes\n"
+            "  -g    Print the basic block graph rather than a listing\n";
+    exit(2);
+}
+
+int main(int argc, char *argv[]) {
+    Options options;
+
+    int opt;
+    while( (opt = getopt(argc, argv, "l:e:cg")) != -1 ) {
+        switch( opt ) {
+        case 'l': options.load_address = strtoul(optarg, nullptr, 16); break;
+        case 'e': options.entries.push_back( strtoul(optarg, nullptr, 16) ); break;
+        case 'c': options.variant = CodeMap::Variant::Cmos; break;
+        case 'g': options.graph = true; break;
+        default: usage(argv[0]);
+        }
+    }
+
+    if( argc-optind != 1 )
+        usage(argv[0]);
+
+    std::ifstream rom(argv[optind], std::ios::binary);
+    std::vector<char> contents( std::istreambuf_iterator<char>(rom), std::istreambuf_iterator<char>{} );
+    if( contents.empty() || contents.size()>65536 ) {
+        std::cerr<<"Failed reading a ROM of 1 to 65536 bytes from "<<argv[optind]<<"\n";
+        return 2;
+    }
+
+    Addr first = options.load_address.value_or( 65536 - contents.size() );
+    if( first + contents.size() > 65536 )
+        usage(argv[0]);
+    Addr last = first + contents.size() - 1;
+
+    Image image{};
+    std::copy( contents.begin(), contents.end(), &image[first] );
+
+    CodeMap map(image, first, last, options.variant);
+    if( options.entries.empty() ) {
+        if( last!=0xffff ) {
+            std::cerr<<"The image doesn't hold the vectors, so entry points have to be given with -e\n";
+            return 2;
+        }
+        map.addVectors();
+    }
+    for( Addr entry : options.entries )
+        map.addEntry(entry);
+    map.analyse();
+
+    if( options.graph )
+        print_graph(map);
+    else
+        print_listing(image, map);
+
+    size_t code_bytes = 0;
+    for( uint32_t address = first; address<=last; ++address )
+        code_bytes += map.isCode(address);
+
+    std::cerr<<map.blocks().size()<<" blocks, "<<map.callTargets().size()<<" subroutines, "<<code_bytes<<" of "<<
+            contents.size()<<" bytes code, "<<map.externalTargets().size()<<" targets outside the image\n";
+
+    return 0;
+}
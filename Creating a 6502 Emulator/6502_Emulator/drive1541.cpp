@@ -0,0 +1,136 @@
+#include "drive1541.h"
+
+#include <algorithm>
+
+Drive1541::Drive1541(Scheduler &scheduler, D64Image &image) :
+    scheduler_(scheduler),
+    image_(image),
+    via_(scheduler),
+    byte_event_( [this]() { byteTime(); } )
+{
+    via_.on_port_a = [this](uint8_t value) { write_byte_ = value; };
+    via_.on_port_b = [this](uint8_t value) { portB(value); };
+    updateInputs();
+}
+
+Drive1541::~Drive1541() {
+    scheduler_.cancel(byte_event_);
+    flush();
+}
+
+void Drive1541::seek(unsigned half_track) {
+    const Track *old = cached();
+    size_t old_length = old ? old->gcr.size() : 0;
+
+    half_track_ = std::clamp(half_track, 2u, 2*image_.tracks() + 1);
+
+    // Keep the same angle on the disk
+    if( Track *current = track() ) {
+        size_t length = current->gcr.size();
+        position_ = old_length ? position_ * length / old_length : position_ % length;
+    }
+
+    updateInputs();
+}
+
+size_t Drive1541::encodedTracks() const {
+    size_t count = 0;
+    for( const auto &track : tracks_ )
+        count += track.has_value();
+
+    return count;
+}
+
+void Drive1541::flush() {
+    for( unsigned index = 0; index<tracks_.size(); ++index ) {
+        auto &track = tracks_[index];
+        if( track && track->dirty && image_.writable() ) {
+            Gcr::decodeTrack(track->gcr, index+1, image_);
+            track->dirty = false;
+        }
+    }
+
+    image_.flush();
+}
+
+Drive1541::Track *Drive1541::track() {
+    if( half_track_ % 2 )
+        return nullptr;
+
+    unsigned number = half_track_ / 2;
+    auto &track = tracks_[number-1];
+    if( !track )
+        track = Track{ .gcr = Gcr::encodeTrack(image_, number) };
+
+    return &*track;
+}
+
+const Drive1541::Track *Drive1541::cached() const {
+    if( half_track_ % 2 || !tracks_[half_track_/2 - 1] )
+        return nullptr;
+
+    return &*tracks_[half_track_/2 - 1];
+}
+
+// The head sees a sync when it is inside a run of ones longer than a byte
+bool Drive1541::sync() const {
+    const Track *current = cached();
+    if( !current )
+        return false;
+
+    const auto &gcr = current->gcr;
+    size_t previous = position_==0 ? gcr.size()-1 : position_-1;
+
+    return gcr[position_]==0xff && gcr[previous]==0xff;
+}
+
+// PB0-1 stepper phase, PB2 motor, PB5-6 density
+void Drive1541::portB(uint8_t value) {
+    uint8_t phase = value & 3;
+    if( phase==((phase_+1) & 3) )
+        seek(half_track_ + 1);
+    else if( phase==((phase_-1) & 3) )
+        seek(half_track_ - 1);
+    phase_ = phase;
+
+    cycles_per_byte_ = Gcr::cyclesPerByte( (value >> 5) & 3 );
+
+    bool motor = value & 0x04;
+    if( motor && !motor_ )
+        scheduler_.schedule(byte_event_, scheduler_.now() + cycles_per_byte_);
+    else if( !motor )
+        scheduler_.cancel(byte_event_);
+    motor_ = motor;
+}
+
+void Drive1541::byteTime() {
+    scheduler_.schedule(byte_event_, scheduler_.now() + cycles_per_byte_);
+
+    Track *current = track();
+    if( current ) {
+        position_ = (position_ + 1) % current->gcr.size();
+
+        // CB2 low selects write mode
+        if( !via_.cb2() ) {
+            current->gcr[position_] = write_byte_;
+            current->dirty = true;
+        }
+    }
+
+    updateInputs();
+    if( sync() )
+        return;
+
+    via_.setCa1(true);
+    via_.setCa1(false);
+    if( via_.ca2() && on_byte_ready )
+        on_byte_ready();
+}
+
+// PA is the byte under the head. PB7 is SYNC and PB4 write protect, both active low.
+void Drive1541::updateInputs() {
+    const Track *current = cached();
+
+    via_.setPortA( current ? current->gcr[position_] : 0 );
+    via_.setPortB( 0x6f | ( sync() ? 0 : 0x80 ) | ( image_.writable() ? 0x10 : 0 ) );
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "Bus.h"
+#include "d64.h"
+#include "scheduler.h"
+#include "via6522.h"
+
+#include <array>
+#include <functional>
+#include <optional>
+#include <vector>
+
+#include <stdint.h>
+
+// The disk mechanism of a 1541 (head, stepper motor and spindle) behind the drive's second VIA, which
+// the drive CPU sees at 0x1C00.
+//
+// Tracks are GCR encoded from the image only when the head first reaches them, and stay cached. Tracks
+// the drive writes to are decoded back into the image by flush(), or when the drive goes away.
+//
+// While the motor runs, an event fires each time a byte passes the head. Outside a sync it latches the
+// byte into port A and signals BYTE READY: on CA1, and on the CPU's SO pin when CA2 (SOE) is high.
+// In write mode (CB2 low) the byte in port A's output register is written instead.
+class Drive1541 {
+public:
+    static constexpr Addr ViaAddress = 0x1c00;
+
+    // Pulses the drive CPU's SO pin. Typically calls c6502::setSo(true) then setSo(false).
+    std::function<void ()> on_byte_ready;
+
+private:
+    struct Track {
+        std::vector<uint8_t> gcr;
+        bool dirty = false;
+    };
+
+    Scheduler &scheduler_;
+    D64Image &image_;
+    Via6522 via_;
+    Scheduler::Event byte_event_;
+
+    std::array<std::optional<Track>, D64Image::MaxTracks> tracks_;
+
+    // Half tracks count from 2 for track 1. Odd ones sit between tracks, and read as unformatted.
+    unsigned half_track_ = 2 * 18;
+    size_t position_ = 0;
+    uint8_t phase_ = 0;
+    bool motor_ = false;
+    unsigned cycles_per_byte_ = 26;
+    uint8_t write_byte_ = 0;
+
+public:
+    Drive1541(Scheduler &scheduler, D64Image &image);
+    ~Drive1541();
+
+    Drive1541(const Drive1541 &that) = delete;
+    Drive1541 &operator=(const Drive1541 &that) = delete;
+
+    Via6522 &via() { return via_; }
+
+    // Moves the head directly, as if the stepper had taken it there
+    void seek(unsigned half_track);
+    unsigned halfTrack() const { return half_track_; }
+
+    // Number of tracks encoded so far
+    size_t encodedTracks() const;
+
+    // Decodes modified tracks back into the image, and syncs the image to its file
+    void flush();
+
+private:
+    // The track under the head, encoding it if this is the first visit. Nothing between tracks.
+    Track *track();
+    const Track *cached() const;
+    bool sync() const;
+    void portB(uint8_t value);
+    void byteTime();
+    void updateInputs();
+};
@@ -0,0 +1,179 @@
+// Runs a drive CPU reading raw GCR off a D64 image through the 1541 disk mechanism. The drive code waits
+// for each sync and captures the first 10 bytes after it, paced by BYTE READY on SO, until it has 16
+// blocks. Those are then decoded here and checked against the image.
+
+#include "Bus.h"
+#include "c6502.h"
+#include "d64.h"
+#include "drive1541.h"
+#include "scheduler.h"
+
+#include <iostream>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+using Image = std::array<uint8_t, 65536>;
+
+static constexpr Addr CodeAddress = 0x0300, DoneAddress = 0x0335, Captures = 0x0400;
+static constexpr size_t NumCaptures = 16, CaptureStride = 16, CaptureLength = 10;
+
+// Turns on the motor at the density patched in at Density, then captures the blocks
+static constexpr uint8_t DriveProgram[] = {
+    0xa9, 0xee,             //        LDA #$EE
+    0x8d, 0x0c, 0x1c,       //        STA PCR         ; SOE on, read mode
+    0xa9, 0x6f,             //        LDA #$6F
+    0x8d, 0x02, 0x1c,       //        STA DDRB
+    0xa9, 0x64,             //        LDA #$64        ; motor on, density
+    0x8d, 0x00, 0x1c,       //        STA ORB
+    0xa9, 0x00,             //        LDA #$00
+    0x8d, 0x03, 0x1c,       //        STA DDRA
+    0xa2, 0x00,             //        LDX #0
+    0x2c, 0x00, 0x1c,       // sync:  BIT ORB
+    0x30, 0xfb,             //        BMI sync
+    0xad, 0x01, 0x1c,       //        LDA ORA
+    0xb8,                   //        CLV
+    0xa0, 0x0a,             //        LDY #10
+    0x50, 0xfe,             // byte:  BVC byte
+    0xb8,                   //        CLV
+    0xad, 0x01, 0x1c,       //        LDA ORA
+    0x9d, 0x00, 0x04,       //        STA Captures,X
+    0xe8,                   //        INX
+    0x88,                   //        DEY
+    0xd0, 0xf3,             //        BNE byte
+    0x8a,                   //        TXA
+    0x18,                   //        CLC
+    0x69, 0x06,             //        ADC #6          ; on to the next 16 byte slot
+    0xaa,                   //        TAX
+    0xd0, 0xe1,             //        BNE sync
+    0x4c, 0x35, 0x03,       // done:  JMP done
+};
+static constexpr size_t Density = 11;
+
+class CaptureDone {};
+class CaptureTimeout {};
+
+class DriveBus : public Bus {
+    Image       &memory;
+    Scheduler   &scheduler;
+    Drive1541   &drive;
+    uint64_t    max_cycles;
+
+public:
+    DriveBus(Image &memory, Scheduler &scheduler, Drive1541 &drive, uint64_t max_cycles) :
+        memory(memory), scheduler(scheduler), drive(drive), max_cycles(max_cycles) {}
+
+    virtual uint8_t read( c6502 *cpu, Addr address, bool sync = false ) override {
+        tick();
+
+        if( sync && address==DoneAddress )
+            throw CaptureDone();
+        if( (address & 0xfff0)==Drive1541::ViaAddress )
+            return drive.via().read(address);
+
+        return memory[address];
+    }
+
+    virtual void write( c6502 *cpu, Addr address, uint8_t value ) override {
+        tick();
+
+        if( (address & 0xfff0)==Drive1541::ViaAddress )
+            drive.via().write(address, value);
+        else
+            memory[address] = value;
+    }
+
+private:
+    void tick() {
+        scheduler.tick();
+        if( scheduler.now()>=max_cycles )
+            throw CaptureTimeout();
+    }
+};
+
+static void usage(const char *name) {
+    std::cerr<<"Usage: "<<name<<" [-t track] image.d64\n"
+            "  -t    Track to read (default 18)\n";
+    exit(2);
+}
+
+int main(int argc, char *argv[]) {
+    unsigned track = 18;
+
+    int opt;
+    while( (opt = getopt(argc, argv, "t:")) != -1 ) {
+        switch( opt ) {
+        case 't': track = strtoul(optarg, nullptr, 0); break;
+        default: usage(argv[0]);
+        }
+    }
+
+    if( argc-optind != 1 )
+        usage(argv[0]);
+
+    D64Image image(argv[optind]);
+    if( track<1 || track>image.tracks() )
+        usage(argv[0]);
+
+    Image memory{};
+    memcpy(&memory[CodeAddress], DriveProgram, sizeof(DriveProgram));
+    memory[CodeAddress + Density] = 0x04 | Gcr::zone(track)<<5;
+
+    Scheduler scheduler;
+    Drive1541 drive(scheduler, image);
+    drive.seek(2*track);
+
+    // Two revolutions are plenty
+    DriveBus bus(memory, scheduler, drive, 4 * Gcr::trackLength(Gcr::zone(track)) * Gcr::cyclesPerByte(Gcr::zone(track)));
+    c6502 cpu(bus);
+    cpu.setSignalLogging(false);
+    drive.on_byte_ready = [&cpu]() {
+        cpu.setSo(true);
+        cpu.setSo(false);
+    };
+
+    cpu.setState( c6502::State{ .regA = 0, .regX = 0, .regY = 0, .regSp = 0xff, .regStatus = 0x34,
+            .pc = CodeAddress } );
+
+    try {
+        cpu.runCpu();
+    } catch( CaptureDone ex ) {
+    } catch( CaptureTimeout ex ) {
+        std::cerr<<"The drive code didn't capture "<<NumCaptures<<" blocks\n";
+        return 1;
+    }
+
+    size_t errors = 0;
+    int sector = -1;
+    for( size_t i = 0; i<NumCaptures; ++i ) {
+        uint8_t block[CaptureLength/5*4];
+        bool valid = Gcr::decode(&memory[Captures + i*CaptureStride], block) &&
+                Gcr::decode(&memory[Captures + i*CaptureStride + 5], block + 4);
+
+        char buffer[128];
+        if( valid && block[0]==0x08 ) {
+            bool checksum_ok = (block[1] ^ block[2] ^ block[3] ^ block[4] ^ block[5])==0;
+            snprintf(buffer, sizeof(buffer), "header: track %u sector %u id %c%c%s\n", block[3], block[2], block[5], block[4],
+                    checksum_ok && block[3]==track ? "" : "  BAD");
+            sector = checksum_ok ? block[2] : -1;
+            errors += !checksum_ok || block[3]!=track;
+        } else if( valid && block[0]==0x07 ) {
+            // The first block may be data whose header went by before the capture started
+            bool data_ok = sector<0 || memcmp(block + 1, image.sector(track, sector), sizeof(block) - 1)==0;
+            snprintf(buffer, sizeof(buffer), "data:   %02x %02x %02x %02x...%s\n", block[1], block[2], block[3], block[4],
+                    data_ok ? "" : "  DOESN'T MATCH IMAGE");
+            errors += !data_ok;
+            sector = -1;
+        } else {
+            snprintf(buffer, sizeof(buffer), "unrecognised block\n");
+            errors++;
+        }
+        std::cout<<buffer;
+    }
+
+    std::cout<<scheduler.now()<<" cycles, "<<drive.encodedTracks()<<" of "<<image.tracks()<<" tracks encoded, "<<errors<<" errors\n";
+
+    return errors==0 ? 0 : 1;
+}
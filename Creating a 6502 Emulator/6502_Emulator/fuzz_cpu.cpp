@@ -0,0 +1,556 @@
+// Differential fuzzer: runs random instruction sequences on c6502 and on the perfect6502 netlist in
+// lockstep, and minimises every case on which the two bus traces diverge.
+
+#include "Bus.h"
+#include "c6502.h"
+#include "netlist_cpu.h"
+#include "opcodes.h"
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+using Image = std::array<uint8_t, 65536>;
+
+static constexpr Addr StubAddress = 0xf000;
+static constexpr Addr CodeAddress = 0x0400;
+static constexpr size_t MaxInstructions = 1024;
+static constexpr size_t MaxResetCycles = 50;
+static constexpr size_t HistoryLength = 8;
+
+struct FuzzOpcode {
+    uint8_t opcode, length;
+};
+
+// Documented NMOS opcodes, all of which c6502 implements
+static std::vector<FuzzOpcode> fuzz_opcodes() {
+    std::vector<FuzzOpcode> result;
+    for( unsigned opcode = 0; opcode<256; ++opcode ) {
+        if( Opcodes::isNmos(opcode) )
+            result.push_back( FuzzOpcode{ uint8_t(opcode), uint8_t( Opcodes::length(opcode) ) } );
+    }
+
+    return result;
+}
+
+static const std::vector<FuzzOpcode> FuzzOpcodes = fuzz_opcodes();
+
+static std::array<bool, 256> supported_opcodes() {
+    std::array<bool, 256> result{};
+    for( auto op : FuzzOpcodes )
+        result[op.opcode] = true;
+
+    return result;
+}
+
+static const std::array<bool, 256> Supported = supported_opcodes();
+
+static bool is_branch(uint8_t opcode) {
+    return (opcode & 0x1f) == 0x10;
+}
+
+struct Options {
+    uint64_t seed = 1;
+    uint64_t num_cases = 0;             // 0 means run until max_failures
+    size_t num_threads = std::thread::hardware_concurrency();
+    size_t num_instructions = 24;
+    size_t max_cycles = 1000;
+    size_t max_failures = 10;
+    bool decimal = false;
+    std::filesystem::path output_dir = ".";
+};
+
+struct FuzzCase {
+    uint64_t index;
+    uint8_t regA, regX, regY, regSp, regStatus;
+    std::vector< std::vector<uint8_t> > instructions;
+    uint64_t memory_seed;               // Background memory contents. 0 means all zeros
+    size_t max_cycles;
+};
+
+struct Divergence {
+    size_t cycle;
+    NetlistCpu::BusCycle expected, actual;
+    std::deque<NetlistCpu::BusCycle> history;
+};
+
+class CaseDone {};
+
+// The harness, not the CPU, went wrong
+class HarnessError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+class Diverged {
+public:
+    Divergence divergence;
+};
+
+static FuzzCase generate(const Options &options, uint64_t index) {
+    std::seed_seq seq{
+        uint32_t(options.seed), uint32_t(options.seed>>32), uint32_t(index), uint32_t(index>>32) };
+    std::mt19937_64 rng(seq);
+    auto byte = [&]() { return uint8_t(rng()); };
+    auto chance = [&](unsigned percent) { return rng()%100 < percent; };
+
+    FuzzCase result;
+    result.index = index;
+    result.regA = byte();
+    result.regX = byte();
+    result.regY = byte();
+    result.regSp = byte();
+    result.regStatus = byte();
+    if( !options.decimal )
+        result.regStatus &= 0xf7;
+    result.memory_seed = rng() | 1;
+    result.max_cycles = options.max_cycles;
+
+    std::vector<Addr> starts;
+    Addr address = CodeAddress;
+    for( size_t i=0; i<options.num_instructions; ++i ) {
+        // SED would otherwise drown every other divergence in missing decimal mode support
+        auto op = FuzzOpcodes[ rng() % std::size(FuzzOpcodes) ];
+        while( op.opcode==0xf8 && !options.decimal )
+            op = FuzzOpcodes[ rng() % std::size(FuzzOpcodes) ];
+
+        std::vector<uint8_t> instruction{ op.opcode };
+        for( size_t j=1; j<op.length; ++j )
+            instruction.push_back( byte() );
+
+        if( is_branch(op.opcode) && chance(75) ) {
+            // Mostly short forward branches that stay inside the generated code
+            instruction[1] = rng() % 16;
+        } else if( op.length==3 && chance(50) ) {
+            // Favour the pages where the code, stack and zero page live
+            static constexpr uint8_t Pages[] = { 0x00, 0x01, 0x03, CodeAddress>>8 };
+            instruction[2] = Pages[ rng() % std::size(Pages) ];
+        }
+
+        starts.push_back(address);
+        address += op.length;
+        result.instructions.push_back( std::move(instruction) );
+    }
+
+    // Point most absolute jumps and calls at the start of a generated instruction
+    for( auto &instruction : result.instructions ) {
+        if( (instruction[0]==0x4c || instruction[0]==0x20) && chance(75) ) {
+            Addr target = starts[ rng() % starts.size() ];
+            instruction[1] = target & 0xff;
+            instruction[2] = target >> 8;
+        }
+    }
+
+    return result;
+}
+
+static Image layout(const FuzzCase &fuzz_case) {
+    Image image{};
+
+    if( fuzz_case.memory_seed!=0 ) {
+        std::mt19937_64 rng(fuzz_case.memory_seed);
+        for( auto &byte : image )
+            byte = rng();
+    }
+
+    // Loader stub, same idea as perfect6502's compare.c
+    Addr addr = StubAddress;
+    for( uint8_t byte : {
+            uint8_t(0xa2), fuzz_case.regSp,                     // LDX #S
+            uint8_t(0x9a),                                      // TXS
+            uint8_t(0xa9), fuzz_case.regStatus,                 // LDA #P
+            uint8_t(0x48),                                      // PHA
+            uint8_t(0xa9), fuzz_case.regA,                      // LDA #A
+            uint8_t(0xa2), fuzz_case.regX,                      // LDX #X
+            uint8_t(0xa0), fuzz_case.regY,                      // LDY #Y
+            uint8_t(0x28),                                      // PLP
+            uint8_t(0x4c), uint8_t(CodeAddress & 0xff), uint8_t(CodeAddress >> 8) } )  // JMP code
+    {
+        image[addr++] = byte;
+    }
+
+    image[0xfffc] = StubAddress & 0xff;
+    image[0xfffd] = StubAddress >> 8;
+
+    addr = CodeAddress;
+    for( const auto &instruction : fuzz_case.instructions ) {
+        for( uint8_t byte : instruction )
+            image[addr++] = byte;
+    }
+
+    // STA $0200: the test harness' "finished" trigger
+    image[addr++] = 0x8d;
+    image[addr++] = 0x00;
+    image[addr++] = 0x02;
+
+    return image;
+}
+
+class LockstepBus : public Bus {
+    Image                               memory;
+    NetlistCpu                          &reference;
+    std::optional<NetlistCpu::BusCycle> primed;
+    size_t                              max_cycles;
+    size_t                              reset_reads = 0;
+    bool                                started = false;
+    size_t                              cycle_num = 0;
+    bool                                decimal;
+    bool                                stub_fetched = false;
+    std::deque<NetlistCpu::BusCycle>    history;
+
+public:
+    LockstepBus(const Image &image, NetlistCpu &reference, NetlistCpu::BusCycle vector_read, size_t max_cycles, bool decimal) :
+        memory(image),
+        reference(reference),
+        primed(vector_read),
+        max_cycles(max_cycles),
+        decimal(decimal)
+    {}
+
+    virtual uint8_t read( c6502 *cpu, Addr address, bool sync = false ) override {
+        uint8_t ret = memory[address];
+
+        if( !started ) {
+            ++reset_reads;
+            if( reset_reads==3 )
+                cpu->setReset(false);
+
+            if( reset_reads>3 && address==0xfffc ) {
+                started = true;
+            } else {
+                if( reset_reads>MaxResetCycles )
+                    throw HarnessError("c6502 failed to read the reset vector");
+
+                return ret;
+            }
+        }
+
+        compare( cpu, NetlistCpu::BusCycle{ .address = address, .data = ret, .read = true, .sync = sync } );
+
+        // Anything c6502 can't decode ends the case rather than aborting the fuzzer
+        if( sync && !Supported[ret] )
+            throw CaseDone();
+
+        // Without -d, so does decimal arithmetic. Keeping D out of the initial P isn't enough, as PLP and
+        // RTI pull it from a stack page of random bytes.
+        if( sync && !decimal && isDecimalArithmetic(ret) && (cpu->getState().regStatus & 0x08) )
+            throw CaseDone();
+
+        return ret;
+    }
+
+    virtual void write( c6502 *cpu, Addr address, uint8_t value ) override {
+        compare( cpu, NetlistCpu::BusCycle{ .address = address, .data = value, .read = false, .sync = false } );
+
+        memory[address] = value;
+
+        // Page 2 holds the test harness' I/O triggers. We don't emulate them, so stop here.
+        if( (address>>8) == 0x02 )
+            throw CaseDone();
+    }
+
+private:
+    static bool isDecimalArithmetic(uint8_t opcode) {
+        Operation op = Opcodes::operation(opcode);
+        return op==Operation::Op_ADC || op==Operation::Op_SBC;
+    }
+
+    void compare( const c6502 *cpu, NetlistCpu::BusCycle actual ) {
+        NetlistCpu::BusCycle expected;
+        if( primed ) {
+            expected = *primed;
+            primed.reset();
+        } else {
+            expected = reference.cycle();
+        }
+
+        if( expected.sync && !stub_fetched ) {
+            if( expected.address!=StubAddress ) {
+                char buffer[64];
+                snprintf(buffer, sizeof(buffer), "Netlist fetched its first opcode from %04x, not the loader at %04x",
+                        expected.address, StubAddress);
+                throw HarnessError(buffer);
+            }
+            stub_fetched = true;
+        }
+
+        cycle_num++;
+
+        if( expected!=actual && !cpu->isIncompatible() )
+            throw Diverged{ Divergence{ cycle_num, expected, actual, history } };
+
+        history.push_back(expected);
+        if( history.size()>HistoryLength )
+            history.pop_front();
+
+        if( cycle_num>=max_cycles )
+            throw CaseDone();
+    }
+};
+
+// A netlist for one thread, and its state as built. Resetting a netlist that has run a case doesn't
+// return all of it to a known state, so every case starts from the snapshot instead.
+struct Reference {
+    NetlistCpu cpu;
+    NetlistCpu::Snapshot pristine;
+
+    Reference() {
+        cpu.save(pristine, false);
+    }
+};
+
+static std::optional<Divergence> run_case(const Options &options, const FuzzCase &fuzz_case, Reference &reference) {
+    Image image = layout(fuzz_case);
+
+    reference.cpu.restore(reference.pristine, false);
+    reference.cpu.memory = image;
+    auto vector_read = reference.cpu.reset();
+    if( !vector_read )
+        throw HarnessError("Netlist failed to read the reset vector");
+
+    LockstepBus bus(image, reference.cpu, *vector_read, fuzz_case.max_cycles, options.decimal);
+    c6502 cpu(bus);
+    cpu.setSignalLogging(false);
+    cpu.setReset(true);
+
+    try {
+        cpu.runCpu();
+    } catch( CaseDone ex ) {
+    } catch( Diverged &ex ) {
+        return ex.divergence;
+    }
+
+    return std::nullopt;
+}
+
+// Greedily simplifies the case for as long as it keeps diverging
+static FuzzCase minimise(const Options &options, FuzzCase fuzz_case, Reference &reference, Divergence &divergence) {
+    bool progress = true;
+
+    auto attempt = [&](const FuzzCase &candidate) {
+        auto result = run_case(options, candidate, reference);
+        if( !result )
+            return;
+
+        fuzz_case = candidate;
+        divergence = *result;
+        progress = true;
+    };
+
+    while( progress ) {
+        progress = false;
+
+        if( fuzz_case.memory_seed!=0 ) {
+            FuzzCase candidate = fuzz_case;
+            candidate.memory_seed = 0;
+            attempt(candidate);
+        }
+
+        for( size_t i=fuzz_case.instructions.size(); i-->0; ) {
+            FuzzCase candidate = fuzz_case;
+            candidate.instructions.erase( candidate.instructions.begin() + i );
+            attempt(candidate);
+        }
+
+        for( size_t i=0; i<fuzz_case.instructions.size(); ++i ) {
+            for( size_t j=1; j<fuzz_case.instructions[i].size(); ++j ) {
+                if( fuzz_case.instructions[i][j]==0 )
+                    continue;
+
+                FuzzCase candidate = fuzz_case;
+                candidate.instructions[i][j] = 0;
+                attempt(candidate);
+            }
+        }
+
+        for( auto reg : { &FuzzCase::regA, &FuzzCase::regX, &FuzzCase::regY, &FuzzCase::regStatus } ) {
+            if( fuzz_case.*reg!=0 ) {
+                FuzzCase candidate = fuzz_case;
+                candidate.*reg = 0;
+                attempt(candidate);
+            }
+        }
+
+        if( fuzz_case.regSp!=0xff ) {
+            FuzzCase candidate = fuzz_case;
+            candidate.regSp = 0xff;
+            attempt(candidate);
+        }
+    }
+
+    return fuzz_case;
+}
+
+static std::ostream &operator<<(std::ostream &out, const NetlistCpu::BusCycle &bus) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%c %04x %02x%s", bus.read ? 'R' : 'W', bus.address, bus.data, bus.sync ? " sync" : "");
+
+    return out<<buffer;
+}
+
+static std::string hex_bytes(const std::vector<uint8_t> &bytes) {
+    std::string result;
+    char buffer[4];
+    for( uint8_t byte : bytes ) {
+        snprintf(buffer, sizeof(buffer), "%02x ", byte);
+        result += buffer;
+    }
+
+    return result;
+}
+
+static std::string registers(const FuzzCase &fuzz_case) {
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "A=%02x X=%02x Y=%02x S=%02x P=%02x",
+            fuzz_case.regA, fuzz_case.regX, fuzz_case.regY, fuzz_case.regSp, fuzz_case.regStatus);
+
+    return buffer;
+}
+
+// Writes the case as a memory image that verify_cpu and simulate_mos can load
+static std::filesystem::path write_case(const Options &options, const FuzzCase &fuzz_case) {
+    auto path = options.output_dir / ( "fuzz_" + std::to_string(options.seed) + "_" + std::to_string(fuzz_case.index) + ".mem" );
+    std::ofstream out(path);
+    Image image = layout(fuzz_case);
+
+    char buffer[16];
+    for( size_t row=0; row<image.size(); row+=16 ) {
+        bool empty = true;
+        for( size_t i=0; i<16; ++i )
+            empty = empty && image[row+i]==0;
+        if( empty )
+            continue;
+
+        snprintf(buffer, sizeof(buffer), "@%04zx", row);
+        out<<buffer;
+        for( size_t i=0; i<16; ++i ) {
+            snprintf(buffer, sizeof(buffer), " %02x", image[row+i]);
+            out<<buffer;
+        }
+
+        if( row==StubAddress )
+            out<<"\t// loader: "<<registers(fuzz_case);
+        out<<"\n";
+    }
+
+    return path;
+}
+
+static void report(const Options &options, const FuzzCase &fuzz_case, const Divergence &divergence) {
+    auto path = write_case(options, fuzz_case);
+
+    std::cout<<"Divergence in case "<<fuzz_case.index<<" ("<<path.string()<<")\n";
+    std::cout<<"  Initial state: "<<registers(fuzz_case)<<( fuzz_case.memory_seed ? ", random memory" : ", zeroed memory" )<<"\n";
+
+    Addr address = CodeAddress;
+    for( const auto &instruction : fuzz_case.instructions ) {
+        char buffer[16];
+        snprintf(buffer, sizeof(buffer), "  %04x: ", address);
+        std::cout<<buffer<<hex_bytes(instruction)<<"\n";
+        address += instruction.size();
+    }
+
+    std::cout<<"  Last matching cycles:\n";
+    for( const auto &bus : divergence.history )
+        std::cout<<"    "<<bus<<"\n";
+    std::cout<<"  Cycle "<<divergence.cycle<<": netlist "<<divergence.expected<<", c6502 "<<divergence.actual<<"\n";
+}
+
+static void usage(const char *name) {
+    std::cerr<<"Usage: "<<name<<" [-s seed] [-n cases] [-j threads] [-l instructions] [-c max_cycles]"
+            " [-f max_failures] [-o output_dir] [-d]\n"
+            "  -d    Allow decimal mode\n";
+    exit(2);
+}
+
+int main(int argc, char *argv[]) {
+    Options options;
+
+    int opt;
+    while( (opt = getopt(argc, argv, "s:n:j:l:c:f:o:d")) != -1 ) {
+        switch( opt ) {
+        case 's': options.seed = strtoull(optarg, nullptr, 0); break;
+        case 'n': options.num_cases = strtoull(optarg, nullptr, 0); break;
+        case 'j': options.num_threads = strtoul(optarg, nullptr, 0); break;
+        case 'l': options.num_instructions = strtoul(optarg, nullptr, 0); break;
+        case 'c': options.max_cycles = strtoul(optarg, nullptr, 0); break;
+        case 'f': options.max_failures = strtoul(optarg, nullptr, 0); break;
+        case 'o': options.output_dir = optarg; break;
+        case 'd': options.decimal = true; break;
+        default: usage(argv[0]);
+        }
+    }
+
+    if( options.num_threads==0 )
+        options.num_threads = 1;
+    if( options.num_instructions==0 || options.num_instructions>MaxInstructions ) {
+        std::cerr<<"Number of instructions must be between 1 and "<<MaxInstructions<<"\n";
+        return 2;
+    }
+
+    std::atomic<uint64_t> next_case = 0, cases_run = 0;
+    std::atomic<size_t> failures = 0;
+    std::atomic<bool> harness_failed = false;
+    std::mutex report_mutex;
+
+    auto worker = [&]() {
+        Reference reference;
+
+        while( failures<options.max_failures && !harness_failed ) {
+            uint64_t index = next_case++;
+            if( options.num_cases!=0 && index>=options.num_cases )
+                break;
+
+            FuzzCase fuzz_case = generate(options, index);
+            try {
+                auto divergence = run_case(options, fuzz_case, reference);
+                cases_run++;
+
+                if( !divergence )
+                    continue;
+
+                if( failures++>=options.max_failures )
+                    break;
+
+                fuzz_case = minimise(options, fuzz_case, reference, *divergence);
+
+                std::lock_guard guard(report_mutex);
+                report(options, fuzz_case, *divergence);
+            } catch( HarnessError &ex ) {
+                harness_failed = true;
+
+                std::lock_guard guard(report_mutex);
+                std::cerr<<"Harness error in case "<<index<<": "<<ex.what()<<"\n";
+            }
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> threads;
+    for( size_t i=0; i<options.num_threads; ++i )
+        threads.emplace_back(worker);
+    for( auto &thread : threads )
+        thread.join();
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout<<"Ran "<<cases_run<<" cases on "<<options.num_threads<<" threads in "<<elapsed.count()<<"s ("<<
+            cases_run/elapsed.count()<<" cases/s), "<<std::min(size_t(failures), options.max_failures)<<" divergences\n";
+
+    if( harness_failed )
+        return 2;
+    return failures!=0 ? 1 : 0;
+}
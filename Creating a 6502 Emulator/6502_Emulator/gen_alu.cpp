@@ -0,0 +1,212 @@
+// Generates the golden ALU table by running every input combination through the perfect6502 netlist.
+//
+// Each input runs the loop below, with the inputs patched into memory between iterations and the
+// results picked off the bus as PHP and STA write them. At about 17 cycles per input, a full table is a
+// few hours of netlist time on a single core.
+
+#include "alu_table.h"
+#include "netlist_cpu.h"
+
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static constexpr Addr SetupAddress = 0x0300, LoopAddress = 0x0400, ResultAddress = 0x0011, StackSlot = 0x01ff;
+static constexpr size_t MaxCyclesPerInput = 100;
+
+struct Options {
+    size_t num_threads = std::thread::hardware_concurrency();
+    unsigned num_a = 256;
+    std::vector<const AluTable::Op *> ops;
+};
+
+// Sets up the stack, then loops over: PLP, LDA #a, the op, PHP, STA result, JMP loop
+static void install_program(NetlistCpu &cpu, const AluTable::Op &op) {
+    auto &memory = cpu.memory;
+
+    const uint8_t setup[] = { 0xa2, 0xfe, 0x9a, 0x4c, LoopAddress & 0xff, LoopAddress >> 8 };
+    memcpy(&memory[SetupAddress], setup, sizeof(setup));
+    memory[0xfffc] = SetupAddress & 0xff;
+    memory[0xfffd] = SetupAddress >> 8;
+
+    Addr pc = LoopAddress;
+    memory[pc++] = 0x28;
+    memory[pc++] = 0xa9;
+    memory[pc++] = 0x00;
+    memory[pc++] = op.opcode;
+    if( op.opcode==0x24 )
+        memory[pc++] = AluTable::BitOperand;
+    else if( op.has_operand )
+        memory[pc++] = 0x00;
+    memory[pc++] = 0x08;
+    memory[pc++] = 0x85;
+    memory[pc++] = ResultAddress;
+    memory[pc++] = 0x4c;
+    memory[pc++] = LoopAddress & 0xff;
+    memory[pc++] = LoopAddress >> 8;
+}
+
+static void set_inputs(NetlistCpu &cpu, const AluTable::Op &op, uint8_t a, uint8_t m, unsigned flags) {
+    cpu.memory[StackSlot] = AluTable::status(flags);
+    cpu.memory[LoopAddress + 2] = a;
+
+    if( op.opcode==0x24 )
+        cpu.memory[AluTable::BitOperand] = m;
+    else if( op.has_operand )
+        cpu.memory[LoopAddress + 4] = m;
+}
+
+// Runs all inputs for one value of A
+static void run_a(NetlistCpu &cpu, const AluTable::Op &op, uint8_t a, AluTable::Result *results) {
+    size_t count = AluTable::resultsPerA(op);
+
+    for( size_t i = 0; i<count; ++i ) {
+        uint8_t m = op.has_operand ? i / AluTable::NumFlagCombinations : 0;
+        unsigned flags = i % AluTable::NumFlagCombinations;
+
+        set_inputs(cpu, op, a, m, flags);
+
+        // The CPU is just past the previous input's STA (or the reset), so nothing read the inputs yet
+        std::optional<uint8_t> status;
+        size_t cycles = 0;
+        while( true ) {
+            if( ++cycles>MaxCyclesPerInput )
+                throw std::runtime_error("Netlist stopped producing results");
+
+            auto bus = cpu.cycle();
+            if( bus.read )
+                continue;
+
+            if( bus.address==StackSlot ) {
+                status = bus.data;
+            } else if( bus.address==ResultAddress ) {
+                if( !status )
+                    throw std::runtime_error("Result written before the status");
+
+                results[ AluTable::index(op, a, m, flags) ] = AluTable::Result{ .regA = bus.data, .regStatus = *status };
+                break;
+            }
+        }
+    }
+}
+
+static std::vector<AluTable::Result> generate(const Options &options, const AluTable::Op &op) {
+    std::vector<AluTable::Result> results( options.num_a * AluTable::resultsPerA(op) );
+    std::atomic<unsigned> next_a = 0;
+    std::atomic<unsigned> done = 0;
+    std::mutex report_mutex;
+
+    auto worker = [&]() {
+        NetlistCpu cpu;
+        install_program(cpu, op);
+
+        if( !cpu.reset() )
+            throw std::runtime_error("Netlist failed to read the reset vector");
+
+        for( unsigned a = next_a++; a<options.num_a; a = next_a++ ) {
+            run_a(cpu, op, a, results.data());
+
+            std::lock_guard guard(report_mutex);
+            std::cerr<<"\r"<<op.name<<": "<<++done<<"/"<<options.num_a<<std::flush;
+        }
+    };
+
+    // A throwing worker would terminate the program, which is what we want here
+    std::vector<std::thread> threads;
+    for( size_t i=0; i<options.num_threads; ++i )
+        threads.emplace_back(worker);
+    for( auto &thread : threads )
+        thread.join();
+
+    std::cerr<<"\n";
+
+    return results;
+}
+
+static void usage(const char *name) {
+    std::cerr<<"Usage: "<<name<<" [-j threads] [-a num_a] [-p op[,op...]] table.bin\n"
+            "  -a    Only generate results for A below num_a, for quick partial tables\n"
+            "  -p    Ops to generate (default all of:";
+    for( const auto &op : AluTable::Ops )
+        std::cerr<<" "<<op.name;
+    std::cerr<<")\n";
+    exit(2);
+}
+
+int main(int argc, char *argv[]) {
+    Options options;
+
+    int opt;
+    while( (opt = getopt(argc, argv, "j:a:p:")) != -1 ) {
+        switch( opt ) {
+        case 'j': options.num_threads = strtoul(optarg, nullptr, 0); break;
+        case 'a': options.num_a = strtoul(optarg, nullptr, 0); break;
+        case 'p':
+            for( char *name = strtok(optarg, ","); name!=nullptr; name = strtok(nullptr, ",") ) {
+                const AluTable::Op *found = nullptr;
+                for( const auto &op : AluTable::Ops ) {
+                    if( strcmp(op.name, name)==0 )
+                        found = &op;
+                }
+
+                if( found==nullptr )
+                    usage(argv[0]);
+                options.ops.push_back(found);
+            }
+            break;
+        default: usage(argv[0]);
+        }
+    }
+
+    if( argc-optind != 1 || options.num_a==0 || options.num_a>256 )
+        usage(argv[0]);
+
+    if( options.num_threads==0 )
+        options.num_threads = 1;
+
+    if( options.ops.empty() ) {
+        for( const auto &op : AluTable::Ops )
+            options.ops.push_back(&op);
+    }
+
+    std::ofstream out(argv[optind], std::ios::binary);
+
+    AluTable::Header header{};
+    memcpy(header.magic, AluTable::Magic, sizeof(header.magic));
+    header.version = AluTable::Version;
+    header.netlist_checksum = NetlistCpu::netlistChecksum();
+    memcpy(header.variant, AluTable::Variant, sizeof(header.variant));
+    header.num_sections = options.ops.size();
+    out.write( reinterpret_cast<const char *>(&header), sizeof(header) );
+
+    for( const auto *op : options.ops ) {
+        auto results = generate(options, *op);
+
+        AluTable::Section section{};
+        strncpy(section.name, op->name, sizeof(section.name));
+        section.opcode = op->opcode;
+        section.has_operand = op->has_operand;
+        section.num_a = options.num_a;
+        section.num_results = results.size();
+
+        out.write( reinterpret_cast<const char *>(&section), sizeof(section) );
+        out.write( reinterpret_cast<const char *>(results.data()), results.size()*sizeof(AluTable::Result) );
+    }
+
+    if( !out ) {
+        std::cerr<<"Failed writing "<<argv[optind]<<"\n";
+        return 1;
+    }
+
+    return 0;
+}
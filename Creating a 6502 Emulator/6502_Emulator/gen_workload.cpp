@@ -0,0 +1,572 @@
+// Synthetic workloads for benchmarking the core: generates a loop whose body has a chosen instruction
+// mix, and writes it as a memory image in verify_cpu's format. The program starts from reset, runs the
+// body a set number of times, and ends by writing to 0x0200, so digest_cpu can time it on any backend.
+//
+// The body is straight line code. Branches are preceded by the flag setting instruction that makes
+// them taken or not, and taken branches only skip bytes that never run, so every iteration runs the same
+// instructions and the mix reported is the one run. X and Y are kept constant, which lets indexed
+// accesses cross pages exactly as often as asked.
+
+#include "Bus.h"
+#include "opcodes.h"
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+using Image = std::array<uint8_t, 65536>;
+
+static constexpr Addr ZpPointers = 0xc0;
+static constexpr unsigned NumPointers = 16;
+static constexpr Addr ZpCounter = 0xf0;
+static constexpr Addr AbsData = 0x1000;
+static constexpr Addr CodeStart = 0x8000;
+static constexpr Addr CodeEnd = 0xfff0;
+static constexpr Addr DoneAddress = 0x0200;
+static constexpr uint8_t XIndex = 0x40;
+static constexpr uint8_t YIndex = 0x80;
+static constexpr size_t MaxPushes = 8;
+static constexpr unsigned MaxIterations = 65535;
+
+enum class Mode { Implied, Immediate, Zp, ZpX, Abs, AbsX, AbsY, ZpXInd, ZpIndY, Count };
+static constexpr size_t NumModes = size_t(Mode::Count);
+
+static const char * const ModeNames[NumModes] = { "imp", "imm", "zp", "zpx", "abs", "absx", "absy", "indx", "indy" };
+static constexpr AddressingMode AddressingModes[NumModes] = {
+    AddressingMode::Implied, AddressingMode::Immediate, AddressingMode::Zp, AddressingMode::Zp_x, AddressingMode::Abs,
+    AddressingMode::Abs_x, AddressingMode::Abs_y, AddressingMode::Zp_x_ind, AddressingMode::Zp_ind_y,
+};
+
+struct Options {
+    uint64_t seed = 1;
+    unsigned instructions = 1000;
+    unsigned iterations = 1000;
+    // Weights of the addressing modes, for instructions that are neither branches nor stack operations
+    std::array<unsigned, NumModes> mix = { 15, 25, 25, 5, 15, 7, 3, 1, 4 };
+    unsigned branch_percent = 15;
+    unsigned taken_percent = 50;
+    // Of indexed accesses that can cross a page, and of taken branches
+    unsigned cross_percent = 10;
+    // Of instructions with a memory operand
+    unsigned rmw_percent = 10;
+    unsigned stack_percent = 5;
+    unsigned zp_bytes = 64;
+    unsigned abs_bytes = 4096;
+    const char *output = "workload.mem";
+};
+
+struct Stats {
+    std::array<size_t, NumModes> modes{};
+    size_t instructions = 0, branches = 0, taken = 0, stack = 0;
+    size_t memory_operands = 0, rmw = 0;
+    size_t could_cross = 0, crossed = 0;
+};
+
+static uint8_t opcode_for(Operation op, AddressingMode mode) {
+    for( unsigned opcode = 0; opcode<256; ++opcode ) {
+        if( Opcodes::isNmos(opcode) && Opcodes::operation(opcode)==op && Opcodes::mode(opcode)==mode )
+            return opcode;
+    }
+
+    throw std::logic_error("No opcode for an instruction the generator asked for");
+}
+
+static bool has_opcode(Operation op, AddressingMode mode) {
+    for( unsigned opcode = 0; opcode<256; ++opcode ) {
+        if( Opcodes::isNmos(opcode) && Opcodes::operation(opcode)==op && Opcodes::mode(opcode)==mode )
+            return true;
+    }
+
+    return false;
+}
+
+class Generator {
+    const Options &options_;
+    std::mt19937_64 rng_;
+    Image image_{};
+    Addr pc_ = CodeStart;
+    Stats stats_;
+    std::vector<Operation> pushes_;
+    Addr subroutine_ = 0;
+    unsigned owed_crossings_ = 0;
+    // Chance that an instruction in a mode that can be RMW is, which makes RMW the asked share of all
+    // memory operands
+    unsigned rmw_chance_ = 0;
+
+public:
+    explicit Generator(const Options &options) : options_(options), rng_(options.seed) {
+        unsigned memory_weight = 0, rmw_weight = 0;
+        for( size_t mode = 0; mode<NumModes; ++mode ) {
+            if( mode==size_t(Mode::Implied) || mode==size_t(Mode::Immediate) )
+                continue;
+            memory_weight += options.mix[mode];
+            if( canRmw( Mode(mode) ) )
+                rmw_weight += options.mix[mode];
+        }
+        if( rmw_weight!=0 )
+            rmw_chance_ = std::min( 100u, options.rmw_percent*memory_weight/rmw_weight );
+    }
+
+    const Image &image() const { return image_; }
+    const Stats &stats() const { return stats_; }
+    size_t codeSize() const { return pc_-CodeStart; }
+
+    void generate();
+
+private:
+    unsigned below(unsigned limit) { return rng_() % limit; }
+    bool chance(unsigned percent) { return below(100)<percent; }
+
+    void emit(uint8_t byte);
+    void emit(Operation op, AddressingMode mode);
+    void emit(Operation op, AddressingMode mode, uint8_t operand);
+    void emitAbs(Operation op, AddressingMode mode, Addr operand);
+    // Counts the instruction as one of the body's
+    void count(Mode mode) { stats_.modes[size_t(mode)]++; stats_.instructions++; }
+
+    void fillData();
+    void branch();
+    void stackOperation();
+    void pull();
+    void modeOperation();
+
+    static bool canRmw(Mode mode) {
+        return mode==Mode::Zp || mode==Mode::ZpX || mode==Mode::Abs || mode==Mode::AbsX;
+    }
+    Operation pick(std::initializer_list<Operation> ops, AddressingMode mode);
+    Addr absTarget(uint8_t index, bool cross);
+};
+
+void Generator::emit(uint8_t byte) {
+    if( pc_>=CodeEnd )
+        throw std::runtime_error("The program doesn't fit in memory, use fewer instructions");
+    image_[pc_++] = byte;
+}
+
+void Generator::emit(Operation op, AddressingMode mode) {
+    emit( opcode_for(op, mode) );
+}
+
+void Generator::emit(Operation op, AddressingMode mode, uint8_t operand) {
+    emit( opcode_for(op, mode) );
+    emit( operand );
+}
+
+void Generator::emitAbs(Operation op, AddressingMode mode, Addr operand) {
+    emit( opcode_for(op, mode) );
+    emit( operand & 0xff );
+    emit( operand >> 8 );
+}
+
+void Generator::generate() {
+    fillData();
+
+    subroutine_ = pc_;
+    emit(Operation::Op_RTS, AddressingMode::Stack);
+
+    Addr init = pc_;
+    unsigned iterations = options_.iterations;
+    emit(Operation::Op_LDX, AddressingMode::Immediate, 0xff);
+    emit(Operation::Op_TXS, AddressingMode::Implied);
+    // Reset leaves C and V to chance, and PHP would push them, so start from a known P: I set, D clear
+    emit(Operation::Op_LDA, AddressingMode::Immediate, 0x24);
+    emit(Operation::Op_PHA, AddressingMode::Stack);
+    emit(Operation::Op_PLP, AddressingMode::Stack);
+    emit(Operation::Op_LDA, AddressingMode::Immediate, iterations & 0xff);
+    emit(Operation::Op_STA, AddressingMode::Zp, ZpCounter);
+    emit(Operation::Op_LDA, AddressingMode::Immediate, (iterations+255) >> 8);
+    emit(Operation::Op_STA, AddressingMode::Zp, ZpCounter+1);
+    emit(Operation::Op_LDX, AddressingMode::Immediate, XIndex);
+    emit(Operation::Op_LDY, AddressingMode::Immediate, YIndex);
+
+    Addr loop = pc_;
+    while( stats_.instructions<options_.instructions ) {
+        unsigned kind = below(100);
+        if( kind<options_.branch_percent )
+            branch();
+        else if( kind<options_.branch_percent+options_.stack_percent )
+            stackOperation();
+        else
+            modeOperation();
+    }
+    while( !pushes_.empty() )
+        pull();
+
+    // Count down a 16 bit counter, which takes the high byte as one more than the iterations left over
+    // the low byte
+    emit(Operation::Op_DEC, AddressingMode::Zp, ZpCounter);
+    emit(Operation::Op_BEQ, AddressingMode::Pc_rel, 3);
+    emitAbs(Operation::Op_JMP, AddressingMode::Abs, loop);
+    emit(Operation::Op_DEC, AddressingMode::Zp, ZpCounter+1);
+    emit(Operation::Op_BEQ, AddressingMode::Pc_rel, 3);
+    emitAbs(Operation::Op_JMP, AddressingMode::Abs, loop);
+
+    Addr done = pc_;
+    emitAbs(Operation::Op_STA, AddressingMode::Abs, DoneAddress);
+    emitAbs(Operation::Op_JMP, AddressingMode::Abs, done);
+
+    image_[0xfffa] = done & 0xff;
+    image_[0xfffb] = done >> 8;
+    image_[0xfffc] = init & 0xff;
+    image_[0xfffd] = init >> 8;
+    image_[0xfffe] = done & 0xff;
+    image_[0xffff] = done >> 8;
+}
+
+void Generator::fillData() {
+    for( unsigned i = 0; i<options_.zp_bytes; ++i )
+        image_[i] = rng_();
+    for( unsigned i = 0; i<options_.abs_bytes; ++i )
+        image_[AbsData+i] = rng_();
+
+    // Even pointers cross a page when indexed by Y, odd ones don't. (zp,x) uses them unindexed.
+    for( unsigned i = 0; i<NumPointers; ++i ) {
+        Addr pointer = absTarget(YIndex, i%2==0) - YIndex;
+        image_[ZpPointers + 2*i] = pointer & 0xff;
+        image_[ZpPointers + 2*i + 1] = pointer >> 8;
+    }
+}
+
+void Generator::branch() {
+    bool taken = chance(options_.taken_percent);
+
+    Operation op;
+    if( below(4)!=0 ) {
+        bool carry = chance(50);
+        emit( carry ? Operation::Op_SEC : Operation::Op_CLC, AddressingMode::Implied );
+        op = carry==taken ? Operation::Op_BCS : Operation::Op_BCC;
+    } else {
+        emit( Operation::Op_CLV, AddressingMode::Implied );
+        op = taken ? Operation::Op_BVC : Operation::Op_BVS;
+    }
+    count(Mode::Implied);
+
+    // Branches not taken go nowhere
+    unsigned offset = 0;
+    if( taken ) {
+        Addr next = pc_+2;
+        unsigned to_next_page = 0x100 - (next & 0xff);
+
+        // A branch only reaches the next page from near the end of this one, so crossings that can't
+        // happen yet are owed, and skips run up to the end of the page until they can
+        if( chance(options_.cross_percent) )
+            owed_crossings_++;
+
+        if( owed_crossings_>0 && to_next_page<=127 ) {
+            offset = std::min( to_next_page + below(4), 127u );
+            owed_crossings_--;
+        } else if( owed_crossings_>0 ) {
+            offset = std::min( 127u, to_next_page-1 );
+        } else {
+            offset = std::min( 1 + below(4), to_next_page-1 );
+        }
+
+        stats_.taken++;
+        stats_.could_cross++;
+        if( ((next+offset) ^ next) & 0xff00 )
+            stats_.crossed++;
+    }
+
+    emit(op, AddressingMode::Pc_rel, offset);
+    stats_.branches++;
+    stats_.instructions++;
+
+    for( unsigned i = 0; i<offset; ++i )
+        emit( opcode_for(Operation::Op_NOP, AddressingMode::Implied) );
+}
+
+void Generator::stackOperation() {
+    stats_.stack++;
+    stats_.instructions++;
+
+    if( below(3)==0 ) {
+        emitAbs(Operation::Op_JSR, AddressingMode::Abs, subroutine_);
+    } else if( pushes_.size()<MaxPushes && (pushes_.empty() || chance(50)) ) {
+        // A pushes data, and P pushes flags, so each gets pulled back by its own kind
+        Operation op = chance(50) ? Operation::Op_PHA : Operation::Op_PHP;
+        emit(op, AddressingMode::Stack);
+        pushes_.push_back(op);
+    } else {
+        stats_.stack--;
+        stats_.instructions--;
+        pull();
+    }
+}
+
+void Generator::pull() {
+    Operation op = pushes_.back()==Operation::Op_PHA ? Operation::Op_PLA : Operation::Op_PLP;
+    pushes_.pop_back();
+
+    emit(op, AddressingMode::Stack);
+    stats_.stack++;
+    stats_.instructions++;
+}
+
+Operation Generator::pick(std::initializer_list<Operation> ops, AddressingMode mode) {
+    std::vector<Operation> candidates;
+    for( Operation op : ops ) {
+        if( has_opcode(op, mode) )
+            candidates.push_back(op);
+    }
+
+    return candidates[ below( candidates.size() ) ];
+}
+
+// An address in the absolute data area which, indexed by index, crosses a page or not
+Addr Generator::absTarget(uint8_t index, bool cross) {
+    Addr target = AbsData;
+    for( unsigned attempt = 0; attempt<32; ++attempt ) {
+        target = AbsData + below(options_.abs_bytes);
+        if( ((target & 0xff) < index) == cross )
+            break;
+    }
+
+    return target;
+}
+
+void Generator::modeOperation() {
+    static constexpr std::initializer_list<Operation> AluOps = {
+        Operation::Op_LDA, Operation::Op_ORA, Operation::Op_AND, Operation::Op_EOR, Operation::Op_ADC,
+        Operation::Op_SBC, Operation::Op_CMP, Operation::Op_BIT, Operation::Op_CPX, Operation::Op_CPY,
+    };
+    static constexpr std::initializer_list<Operation> StoreOps = {
+        Operation::Op_STA, Operation::Op_STX, Operation::Op_STY,
+    };
+    static constexpr std::initializer_list<Operation> RmwOps = {
+        Operation::Op_ASL, Operation::Op_LSR, Operation::Op_ROL, Operation::Op_ROR, Operation::Op_INC, Operation::Op_DEC,
+    };
+    // X and Y stay constant, so nothing here loads them
+    static constexpr std::initializer_list<Operation> ImpliedOps = {
+        Operation::Op_CLC, Operation::Op_SEC, Operation::Op_CLV, Operation::Op_NOP, Operation::Op_TXA, Operation::Op_TYA,
+    };
+
+    unsigned total = 0;
+    for( unsigned weight : options_.mix )
+        total += weight;
+
+    unsigned choice = below(total);
+    size_t mode_index = 0;
+    while( choice>=options_.mix[mode_index] )
+        choice -= options_.mix[mode_index++];
+    Mode mode = Mode(mode_index);
+    AddressingMode addressing = AddressingModes[mode_index];
+
+    count(mode);
+
+    if( mode==Mode::Implied ) {
+        // Shifts and rotates of A are implied too, as far as the mix goes
+        if( chance(30) )
+            emit( pick(RmwOps, AddressingMode::Accumulator), AddressingMode::Accumulator );
+        else
+            emit( pick(ImpliedOps, AddressingMode::Implied), AddressingMode::Implied );
+        return;
+    }
+    if( mode==Mode::Immediate ) {
+        emit( pick(AluOps, addressing), addressing, rng_() );
+        return;
+    }
+
+    stats_.memory_operands++;
+
+    Operation op;
+    if( canRmw(mode) && chance(rmw_chance_) ) {
+        op = pick(RmwOps, addressing);
+        stats_.rmw++;
+    } else if( chance(20) ) {
+        op = pick(StoreOps, addressing);
+    } else {
+        op = pick(AluOps, addressing);
+    }
+
+    bool cross = chance(options_.cross_percent);
+    switch( mode ) {
+    case Mode::Zp:
+        emit( op, addressing, below(options_.zp_bytes) );
+        break;
+    case Mode::ZpX:
+        emit( op, addressing, uint8_t( below(options_.zp_bytes) - XIndex ) );
+        break;
+    case Mode::Abs:
+        emitAbs( op, addressing, AbsData + below(options_.abs_bytes) );
+        break;
+    case Mode::AbsX:
+    case Mode::AbsY: {
+        uint8_t index = mode==Mode::AbsX ? XIndex : YIndex;
+        Addr base = absTarget(index, cross) - index;
+        emitAbs( op, addressing, base );
+
+        stats_.could_cross++;
+        if( (base & 0xff) + index > 0xff )
+            stats_.crossed++;
+        break;
+    }
+    case Mode::ZpXInd:
+        emit( op, addressing, uint8_t( ZpPointers + 2*below(NumPointers) - XIndex ) );
+        break;
+    case Mode::ZpIndY: {
+        unsigned pointer = 2*below(NumPointers/2) + (cross ? 0 : 1);
+        emit( op, addressing, ZpPointers + 2*pointer );
+
+        Addr base = image_[ZpPointers + 2*pointer] | image_[ZpPointers + 2*pointer + 1]<<8;
+        stats_.could_cross++;
+        if( (base & 0xff) + YIndex > 0xff )
+            stats_.crossed++;
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+static void write_image(const char *path, const Image &image, const std::string &description) {
+    std::ofstream out(path);
+    if( !out )
+        throw std::runtime_error( std::string("Can't write to ") + path );
+
+    bool described = false;
+    char buffer[24];
+    for( size_t row=0; row<image.size(); row+=16 ) {
+        bool empty = true;
+        for( size_t i=0; i<16; ++i )
+            empty = empty && image[row+i]==0;
+        if( empty )
+            continue;
+
+        snprintf(buffer, sizeof(buffer), "@%04zx", row);
+        out<<buffer;
+        for( size_t i=0; i<16; ++i ) {
+            snprintf(buffer, sizeof(buffer), " %02x", image[row+i]);
+            out<<buffer;
+        }
+
+        if( !described ) {
+            out<<"\t// "<<description;
+            described = true;
+        }
+        out<<"\n";
+    }
+}
+
+static std::string percent(size_t part, size_t whole) {
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "%.1f%%", whole==0 ? 0.0 : 100.0*part/whole);
+
+    return buffer;
+}
+
+static void parse_mix(const char *spec, std::array<unsigned, NumModes> &mix) {
+    mix.fill(0);
+
+    std::string rest = spec;
+    while( !rest.empty() ) {
+        size_t comma = rest.find(',');
+        std::string item = rest.substr(0, comma);
+        rest = comma==std::string::npos ? "" : rest.substr(comma+1);
+
+        size_t equals = item.find('=');
+        auto name = std::find( std::begin(ModeNames), std::end(ModeNames), item.substr(0, equals) );
+        if( equals==std::string::npos || name==std::end(ModeNames) )
+            throw std::runtime_error("Unknown addressing mode in mix: " + item);
+
+        mix[ name-std::begin(ModeNames) ] = strtoul( item.c_str()+equals+1, nullptr, 0 );
+    }
+}
+
+static void usage(const char *name) {
+    std::cerr<<"Usage: "<<name<<" [-s seed] [-n instructions] [-i iterations] [-m mix] [-b branch%] [-t taken%]"
+            " [-p cross%] [-r rmw%] [-k stack%] [-z zp_bytes] [-a abs_bytes] [-o output]\n"
+            "  -m    Addressing mode weights, as mode=weight,... with modes imp, imm, zp, zpx, abs, absx, absy,\n"
+            "        indx and indy. Modes left out aren't used\n"
+            "  -b    Share of instructions that are conditional branches, each with its flag setting instruction\n"
+            "  -t    Share of branches taken\n"
+            "  -p    Share of indexed accesses and taken branches that cross a page. Each taken branch that\n"
+            "        crosses takes up to a page of code\n"
+            "  -r    Share of memory operands that are read-modify-write\n"
+            "  -k    Share of instructions that use the stack: pushes, pulls and JSR to an RTS\n"
+            "  -z    Size of the zero page data area, up to 192 bytes\n"
+            "  -a    Size of the absolute data area, up to 28K\n";
+    exit(2);
+}
+
+int main(int argc, char *argv[]) {
+    Options options;
+
+    try {
+        int opt;
+        while( (opt = getopt(argc, argv, "s:n:i:m:b:t:p:r:k:z:a:o:")) != -1 ) {
+            switch( opt ) {
+            case 's': options.seed = strtoull(optarg, nullptr, 0); break;
+            case 'n': options.instructions = strtoul(optarg, nullptr, 0); break;
+            case 'i': options.iterations = strtoul(optarg, nullptr, 0); break;
+            case 'm': parse_mix(optarg, options.mix); break;
+            case 'b': options.branch_percent = strtoul(optarg, nullptr, 0); break;
+            case 't': options.taken_percent = strtoul(optarg, nullptr, 0); break;
+            case 'p': options.cross_percent = strtoul(optarg, nullptr, 0); break;
+            case 'r': options.rmw_percent = strtoul(optarg, nullptr, 0); break;
+            case 'k': options.stack_percent = strtoul(optarg, nullptr, 0); break;
+            case 'z': options.zp_bytes = strtoul(optarg, nullptr, 0); break;
+            case 'a': options.abs_bytes = strtoul(optarg, nullptr, 0); break;
+            case 'o': options.output = optarg; break;
+            default: usage(argv[0]);
+            }
+        }
+    } catch( const std::exception &ex ) {
+        std::cerr<<ex.what()<<"\n";
+        usage(argv[0]);
+    }
+
+    if( optind!=argc )
+        usage(argv[0]);
+
+    unsigned mix_total = 0;
+    for( unsigned weight : options.mix )
+        mix_total += weight;
+
+    if( mix_total==0 || options.branch_percent+options.stack_percent>100 || options.taken_percent>100 ||
+            options.cross_percent>100 || options.rmw_percent>100 || options.zp_bytes==0 || options.zp_bytes>ZpPointers ||
+            options.abs_bytes==0 || options.abs_bytes>CodeStart-AbsData || options.iterations==0 ||
+            options.iterations>MaxIterations )
+    {
+        std::cerr<<"Knobs out of range\n";
+        usage(argv[0]);
+    }
+
+    Generator generator(options);
+    try {
+        generator.generate();
+    } catch( const std::runtime_error &ex ) {
+        std::cerr<<ex.what()<<"\n";
+        return 1;
+    }
+
+    const Stats &stats = generator.stats();
+    std::string mix;
+    for( size_t mode = 0; mode<NumModes; ++mode )
+        mix += std::string(" ") + ModeNames[mode] + " " + percent(stats.modes[mode], stats.instructions);
+
+    char buffer[512];
+    snprintf(buffer, sizeof(buffer), "seed %llu, %zu instructions x %u, branches %s (taken %s), stack %s,"
+            " rmw %s of memory operands, page crossings %s of %zu that could, modes%s",
+            (unsigned long long)options.seed, stats.instructions, options.iterations,
+            percent(stats.branches, stats.instructions).c_str(), percent(stats.taken, stats.branches).c_str(),
+            percent(stats.stack, stats.instructions).c_str(), percent(stats.rmw, stats.memory_operands).c_str(),
+            percent(stats.crossed, stats.could_cross).c_str(), stats.could_cross, mix.c_str());
+
+    try {
+        write_image(options.output, generator.image(), buffer);
+    } catch( const std::runtime_error &ex ) {
+        std::cerr<<ex.what()<<"\n";
+        return 1;
+    }
+
+    std::cout<<options.output<<": "<<generator.codeSize()<<" bytes of code, "<<buffer<<"\n";
+}
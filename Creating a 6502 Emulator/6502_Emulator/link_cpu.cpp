@@ -0,0 +1,230 @@
+// A host and a number of drive CPUs, each on its own thread, exchanging bytes over serial links. The
+// host sends a byte to each drive in turn and waits for the reply; each drive answers with the byte
+// plus one. Reports how many exchanges completed, and how the machine group's quanta behaved.
+
+#include "Bus.h"
+#include "c6502.h"
+#include "machine_group.h"
+#include "mailbox.h"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+using Image = std::array<uint8_t, 65536>;
+
+static constexpr Addr CodeAddress = 0x0400;
+// Port n's data register is at LinkData+n, and its status (bit 7 set when a byte is waiting) at LinkStatus+n
+static constexpr Addr LinkData = 0xc000, LinkStatus = 0xc010;
+static constexpr size_t MaxLinks = 16;
+static constexpr Addr NumDrives = 0x0000, Rounds = 0x0010, Replies = 0x0200;
+
+// For each drive X: send X, wait for the reply, store it at Replies+X. Then count the round and repeat.
+static constexpr uint8_t HostProgram[] = {
+    0xa2, 0x00,             // start: LDX #0
+    0x8a,                   // loop:  TXA
+    0x9d, 0x00, 0xc0,       //        STA LinkData,X
+    0xbd, 0x10, 0xc0,       // wait:  LDA LinkStatus,X
+    0x10, 0xfb,             //        BPL wait
+    0xbd, 0x00, 0xc0,       //        LDA LinkData,X
+    0x9d, 0x00, 0x02,       //        STA Replies,X
+    0xe8,                   //        INX
+    0xe4, 0x00,             //        CPX NumDrives
+    0xd0, 0xec,             //        BNE loop
+    0xe6, 0x10,             //        INC Rounds
+    0x4c, 0x00, 0x04,       //        JMP start
+};
+
+// Wait for a byte from the host and send back one more
+static constexpr uint8_t DriveProgram[] = {
+    0xad, 0x10, 0xc0,       // wait:  LDA LinkStatus
+    0x10, 0xfb,             //        BPL wait
+    0xad, 0x00, 0xc0,       //        LDA LinkData
+    0x18,                   //        CLC
+    0x69, 0x01,             //        ADC #1
+    0x8d, 0x00, 0xc0,       //        STA LinkData
+    0x4c, 0x00, 0x04,       //        JMP wait
+};
+
+struct LinkMessage {
+    uint64_t cycle;
+    uint8_t value;
+};
+
+using LinkMailbox = Mailbox<LinkMessage, 1024>;
+
+// One end of a serial link
+struct Port {
+    LinkMailbox *out, *in;
+    std::deque<uint8_t> received;
+    size_t overruns = 0;
+};
+
+class LinkBus : public Bus {
+    Image                   memory;
+    MachineGroup            &group;
+    MachineGroup::Clock     &clock;
+
+public:
+    std::vector<Port> ports;
+
+    LinkBus(const Image &image, MachineGroup &group, size_t machine) :
+        memory(image), group(group), clock(group.clock(machine))
+    {
+        clock.on_quantum = [this](uint64_t start) { deliver(start); };
+    }
+
+    uint8_t peek(Addr address) const { return memory[address]; }
+
+    virtual uint8_t read( c6502 *cpu, Addr address, bool sync = false ) override {
+        clock.tick();
+
+        if( Port *port = decode(address, LinkData) ) {
+            if( port->received.empty() )
+                return 0;
+
+            uint8_t value = port->received.front();
+            port->received.pop_front();
+            return value;
+        }
+        if( Port *port = decode(address, LinkStatus) )
+            return port->received.empty() ? 0x00 : 0x80;
+
+        return memory[address];
+    }
+
+    virtual void write( c6502 *cpu, Addr address, uint8_t value ) override {
+        clock.tick();
+
+        if( Port *port = decode(address, LinkData) ) {
+            if( !port->out->push( LinkMessage{ clock.now(), value } ) )
+                port->overruns++;
+            group.noteTraffic();
+            return;
+        }
+
+        memory[address] = value;
+    }
+
+private:
+    Port *decode(Addr address, Addr base) {
+        if( address<base || address>=base+ports.size() )
+            return nullptr;
+
+        return &ports[address - base];
+    }
+
+    // Only what was sent in an earlier quantum, so the result doesn't depend on how far ahead the
+    // sending thread has already run
+    void deliver(uint64_t start) {
+        for( auto &port : ports ) {
+            while( const LinkMessage *message = port.in->front() ) {
+                if( message->cycle>=start )
+                    break;
+
+                port.received.push_back(message->value);
+                port.in->pop();
+            }
+        }
+    }
+};
+
+struct Options {
+    size_t drives = 2;
+    uint64_t cycles = 1000000;
+    uint32_t min_quantum = 16, max_quantum = 4096;
+};
+
+static void usage(const char *name) {
+    std::cerr<<"Usage: "<<name<<" [-d drives] [-c cycles] [-q min:max]\n"
+            "  -d    Number of drive CPUs, each on its own thread (1-"<<MaxLinks<<", default 2)\n"
+            "  -c    Cycles to run (default 1000000)\n"
+            "  -q    Quantum bounds in cycles (default 16:4096)\n";
+    exit(2);
+}
+
+int main(int argc, char *argv[]) {
+    Options options;
+
+    int opt;
+    while( (opt = getopt(argc, argv, "d:c:q:")) != -1 ) {
+        switch( opt ) {
+        case 'd': options.drives = strtoul(optarg, nullptr, 0); break;
+        case 'c': options.cycles = strtoull(optarg, nullptr, 0); break;
+        case 'q':
+            if( sscanf(optarg, "%u:%u", &options.min_quantum, &options.max_quantum)!=2 )
+                usage(argv[0]);
+            break;
+        default: usage(argv[0]);
+        }
+    }
+
+    if( argc!=optind || options.drives==0 || options.drives>MaxLinks || options.min_quantum==0 ||
+            options.min_quantum>options.max_quantum )
+        usage(argv[0]);
+
+    MachineGroup group(options.drives + 1, options.min_quantum, options.max_quantum);
+
+    Image host_image{}, drive_image{};
+    memcpy(&host_image[CodeAddress], HostProgram, sizeof(HostProgram));
+    host_image[NumDrives] = options.drives;
+    memcpy(&drive_image[CodeAddress], DriveProgram, sizeof(DriveProgram));
+
+    // Mailboxes to and from each drive
+    std::vector<std::unique_ptr<LinkMailbox>> to_drive, from_drive;
+    std::vector<std::unique_ptr<LinkBus>> buses;
+
+    buses.push_back( std::make_unique<LinkBus>(host_image, group, 0) );
+    for( size_t drive = 0; drive<options.drives; ++drive ) {
+        to_drive.push_back( std::make_unique<LinkMailbox>() );
+        from_drive.push_back( std::make_unique<LinkMailbox>() );
+
+        buses[0]->ports.push_back( Port{ .out = to_drive.back().get(), .in = from_drive.back().get() } );
+
+        buses.push_back( std::make_unique<LinkBus>(drive_image, group, drive+1) );
+        buses.back()->ports.push_back( Port{ .out = from_drive.back().get(), .in = to_drive.back().get() } );
+    }
+
+    std::vector<std::function<void ()>> bodies;
+    for( auto &bus : buses ) {
+        bodies.push_back( [&bus]() {
+            c6502 cpu(*bus);
+            cpu.setSignalLogging(false);
+            cpu.setState( c6502::State{ .regA = 0, .regX = 0, .regY = 0, .regSp = 0xfd, .regStatus = 0x34,
+                    .pc = CodeAddress } );
+            cpu.runCpu();
+        } );
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    group.run(bodies, options.cycles);
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - start );
+
+    const LinkBus &host = *buses[0];
+    bool replies_ok = true;
+    size_t overruns = 0;
+    for( size_t drive = 0; drive<options.drives; ++drive ) {
+        replies_ok = replies_ok && ( host.peek(Replies+drive)==0 || host.peek(Replies+drive)==drive+1 );
+        overruns += buses[drive+1]->ports[0].overruns + host.ports[drive].overruns;
+    }
+
+    auto stats = group.stats();
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer), "%zu machines, %llu cycles each in %.3fs (%.3f MHz per machine)\n"
+            "%u rounds (mod 256), replies %s, %zu overruns\n%llu quanta, %llu shortened by link traffic\n",
+            options.drives+1, (unsigned long long)options.cycles, elapsed.count() / 1e6,
+            double(options.cycles) / std::max<int64_t>(elapsed.count(), 1), host.peek(Rounds),
+            replies_ok ? "correct" : "WRONG", overruns, (unsigned long long)stats.quanta,
+            (unsigned long long)stats.short_quanta);
+    std::cout<<buffer;
+
+    return replies_ok && overruns==0 ? 0 : 1;
+}
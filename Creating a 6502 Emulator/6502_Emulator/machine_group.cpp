@@ -0,0 +1,73 @@
+#include "machine_group.h"
+
+#include <algorithm>
+#include <thread>
+
+MachineGroup::MachineGroup(size_t machines, uint32_t min_quantum, uint32_t max_quantum) :
+    min_quantum_(min_quantum),
+    max_quantum_(max_quantum),
+    quantum_(max_quantum)
+{
+    for( size_t i=0; i<machines; ++i )
+        clocks_.push_back( std::make_unique<Clock>(*this) );
+
+    barrier_ = std::make_unique<std::barrier<Completion>>( machines, Completion{this} );
+}
+
+void MachineGroup::run(const std::vector<std::function<void ()>> &bodies, uint64_t cycles) {
+    end_cycle_ = cycles;
+    stopping_ = false;
+    stats_ = Stats{};
+
+    quantum_end_ = std::min<uint64_t>(quantum_, end_cycle_);
+    for( auto &clock : clocks_ ) {
+        clock->cycle_ = 0;
+        clock->quantum_end_ = quantum_end_;
+        if( clock->on_quantum )
+            clock->on_quantum(0);
+    }
+
+    std::vector<std::thread> threads;
+    for( const auto &body : bodies ) {
+        threads.emplace_back( [&body]() {
+            try {
+                body();
+            } catch( Stopped ex ) {
+            }
+        } );
+    }
+
+    for( auto &thread : threads )
+        thread.join();
+}
+
+void MachineGroup::endQuantum(Clock &clock) {
+    barrier_->arrive_and_wait();
+
+    if( stopping_ )
+        throw Stopped();
+
+    uint64_t start = clock.quantum_end_;
+    clock.quantum_end_ = quantum_end_;
+    if( clock.on_quantum )
+        clock.on_quantum(start);
+}
+
+// Runs once per quantum, on one thread, while all the others wait at the barrier
+void MachineGroup::nextQuantum() {
+    stats_.quanta++;
+
+    if( quantum_end_>=end_cycle_ ) {
+        stopping_ = true;
+        return;
+    }
+
+    if( traffic_.exchange(false, std::memory_order_relaxed) ) {
+        quantum_ = min_quantum_;
+        stats_.short_quanta++;
+    } else {
+        quantum_ = std::min(quantum_*2, max_quantum_);
+    }
+
+    quantum_end_ = std::min<uint64_t>(quantum_end_ + quantum_, end_cycle_);
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <barrier>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <stdint.h>
+
+// Runs several loosely coupled machines, such as a computer and its disk drives, each on its own thread.
+//
+// All machines share one cycle count, and run in quanta: every machine runs to the end of the quantum,
+// then waits at a barrier for the others. Anything sent between machines must be timestamped with the
+// sender's cycle and only acted on by the receiver once the quantum it was sent in has ended, which
+// makes runs deterministic regardless of thread scheduling. Traffic in a quantum shrinks the next one to
+// the minimum, so exchanges see low latency; quiet quanta double back up to the maximum.
+class MachineGroup {
+public:
+    // Thrown from Clock::tick() once the group has run its cycles. Ends the machine's thread.
+    class Stopped {};
+
+    // One per machine. The machine's bus calls tick() once per cycle.
+    class Clock {
+        friend class MachineGroup;
+
+        MachineGroup &group_;
+        uint64_t cycle_ = 0;
+        uint64_t quantum_end_ = 0;
+
+    public:
+        // Called on the machine's own thread at the start of each quantum, with the cycle the quantum
+        // starts at. This is where messages stamped before that cycle get delivered.
+        std::function<void (uint64_t start)> on_quantum;
+
+        explicit Clock(MachineGroup &group) : group_(group) {}
+
+        void tick() {
+            if( ++cycle_==quantum_end_ )
+                group_.endQuantum(*this);
+        }
+
+        uint64_t now() const { return cycle_; }
+    };
+
+    struct Stats {
+        uint64_t quanta, short_quanta;
+    };
+
+private:
+    struct Completion {
+        MachineGroup *group;
+        void operator()() noexcept { group->nextQuantum(); }
+    };
+
+    uint32_t min_quantum_, max_quantum_;
+    uint32_t quantum_;
+    uint64_t end_cycle_ = 0;
+    uint64_t quantum_end_ = 0;
+    bool stopping_ = false;
+
+    std::atomic<bool> traffic_{false};
+    std::vector<std::unique_ptr<Clock>> clocks_;
+    std::unique_ptr<std::barrier<Completion>> barrier_;
+
+    Stats stats_{};
+
+public:
+    MachineGroup(size_t machines, uint32_t min_quantum, uint32_t max_quantum);
+
+    Clock &clock(size_t machine) { return *clocks_[machine]; }
+
+    // Tells the group that a machine sent something in this quantum, so the next one is short
+    void noteTraffic() { traffic_.store(true, std::memory_order_relaxed); }
+
+    // Runs every machine's body on its own thread for the given number of cycles. Each body runs its
+    // machine until the Stopped thrown from its clock.
+    void run(const std::vector<std::function<void ()>> &bodies, uint64_t cycles);
+
+    Stats stats() const { return stats_; }
+
+private:
+    void endQuantum(Clock &clock);
+    void nextQuantum();
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+
+#include <stddef.h>
+
+// Lock free single producer, single consumer queue of fixed capacity
+template<typename T, size_t Size>
+class Mailbox {
+    static_assert( (Size & (Size-1))==0, "Mailbox size must be a power of two" );
+
+    std::array<T, Size> slots_;
+
+    // Kept on separate cache lines, as each is written by a different thread
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+
+public:
+    // Producer side. Returns false if the mailbox is full.
+    bool push(const T &value) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if( tail - head_.load(std::memory_order_acquire) == Size )
+            return false;
+
+        slots_[tail % Size] = value;
+        tail_.store(tail+1, std::memory_order_release);
+
+        return true;
+    }
+
+    // Consumer side. Returns the oldest value without removing it, or nullptr if empty.
+    const T *front() const {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if( head==tail_.load(std::memory_order_acquire) )
+            return nullptr;
+
+        return &slots_[head % Size];
+    }
+
+    void pop() {
+        head_.store(head_.load(std::memory_order_relaxed)+1, std::memory_order_release);
+    }
+};
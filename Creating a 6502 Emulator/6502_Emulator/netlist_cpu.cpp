@@ -0,0 +1,152 @@
+#include "netlist_cpu.h"
+
+extern "C" {
+#include "cpu/perfect6502.h"
+#include "cpu/types.h"
+#include "cpu/netlist_sim.h"
+}
+
+#include <mutex>
+
+static constexpr nodenum_t
+        CLK0 = 1171,
+        RW = 1156,
+        SYNC = 539,
+        RDY = 89,
+        RES = 159,
+        IRQ = 103,
+        NMI = 1297,
+        SO = 1672;
+
+// initAndResetChip clocks the chip through perfect6502's global memory and cycle counter
+static std::mutex init_mutex;
+
+NetlistCpu::NetlistCpu() {
+    {
+        std::lock_guard guard(init_mutex);
+        state_ = initAndResetChip();
+    }
+
+    setSo(false);
+    setNmi(false);
+}
+
+NetlistCpu::~NetlistCpu() {
+    destroyChip(state_);
+}
+
+NetlistCpu::BusCycle NetlistCpu::cycle() {
+    halfStep();
+    halfStep();
+
+    return BusCycle{
+        .address = readAddressBus(state_),
+        .data = readDataBus(state_),
+        .read = bool( readRW(state_) ),
+        .sync = bool( isNodeHigh(state_, SYNC) )
+    };
+}
+
+std::optional<NetlistCpu::BusCycle> NetlistCpu::reset(size_t hold_cycles, size_t max_cycles) {
+    setReset(true);
+    for( size_t i=0; i<hold_cycles; ++i )
+        cycle();
+    setReset(false);
+
+    for( size_t i=0; i<max_cycles; ++i ) {
+        BusCycle bus = cycle();
+        if( bus.read && bus.address==0xfffc )
+            return bus;
+    }
+
+    return std::nullopt;
+}
+
+void NetlistCpu::setIo(Addr mask, Addr match, IoRead io_read) {
+    io_mask_ = mask;
+    io_match_ = match;
+    io_read_ = std::move(io_read);
+}
+
+void NetlistCpu::save(Snapshot &snapshot, bool with_memory) const {
+    snapshot.nodes.resize( nodeStateSize(state_) );
+    saveNodeState(state_, snapshot.nodes.data());
+
+    if( with_memory )
+        snapshot.memory = memory;
+}
+
+void NetlistCpu::restore(const Snapshot &snapshot, bool with_memory) {
+    restoreNodeState(state_, snapshot.nodes.data());
+
+    if( with_memory )
+        memory = snapshot.memory;
+}
+
+void NetlistCpu::setReset(bool state) {
+    setNode(state_, RES, !state);
+}
+
+void NetlistCpu::setIrq(bool state) {
+    setNode(state_, IRQ, !state);
+}
+
+void NetlistCpu::setNmi(bool state) {
+    setNode(state_, NMI, !state);
+}
+
+void NetlistCpu::setReady(bool state) {
+    setNode(state_, RDY, !state);
+}
+
+void NetlistCpu::setSo(bool state) {
+    setNode(state_, SO, !state);
+}
+
+uint32_t NetlistCpu::netlistChecksum() {
+    return ::netlistChecksum();
+}
+
+uint8_t NetlistCpu::regA() const {
+    return readA(state_);
+}
+
+uint8_t NetlistCpu::regX() const {
+    return readX(state_);
+}
+
+uint8_t NetlistCpu::regY() const {
+    return readY(state_);
+}
+
+uint8_t NetlistCpu::regSp() const {
+    return readSP(state_);
+}
+
+uint8_t NetlistCpu::regStatus() const {
+    return readP(state_);
+}
+
+Addr NetlistCpu::pc() const {
+    return readPC(state_);
+}
+
+bool NetlistCpu::sync() const {
+    return isNodeHigh(state_, SYNC);
+}
+
+// Same as perfect6502's step(), except memory comes from this instance
+void NetlistCpu::halfStep() {
+    bool clk = isNodeHigh(state_, CLK0);
+
+    setNode(state_, CLK0, !clk);
+
+    if( !clk ) {
+        Addr address = readAddressBus(state_);
+
+        if( isNodeHigh(state_, RW) )
+            writeDataBus(state_, io_read_ && (address & io_mask_)==io_match_ ? io_read_(address) : memory[address]);
+        else
+            memory[address] = readDataBus(state_);
+    }
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "Bus.h"
+
+#include <array>
+#include <functional>
+#include <optional>
+#include <vector>
+
+#include <stdint.h>
+
+// A single perfect6502 netlist instance.
+//
+// Unlike the stock perfect6502 driver, memory belongs to the instance rather than to the global
+// `memory` array, so each thread can run its own netlist without stepping on the others.
+class NetlistCpu {
+public:
+    struct BusCycle {
+        Addr address;
+        uint8_t data;
+        bool read;
+        bool sync;
+
+        bool operator==(const BusCycle &that) const = default;
+    };
+
+    // Complete chip and memory state, taken between two cycles
+    struct Snapshot {
+        std::vector<unsigned char> nodes;
+        std::array<uint8_t, 65536> memory;
+    };
+
+    std::array<uint8_t, 65536> memory{};
+
+    // Serves reads of I/O registers, whose value may depend on the read itself
+    using IoRead = std::function<uint8_t (Addr address)>;
+
+private:
+    void *state_;
+
+    IoRead io_read_;
+    Addr io_mask_ = 0, io_match_ = 0;
+
+public:
+    NetlistCpu();
+    ~NetlistCpu();
+
+    NetlistCpu(const NetlistCpu &that) = delete;
+    NetlistCpu &operator=(const NetlistCpu &that) = delete;
+
+    // Runs one full clock cycle and returns the bus state after memory was accessed
+    BusCycle cycle();
+
+    // Holds RES for the given number of cycles, then runs until the reset vector is read. Returns the
+    // cycle reading the vector, or nothing if it was not read within max_cycles.
+    std::optional<BusCycle> reset(size_t hold_cycles = 8, size_t max_cycles = 50);
+
+    // Reads of addresses where (address & mask)==match go to io_read rather than memory. Writes still
+    // land in memory, and show up in the cycle's BusCycle.
+    void setIo(Addr mask, Addr match, IoRead io_read);
+
+    // Snapshots can be restored into any NetlistCpu, not just the one that took them
+    void save(Snapshot &snapshot, bool with_memory = true) const;
+    void restore(const Snapshot &snapshot, bool with_memory = true);
+
+    // Signals use the same polarity as c6502: true means the (active low) pin is asserted
+    void setReset(bool state);
+    void setIrq(bool state);
+    void setNmi(bool state);
+    void setReady(bool state);
+    void setSo(bool state);
+
+    // Identifies the netlist, so results generated from it can be tied to it
+    static uint32_t netlistChecksum();
+
+    uint8_t regA() const;
+    uint8_t regX() const;
+    uint8_t regY() const;
+    uint8_t regSp() const;
+    uint8_t regStatus() const;
+    Addr pc() const;
+    // Whether SYNC is high, i.e. the current cycle fetches an opcode
+    bool sync() const;
+
+private:
+    void halfStep();
+};
@@ -0,0 +1,152 @@
+#pragma once
+
+// Opcode metadata for every tool. The table itself is the test harness' operations.h, which covers the
+// 65C02; what the NMOS 6502 lacks is marked here. All but name() work at compile time.
+
+#include "operations.h"
+
+#include <stdint.h>
+
+namespace Opcodes {
+
+// How an instruction hands on control
+enum class Flow {
+    Next,           // Falls through to the next instruction
+    Branch,         // Conditional relative branch
+    Jump,           // Unconditional, to a known target
+    IndirectJump,   // Through memory, target unknown until run time
+    Call,           // JSR; assumed to come back to the next instruction
+    Return,         // RTS and RTI
+    Interrupt,      // BRK
+    Stop,           // STP, and anything undefined
+};
+
+// Added by the 65C02, undefined on the NMOS 6502
+inline constexpr uint8_t CmosOnly[] = {
+    0x04, 0x0c, 0x12, 0x14, 0x1a, 0x1c, 0x32, 0x34, 0x3a, 0x3c, 0x52, 0x5a, 0x64, 0x72, 0x74, 0x7a,
+    0x7c, 0x80, 0x89, 0x92, 0x9c, 0x9e, 0xb2, 0xcb, 0xd2, 0xda, 0xdb, 0xf2, 0xfa,
+    // RMB, SMB, BBR and BBS
+    0x07, 0x17, 0x27, 0x37, 0x47, 0x57, 0x67, 0x77, 0x87, 0x97, 0xa7, 0xb7, 0xc7, 0xd7, 0xe7, 0xf7,
+    0x0f, 0x1f, 0x2f, 0x3f, 0x4f, 0x5f, 0x6f, 0x7f, 0x8f, 0x9f, 0xaf, 0xbf, 0xcf, 0xdf, 0xef, 0xff,
+};
+
+constexpr Operation operation(uint8_t opcode) {
+    return opcodes[opcode].op;
+}
+
+constexpr AddressingMode mode(uint8_t opcode) {
+    return opcodes[opcode].mode;
+}
+
+constexpr bool isCmos(uint8_t opcode) {
+    return operation(opcode)!=Operation::Op_Unknown;
+}
+
+constexpr bool isNmos(uint8_t opcode) {
+    for( uint8_t cmos_only : CmosOnly ) {
+        if( opcode==cmos_only )
+            return false;
+    }
+
+    return isCmos(opcode);
+}
+
+// Instruction length in bytes, opcode included
+constexpr unsigned length(uint8_t opcode) {
+    // BBR and BBS take a zero page address and a branch offset
+    if( operation(opcode)==Operation::Op_BBR || operation(opcode)==Operation::Op_BBS )
+        return 3;
+    // BRK skips a padding byte
+    if( operation(opcode)==Operation::Op_BRK )
+        return 2;
+
+    switch( mode(opcode) ) {
+    case AddressingMode::Abs:
+    case AddressingMode::Abs_x_ind:
+    case AddressingMode::Abs_x:
+    case AddressingMode::Abs_y:
+    case AddressingMode::Abs_ind:
+        return 3;
+    case AddressingMode::Immediate:
+    case AddressingMode::Pc_rel:
+    case AddressingMode::Zp:
+    case AddressingMode::Zp_x_ind:
+    case AddressingMode::Zp_x:
+    case AddressingMode::Zp_y:
+    case AddressingMode::Zp_ind:
+    case AddressingMode::Zp_ind_y:
+        return 2;
+    default:
+        return 1;
+    }
+}
+
+// Cycles an NMOS instruction takes, less the one an indexed read takes when it crosses a page and the one
+// or two a taken branch takes. 0 for what the NMOS 6502 doesn't have.
+constexpr unsigned nmosCycles(uint8_t opcode) {
+    if( !isNmos(opcode) )
+        return 0;
+
+    Operation op = operation(opcode);
+    switch( op ) {
+    case Operation::Op_BRK:
+        return 7;
+    case Operation::Op_JSR: case Operation::Op_RTS: case Operation::Op_RTI:
+        return 6;
+    case Operation::Op_PHA: case Operation::Op_PHP:
+        return 3;
+    case Operation::Op_PLA: case Operation::Op_PLP:
+        return 4;
+    case Operation::Op_JMP:
+        return mode(opcode)==AddressingMode::Abs ? 3 : 5;
+    default:
+        break;
+    }
+
+    bool read_modify_write = op==Operation::Op_ASL || op==Operation::Op_LSR || op==Operation::Op_ROL ||
+            op==Operation::Op_ROR || op==Operation::Op_INC || op==Operation::Op_DEC;
+    bool store = op==Operation::Op_STA || op==Operation::Op_STX || op==Operation::Op_STY;
+
+    switch( mode(opcode) ) {
+    case AddressingMode::Zp:        return read_modify_write ? 5 : 3;
+    case AddressingMode::Zp_x:
+    case AddressingMode::Zp_y:      return read_modify_write ? 6 : 4;
+    case AddressingMode::Abs:       return read_modify_write ? 6 : 4;
+    case AddressingMode::Abs_x:
+    case AddressingMode::Abs_y:     return read_modify_write ? 7 : store ? 5 : 4;
+    case AddressingMode::Zp_x_ind:  return 6;
+    case AddressingMode::Zp_ind_y:  return store ? 6 : 5;
+    default:                        return 2;
+    }
+}
+
+constexpr Flow flow(uint8_t opcode) {
+    switch( operation(opcode) ) {
+    case Operation::Op_BCC: case Operation::Op_BCS: case Operation::Op_BEQ: case Operation::Op_BMI:
+    case Operation::Op_BNE: case Operation::Op_BPL: case Operation::Op_BVC: case Operation::Op_BVS:
+    case Operation::Op_BBR: case Operation::Op_BBS:
+        return Flow::Branch;
+    case Operation::Op_BRA:
+        return Flow::Jump;
+    case Operation::Op_JMP:
+        return mode(opcode)==AddressingMode::Abs ? Flow::Jump : Flow::IndirectJump;
+    case Operation::Op_JSR:
+        return Flow::Call;
+    case Operation::Op_RTS:
+    case Operation::Op_RTI:
+        return Flow::Return;
+    case Operation::Op_BRK:
+        return Flow::Interrupt;
+    case Operation::Op_STP:
+    case Operation::Op_Unknown:
+        return Flow::Stop;
+    default:
+        return Flow::Next;
+    }
+}
+
+inline const char *name(uint8_t opcode) {
+    return OperationNames[ int(operation(opcode)) ];
+}
+
+} // namespace Opcodes
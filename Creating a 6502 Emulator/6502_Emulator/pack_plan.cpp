@@ -0,0 +1,71 @@
+// Converts a text test plan into the packed format, which verify_cpu and the other tools map instead of
+// parsing. With -d, converts a packed plan back into text.
+
+#include "test_plan.h"
+
+#include "readmem.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+static void usage(const char *name) {
+    std::cerr<<"Usage: "<<name<<" [-d] [-o output] test_plan\n"
+            "  -d    Write the plan as text, as gen_test_plan does. Lines that held nothing but a comment are left out.\n"
+            "  -o    Where to write the plan (default: stdout)\n";
+    exit(2);
+}
+
+int main(int argc, char *argv[]) {
+    bool text = false;
+    const char *output = nullptr;
+
+    int opt;
+    while( (opt = getopt(argc, argv, "do:")) != -1 ) {
+        switch( opt ) {
+        case 'd': text = true; break;
+        case 'o': output = optarg; break;
+        default: usage(argv[0]);
+        }
+    }
+
+    if( argc-optind != 1 )
+        usage(argv[0]);
+    const char *plan_name = argv[optind];
+
+    TestPlan plan;
+    try {
+        plan = readTestPlan(plan_name);
+    } catch( ParseError &ex ) {
+        std::cerr<<"Malformed test plan "<<plan_name<<"\n";
+        return 1;
+    } catch( std::runtime_error &ex ) {
+        std::cerr<<ex.what()<<"\n";
+        return 1;
+    }
+
+    // Written whole or not at all, so a failed run doesn't leave a truncated plan for make to trust
+    std::ostringstream converted;
+    if( text )
+        writeTextPlan(converted, plan);
+    else
+        writePackedPlan(converted, plan);
+
+    if( output ) {
+        std::ofstream out(output, std::ios::binary);
+        out<<converted.str();
+        if( !out.flush() ) {
+            std::cerr<<"Failed writing "<<output<<"\n";
+            return 2;
+        }
+    } else {
+        std::cout<<converted.str();
+    }
+
+    std::cerr<<plan.size()<<" cycles, "<<plan.waits().size()<<" waits\n";
+
+    return 0;
+}
@@ -0,0 +1,311 @@
+// Translates a ROM image ahead of time into a C++ translation unit for the aot.h runtime. Every basic
+// block reachable from the entry points becomes a native function; see aot.h for what happens to the
+// rest.
+
+#include "aot.h"
+#include "disasm.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+using Image = std::array<uint8_t, 65536>;
+
+struct Options {
+    std::optional<Addr> load_address;
+    std::vector<Addr> entries;
+    const char *entries_file = nullptr;
+    std::string name;
+    const char *output = nullptr;
+};
+
+static std::string hex(unsigned value, int digits) {
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "0x%0*x", digits, value);
+
+    return buffer;
+}
+
+// The effective address of a memory operand. Reads through an index are charged the extra cycle they take
+// when it carries into the high byte.
+static std::string effective_address(const Instruction &instruction, bool read = false) {
+    unsigned operand = instruction.operand;
+
+    switch( Opcodes::mode(instruction.opcode) ) {
+    case AddressingMode::Zp:        return hex(operand, 2);
+    case AddressingMode::Zp_x:      return "uint8_t(" + hex(operand, 2) + " + c.x)";
+    case AddressingMode::Zp_y:      return "uint8_t(" + hex(operand, 2) + " + c.y)";
+    case AddressingMode::Abs:       return hex(operand, 4);
+    case AddressingMode::Abs_x:
+        return read ? "c.indexed(" + hex(operand, 4) + ", c.x)" : "Addr(" + hex(operand, 4) + " + c.x)";
+    case AddressingMode::Abs_y:
+        return read ? "c.indexed(" + hex(operand, 4) + ", c.y)" : "Addr(" + hex(operand, 4) + " + c.y)";
+    case AddressingMode::Zp_x_ind:  return "c.read16zp(" + hex(operand, 2) + " + c.x)";
+    case AddressingMode::Zp_ind_y:
+        return read ? "c.indexed(c.read16zp(" + hex(operand, 2) + "), c.y)" : "Addr(c.read16zp(" + hex(operand, 2) + ") + c.y)";
+    default:                        throw std::logic_error("No memory operand");
+    }
+}
+
+static std::string value(const Instruction &instruction) {
+    if( Opcodes::mode(instruction.opcode)==AddressingMode::Immediate )
+        return hex(instruction.operand, 2);
+
+    return "c.read(" + effective_address(instruction, true) + ")";
+}
+
+static std::string branch_condition(Operation op) {
+    switch( op ) {
+    case Operation::Op_BCC: return "!c.flag(C::C)";
+    case Operation::Op_BCS: return "c.flag(C::C)";
+    case Operation::Op_BNE: return "!c.flag(C::Z)";
+    case Operation::Op_BEQ: return "c.flag(C::Z)";
+    case Operation::Op_BPL: return "!c.flag(C::N)";
+    case Operation::Op_BMI: return "c.flag(C::N)";
+    case Operation::Op_BVC: return "!c.flag(C::V)";
+    case Operation::Op_BVS: return "c.flag(C::V)";
+    default:                throw std::logic_error("Not a branch");
+    }
+}
+
+// C++ for one NMOS instruction, after its opcode fetch
+static std::string translate(const Instruction &instruction) {
+    Operation op = Opcodes::operation(instruction.opcode);
+    bool accumulator = Opcodes::mode(instruction.opcode)==AddressingMode::Accumulator;
+    Addr next = instruction.address + instruction.length;
+
+    auto read_modify_write = [&](const char *function) {
+        if( accumulator )
+            return "c.a = c." + std::string(function) + "(c.a);";
+        return "{ Addr ea = " + effective_address(instruction) + "; c.write(ea, c." + function + "(c.read(ea))); }";
+    };
+    auto step = [&](const char *reg, const char *change) {
+        return "c." + std::string(reg) + " = c.nz(c." + reg + change + ");";
+    };
+
+    switch( op ) {
+    case Operation::Op_LDA: return "c.a = c.nz(" + value(instruction) + ");";
+    case Operation::Op_LDX: return "c.x = c.nz(" + value(instruction) + ");";
+    case Operation::Op_LDY: return "c.y = c.nz(" + value(instruction) + ");";
+    case Operation::Op_STA: return "c.write(" + effective_address(instruction) + ", c.a);";
+    case Operation::Op_STX: return "c.write(" + effective_address(instruction) + ", c.x);";
+    case Operation::Op_STY: return "c.write(" + effective_address(instruction) + ", c.y);";
+
+    case Operation::Op_ADC: return "c.adc(" + value(instruction) + ");";
+    case Operation::Op_SBC: return "c.sbc(" + value(instruction) + ");";
+    case Operation::Op_AND: return "c.a = c.nz(c.a & " + value(instruction) + ");";
+    case Operation::Op_ORA: return "c.a = c.nz(c.a | " + value(instruction) + ");";
+    case Operation::Op_EOR: return "c.a = c.nz(c.a ^ " + value(instruction) + ");";
+    case Operation::Op_CMP: return "c.compare(c.a, " + value(instruction) + ");";
+    case Operation::Op_CPX: return "c.compare(c.x, " + value(instruction) + ");";
+    case Operation::Op_CPY: return "c.compare(c.y, " + value(instruction) + ");";
+    case Operation::Op_BIT: return "c.bit(" + value(instruction) + ");";
+
+    case Operation::Op_ASL: return read_modify_write("asl");
+    case Operation::Op_LSR: return read_modify_write("lsr");
+    case Operation::Op_ROL: return read_modify_write("rol");
+    case Operation::Op_ROR: return read_modify_write("ror");
+    case Operation::Op_INC:
+        return "{ Addr ea = " + effective_address(instruction) + "; c.write(ea, c.nz(c.read(ea) + 1)); }";
+    case Operation::Op_DEC:
+        return "{ Addr ea = " + effective_address(instruction) + "; c.write(ea, c.nz(c.read(ea) - 1)); }";
+    case Operation::Op_INX: return step("x", " + 1");
+    case Operation::Op_INY: return step("y", " + 1");
+    case Operation::Op_DEX: return step("x", " - 1");
+    case Operation::Op_DEY: return step("y", " - 1");
+
+    case Operation::Op_TAX: return "c.x = c.nz(c.a);";
+    case Operation::Op_TAY: return "c.y = c.nz(c.a);";
+    case Operation::Op_TXA: return "c.a = c.nz(c.x);";
+    case Operation::Op_TYA: return "c.a = c.nz(c.y);";
+    case Operation::Op_TSX: return "c.x = c.nz(c.s);";
+    case Operation::Op_TXS: return "c.s = c.x;";
+
+    case Operation::Op_PHA: return "c.push(c.a);";
+    case Operation::Op_PHP: return "c.push(c.p | 0x30);";
+    case Operation::Op_PLA: return "c.a = c.nz(c.pull());";
+    case Operation::Op_PLP: return "c.p = c.pull() | 0x30;";
+
+    case Operation::Op_CLC: return "c.flag(C::C, false);";
+    case Operation::Op_SEC: return "c.flag(C::C, true);";
+    case Operation::Op_CLI: return "c.flag(C::I, false);";
+    case Operation::Op_SEI: return "c.flag(C::I, true);";
+    case Operation::Op_CLV: return "c.flag(C::V, false);";
+    case Operation::Op_CLD: return "c.flag(C::D, false);";
+    case Operation::Op_SED: return "c.flag(C::D, true);";
+    case Operation::Op_NOP: return "";
+
+    case Operation::Op_BCC: case Operation::Op_BCS: case Operation::Op_BNE: case Operation::Op_BEQ:
+    case Operation::Op_BPL: case Operation::Op_BMI: case Operation::Op_BVC: case Operation::Op_BVS: {
+        // A taken branch takes another cycle, and one more if it lands in another page
+        unsigned taken = (next ^ *instruction.target) & 0xff00 ? 2 : 1;
+        return "if( " + branch_condition(op) + " ) { c.cycles += " + std::to_string(taken) + "; return " +
+                hex(*instruction.target, 4) + "; }";
+    }
+    case Operation::Op_JMP:
+        if( instruction.target )
+            return "return " + hex(*instruction.target, 4) + ";";
+        return "return c.read16page(" + hex(instruction.operand, 4) + ");";
+    case Operation::Op_JSR:
+        return "c.push16(" + hex( Addr(next - 1), 4 ) + "); return " + hex(*instruction.target, 4) + ";";
+    case Operation::Op_RTS: return "return Addr(c.pull16() + 1);";
+    case Operation::Op_RTI: return "c.p = c.pull() | 0x30; return c.pull16();";
+    case Operation::Op_BRK: return "return c.interrupt(" + hex(next, 4) + ", 0xfffe, true);";
+
+    default:
+        throw std::logic_error( std::string("Can't translate ") + Opcodes::name(instruction.opcode) );
+    }
+}
+
+static void write_program(std::ostream &out, const Options &options, const Image &image, const CodeMap &map,
+        Addr first, Addr last, const std::string &source)
+{
+    out<<"// Generated by recompile from "<<source<<". Do not edit.\n\n"
+            "#include \"aot.h\"\n\n"
+            "#include <iterator>\n\n"
+            "namespace {\n\n"
+            "using C = AotContext;\n";
+
+    for( const auto &[start, block] : map.blocks() ) {
+        out<<"\nAddr block_"<<hex(start, 4)<<"(AotContext &c) {\n";
+
+        unsigned cycles = 0;
+        for( Addr address : block.instructions )
+            cycles += Opcodes::nmosCycles(image[address]);
+        out<<"    c.cycles += "<<cycles<<";\n";
+
+        for( Addr address : block.instructions ) {
+            Instruction instruction = decode(image, address);
+            char buffer[32];
+            snprintf(buffer, sizeof(buffer), "%04X  ", address);
+
+            out<<"    // "<<buffer<<format(instruction)<<"\n"
+                    "    c.fetch("<<hex(address, 4)<<");\n";
+            std::string code = translate(instruction);
+            if( !code.empty() )
+                out<<"    "<<code<<"\n";
+        }
+
+        // Blocks that don't end in a jump or return go on to the next instruction
+        Instruction last_instruction = decode(image, block.instructions.back());
+        switch( last_instruction.flow() ) {
+        case Opcodes::Flow::Next:
+        case Opcodes::Flow::Branch:
+            out<<"    return "<<hex( Addr(block.end), 4 )<<";\n";
+            break;
+        default:
+            break;
+        }
+        out<<"}\n";
+    }
+
+    out<<"\nconst AotBlock blocks[] = {\n";
+    for( const auto &[start, block] : map.blocks() )
+        out<<"    { "<<hex(start, 4)<<", "<<hex(block.end, 4)<<", block_"<<hex(start, 4)<<" },\n";
+    out<<"};\n\n"
+            "} // namespace\n\n";
+
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "0x%016llxull", (unsigned long long)AotProgram::hash(&image[first], last - first + 1));
+    out<<"extern const AotProgram "<<options.name<<" = { \""<<options.name<<"\", "<<hex(first, 4)<<", "<<hex(last, 4)<<", "<<
+            buffer<<", blocks, std::size(blocks) };\n";
+}
+
+// Entry points in hex, separated by white space, such as apple1 -m writes
+static bool read_entries(const char *path, std::vector<Addr> &entries) {
+    std::ifstream in(path);
+    if( !in )
+        return false;
+
+    std::string word;
+    while( in>>word )
+        entries.push_back( strtoul(word.c_str(), nullptr, 16) );
+
+    return in.eof();
+}
+
+static void usage(const char *name) {
+    std::cerr<<"Usage: "<<name<<" [-l load_address] [-e entry]... [-E entries] [-n name] [-o output.cpp] rom.bin\n"
+            "  -l    Where the image goes in memory, in hex (default: so that it ends at FFFF)\n"
+            "  -e    Entry point, in hex; may be repeated. Defaults to the vectors at FFFA-FFFF\n"
+            "  -E    File of more entry points, such as the ones code reaches through tables\n"
+            "  -n    Name of the AotProgram to define (default: the ROM file's name)\n"
+            "  -o    Write the translation unit here rather than to stdout\n";
+    exit(2);
+}
+
+int main(int argc, char *argv[]) {
+    Options options;
+
+    int opt;
+    while( (opt = getopt(argc, argv, "l:e:E:n:o:")) != -1 ) {
+        switch( opt ) {
+        case 'l': options.load_address = strtoul(optarg, nullptr, 16); break;
+        case 'e': options.entries.push_back( strtoul(optarg, nullptr, 16) ); break;
+        case 'E': options.entries_file = optarg; break;
+        case 'n': options.name = optarg; break;
+        case 'o': options.output = optarg; break;
+        default: usage(argv[0]);
+        }
+    }
+
+    if( argc-optind != 1 )
+        usage(argv[0]);
+
+    if( options.entries_file && !read_entries(options.entries_file, options.entries) ) {
+        std::cerr<<"Failed reading entry points from "<<options.entries_file<<"\n";
+        return 2;
+    }
+
+    std::filesystem::path source(argv[optind]);
+    if( options.name.empty() )
+        options.name = source.stem().string();
+
+    std::ifstream rom(source, std::ios::binary);
+    std::vector<char> contents( std::istreambuf_iterator<char>(rom), std::istreambuf_iterator<char>{} );
+    if( contents.empty() || contents.size()>65536 ) {
+        std::cerr<<"Failed reading a ROM of 1 to 65536 bytes from "<<source.string()<<"\n";
+        return 2;
+    }
+
+    Addr first = options.load_address.value_or( 65536 - contents.size() );
+    if( first + contents.size() > 65536 )
+        usage(argv[0]);
+    Addr last = first + contents.size() - 1;
+
+    Image image{};
+    std::copy( contents.begin(), contents.end(), &image[first] );
+
+    CodeMap map(image, first, last);
+    if( options.entries.empty() ) {
+        if( last!=0xffff ) {
+            std::cerr<<"The image doesn't hold the vectors, so entry points have to be given with -e\n";
+            return 2;
+        }
+        map.addVectors();
+    }
+    for( Addr entry : options.entries )
+        map.addEntry(entry);
+    map.analyse();
+
+    if( options.output ) {
+        std::ofstream out(options.output);
+        write_program(out, options, image, map, first, last, source.filename().string());
+        if( !out ) {
+            std::cerr<<"Failed writing "<<options.output<<"\n";
+            return 1;
+        }
+    } else {
+        write_program(std::cout, options, image, map, first, last, source.filename().string());
+    }
+
+    std::cerr<<"Translated "<<map.blocks().size()<<" blocks of "<<options.name<<"\n";
+
+    return 0;
+}
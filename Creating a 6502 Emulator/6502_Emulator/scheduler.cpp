@@ -0,0 +1,44 @@
+#include "scheduler.h"
+
+#include <algorithm>
+
+void Scheduler::schedule(Event &event, uint64_t when) {
+    if( !event.scheduled() )
+        events_.push_back(&event);
+
+    event.when_ = when;
+    next_ = std::min(next_, when);
+}
+
+void Scheduler::cancel(Event &event) {
+    if( !event.scheduled() )
+        return;
+
+    event.when_ = Never;
+    events_.erase( std::find(events_.begin(), events_.end(), &event) );
+    updateNext();
+}
+
+void Scheduler::dispatch() {
+    // Actions may schedule or cancel events, including the one running
+    for( size_t i=0; i<events_.size(); ) {
+        Event *event = events_[i];
+        if( event->when_>now_ ) {
+            ++i;
+            continue;
+        }
+
+        event->when_ = Never;
+        events_.erase( events_.begin() + i );
+        event->action_();
+        i = 0;
+    }
+
+    updateNext();
+}
+
+void Scheduler::updateNext() {
+    next_ = Never;
+    for( const Event *event : events_ )
+        next_ = std::min(next_, event->when_);
+}
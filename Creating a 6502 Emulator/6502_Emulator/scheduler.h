@@ -0,0 +1,53 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include <stdint.h>
+
+// Cycle count shared by a machine's devices, and events timed against it.
+//
+// The bus calls tick() once per cycle; that is a single compare unless an event is due. Devices compute
+// their state from now() when accessed, and schedule events only for things that must happen on their
+// own, such as a timer raising an interrupt.
+class Scheduler {
+public:
+    static constexpr uint64_t Never = UINT64_MAX;
+
+    // Owned by the device. Must not be destroyed while scheduled.
+    class Event {
+        friend class Scheduler;
+
+        uint64_t when_ = Never;
+        std::function<void ()> action_;
+
+    public:
+        explicit Event(std::function<void ()> action) : action_(std::move(action)) {}
+
+        bool scheduled() const { return when_!=Never; }
+        uint64_t when() const { return when_; }
+    };
+
+private:
+    uint64_t now_ = 0;
+    uint64_t next_ = Never;
+    // Only a handful per machine, so a plain list beats a heap
+    std::vector<Event *> events_;
+
+public:
+    void tick() {
+        if( ++now_>=next_ )
+            dispatch();
+    }
+
+    uint64_t now() const { return now_; }
+
+    // Runs the event's action at the given cycle, replacing any time it was already scheduled for. A
+    // cycle that has already passed runs on the next tick.
+    void schedule(Event &event, uint64_t when);
+    void cancel(Event &event);
+
+private:
+    void dispatch();
+    void updateNext();
+};
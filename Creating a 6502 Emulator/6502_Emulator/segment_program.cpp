@@ -0,0 +1,197 @@
+// Splits a test program into segments verify_cpu -m can check independently, and in parallel. Each label
+// that starts with the prefix (test_ by default) begins a segment. The reference CPU runs the whole
+// program against its plan once, and the registers, memory and plan position at the first fetch from each
+// of those labels go in the manifest.
+
+#include "assembler.h"
+#include "cpu_backend.h"
+#include "test_bus.h"
+
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <unordered_set>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+struct Options {
+    const char *backend_name = "c6502";
+    Assembler::Variant variant = Assembler::Variant::Nmos;
+    std::vector< std::pair<std::string, int32_t> > defines;
+    std::string prefix = "test_";
+    const char *output = nullptr;
+};
+
+class SegmentError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+static void usage(const char *name) {
+    std::cerr<<"Usage: "<<name<<" [-b backend] [-c] [-D name[=value]]... [-p prefix] [-o manifest] "
+            "source.s memory_image test_plan\n"
+            "  -b    Reference CPU to run the program on: c6502 (default) or netlist\n"
+            "  -c    Assemble for the 65C02, with the WDC additions\n"
+            "  -D    Define a symbol, as 1 if no value is given\n"
+            "  -p    Prefix of the labels that start segments (default: test_)\n"
+            "  -o    Where to write the manifest (default: stdout)\n"
+            "memory_image has to be what source.s assembles to with these options.\n";
+    exit(2);
+}
+
+// Entry points by address, from the labels with the prefix
+static std::map<Addr, std::string> find_entries(const Options &options, const char *source_name,
+        const MemoryImage &image)
+{
+    std::ifstream file(source_name);
+    if( !file )
+        throw SegmentError( std::string("Failed opening ") + source_name );
+    std::string source( std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>{} );
+
+    Assembler assembler(options.variant);
+    for( const auto &[name, value] : options.defines )
+        assembler.define(name, value);
+
+    Program program;
+    try {
+        assembler.assemble(source, program);
+    } catch( AssemblyError &ex ) {
+        throw SegmentError( std::string(source_name) + ":" + std::to_string(ex.line()) + ": " + ex.what() );
+    }
+
+    for( uint32_t address = 0; address<image.size(); ++address ) {
+        if( program.memory[address]!=image[address] ) {
+            char buffer[16];
+            snprintf(buffer, sizeof(buffer), "$%04x", address);
+            throw SegmentError( std::string("The memory image differs from ") + source_name +
+                    " assembled with these options at " + buffer );
+        }
+    }
+
+    std::map<Addr, std::string> entries;
+    for( const auto &[name, value] : program.symbols ) {
+        if( !name.starts_with(options.prefix) || value<0 || value>0xffff )
+            continue;
+
+        auto [iter, added] = entries.try_emplace( Addr(value), name );
+        if( !added )
+            throw SegmentError( name + " and " + iter->second + " start at the same address" );
+    }
+
+    return entries;
+}
+
+static std::vector<Segment> find_segments(const Options &options, const MemoryImage &image,
+        const TestPlan &plan, const std::map<Addr, std::string> &entries)
+{
+    std::vector<Segment> segments{ Segment{ .name = "reset", .first_cycle = 0 } };
+    std::unordered_set<Addr> reached;
+
+    TestBus bus;
+    std::unique_ptr<CpuBackend> backend = makeCpuBackend(options.backend_name, bus);
+    if( !backend || !backend->registers() )
+        throw SegmentError( std::string("The reference CPU has to be c6502 or netlist, not ") + options.backend_name );
+
+    bus.on_fetch = [&](Addr address) {
+        auto entry = entries.find(address);
+        if( entry==entries.end() || !reached.insert(address).second )
+            return;
+
+        // Whatever the I/O registers scheduled would be lost by starting here
+        if( bus.signalsPending() )
+            throw SegmentError( entry->second + " is reached with signal changes still scheduled, so it can't start a segment" );
+
+        Segment &segment = segments.emplace_back( Segment{ .name = entry->second, .first_cycle = bus.planPosition() } );
+        segment.resume = ResumePoint{ .entry = address, .registers = *backend->registers(), .cycle = bus.cycleNumber() };
+        for( uint32_t i = 0; i<image.size(); ++i ) {
+            if( bus.memory()[i]!=image[i] )
+                segment.memory.emplace_back( Addr(i), bus.memory()[i] );
+        }
+    };
+
+    bus.start(image, &plan, *backend);
+    backend->setReset(true);
+
+    try {
+        while( true )
+            backend->run(1000000);
+    } catch(TestDone ex) {
+    } catch(const PlanMismatch &ex) {
+        throw SegmentError( std::string("The reference CPU fails the test plan: ") + ex.what() );
+    }
+
+    for( size_t i = 0; i<segments.size(); ++i ) {
+        size_t end = i+1<segments.size() ? segments[i+1].first_cycle : bus.planPosition();
+        segments[i].num_cycles = end - segments[i].first_cycle;
+    }
+
+    for( const auto &[address, name] : entries ) {
+        if( !reached.count(address) )
+            std::cerr<<"Warning: "<<name<<" is never reached, so it doesn't start a segment\n";
+    }
+
+    return segments;
+}
+
+int main(int argc, char *argv[]) {
+    Options options;
+
+    int opt;
+    while( (opt = getopt(argc, argv, "b:cD:p:o:")) != -1 ) {
+        switch( opt ) {
+        case 'b': options.backend_name = optarg; break;
+        case 'c': options.variant = Assembler::Variant::Cmos; break;
+        case 'D': {
+            const char *equals = strchr(optarg, '=');
+            if( equals )
+                options.defines.emplace_back( std::string(optarg, equals-optarg), strtol(equals+1, nullptr, 0) );
+            else
+                options.defines.emplace_back( optarg, 1 );
+            break;
+        }
+        case 'p': options.prefix = optarg; break;
+        case 'o': options.output = optarg; break;
+        default: usage(argv[0]);
+        }
+    }
+
+    if( argc-optind != 3 )
+        usage(argv[0]);
+    const char *source_name = argv[optind], *image_name = argv[optind+1], *plan_name = argv[optind+2];
+
+    std::vector<Segment> segments;
+    try {
+        MemoryImage image = readMemoryImage(image_name);
+        TestPlan plan = readTestPlan(plan_name);
+
+        segments = find_segments( options, image, plan, find_entries(options, source_name, image) );
+    } catch( SegmentError &ex ) {
+        std::cerr<<ex.what()<<"\n";
+        return 1;
+    }
+
+    std::ofstream file;
+    if( options.output )
+        file.open(options.output);
+    std::ostream &out = options.output ? file : std::cout;
+
+    out<<"# Segments of "<<image_name<<", from "<<plan_name<<" on "<<options.backend_name<<"\n";
+    writeSegments(out, segments);
+    if( !out.flush() ) {
+        std::cerr<<"Failed writing "<<options.output<<"\n";
+        return 2;
+    }
+
+    size_t longest = 0;
+    for( const Segment &segment : segments )
+        longest = std::max( longest, segment.num_cycles );
+    std::cerr<<segments.size()<<" segments, longest "<<longest<<" of "<<segments.back().first_cycle+segments.back().num_cycles<<
+            " cycles\n";
+
+    return 0;
+}
@@ -0,0 +1,559 @@
+// Signal timing sweep: reruns a segment of a test program with one input signal pulsed at every
+// (offset, width) combination in a range, and reports which combinations make c6502 diverge from the
+// perfect6502 netlist or from previously recorded golden traces.
+//
+// Each combination starts from a snapshot taken when the segment's first instruction is fetched, so
+// only the segment itself is ever rerun.
+
+#include "readmem.h"
+
+#include "Bus.h"
+#include "c6502.h"
+#include "netlist_cpu.h"
+
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+using Image = std::array<uint8_t, 65536>;
+
+static constexpr size_t MaxResetCycles = 50;
+static constexpr size_t MaxApproachCycles = 50'000'000;
+
+enum class Signal { Irq, Nmi, Reset, Ready, So, Count };
+static constexpr const char *SignalNames[] = { "irq", "nmi", "reset", "ready", "so" };
+
+template<typename Cpu>
+static void set_signal(Cpu &cpu, Signal signal, bool state) {
+    switch( signal ) {
+    case Signal::Irq:   cpu.setIrq(state);    break;
+    case Signal::Nmi:   cpu.setNmi(state);    break;
+    case Signal::Reset: cpu.setReset(state);  break;
+    case Signal::Ready: cpu.setReady(state);  break;
+    case Signal::So:    cpu.setSo(state);     break;
+    case Signal::Count: break;
+    }
+}
+
+// Pending pin changes, keyed by cycle
+class PinSchedule {
+    std::multimap< size_t, std::pair<Signal, bool> > changes;
+    std::array< uint8_t, size_t(Signal::Count) > widths{};
+
+public:
+    void pulse(Signal signal, size_t start, size_t width) {
+        changes.emplace( start, std::pair(signal, true) );
+        changes.emplace( start + width, std::pair(signal, false) );
+    }
+
+    // The test program's own 0x02xx trigger registers, as simulate_mos interprets them
+    void ioWrite(Addr address, uint8_t value, size_t cycle) {
+        switch( address ) {
+        case 0x280: widths[size_t(Signal::Ready)] = value; break;
+        case 0x281: pulse( Signal::Ready, cycle+value, widths[size_t(Signal::Ready)] ); break;
+        case 0x282: widths[size_t(Signal::So)] = value; break;
+        case 0x283: pulse( Signal::So, cycle+value, widths[size_t(Signal::So)] ); break;
+        case 0x2fa: widths[size_t(Signal::Nmi)] = value; break;
+        case 0x2fb: pulse( Signal::Nmi, cycle+value, widths[size_t(Signal::Nmi)] ); break;
+        case 0x2fc: widths[size_t(Signal::Reset)] = value; break;
+        case 0x2fd: pulse( Signal::Reset, cycle+value, widths[size_t(Signal::Reset)] ); break;
+        case 0x2fe: widths[size_t(Signal::Irq)] = value; break;
+        case 0x2ff: pulse( Signal::Irq, cycle+value, widths[size_t(Signal::Irq)] ); break;
+        }
+    }
+
+    template<typename Cpu>
+    void apply(size_t cycle, Cpu &cpu) {
+        while( !changes.empty() && changes.begin()->first<=cycle ) {
+            set_signal( cpu, changes.begin()->second.first, changes.begin()->second.second );
+            changes.erase( changes.begin() );
+        }
+    }
+
+    // Returns the changes still pending at origin, with origin becoming cycle 0
+    PinSchedule rebased(size_t origin) const {
+        PinSchedule result;
+        result.widths = widths;
+        for( auto iter = changes.lower_bound(origin); iter!=changes.end(); ++iter )
+            result.changes.emplace( iter->first - origin, iter->second );
+
+        return result;
+    }
+};
+
+struct Options {
+    size_t num_threads = std::thread::hardware_concurrency();
+    std::optional<Addr> end;
+    size_t max_cycles = 200;
+    size_t first_offset = 0, last_offset = 20;
+    size_t first_width = 1, last_width = 1;
+    std::optional<std::filesystem::path> record_dir, golden_dir;
+
+    std::filesystem::path program;
+    Addr start;
+    Signal signal;
+};
+
+struct Snapshot {
+    c6502::State cpu_state;
+    Image cpu_memory;
+    PinSchedule cpu_pins;
+    size_t cpu_cycles;
+
+    NetlistCpu::Snapshot netlist;
+    PinSchedule netlist_pins;
+    size_t netlist_cycles;
+};
+
+struct Divergence {
+    size_t cycle;
+    NetlistCpu::BusCycle expected, actual;
+};
+
+struct CellResult {
+    std::optional<Divergence> divergence;
+    std::string error;
+};
+
+class CaseDone {};
+class SegmentReached {};
+
+class Diverged {
+public:
+    Divergence divergence;
+};
+
+// Runs c6502 from reset up to the segment's first opcode fetch
+class ApproachBus : public Bus {
+    Image               &memory;
+    PinSchedule         &pins;
+    Addr                start;
+    size_t              reset_reads = 0;
+    bool                started = false;
+
+public:
+    size_t              cycle_num = 0;
+
+    ApproachBus(Image &memory, PinSchedule &pins, Addr start) : memory(memory), pins(pins), start(start) {}
+
+    virtual uint8_t read( c6502 *cpu, Addr address, bool sync = false ) override {
+        if( !started ) {
+            ++reset_reads;
+            if( reset_reads==3 )
+                cpu->setReset(false);
+
+            if( reset_reads>3 && address==0xfffc ) {
+                started = true;
+            } else {
+                if( reset_reads>MaxResetCycles )
+                    throw std::runtime_error("c6502 failed to read the reset vector");
+
+                return memory[address];
+            }
+        }
+
+        if( sync && address==start )
+            throw SegmentReached();
+
+        tick(cpu);
+
+        return memory[address];
+    }
+
+    virtual void write( c6502 *cpu, Addr address, uint8_t value ) override {
+        size_t cycle = tick(cpu);
+
+        memory[address] = value;
+
+        if( (address>>8) == 0x02 ) {
+            if( address==0x200 )
+                throw std::runtime_error("c6502 finished the program before reaching the segment");
+
+            pins.ioWrite(address, value, cycle);
+        }
+    }
+
+private:
+    size_t tick(c6502 *cpu) {
+        pins.apply(cycle_num, *cpu);
+
+        if( cycle_num>=MaxApproachCycles )
+            throw std::runtime_error("c6502 did not reach the segment");
+
+        return cycle_num++;
+    }
+};
+
+// Runs c6502 over one sweep cell, comparing each cycle against the reference trace
+class CellBus : public Bus {
+    Image                                       memory;
+    const std::vector<NetlistCpu::BusCycle>     &reference;
+    PinSchedule                                 pins;
+    size_t                                      cycle_num = 0;
+
+public:
+    CellBus(const Image &memory, const std::vector<NetlistCpu::BusCycle> &reference, const PinSchedule &pins) :
+        memory(memory), reference(reference), pins(pins)
+    {}
+
+    virtual uint8_t read( c6502 *cpu, Addr address, bool sync = false ) override {
+        uint8_t ret = memory[address];
+        access( cpu, NetlistCpu::BusCycle{ .address = address, .data = ret, .read = true, .sync = sync } );
+
+        return ret;
+    }
+
+    virtual void write( c6502 *cpu, Addr address, uint8_t value ) override {
+        size_t cycle = access( cpu, NetlistCpu::BusCycle{ .address = address, .data = value, .read = false, .sync = false } );
+
+        memory[address] = value;
+
+        if( (address>>8) == 0x02 )
+            pins.ioWrite(address, value, cycle);
+    }
+
+private:
+    size_t access( c6502 *cpu, NetlistCpu::BusCycle actual ) {
+        if( cycle_num>=reference.size() )
+            throw CaseDone();
+
+        pins.apply(cycle_num, *cpu);
+
+        const auto &expected = reference[cycle_num];
+        if( expected!=actual && !cpu->isIncompatible() )
+            throw Diverged{ Divergence{ cycle_num, expected, actual } };
+
+        return cycle_num++;
+    }
+};
+
+static std::ostream &operator<<(std::ostream &out, const NetlistCpu::BusCycle &bus) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%c %04x %02x%s", bus.read ? 'R' : 'W', bus.address, bus.data, bus.sync ? " sync" : "");
+
+    return out<<buffer;
+}
+
+static Image load_program(const std::filesystem::path &path) {
+    Image image{};
+    ReadMem<8> memory_image(path);
+
+    while( memory_image.read_line() ) {
+        image[memory_image.address()] = memory_image[0];
+    }
+
+    return image;
+}
+
+static void approach_c6502(const Options &options, const Image &image, Snapshot &snapshot) {
+    snapshot.cpu_memory = image;
+    PinSchedule pins;
+    ApproachBus bus(snapshot.cpu_memory, pins, options.start);
+    c6502 cpu(bus);
+    cpu.setSignalLogging(false);
+    cpu.setReset(true);
+
+    try {
+        cpu.runCpu();
+    } catch( SegmentReached ex ) {
+    }
+
+    snapshot.cpu_state = cpu.getState();
+    snapshot.cpu_pins = pins.rebased(bus.cycle_num);
+    snapshot.cpu_cycles = bus.cycle_num;
+}
+
+static void approach_netlist(const Options &options, const Image &image, Snapshot &snapshot) {
+    NetlistCpu cpu;
+    PinSchedule pins;
+
+    cpu.memory = image;
+    if( !cpu.reset() )
+        throw std::runtime_error("Netlist failed to read the reset vector");
+
+    for( size_t cycle_num = 1; ; ++cycle_num ) {
+        if( cycle_num>=MaxApproachCycles )
+            throw std::runtime_error("Netlist did not reach the segment");
+
+        cpu.save(snapshot.netlist, false);
+        pins.apply(cycle_num, cpu);
+
+        auto bus = cpu.cycle();
+        if( bus.sync && bus.address==options.start ) {
+            // An opcode fetch doesn't modify memory, so it is still as it was when the nodes were saved
+            snapshot.netlist.memory = cpu.memory;
+            snapshot.netlist_pins = pins.rebased(cycle_num);
+            snapshot.netlist_cycles = cycle_num;
+
+            return;
+        }
+
+        if( !bus.read && (bus.address>>8) == 0x02 ) {
+            if( bus.address==0x200 )
+                throw std::runtime_error("Netlist finished the program before reaching the segment");
+
+            pins.ioWrite(bus.address, bus.data, cycle_num);
+        }
+    }
+}
+
+static std::vector<NetlistCpu::BusCycle> run_netlist_cell(
+        const Options &options, NetlistCpu &cpu, const Snapshot &snapshot, size_t offset, size_t width)
+{
+    std::vector<NetlistCpu::BusCycle> trace;
+    PinSchedule pins = snapshot.netlist_pins;
+    pins.pulse(options.signal, offset, width);
+
+    cpu.restore(snapshot.netlist);
+
+    for( size_t cycle_num = 0; cycle_num<options.max_cycles; ++cycle_num ) {
+        pins.apply(cycle_num, cpu);
+
+        auto bus = cpu.cycle();
+        trace.push_back(bus);
+
+        if( !bus.read && (bus.address>>8) == 0x02 ) {
+            if( bus.address==0x200 )
+                break;
+
+            pins.ioWrite(bus.address, bus.data, cycle_num);
+        }
+
+        if( cycle_num>0 && bus.sync && options.end && bus.address==*options.end )
+            break;
+    }
+
+    return trace;
+}
+
+static std::optional<Divergence> run_cpu_cell(
+        const Options &options, const Snapshot &snapshot, const std::vector<NetlistCpu::BusCycle> &reference,
+        size_t offset, size_t width)
+{
+    PinSchedule pins = snapshot.cpu_pins;
+    pins.pulse(options.signal, offset, width);
+
+    CellBus bus(snapshot.cpu_memory, reference, pins);
+    c6502 cpu(bus);
+    cpu.setSignalLogging(false);
+    cpu.setState(snapshot.cpu_state);
+
+    try {
+        cpu.runCpu();
+    } catch( CaseDone ex ) {
+    } catch( Diverged &ex ) {
+        return ex.divergence;
+    }
+
+    return std::nullopt;
+}
+
+static std::filesystem::path golden_path(const std::filesystem::path &dir, const Options &options, size_t offset, size_t width) {
+    return dir / ( std::string(SignalNames[size_t(options.signal)]) + "_" + std::to_string(offset) + "_" +
+            std::to_string(width) + ".mem" );
+}
+
+// Golden traces use the test plan line format, with bit 1 of the flags marking SYNC
+static void write_golden(const std::filesystem::path &path, const std::vector<NetlistCpu::BusCycle> &trace) {
+    std::ofstream out(path);
+    char buffer[32];
+
+    for( const auto &bus : trace ) {
+        snprintf(buffer, sizeof(buffer), "1_%04x_%02x_%02x\n", bus.address, bus.data, (bus.sync ? 0x02 : 0) | (bus.read ? 0x01 : 0));
+        out<<buffer;
+    }
+
+    if( !out )
+        throw std::runtime_error("Failed to write " + path.string());
+}
+
+static std::vector<NetlistCpu::BusCycle> read_golden(const std::filesystem::path &path) {
+    std::vector<NetlistCpu::BusCycle> trace;
+    ReadMem<8,8,16,4> golden(path);
+
+    while( golden.read_line() ) {
+        trace.push_back( NetlistCpu::BusCycle{
+                .address = Addr( golden[2] ),
+                .data = uint8_t( golden[1] ),
+                .read = bool( golden[0] & 0x01 ),
+                .sync = bool( golden[0] & 0x02 ) } );
+    }
+
+    return trace;
+}
+
+static void report(const Options &options, const std::vector<CellResult> &results) {
+    size_t num_offsets = options.last_offset - options.first_offset + 1;
+
+    std::cout<<"\n        offset "<<options.first_offset<<"-"<<options.last_offset<<"\nwidth   ";
+    for( size_t offset = options.first_offset; offset<=options.last_offset; ++offset )
+        std::cout<<( offset%10==0 ? char('0' + offset/10%10) : ' ' );
+    std::cout<<"\n        ";
+    for( size_t offset = options.first_offset; offset<=options.last_offset; ++offset )
+        std::cout<<char('0' + offset%10);
+    std::cout<<"\n";
+
+    size_t diverged = 0;
+    for( size_t width = options.first_width; width<=options.last_width; ++width ) {
+        char buffer[16];
+        snprintf(buffer, sizeof(buffer), "%5zu   ", width);
+        std::cout<<buffer;
+
+        for( size_t offset = options.first_offset; offset<=options.last_offset; ++offset ) {
+            const auto &result = results[ (width-options.first_width)*num_offsets + offset-options.first_offset ];
+            if( !result.error.empty() ) {
+                std::cout<<'E';
+            } else if( result.divergence ) {
+                std::cout<<'X';
+                diverged++;
+            } else {
+                std::cout<<'.';
+            }
+        }
+        std::cout<<"\n";
+    }
+
+    std::cout<<"\n"<<diverged<<" of "<<results.size()<<" cells diverged\n";
+
+    for( size_t i = 0; i<results.size(); ++i ) {
+        const auto &result = results[i];
+        size_t offset = options.first_offset + i%num_offsets, width = options.first_width + i/num_offsets;
+
+        if( !result.error.empty() ) {
+            std::cout<<"offset "<<offset<<" width "<<width<<": "<<result.error<<"\n";
+        } else if( result.divergence ) {
+            std::cout<<"offset "<<offset<<" width "<<width<<": cycle "<<result.divergence->cycle<<
+                    " expected "<<result.divergence->expected<<", c6502 "<<result.divergence->actual<<"\n";
+        }
+    }
+}
+
+static bool parse_range(const char *arg, size_t &first, size_t &last) {
+    char *end;
+    first = last = strtoul(arg, &end, 0);
+    if( *end==':' )
+        last = strtoul(end+1, &end, 0);
+
+    return *end=='\0' && first<=last;
+}
+
+static void usage(const char *name) {
+    std::cerr<<"Usage: "<<name<<" [-j threads] [-o first[:last]] [-w first[:last]] [-e end_address]"
+            " [-c max_cycles] [-r record_dir | -g golden_dir] program.mem start_address signal\n"
+            "  signal is one of irq, nmi, reset, ready, so\n"
+            "  -o    Cycle offsets, counted from the segment's first opcode fetch\n"
+            "  -w    Pulse widths in cycles\n"
+            "  -r    Record the netlist traces as golden traces into the directory\n"
+            "  -g    Compare against golden traces from the directory instead of running the netlist\n";
+    exit(2);
+}
+
+int main(int argc, char *argv[]) {
+    Options options;
+
+    int opt;
+    while( (opt = getopt(argc, argv, "j:o:w:e:c:r:g:")) != -1 ) {
+        switch( opt ) {
+        case 'j': options.num_threads = strtoul(optarg, nullptr, 0); break;
+        case 'o': if( !parse_range(optarg, options.first_offset, options.last_offset) ) usage(argv[0]); break;
+        case 'w': if( !parse_range(optarg, options.first_width, options.last_width) ) usage(argv[0]); break;
+        case 'e': options.end = strtoul(optarg, nullptr, 16); break;
+        case 'c': options.max_cycles = strtoul(optarg, nullptr, 0); break;
+        case 'r': options.record_dir = optarg; break;
+        case 'g': options.golden_dir = optarg; break;
+        default: usage(argv[0]);
+        }
+    }
+
+    if( argc-optind != 3 || (options.record_dir && options.golden_dir) )
+        usage(argv[0]);
+
+    options.program = argv[optind];
+    options.start = strtoul(argv[optind+1], nullptr, 16);
+
+    size_t signal = 0;
+    while( signal<size_t(Signal::Count) && strcmp(SignalNames[signal], argv[optind+2])!=0 )
+        ++signal;
+    if( signal==size_t(Signal::Count) )
+        usage(argv[0]);
+    options.signal = Signal(signal);
+
+    if( options.num_threads==0 )
+        options.num_threads = 1;
+
+    Image image = load_program(options.program);
+    Snapshot snapshot;
+
+    approach_c6502(options, image, snapshot);
+    std::cout<<"c6502 reached the segment after "<<snapshot.cpu_cycles<<" cycles\n";
+
+    bool use_netlist = !options.golden_dir;
+    if( use_netlist ) {
+        approach_netlist(options, image, snapshot);
+        std::cout<<"Netlist reached the segment after "<<snapshot.netlist_cycles<<" cycles\n";
+
+        if( snapshot.netlist_cycles!=snapshot.cpu_cycles )
+            std::cout<<"Warning: c6502 and the netlist disagree on when the segment starts\n";
+    }
+
+    if( options.record_dir )
+        std::filesystem::create_directories(*options.record_dir);
+
+    size_t num_offsets = options.last_offset - options.first_offset + 1;
+    size_t num_cells = num_offsets * (options.last_width - options.first_width + 1);
+    std::vector<CellResult> results(num_cells);
+    std::atomic<size_t> next_cell = 0;
+
+    auto worker = [&]() {
+        std::unique_ptr<NetlistCpu> netlist;
+        if( use_netlist )
+            netlist = std::make_unique<NetlistCpu>();
+
+        for( size_t cell = next_cell++; cell<num_cells; cell = next_cell++ ) {
+            size_t offset = options.first_offset + cell%num_offsets;
+            size_t width = options.first_width + cell/num_offsets;
+
+            try {
+                std::vector<NetlistCpu::BusCycle> reference;
+                if( use_netlist ) {
+                    reference = run_netlist_cell(options, *netlist, snapshot, offset, width);
+                    if( options.record_dir )
+                        write_golden( golden_path(*options.record_dir, options, offset, width), reference );
+                } else {
+                    reference = read_golden( golden_path(*options.golden_dir, options, offset, width) );
+                }
+
+                results[cell].divergence = run_cpu_cell(options, snapshot, reference, offset, width);
+            } catch( std::exception &ex ) {
+                results[cell].error = ex.what();
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for( size_t i=0; i<options.num_threads; ++i )
+        threads.emplace_back(worker);
+    for( auto &thread : threads )
+        thread.join();
+
+    report(options, results);
+
+    for( const auto &result : results ) {
+        if( result.divergence || !result.error.empty() )
+            return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,402 @@
+#include "test_bus.h"
+
+#include "readmem.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include <stdio.h>
+
+MemoryImage readMemoryImage(const std::filesystem::path &path) {
+    MemoryImage memory{};
+    ReadMem<8> memory_image(path);
+
+    while( memory_image.read_line() ) {
+        memory[memory_image.address()] = memory_image[0];
+    }
+
+    return memory;
+}
+
+std::vector<Segment> readSegments(const std::filesystem::path &path) {
+    std::ifstream file(path);
+    if( !file )
+        throw std::runtime_error("Failed opening segment manifest " + path.string());
+
+    std::vector<Segment> segments;
+    std::string line;
+    size_t line_number = 0;
+    while( std::getline(file, line) ) {
+        line_number++;
+
+        std::istringstream fields(line);
+        std::string kind;
+        if( !(fields>>kind) || kind[0]=='#' )
+            continue;
+
+        auto malformed = [&] {
+            return std::runtime_error( "Malformed segment manifest " + path.string() + " line " +
+                    std::to_string(line_number) );
+        };
+        if( kind!="segment" && segments.empty() )
+            throw malformed();
+
+        if( kind=="segment" ) {
+            Segment &segment = segments.emplace_back();
+            if( !(fields>>segment.name>>segment.first_cycle>>segment.num_cycles) )
+                throw malformed();
+        } else if( kind=="resume" ) {
+            unsigned entry, a, x, y, sp, status;
+            size_t cycle;
+            if( !(fields>>std::hex>>entry>>std::dec>>cycle>>std::hex>>a>>x>>y>>sp>>status) )
+                throw malformed();
+
+            segments.back().resume = ResumePoint{ .entry = Addr(entry), .registers = CpuBackend::Registers{
+                    .regA = uint8_t(a), .regX = uint8_t(x), .regY = uint8_t(y), .regSp = uint8_t(sp),
+                    .regStatus = uint8_t(status), .pc = Addr(entry) }, .cycle = cycle };
+        } else if( kind=="memory" ) {
+            unsigned address, value;
+            if( !(fields>>std::hex>>address) )
+                throw malformed();
+            while( fields>>value )
+                segments.back().memory.emplace_back( Addr(address++), uint8_t(value) );
+            if( !fields.eof() )
+                throw malformed();
+        } else {
+            throw malformed();
+        }
+    }
+
+    return segments;
+}
+
+void writeSegments(std::ostream &out, const std::vector<Segment> &segments) {
+    static constexpr size_t BytesPerLine = 16;
+    char buffer[64];
+
+    for( const Segment &segment : segments ) {
+        out<<"segment "<<segment.name<<" "<<segment.first_cycle<<" "<<segment.num_cycles<<"\n";
+
+        if( const auto &resume = segment.resume ) {
+            const CpuBackend::Registers &registers = resume->registers;
+            snprintf(buffer, sizeof(buffer), "resume %04x %zu %02x %02x %02x %02x %02x\n", resume->entry, resume->cycle,
+                    registers.regA, registers.regX, registers.regY, registers.regSp, registers.regStatus);
+            out<<buffer;
+        }
+
+        // Runs of consecutive addresses share a line
+        for( size_t i = 0; i<segment.memory.size(); ) {
+            Addr address = segment.memory[i].first;
+            snprintf(buffer, sizeof(buffer), "memory %04x", address);
+            out<<buffer;
+
+            for( size_t count = 0; count<BytesPerLine && i<segment.memory.size() &&
+                    segment.memory[i].first==address+count; ++count, ++i )
+            {
+                snprintf(buffer, sizeof(buffer), " %02x", segment.memory[i].second);
+                out<<buffer;
+            }
+            out<<"\n";
+        }
+    }
+}
+
+void TestBus::start(const MemoryImage &image, const TestPlan *plan, CpuBackend &backend,
+        const ResumePoint *resume)
+{
+    memory_ = image;
+    resume_.reset();
+    preamble_cycles_ = 0;
+    if( resume ) {
+        resume_ = *resume;
+        resume_memory_ = image;
+
+        // The preamble runs from a page well away from the entry point, on a copy of memory that's swapped
+        // for the real one at the fetch from entry
+        const CpuBackend::Registers &registers = resume->registers;
+        Addr preamble = Addr( (resume->entry + 0x8000) & 0xff00 );
+        const uint8_t code[] = {
+            0xa2, registers.regSp,      // LDX #sp
+            0x9a,                       // TXS
+            0xa9, registers.regStatus,  // LDA #status
+            0x48,                       // PHA
+            0xa0, registers.regY,       // LDY #y
+            0xa2, registers.regX,       // LDX #x
+            0xa9, registers.regA,       // LDA #a
+            0x28,                       // PLP
+            0x4c, uint8_t(resume->entry & 0xff), uint8_t(resume->entry >> 8),     // JMP entry
+        };
+        std::copy( std::begin(code), std::end(code), &memory_[preamble] );
+        memory_[0xfffc] = preamble & 0xff;
+        memory_[0xfffd] = preamble >> 8;
+    }
+
+    plan_ = plan;
+    next_plan_ = 0;
+    log_.clear();
+    plan_columns_.clear();
+    if( batched && plan ) {
+        log_.reserve( plan->size() );
+        plan_columns_.reserve( plan->size() );
+        for( const PlanCycle &cycle : plan->cycles() )
+            plan_columns_.push_back(cycle.address, cycle.data, cycle.flags);
+    }
+    backend_ = &backend;
+
+    cycles_until_start_ = StartGraceCycles;
+    cpu_in_reset_ = true;
+    cycle_num_ = 0;
+    total_cycles_ = 0;
+    delayed_actions_.clear();
+    cycle_started_ = false;
+}
+
+void TestBus::schedule(size_t cycle, Signal signal) {
+    delayed_actions_.try_emplace( cycle ).first->second.emplace(signal);
+}
+
+uint8_t TestBus::read( c6502 *cpu, Addr address, bool sync ) {
+    if( !cycle_started_ )
+        performIo(true);
+    cycle_started_ = false;
+    total_cycles_++;
+
+    uint8_t ret = memory_[address];
+
+    if( cycles_until_start_>0 ) {
+        if( StartGraceCycles-cycles_until_start_ == 2 ) {
+            backend_->setReset(false);
+            cpu_in_reset_ = false;
+        }
+
+        if( address==0xfffc && !cpu_in_reset_ ) {
+            cycles_until_start_ = 0;
+            cycle_num_ = 1;
+            if( trace )
+                *trace<<"Reset vector read detected\n";
+        } else {
+            if( --cycles_until_start_ == 0 )
+                throw PlanMismatch("CPU failed to read the reset vector");
+        }
+    }
+
+    if( cycles_until_start_==0 ) {
+        if( resume_ ) {
+            if( !sync || address!=resume_->entry ) {
+                if( ++preamble_cycles_ > PreambleCycles )
+                    throw PlanMismatch("The CPU didn't reach the entry point after the preamble");
+                return ret;
+            }
+
+            memory_ = resume_memory_;
+            ret = memory_[address];
+            cycle_num_ = resume_->cycle;
+            resume_.reset();
+        }
+
+        if( sync && stop_address==address )
+            throw TestDone();
+        if( sync && on_fetch )
+            on_fetch(address);
+
+        if( trace )
+            *trace<<std::dec<<cycle_num_<<" R: "<<std::hex<<address<<" "<<int(ret)<<"\n";
+        cycle_num_++;
+
+        if( plan_ ) {
+            if( !nextPlanCycle() ) {
+                // A mismatch earlier on is what went wrong
+                checkLog();
+                throw PlanMismatch("The test plan ended before the test did");
+            }
+
+            if( batched ) {
+                log_.push_back( address, ret, BusColumns::Read | (sync ? BusColumns::Sync : 0) |
+                        (backend_->isIncompatible() ? BusColumns::Incompatible : 0) );
+            } else {
+                checkCycle( next_plan_-1, true, address, ret, backend_->isIncompatible() );
+            }
+        }
+    }
+
+    return ret;
+}
+
+void TestBus::write( c6502 *cpu, Addr address, uint8_t value ) {
+    if( !cycle_started_ )
+        performIo(true);
+    cycle_started_ = false;
+    total_cycles_++;
+
+    if( resume_ ) {
+        memory_[address] = value;
+        return;
+    }
+
+    if( trace )
+        *trace<<std::dec<<cycle_num_<<" W: "<<std::hex<<address<<" "<<int(value)<<"\n";
+    cycle_num_++;
+
+    if( plan_ && nextPlanCycle() ) {
+        if( batched )
+            log_.push_back( address, value, backend_->isIncompatible() ? BusColumns::Incompatible : 0 );
+        else
+            checkCycle( next_plan_-1, false, address, value, backend_->isIncompatible() );
+    }
+
+    memory_[address] = value;
+
+    if( (address>>8) == 0x02 ) {
+        switch( address & 0xff ) {
+        case 0x00:
+            throw TestDone();
+            break;
+        case 0x81:
+            schedule( cycle_num_+value, Signal::ReadyOn );
+            schedule( cycle_num_+value+memory_[0x280], Signal::ReadyOff );
+            break;
+        case 0x83:
+            schedule( cycle_num_+value, Signal::SoOn );
+            schedule( cycle_num_+value+memory_[0x282], Signal::SoOff );
+            break;
+        case 0xfb:
+            schedule( cycle_num_+value, Signal::NmiOn );
+            schedule( cycle_num_+value+memory_[0x2fa], Signal::NmiOff );
+            break;
+        case 0xfd:
+            schedule( cycle_num_+value, Signal::ResetOn );
+            schedule( cycle_num_+value+memory_[0x2fc], Signal::ResetOff );
+            break;
+        case 0xff:
+            schedule( cycle_num_+value, Signal::IrqOn );
+            schedule( cycle_num_+value+memory_[0x2fe], Signal::IrqOff );
+            break;
+        }
+    }
+}
+
+// The netlist samples its inputs before it gets to the read or write, so the signals due this cycle have
+// to change before it's clocked
+void TestBus::cycleStart() {
+    performIo(false);
+    cycle_started_ = true;
+}
+
+bool TestBus::nextPlanCycle() {
+    if( next_plan_==plan_->size() ) {
+        if( end_with_plan )
+            throw TestDone();
+        return false;
+    }
+
+    next_plan_++;
+    return true;
+}
+
+void TestBus::checkLog() {
+    if( !batched || !plan_ )
+        return;
+
+    for( size_t cycle = firstMismatch(log_, plan_columns_); cycle<log_.size();
+            cycle = firstMismatch(log_, plan_columns_, cycle+1) )
+    {
+        uint8_t flags = log_.flags[cycle];
+        checkCycle( cycle, flags & BusColumns::Read, log_.address[cycle], log_.data[cycle],
+                flags & BusColumns::Incompatible );
+    }
+}
+
+void TestBus::checkCycle( size_t plan_cycle, bool read, Addr address, uint8_t data, bool incompatible ) {
+    const PlanCycle &expected = (*plan_)[plan_cycle];
+
+    if( read ) {
+        check( plan_cycle, incompatible, expected.flags & 0x01, 1, "Read operation where write was expected", address, data );
+        check( plan_cycle, incompatible, expected.address, address, "Read from wrong address", address, data );
+        check( plan_cycle, incompatible, expected.data, data, "Read wrong value from memory", address, data );
+    } else {
+        check( plan_cycle, incompatible, expected.flags & 0x01, 0, "Write operation where read was expected", address, data );
+        check( plan_cycle, incompatible, expected.address, address, "Write to wrong address", address, data );
+        check( plan_cycle, incompatible, expected.data, data, "Write of wrong value to memory", address, data );
+    }
+}
+
+void TestBus::check( size_t plan_cycle, bool incompatible, unsigned expected, unsigned actual, const char *message,
+        Addr address, uint8_t data )
+{
+    if( actual==expected )
+        return;
+
+    std::ostringstream report;
+    report<<"Validation failed on plan line "<<std::dec<<plan_->line(plan_cycle)<<
+            ": "<<message<<" Expected "<<std::hex<<expected<<" got "<<actual<<
+            " @"<<address<<" data "<<int(data);
+
+    if( !incompatible )
+        throw PlanMismatch( report.str() );
+
+    if( notes )
+        *notes<<report.str()<<" known incompatibility\n";
+}
+
+// c6502 only checks READY once an access is done, repeating the access while it's set, so unless the
+// backend started the cycle with cycleStart(), READY changes are made during the access before the one
+// they're due for.
+void TestBus::performIo(bool ready_early) {
+    applySignals( cycle_num_, [&](Signal signal) { return !ready_early || !isReady(signal); } );
+    if( ready_early )
+        applySignals( cycle_num_+1, isReady );
+}
+
+bool TestBus::isReady(Signal signal) {
+    return signal==Signal::ReadyOn || signal==Signal::ReadyOff;
+}
+
+void TestBus::applySignals(size_t cycle, const std::function<bool(Signal)> &which) {
+    auto action_iter = delayed_actions_.find( cycle );
+    if( action_iter==delayed_actions_.end() )
+        return;
+
+    std::erase_if( action_iter->second, [&](Signal action) {
+        if( !which(action) )
+            return false;
+
+        switch( action ) {
+        case Signal::ReadyOn:
+            backend_->setReady(true);
+            break;
+        case Signal::ReadyOff:
+            backend_->setReady(false);
+            break;
+        case Signal::SoOn:
+            backend_->setSo(true);
+            break;
+        case Signal::SoOff:
+            backend_->setSo(false);
+            break;
+        case Signal::NmiOn:
+            backend_->setNmi(true);
+            break;
+        case Signal::NmiOff:
+            backend_->setNmi(false);
+            break;
+        case Signal::ResetOn:
+            backend_->setReset(true);
+            break;
+        case Signal::ResetOff:
+            backend_->setReset(false);
+            break;
+        case Signal::IrqOn:
+            backend_->setIrq(true);
+            break;
+        case Signal::IrqOff:
+            backend_->setIrq(false);
+            break;
+        }
+
+        return true;
+    } );
+
+    if( action_iter->second.empty() )
+        delayed_actions_.erase( action_iter );
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include "Bus.h"
+#include "bus_columns.h"
+#include "cpu_backend.h"
+#include "test_plan.h"
+
+#include <array>
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <stdint.h>
+
+// Runs a test program the way the hardware test harness does: memory from a .mem image, the I/O
+// registers at $02xx that schedule signals, and optionally a test plan every bus cycle is checked
+// against. Shared by verify_cpu and vector_service.
+
+using MemoryImage = std::array<uint8_t, 65536>;
+
+// Where a run picks up part way through a program rather than from reset. After reset, the bus feeds the
+// CPU a preamble that loads the registers and jumps to entry; the run proper, plan and trace included,
+// starts with the fetch from entry.
+struct ResumePoint {
+    Addr entry;
+    CpuBackend::Registers registers;
+    // At the fetch from entry, counted from the reset vector read as the I/O registers count cycles
+    size_t cycle;
+};
+
+// A part of a test program that can be checked on its own: a slice of the test plan, and the state the
+// program is in where the slice starts.
+struct Segment {
+    std::string name;
+    // Into the test plan, not counting wait lines
+    size_t first_cycle, num_cycles;
+    // Not set for the segment that starts at reset
+    std::optional<ResumePoint> resume;
+    // Where memory differs from the image when the segment starts
+    std::vector< std::pair<Addr, uint8_t> > memory;
+};
+
+MemoryImage readMemoryImage(const std::filesystem::path &path);
+
+// Segment manifests, as segment_program writes them
+std::vector<Segment> readSegments(const std::filesystem::path &path);
+void writeSegments(std::ostream &out, const std::vector<Segment> &segments);
+
+// Thrown when the program writes to $0200, or reaches the stop address
+class TestDone {};
+
+// Thrown when the CPU strays from the plan
+class PlanMismatch : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+class TestBus : public Bus {
+public:
+    enum class Signal {
+        ReadyOn, ReadyOff, SoOn, SoOff, NmiOn, NmiOff, ResetOn, ResetOff, IrqOn, IrqOff
+    };
+
+    // Every cycle once the reset vector is read, if set
+    std::ostream *trace = nullptr;
+    // Mismatches the backend knows it has, which don't fail the test
+    std::ostream *notes = nullptr;
+    // Ends the test when an instruction is fetched from here, for programs that never write to $0200
+    std::optional<Addr> stop_address;
+    // Ends the test once the whole plan has been followed, for plans that are a slice of a longer one
+    bool end_with_plan = false;
+    // Called on every instruction fetch once the reset vector is read, before it's checked against the plan
+    std::function<void(Addr address)> on_fetch;
+    // Records the run, to be checked against the plan a batch of cycles at a time by checkLog() once it
+    // ends, which is much faster on long plans than checking each cycle as it happens
+    bool batched = false;
+
+private:
+    static constexpr size_t StartGraceCycles = 50;
+    static constexpr size_t PreambleCycles = 50;
+
+    MemoryImage memory_;
+    std::optional<ResumePoint> resume_;
+    MemoryImage resume_memory_;
+    size_t preamble_cycles_ = 0;
+    const TestPlan *plan_ = nullptr;
+    size_t next_plan_ = 0;
+    BusColumns log_, plan_columns_;
+    CpuBackend *backend_ = nullptr;
+
+    size_t cycles_until_start_ = StartGraceCycles;
+    bool cpu_in_reset_ = true;
+    size_t cycle_num_ = 0;
+    uint64_t total_cycles_ = 0;
+    // Set by cycleStart(), for the access that follows
+    bool cycle_started_ = false;
+
+    std::unordered_map< size_t, std::unordered_set< Signal > > delayed_actions_;
+
+public:
+    // Starts a new run of image, checked against plan unless that is nullptr. The plan isn't copied, so
+    // it has to outlive the run. The caller then asserts reset and runs backend.
+    void start(const MemoryImage &image, const TestPlan *plan, CpuBackend &backend,
+            const ResumePoint *resume = nullptr);
+
+    // Throws PlanMismatch for the first cycle of a batched run that doesn't match the plan, as checking the
+    // cycles as they happened would have. Does nothing if the run wasn't batched.
+    void checkLog();
+
+    // Changes a signal at a cycle counted from the reset vector read, as the I/O registers do
+    void schedule(size_t cycle, Signal signal);
+
+    // Bus cycles since start(), reset included
+    uint64_t cycles() const { return total_cycles_; }
+    const MemoryImage &memory() const { return memory_; }
+    // Counted from the reset vector read
+    size_t cycleNumber() const { return cycle_num_; }
+    // How much of the plan has been checked
+    size_t planPosition() const { return next_plan_; }
+    // Whether I/O register writes scheduled signal changes that haven't happened yet
+    bool signalsPending() const { return !delayed_actions_.empty(); }
+
+    virtual uint8_t read( c6502 *cpu, Addr address, bool sync = false ) override;
+    virtual void write( c6502 *cpu, Addr address, uint8_t value ) override;
+    virtual void cycleStart() override;
+
+private:
+    // Moves on to the next cycle of the plan. Returns false if the plan has ended.
+    bool nextPlanCycle();
+    void checkCycle( size_t plan_cycle, bool read, Addr address, uint8_t data, bool incompatible );
+    void check( size_t plan_cycle, bool incompatible, unsigned expected, unsigned actual, const char *message,
+            Addr address, uint8_t data );
+    void performIo(bool ready_early);
+    static bool isReady(Signal signal);
+    void applySignals(size_t cycle, const std::function<bool(Signal)> &which);
+};
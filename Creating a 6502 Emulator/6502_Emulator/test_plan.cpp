@@ -0,0 +1,265 @@
+#include "test_plan.h"
+
+#include "readmem.h"
+
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char Magic[8] = { '6', '5', '0', '2', 'P', 'L', 'A', 'N' };
+constexpr uint32_t Version = 1;
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t cycles, anchors, waits, comments, strings_size;
+};
+
+template<typename T>
+std::span<const T> take(const char *&section, uint32_t count) {
+    std::span<const T> result( reinterpret_cast<const T *>(section), count );
+    section += size_t(count) * sizeof(T);
+
+    return result;
+}
+
+} // namespace
+
+struct TestPlan::Storage {
+    // Text plans are parsed into these
+    std::vector<PlanCycle> cycles;
+    std::vector<Anchor> anchors;
+    std::vector<Wait> waits;
+    std::vector<Comment> comments;
+    std::string strings;
+
+    // Packed ones are mapped instead
+    const char *mapping = nullptr;
+    size_t mapping_size = 0;
+
+    ~Storage() {
+        if( mapping )
+            munmap( const_cast<char *>(mapping), mapping_size );
+    }
+
+    // Returns false, having done nothing, if path isn't a packed plan
+    bool mapPacked(const std::filesystem::path &path, TestPlan &plan);
+    void parseText(const std::filesystem::path &path, TestPlan &plan);
+};
+
+bool TestPlan::Storage::mapPacked(const std::filesystem::path &path, TestPlan &plan) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if( fd<0 )
+        throw std::runtime_error( "Failed opening " + path.string() + ": " + strerror(errno) );
+
+    struct stat st;
+    char magic[sizeof(Magic)];
+    if( fstat(fd, &st)<0 || size_t(st.st_size)<sizeof(Header) || pread(fd, magic, sizeof(magic), 0)!=sizeof(magic) ||
+            memcmp(magic, Magic, sizeof(Magic))!=0 )
+    {
+        close(fd);
+        return false;
+    }
+
+    if constexpr( std::endian::native!=std::endian::little ) {
+        close(fd);
+        throw std::runtime_error("Packed test plans can only be read on little endian machines");
+    }
+
+    void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if( data==MAP_FAILED )
+        throw std::runtime_error( "Failed mapping " + path.string() + ": " + strerror(errno) );
+    mapping = static_cast<const char *>(data);
+    mapping_size = st.st_size;
+
+    Header header;
+    memcpy(&header, mapping, sizeof(header));
+    if( header.version!=Version )
+        throw std::runtime_error( path.string() + " is a version " + std::to_string(header.version) +
+                " packed test plan, which this doesn't read" );
+
+    auto malformed = [&] {
+        return std::runtime_error("Malformed packed test plan " + path.string());
+    };
+    uint64_t expected_size = sizeof(Header) + uint64_t(header.cycles)*sizeof(PlanCycle) +
+            uint64_t(header.anchors)*sizeof(Anchor) + uint64_t(header.waits)*sizeof(Wait) +
+            uint64_t(header.comments)*sizeof(Comment) + header.strings_size;
+    if( mapping_size!=expected_size )
+        throw malformed();
+
+    const char *section = mapping + sizeof(Header);
+    plan.cycles_ = take<PlanCycle>(section, header.cycles);
+    plan.anchors_ = take<Anchor>(section, header.anchors);
+    plan.waits_ = take<Wait>(section, header.waits);
+    plan.comments_ = take<Comment>(section, header.comments);
+    plan.strings_ = std::string_view(section, header.strings_size);
+
+    // Enough that looking up lines and comments can't go astray
+    if( !plan.cycles_.empty() && (plan.anchors_.empty() || plan.anchors_[0].cycle!=0) )
+        throw malformed();
+    if( !plan.strings_.empty() && plan.strings_.back()!='\0' )
+        throw malformed();
+    for( const Comment &comment : plan.comments_ ) {
+        if( comment.offset>=plan.strings_.size() )
+            throw malformed();
+    }
+
+    return true;
+}
+
+void TestPlan::Storage::parseText(const std::filesystem::path &path, TestPlan &plan) {
+    ReadMem<8,8,16,4> test_plan(path);
+    size_t last_line = 0;
+
+    while( test_plan.read_line() ) {
+        if( test_plan[3]==0 ) {
+            waits.push_back( Wait{ .cycle = uint32_t( cycles.size() ), .count = uint32_t( test_plan[0] ) } );
+            continue;
+        }
+
+        size_t line = test_plan.lineNumber();
+        if( cycles.empty() || line!=last_line+1 )
+            anchors.push_back( Anchor{ .cycle = uint32_t( cycles.size() ), .line = uint32_t(line) } );
+        last_line = line;
+
+        std::string comment = test_plan.comment();
+        if( !comment.empty() ) {
+            comments.push_back( Comment{ .cycle = uint32_t( cycles.size() ), .offset = uint32_t( strings.size() ) } );
+            strings += comment;
+            strings += '\0';
+        }
+
+        cycles.push_back( PlanCycle{ .address = Addr( test_plan[2] ), .data = uint8_t( test_plan[1] ),
+                .flags = uint8_t( test_plan[0] ) } );
+    }
+
+    plan.cycles_ = cycles;
+    plan.anchors_ = anchors;
+    plan.waits_ = waits;
+    plan.comments_ = comments;
+    plan.strings_ = strings;
+}
+
+TestPlan readTestPlan(const std::filesystem::path &path) {
+    auto storage = std::make_shared<TestPlan::Storage>();
+    TestPlan plan;
+
+    if( !storage->mapPacked(path, plan) )
+        storage->parseText(path, plan);
+    plan.storage_ = storage;
+
+    return plan;
+}
+
+size_t TestPlan::line(size_t cycle) const {
+    size_t index = first_ + cycle;
+
+    // The last anchor at or before the cycle
+    auto anchor = std::upper_bound( anchors_.begin(), anchors_.end(), index,
+            [](size_t index, const Anchor &anchor) { return index<anchor.cycle; } );
+    if( anchor==anchors_.begin() )
+        return 0;
+    --anchor;
+
+    return anchor->line + (index - anchor->cycle);
+}
+
+std::string_view TestPlan::comment(size_t cycle) const {
+    size_t index = first_ + cycle;
+
+    auto comment = std::lower_bound( comments_.begin(), comments_.end(), index,
+            [](const Comment &comment, size_t index) { return comment.cycle<index; } );
+    if( comment==comments_.end() || comment->cycle!=index )
+        return {};
+
+    return std::string_view( strings_.data() + comment->offset );
+}
+
+TestPlan TestPlan::slice(size_t first, size_t count) const {
+    TestPlan result = *this;
+    result.cycles_ = cycles_.subspan(first, count);
+    result.waits_ = {};
+    result.first_ = first_ + first;
+
+    return result;
+}
+
+void writeTextPlan(std::ostream &out, const TestPlan &plan) {
+    char buffer[16];
+
+    auto wait = plan.waits().begin();
+    auto write_waits = [&](size_t cycle) {
+        for( ; wait!=plan.waits().end() && wait->cycle<=cycle; ++wait ) {
+            snprintf(buffer, sizeof(buffer), "0_0000_00_%02x\n", wait->count);
+            out<<buffer;
+        }
+    };
+
+    for( size_t i = 0; i<plan.size(); ++i ) {
+        write_waits(i);
+
+        const PlanCycle &cycle = plan[i];
+        snprintf(buffer, sizeof(buffer), "1_%04x_%02x_%02x", cycle.address, cycle.data, cycle.flags);
+        out<<buffer;
+
+        std::string_view comment = plan.comment(i);
+        if( !comment.empty() )
+            out<<"    //"<<comment;
+        out<<"\n";
+    }
+    write_waits( plan.size() );
+}
+
+void writePackedPlan(std::ostream &out, const TestPlan &plan) {
+    if constexpr( std::endian::native!=std::endian::little )
+        throw std::runtime_error("Packed test plans can only be written on little endian machines");
+
+    std::vector<TestPlan::Anchor> anchors;
+    std::vector<TestPlan::Comment> comments;
+    std::string strings;
+
+    for( size_t i = 0; i<plan.size(); ++i ) {
+        size_t line = plan.line(i);
+        if( i==0 || line!=plan.line(i-1)+1 )
+            anchors.push_back( TestPlan::Anchor{ .cycle = uint32_t(i), .line = uint32_t(line) } );
+
+        std::string_view comment = plan.comment(i);
+        if( !comment.empty() ) {
+            comments.push_back( TestPlan::Comment{ .cycle = uint32_t(i), .offset = uint32_t( strings.size() ) } );
+            strings += comment;
+            strings += '\0';
+        }
+    }
+
+    Header header{};
+    memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = Version;
+    header.cycles = plan.size();
+    header.anchors = anchors.size();
+    header.waits = plan.waits().size();
+    header.comments = comments.size();
+    header.strings_size = strings.size();
+
+    auto write = [&](const auto *data, size_t count) {
+        out.write( reinterpret_cast<const char *>(data), count*sizeof(*data) );
+    };
+    write(&header, 1);
+    write(plan.cycles().data(), plan.size());
+    write(anchors.data(), anchors.size());
+    write(plan.waits().data(), plan.waits().size());
+    write(comments.data(), comments.size());
+    write(strings.data(), strings.size());
+}
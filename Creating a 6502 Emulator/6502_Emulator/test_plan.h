@@ -0,0 +1,83 @@
+#pragma once
+
+#include "Bus.h"
+
+#include <filesystem>
+#include <memory>
+#include <ostream>
+#include <span>
+#include <string_view>
+
+#include <stddef.h>
+#include <stdint.h>
+
+// One line of a test plan, `1_address_data_flags`. Flags bit 0 is set for a read, and bit 1 for SYNC.
+// Laid out as packed plans store it, so that those are used straight from the file.
+struct PlanCycle {
+    Addr address;
+    uint8_t data;
+    uint8_t flags;
+};
+static_assert( sizeof(PlanCycle)==4 );
+
+// The bus cycles a run is checked against, along with what else the text plan has: the line each cycle
+// is on, their comments, and the wait lines (`0_0000_00_count`), which only the hardware harness acts on.
+//
+// Plans are read either as text or packed, as pack_plan writes them. A packed plan is mapped rather
+// than parsed, so opening one costs next to nothing however long it is. It is, all little endian:
+//   header      "6502PLAN", then uint32 version, cycles, anchors, waits, comments, string bytes
+//   cycles      PlanCycle each
+//   anchors     uint32 cycle, line: for each cycle whose line doesn't follow the one before's
+//   waits       uint32 cycle the wait comes before, count
+//   comments    uint32 cycle, offset of the comment in the strings
+//   strings     NUL terminated
+//
+// Copies and slices share the plan they came from, which stays loaded until the last of them is gone.
+class TestPlan {
+public:
+    struct Wait {
+        uint32_t cycle, count;
+    };
+
+private:
+    struct Anchor {
+        uint32_t cycle, line;
+    };
+    struct Comment {
+        uint32_t cycle, offset;
+    };
+    struct Storage;
+
+    std::shared_ptr<const Storage> storage_;
+    std::span<const PlanCycle> cycles_;
+    std::span<const Anchor> anchors_;
+    std::span<const Wait> waits_;
+    std::span<const Comment> comments_;
+    std::string_view strings_;
+    // Of a slice, in the plan it was cut from
+    size_t first_ = 0;
+
+public:
+    size_t size() const { return cycles_.size(); }
+    const PlanCycle &operator[](size_t cycle) const { return cycles_[cycle]; }
+    std::span<const PlanCycle> cycles() const { return cycles_; }
+
+    // Line in the plan file, for messages
+    size_t line(size_t cycle) const;
+    // Without the //. Empty if the line has none.
+    std::string_view comment(size_t cycle) const;
+    // By the cycle each comes before. A slice has none.
+    std::span<const Wait> waits() const { return waits_; }
+
+    // count cycles from first on
+    TestPlan slice(size_t first, size_t count) const;
+
+    friend TestPlan readTestPlan(const std::filesystem::path &path);
+    friend void writePackedPlan(std::ostream &out, const TestPlan &plan);
+};
+
+// Either format. Throws ParseError for malformed text, and std::runtime_error for everything else.
+TestPlan readTestPlan(const std::filesystem::path &path);
+
+void writeTextPlan(std::ostream &out, const TestPlan &plan);
+void writePackedPlan(std::ostream &out, const TestPlan &plan);
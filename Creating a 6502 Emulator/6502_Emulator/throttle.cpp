@@ -0,0 +1,102 @@
+#include "throttle.h"
+
+#include <algorithm>
+#include <bit>
+
+#include <errno.h>
+#include <time.h>
+
+static int64_t now_ns() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return int64_t(now.tv_sec)*1000000000 + now.tv_nsec;
+}
+
+Throttle::Throttle(double clock_hz, uint32_t quantum_cycles, int64_t max_lag_ns) :
+    ns_per_cycle(1e9 / clock_hz),
+    quantum_cycles(quantum_cycles),
+    cycles_left(quantum_cycles),
+    max_lag_ns(max_lag_ns),
+    base_ns(now_ns())
+{}
+
+void Throttle::endQuantum() {
+    cycles_left = quantum_cycles;
+    quanta++;
+    quanta_since_base++;
+
+    int64_t deadline = base_ns + int64_t( double(quanta_since_base * quantum_cycles) * ns_per_cycle );
+    int64_t now = now_ns();
+
+    if( now>deadline ) {
+        late_quanta++;
+        recordJitter(now - deadline);
+
+        if( now - deadline > max_lag_ns ) {
+            base_ns = now;
+            quanta_since_base = 0;
+        }
+
+        return;
+    }
+
+    timespec until{ .tv_sec = deadline / 1000000000, .tv_nsec = deadline % 1000000000 };
+    while( clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, nullptr)==EINTR )
+        ;
+
+    recordJitter(now_ns() - deadline);
+}
+
+void Throttle::recordJitter(int64_t jitter_ns) {
+    jitter_ns = std::max<int64_t>(jitter_ns, 0);
+
+    jitter_bins[ jitterBin(jitter_ns) ]++;
+    jitter_max_ns = std::max(jitter_max_ns, jitter_ns);
+}
+
+unsigned Throttle::jitterBin(int64_t jitter_ns) {
+    uint64_t value = jitter_ns;
+    if( value<2*JitterSubBins )
+        return value;
+
+    // The top five bits pick the bin within the doubling
+    unsigned shift = std::bit_width(value) - std::bit_width(2*JitterSubBins-1);
+    return shift*JitterSubBins + (value>>shift);
+}
+
+int64_t Throttle::jitterBinValue(unsigned bin) {
+    if( bin<2*JitterSubBins )
+        return bin;
+
+    unsigned shift = bin/JitterSubBins - 1;
+    uint64_t top = bin%JitterSubBins + JitterSubBins;
+    return (top<<shift) + (uint64_t(1)<<shift)/2;
+}
+
+Throttle::Stats Throttle::stats() const {
+    Stats stats{ .quanta = quanta, .late_quanta = late_quanta };
+
+    uint64_t total = 0;
+    for( uint64_t count : jitter_bins )
+        total += count;
+    if( total==0 )
+        return stats;
+
+    auto percentile = [&](uint64_t percent) {
+        uint64_t rank = (total-1) * percent / 100, seen = 0;
+        for( unsigned bin = 0; bin<jitter_bins.size(); ++bin ) {
+            seen += jitter_bins[bin];
+            if( seen>rank )
+                return std::min( jitterBinValue(bin), jitter_max_ns );
+        }
+
+        return jitter_max_ns;
+    };
+
+    stats.jitter_p50_ns = percentile(50);
+    stats.jitter_p99_ns = percentile(99);
+    stats.jitter_max_ns = jitter_max_ns;
+
+    return stats;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <array>
+
+#include <stdint.h>
+
+// Paces emulation to a target clock rate.
+//
+// The bus calls tick() once per cycle. Every quantum_cycles cycles the thread sleeps until the absolute
+// time at which that many cycles would have finished on the real machine, so sleep overshoot doesn't
+// accumulate. A quantum that ends after its deadline is counted as late and the next one runs without
+// sleeping, catching up on the lost time, unless the lag exceeds max_lag_ns (a debugger stop, a
+// suspended process), in which case the schedule restarts from now.
+class Throttle {
+public:
+    struct Stats {
+        uint64_t quanta, late_quanta;
+        // How long after its deadline each quantum resumed
+        int64_t jitter_p50_ns, jitter_p99_ns, jitter_max_ns;
+    };
+
+private:
+    double ns_per_cycle;
+    uint32_t quantum_cycles;
+    uint32_t cycles_left;
+    int64_t max_lag_ns;
+
+    // Deadlines are computed from here rather than accumulated, so rounding doesn't drift either
+    int64_t base_ns;
+    uint64_t quanta_since_base = 0;
+
+    uint64_t quanta = 0, late_quanta = 0;
+    // Jitter is binned rather than kept, so a long run doesn't grow it: 16 bins to each doubling, which
+    // puts the percentiles within 1/32 of the truth. The maximum is kept exactly.
+    static constexpr unsigned JitterSubBins = 16;
+    std::array<uint64_t, 60*JitterSubBins> jitter_bins{};
+    int64_t jitter_max_ns = 0;
+
+public:
+    Throttle(double clock_hz, uint32_t quantum_cycles, int64_t max_lag_ns = 100000000);
+
+    void tick() {
+        if( --cycles_left==0 )
+            endQuantum();
+    }
+
+    Stats stats() const;
+
+private:
+    void endQuantum();
+    void recordJitter(int64_t jitter_ns);
+
+    static unsigned jitterBin(int64_t jitter_ns);
+    // The middle of the bin's range
+    static int64_t jitterBinValue(unsigned bin);
+};
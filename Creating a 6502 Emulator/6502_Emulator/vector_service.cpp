@@ -0,0 +1,456 @@
+#include "test_bus.h"
+
+#include "cpu_backend.h"
+#include "readmem.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Runs test programs for clients on a Unix socket, on CPUs that are set up once when the service starts
+// rather than once per run, as verify_cpu does. The netlist's setup dominates a short test, and so do
+// process startup and parsing the .mem files, which are kept parsed until they change.
+//
+// Clients send a job as lines of text, ending with `run`:
+//
+//   backend c6502|netlist       The CPU to run on, c6502 by default
+//   mem <path>                  The memory image. Required
+//   plan <path>                 A test plan to check every bus cycle against
+//   signal <name> <on> <off>    Assert ready, so, nmi, reset or irq between two cycles from the reset vector
+//   stop <address>              End the test when an instruction is fetched from this (hex) address
+//   limit <cycles>              Give up after this many bus cycles, 100000000 by default
+//   trace                       Stream every bus cycle
+//
+// Paths are as the service sees them, and take up the rest of the line, spaces included. While the job
+// runs, the service streams `trace` and `note` lines, and then ends it with one of:
+//
+//   pass <cycles>               The program wrote to $0200 or reached the stop address
+//   fail <cycles> <message>     The CPU strayed from the plan
+//   limit <cycles>              The cycle limit ran out
+//   error <message>             The job couldn't be run
+//
+// `pass` and `fail` are preceded by a `registers a x y sp status pc` line. A job with a line that is
+// wrong isn't run, and gets the error for the first one. A connection can run any number of jobs, one
+// after the other.
+
+namespace {
+
+struct Options {
+    const char *socket_path = "vector_service.sock";
+    unsigned instances = std::max( std::thread::hardware_concurrency(), 1u );
+} options;
+
+constexpr uint64_t DefaultLimit = 100000000;
+// Streamed output is sent every this many cycles
+constexpr uint64_t ChunkCycles = 10000;
+
+// Parsed files, reparsed only when their modification time or size changes
+template<class Parsed, Parsed (*parse)(const std::filesystem::path &)>
+class FileCache {
+    struct Entry {
+        std::filesystem::file_time_type mtime;
+        uintmax_t size;
+        std::shared_ptr<const Parsed> parsed;
+    };
+
+    std::mutex mutex_;
+    std::map<std::string, Entry> entries_;
+
+public:
+    std::shared_ptr<const Parsed> get(const std::string &path) {
+        auto mtime = std::filesystem::last_write_time(path);
+        auto size = std::filesystem::file_size(path);
+
+        {
+            std::unique_lock lock(mutex_);
+            auto iter = entries_.find(path);
+            if( iter!=entries_.end() && iter->second.mtime==mtime && iter->second.size==size )
+                return iter->second.parsed;
+        }
+
+        // Parsed unlocked, so a big plan doesn't hold up everybody else
+        std::shared_ptr<const Parsed> parsed;
+        try {
+            parsed = std::make_shared<const Parsed>( parse(path) );
+        } catch( const ParseError &ex ) {
+            throw std::runtime_error("Malformed file " + path);
+        }
+
+        std::unique_lock lock(mutex_);
+        entries_[path] = Entry{ .mtime = mtime, .size = size, .parsed = parsed };
+
+        return parsed;
+    }
+};
+
+FileCache<MemoryImage, readMemoryImage> images;
+FileCache<TestPlan, readTestPlan> plans;
+
+// A bus, and a netlist already set up on it. c6502 is cheap enough to build for every job.
+struct Worker {
+    TestBus bus;
+    std::unique_ptr<NetlistBackend> netlist;
+    NetlistCpu::Snapshot pristine;
+
+    Worker() : netlist( std::make_unique<NetlistBackend>(bus) ) {
+        netlist->cpu().save(pristine, false);
+    }
+};
+
+class Pool {
+    std::mutex mutex_;
+    std::condition_variable available_;
+    std::vector< std::unique_ptr<Worker> > workers_;
+    std::vector<Worker *> idle_;
+
+public:
+    explicit Pool(unsigned size) {
+        for( unsigned i=0; i<size; ++i ) {
+            workers_.push_back( std::make_unique<Worker>() );
+            idle_.push_back( workers_.back().get() );
+        }
+    }
+
+    Worker *acquire() {
+        std::unique_lock lock(mutex_);
+        available_.wait( lock, [this]{ return !idle_.empty(); } );
+
+        Worker *worker = idle_.back();
+        idle_.pop_back();
+        return worker;
+    }
+
+    void release(Worker *worker) {
+        {
+            std::unique_lock lock(mutex_);
+            idle_.push_back(worker);
+        }
+        available_.notify_one();
+    }
+};
+
+std::unique_ptr<Pool> pool;
+
+// The rest of the line, less the whitespace around it, so that paths can have spaces in them
+std::string rest_of_line(std::istringstream &args) {
+    std::string rest;
+    std::getline(args, rest);
+
+    size_t first = rest.find_first_not_of(" \t\r");
+    if( first==std::string::npos )
+        return std::string();
+    size_t last = rest.find_last_not_of(" \t\r");
+
+    return rest.substr(first, last-first+1);
+}
+
+struct Job {
+    std::string backend = "c6502";
+    std::shared_ptr<const MemoryImage> image;
+    std::shared_ptr<const TestPlan> plan;
+    std::vector< std::pair<size_t, TestBus::Signal> > signals;
+    std::optional<Addr> stop;
+    uint64_t limit = DefaultLimit;
+    bool trace = false;
+
+    // From the first line that was wrong
+    std::optional<std::string> error;
+};
+
+class Connection {
+    int fd_;
+    FILE *in_;
+
+public:
+    explicit Connection(int fd) : fd_(fd), in_( fdopen(fd, "r") ) {}
+    ~Connection() {
+        fclose(in_);
+    }
+
+    Connection(const Connection &that) = delete;
+    Connection &operator=(const Connection &that) = delete;
+
+    void serve();
+
+private:
+    void send(const std::string &text);
+    // Sends each line of buffer with prefix, and empties it
+    void sendLines(const char *prefix, std::ostringstream &buffer);
+
+    void parse(Job &job, const std::string &command, std::istringstream &args);
+    void run(const Job &job);
+};
+
+void Connection::serve() {
+    Job job;
+    char *line = nullptr;
+    size_t line_size = 0;
+
+    while( getline(&line, &line_size, in_) != -1 ) {
+        std::istringstream words(line);
+        std::string command;
+        if( !(words>>command) )
+            continue;
+
+        if( command!="run" ) {
+            try {
+                parse(job, command, words);
+            } catch( const std::exception &ex ) {
+                if( !job.error )
+                    job.error = ex.what();
+            }
+            continue;
+        }
+
+        try {
+            if( job.error )
+                throw std::runtime_error(*job.error);
+            run(job);
+        } catch( const std::exception &ex ) {
+            send( std::string("error ") + ex.what() + "\n" );
+        }
+
+        job = Job();
+    }
+
+    free(line);
+}
+
+void Connection::send(const std::string &text) {
+    size_t sent = 0;
+    while( sent<text.size() ) {
+        ssize_t result = ::send(fd_, text.data()+sent, text.size()-sent, MSG_NOSIGNAL);
+        if( result<0 ) {
+            if( errno==EINTR )
+                continue;
+            // The client went away. Whatever it asked for runs to the end, unread.
+            return;
+        }
+        sent += result;
+    }
+}
+
+void Connection::sendLines(const char *prefix, std::ostringstream &buffer) {
+    std::string lines = buffer.str();
+    if( lines.empty() )
+        return;
+    buffer.str("");
+
+    std::string text;
+    size_t start = 0;
+    while( start<lines.size() ) {
+        size_t end = lines.find('\n', start);
+        if( end==std::string::npos )
+            end = lines.size();
+        text += prefix;
+        text.append(lines, start, end-start);
+        text += '\n';
+        start = end+1;
+    }
+
+    send(text);
+}
+
+void Connection::parse(Job &job, const std::string &command, std::istringstream &args) {
+    static const std::map<std::string, std::pair<TestBus::Signal, TestBus::Signal>> signal_names{
+        { "ready", { TestBus::Signal::ReadyOn, TestBus::Signal::ReadyOff } },
+        { "so", { TestBus::Signal::SoOn, TestBus::Signal::SoOff } },
+        { "nmi", { TestBus::Signal::NmiOn, TestBus::Signal::NmiOff } },
+        { "reset", { TestBus::Signal::ResetOn, TestBus::Signal::ResetOff } },
+        { "irq", { TestBus::Signal::IrqOn, TestBus::Signal::IrqOff } },
+    };
+
+    std::string word;
+
+    if( command=="backend" ) {
+        args>>word;
+        if( word!="c6502" && word!="netlist" )
+            throw std::runtime_error("Unknown backend " + word);
+        job.backend = word;
+    } else if( command=="mem" ) {
+        word = rest_of_line(args);
+        if( word.empty() )
+            throw std::runtime_error("mem needs a path");
+        job.image = images.get(word);
+    } else if( command=="plan" ) {
+        word = rest_of_line(args);
+        if( word.empty() )
+            throw std::runtime_error("plan needs a path");
+        job.plan = plans.get(word);
+    } else if( command=="signal" ) {
+        size_t on, off;
+        if( !(args>>word>>on>>off) )
+            throw std::runtime_error("signal needs a name and two cycles");
+        auto signal = signal_names.find(word);
+        if( signal==signal_names.end() )
+            throw std::runtime_error("Unknown signal " + word);
+        job.signals.emplace_back( on, signal->second.first );
+        job.signals.emplace_back( off, signal->second.second );
+    } else if( command=="stop" ) {
+        unsigned address;
+        if( !(args>>std::hex>>address) || address>0xffff )
+            throw std::runtime_error("stop needs an address");
+        job.stop = address;
+    } else if( command=="limit" ) {
+        if( !(args>>job.limit) )
+            throw std::runtime_error("limit needs a number of cycles");
+    } else if( command=="trace" ) {
+        job.trace = true;
+    } else {
+        throw std::runtime_error("Unknown command " + command);
+    }
+}
+
+void Connection::run(const Job &job) {
+    if( !job.image )
+        throw std::runtime_error("The job has no memory image");
+
+    Worker *worker = pool->acquire();
+    struct Release {
+        Worker *worker;
+        ~Release() { pool->release(worker); }
+    } release{ worker };
+
+    TestBus &bus = worker->bus;
+    std::ostringstream trace, notes;
+    bus.trace = job.trace ? &trace : nullptr;
+    bus.notes = &notes;
+    bus.stop_address = job.stop;
+
+    std::unique_ptr<C6502Backend> c6502;
+    CpuBackend *backend;
+    if( job.backend=="c6502" ) {
+        c6502 = std::make_unique<C6502Backend>(bus);
+        backend = c6502.get();
+    } else {
+        worker->netlist->cpu().restore(worker->pristine, false);
+        backend = worker->netlist.get();
+    }
+
+    bus.start(*job.image, job.plan.get(), *backend);
+    for( auto [cycle, signal] : job.signals )
+        bus.schedule(cycle, signal);
+    backend->setReset(true);
+
+    auto sendRegisters = [&]() {
+        auto registers = backend->registers();
+        char line[64];
+        snprintf(line, sizeof(line), "registers %02x %02x %02x %02x %02x %04x\n", registers->regA, registers->regX,
+                registers->regY, registers->regSp, registers->regStatus, registers->pc);
+        send(line);
+    };
+
+    try {
+        while( bus.cycles()<job.limit ) {
+            backend->run( std::min(ChunkCycles, job.limit-bus.cycles()) );
+            sendLines("trace ", trace);
+            sendLines("note ", notes);
+        }
+    } catch( TestDone ex ) {
+        sendLines("trace ", trace);
+        sendLines("note ", notes);
+        sendRegisters();
+        send( "pass " + std::to_string(bus.cycles()) + "\n" );
+        return;
+    } catch( const PlanMismatch &ex ) {
+        sendLines("trace ", trace);
+        sendLines("note ", notes);
+        sendRegisters();
+        send( "fail " + std::to_string(bus.cycles()) + " " + ex.what() + "\n" );
+        return;
+    }
+
+    send( "limit " + std::to_string(bus.cycles()) + "\n" );
+}
+
+int listenOn(const char *path) {
+    sockaddr_un address{ .sun_family = AF_UNIX };
+    if( strlen(path)>=sizeof(address.sun_path) ) {
+        std::cerr<<"Socket path "<<path<<" is too long\n";
+        exit(1);
+    }
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if( fd==-1 ) {
+        perror("Creating socket failed");
+        exit(1);
+    }
+
+    // Left over from a previous run
+    unlink(path);
+    if( bind(fd, (const sockaddr *)&address, sizeof(address))==-1 ) {
+        perror("Binding socket failed");
+        exit(1);
+    }
+    if( listen(fd, 64)==-1 ) {
+        perror("Listening on socket failed");
+        exit(1);
+    }
+
+    return fd;
+}
+
+void usage(const char *name) {
+    std::cerr<<"Usage: "<<name<<" [-s socket] [-j instances]\n"
+            "  -s    Unix socket to listen on, vector_service.sock by default\n"
+            "  -j    Number of jobs run at once, each with a netlist of its own. By default, one per core\n";
+    exit(2);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    int opt;
+    while( (opt = getopt(argc, argv, "s:j:")) != -1 ) {
+        switch( opt ) {
+        case 's': options.socket_path = optarg; break;
+        case 'j': options.instances = strtoul(optarg, nullptr, 0); break;
+        default: usage(argv[0]);
+        }
+    }
+
+    if( optind!=argc || options.instances==0 )
+        usage(argv[0]);
+
+    signal(SIGPIPE, SIG_IGN);
+
+    auto start = std::chrono::steady_clock::now();
+    pool = std::make_unique<Pool>(options.instances);
+    std::cerr<<"Warmed "<<options.instances<<" instances in "<<
+            std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::steady_clock::now()-start ).count()<<"ms\n";
+
+    int listen_fd = listenOn(options.socket_path);
+    std::cerr<<"Listening on "<<options.socket_path<<"\n";
+
+    while( true ) {
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if( fd==-1 ) {
+            if( errno==EINTR )
+                continue;
+            perror("Accepting connection failed");
+            return 1;
+        }
+
+        std::thread( [fd]() { Connection(fd).serve(); } ).detach();
+    }
+}
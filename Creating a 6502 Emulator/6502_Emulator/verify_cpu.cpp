@@ -1,198 +1,212 @@
-#include "readmem.h"
-
-#include "Bus.h"
-
-#include "c6502.h"
-
-#include <assert.h>
-#include <unordered_map>
-#include <unordered_set>
-
-class TestDone {};
+#include "test_bus.h"
+
+#include "cpu_backend.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+struct Options {
+    const char *backend_name = "c6502";
+    const char *manifest = nullptr;
+    bool fast = false;
+    size_t num_threads = std::max( std::thread::hardware_concurrency(), 1u );
+    std::vector<std::string> segments;
+};
 
-class TestBus : public Bus {
-    static constexpr size_t StartGraceCycles = 50;
+struct SegmentResult {
+    bool passed = false;
+    uint64_t cycles = 0;
+    std::string message;
+};
 
-    std::array<std::uint8_t, 65536> memory;
-    ReadMem<8,8,16,4>   test_plan;
-    size_t              cycles_until_start = StartGraceCycles;
-    bool                cpuInReset = true;
-    size_t              cycle_num = 0;
+static void usage(const char *name) {
+    std::cerr<<"Usage: "<<name<<" [-b backend] [-f] [-m manifest [-j threads] [-s segment]...] memory_image test_plan\n"
+            "  -b    CPU to verify: c6502 (default), netlist, or trace:<file>\n"
+            "  -f    Fast: check the plan in batches once the run ends, and don't print the trace\n"
+            "  -m    Verify the segments segment_program listed in manifest independently, in parallel\n"
+            "  -j    How many segments to verify at once (default: one per core)\n"
+            "  -s    Verify only this segment; may be repeated\n"
+            "test_plan may be text or packed by pack_plan, which loads much faster.\n";
+    exit(2);
+}
+
+static SegmentResult verify_segment(const Options &options, const MemoryImage &image, const TestPlan &plan,
+        const Segment &segment)
+{
+    SegmentResult result;
+
+    if( segment.first_cycle+segment.num_cycles > plan.size() ) {
+        result.message = "Segment runs past the end of the test plan";
+        return result;
+    }
 
-    enum class Signals {
-        ReadyOn, ReadyOff, SoOn, SoOff, NmiOn, NmiOff, ResetOn, ResetOff, IrqOn, IrqOff
-    };
+    MemoryImage memory = image;
+    for( auto [address, value] : segment.memory )
+        memory[address] = value;
+    TestPlan slice = plan.slice(segment.first_cycle, segment.num_cycles);
 
-    std::unordered_map< size_t, std::unordered_set< Signals > > delayed_actions;
+    TestBus bus;
+    bus.end_with_plan = true;
+    bus.batched = options.fast;
+    std::unique_ptr<CpuBackend> backend = makeCpuBackend(options.backend_name, bus);
 
+    bus.start(memory, &slice, *backend, segment.resume ? &*segment.resume : nullptr);
+    backend->setReset(true);
 
-public:
-    TestBus(const char *memory_image_file, const char *test_plan_file) : test_plan(test_plan_file) {
-        ReadMem<8> memory_image(memory_image_file);
+    try {
+        try {
+            while( true )
+                backend->run(1000000);
+        } catch(TestDone ex) {
+        }
 
-        while( memory_image.read_line() ) {
-            memory[memory_image.address()] = memory_image[0];
+        bus.checkLog();
+        if( bus.planPosition()<slice.size() ) {
+            result.message = "Test ended " + std::to_string( slice.size()-bus.planPosition() ) +
+                    " cycles before the segment did";
+        } else {
+            result.passed = true;
         }
+    } catch(const PlanMismatch &ex) {
+        result.message = ex.what();
     }
+    result.cycles = bus.planPosition();
 
-    virtual uint8_t read( c6502 *cpu, Addr address, bool sync = false ) override {
-        perform_io(cpu);
-
-        uint8_t ret = memory[address];
-
-        if( cycles_until_start>0 ) {
-            if( StartGraceCycles-cycles_until_start == 2 ) {
-                cpu->setReset(false);
-                cpuInReset = false;
-            }
-
-            if( address==0xfffc && !cpuInReset ) {
-                cycles_until_start = 0;
-                cycle_num = 1;
-                std::cout<<"Reset vector read detected\n";
-            } else {
-                if( --cycles_until_start == 0 ) {
-                    std::cerr<<"CPU failed to read the reset vector\n";
-                    abort();
-                }
-            }
-        }
+    return result;
+}
 
-        if( cycles_until_start==0 ) {
-            std::cout<<std::dec<<cycle_num<<" R: "<<std::hex<<address<<" "<<int(ret)<<"\n";
-            cycle_num++;
-            bool valid = test_plan.read_line();
-            assert(valid);
+static int verify_segments(const Options &options, const MemoryImage &image, const TestPlan &plan) {
+    std::vector<Segment> segments;
+    try {
+        segments = readSegments(options.manifest);
+    } catch( std::runtime_error &ex ) {
+        std::cerr<<ex.what()<<"\n";
+        return 2;
+    }
 
-            check( cpu, test_plan[0], 1, "Read operation where write was expected", address, ret );
-            check( cpu, test_plan[2], address, "Read from wrong address", address, ret );
-            check( cpu, test_plan[1], ret, "Read wrong value from memory", address, ret );
+    for( const std::string &name : options.segments ) {
+        if( std::none_of( segments.begin(), segments.end(), [&](const Segment &segment) { return segment.name==name; } ) ) {
+            std::cerr<<"No segment named "<<name<<" in "<<options.manifest<<"\n";
+            return 2;
         }
-
-        return ret;
     }
-    virtual void write( c6502 *cpu, Addr address, uint8_t value ) override {
-        perform_io(cpu);
+    if( !options.segments.empty() ) {
+        std::erase_if( segments, [&](const Segment &segment) {
+                return std::find( options.segments.begin(), options.segments.end(), segment.name )==options.segments.end();
+            } );
+    }
 
-        std::cout<<std::dec<<cycle_num<<" W: "<<std::hex<<address<<" "<<int(value)<<"\n";
-        cycle_num++;
+    std::vector<SegmentResult> results( segments.size() );
+    std::atomic<size_t> next_segment = 0;
 
-        bool valid = test_plan.read_line();
-        if( valid ) {
-            check( cpu, test_plan[0], 0, "Write operation where read was expected", address, value );
-            check( cpu, test_plan[2], address, "Write to wrong address", address, value );
-            check( cpu, test_plan[1], value, "Write of wrong value to memory", address, value );
-        }
+    auto worker = [&]() {
+        for( size_t index = next_segment++; index<segments.size(); index = next_segment++ )
+            results[index] = verify_segment(options, image, plan, segments[index]);
+    };
 
-        memory[address] = value;
+    std::vector<std::thread> threads;
+    for( size_t i=0; i<std::min( options.num_threads, segments.size() ); ++i )
+        threads.emplace_back(worker);
+    for( auto &thread : threads )
+        thread.join();
 
-        if( (address>>8) == 0x02 ) {
-            switch( address & 0xff ) {
-            case 0x00:
-                throw TestDone();
-                break;
-            case 0x81:
-                delayed_actions.try_emplace( cycle_num+value-1 ).first->second.emplace(Signals::ReadyOn);
-                delayed_actions.try_emplace( cycle_num+value-1+memory[0x280] ).first->second.emplace(Signals::ReadyOff);
-                break;
-            case 0x83:
-                delayed_actions.try_emplace( cycle_num+value ).first->second.emplace(Signals::SoOn);
-                delayed_actions.try_emplace( cycle_num+value+memory[0x282] ).first->second.emplace(Signals::SoOff);
-                break;
-            case 0xfb:
-                delayed_actions.try_emplace( cycle_num+value ).first->second.emplace(Signals::NmiOn);
-                delayed_actions.try_emplace( cycle_num+value+memory[0x2fa] ).first->second.emplace(Signals::NmiOff);
-                break;
-            case 0xfd:
-                delayed_actions.try_emplace( cycle_num+value ).first->second.emplace(Signals::ResetOn);
-                delayed_actions.try_emplace( cycle_num+value+memory[0x2fc] ).first->second.emplace(Signals::ResetOff);
-                break;
-            case 0xff:
-                delayed_actions.try_emplace( cycle_num+value ).first->second.emplace(Signals::IrqOn);
-                delayed_actions.try_emplace( cycle_num+value+memory[0x2fe] ).first->second.emplace(Signals::IrqOff);
-                break;
-            }
+    std::vector<std::string> failed;
+    for( size_t i=0; i<segments.size(); ++i ) {
+        if( results[i].passed ) {
+            std::cout<<segments[i].name<<": passed in "<<results[i].cycles<<" cycles\n";
+        } else {
+            std::cout<<segments[i].name<<": "<<results[i].message<<"\n";
+            failed.push_back( segments[i].name );
         }
     }
 
-private:
-    void check(
-            const c6502 *cpu,
-            ReadMemSupport::DataContainer expected,
-            ReadMemSupport::DataContainer actual,
-            const char *message,
-            Addr address,
-            uint8_t data )
-    {
-        if( actual==expected )
-            return;
-
-        std::cerr<<"Validation failed on plan line "<<std::dec<<test_plan.lineNumber()<<
-                ": "<<message<<" Expected "<<std::hex<<expected<<" got "<<actual<<
-                " @"<<address<<" data "<<int(data);
-        if( cpu->isIncompatible() ) {
-            std::cerr<<" known incompatibility\n";
-        } else {
-            std::cerr<<"\n";
-            abort();
+    std::cout<<segments.size()-failed.size()<<" of "<<segments.size()<<" segments passed\n";
+    if( failed.empty() )
+        return 0;
+
+    std::cout<<"Rerun the failures with:";
+    for( const std::string &name : failed )
+        std::cout<<" -s "<<name;
+    std::cout<<"\n";
+
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    Options options;
+
+    int opt;
+    while( (opt = getopt(argc, argv, "b:fm:j:s:")) != -1 ) {
+        switch( opt ) {
+        case 'b': options.backend_name = optarg; break;
+        case 'f': options.fast = true; break;
+        case 'm': options.manifest = optarg; break;
+        case 'j': options.num_threads = std::max( strtoul(optarg, nullptr, 0), 1ul ); break;
+        case 's': options.segments.push_back(optarg); break;
+        default: usage(argv[0]);
         }
     }
 
-    void perform_io(c6502 *cpu) {
-        auto action_iter = delayed_actions.find( cycle_num );
-        if( action_iter==delayed_actions.end() )
-            return;
-
-        for( auto action : action_iter->second ) {
-            switch( action ) {
-            case Signals::ReadyOn:
-                cpu->setReady(true);
-                break;
-            case Signals::ReadyOff:
-                cpu->setReady(false);
-                break;
-            case Signals::SoOn:
-                cpu->setSo(true);
-                break;
-            case Signals::SoOff:
-                cpu->setSo(false);
-                break;
-            case Signals::NmiOn:
-                cpu->setNmi(true);
-                break;
-            case Signals::NmiOff:
-                cpu->setNmi(false);
-                break;
-            case Signals::ResetOn:
-                cpu->setReset(true);
-                break;
-            case Signals::ResetOff:
-                cpu->setReset(false);
-                break;
-            case Signals::IrqOn:
-                cpu->setIrq(true);
-                break;
-            case Signals::IrqOff:
-                cpu->setIrq(false);
-                break;
-            }
-        }
+    if( argc-optind != 2 )
+        usage(argv[0]);
+    // A trace replays the whole program from reset, so it can't start part way through
+    if( options.manifest && strncmp(options.backend_name, "trace:", 6)==0 )
+        usage(argv[0]);
+    if( !options.segments.empty() && !options.manifest )
+        usage(argv[0]);
 
-        delayed_actions.erase( action_iter );
+    MemoryImage image = readMemoryImage(argv[optind]);
+    TestPlan plan;
+    try {
+        plan = readTestPlan(argv[optind+1]);
+    } catch( std::runtime_error &ex ) {
+        std::cerr<<ex.what()<<"\n";
+        return 2;
     }
-};
 
-int main(int argc, char *argv[]) {
-    TestBus bus(argv[1], argv[2]);
+    TestBus bus;
+    bus.trace = options.fast ? nullptr : &std::cout;
+    bus.notes = &std::cerr;
+    bus.batched = options.fast;
+
+    std::unique_ptr<CpuBackend> backend = makeCpuBackend(options.backend_name, bus);
+    if( !backend )
+        usage(argv[0]);
 
-    c6502 cpu(bus);
+    if( options.manifest )
+        return verify_segments(options, image, plan);
 
-    cpu.setReset(true);
+    bus.start(image, &plan, *backend);
+    backend->setReset(true);
 
+    bool trace_ended = false;
     try {
-        cpu.runCpu();
-    } catch(TestDone ex) {
+        try {
+            while( true )
+                backend->run(1000000);
+        } catch(TestDone ex) {
+        } catch(TraceBackend::TraceEnded ex) {
+            trace_ended = true;
+        }
+
+        bus.checkLog();
+    } catch(const PlanMismatch &ex) {
+        std::cout<<std::flush;
+        std::cerr<<ex.what()<<"\n";
+        return 1;
+    }
+
+    if( trace_ended ) {
+        std::cerr<<"The trace ended before the test did\n";
+        return 1;
     }
 
     std::cout<<"Test finished successfully\n";
-}
\ No newline at end of file
+}
@@ -0,0 +1,245 @@
+#include "via6522.h"
+
+Via6522::Via6522(Scheduler &scheduler) :
+    scheduler_(scheduler),
+    t1_timeout_( [this]() { t1Timeout(); } ),
+    t2_timeout_( [this]() { t2Timeout(); } )
+{}
+
+Via6522::~Via6522() {
+    scheduler_.cancel(t1_timeout_);
+    scheduler_.cancel(t2_timeout_);
+}
+
+uint8_t Via6522::read(uint8_t reg) {
+    uint64_t now = scheduler_.now();
+
+    switch( reg & 0xf ) {
+    case ORB:
+        clearFlags(IrqCb1 | IrqCb2);
+        return portB();
+    case ORA:
+        clearFlags(IrqCa1 | IrqCa2);
+        return portA();
+    case DDRB: return ddrb_;
+    case DDRA: return ddra_;
+    case T1CL:
+        clearFlags(IrqT1);
+        return t1Counter(now) & 0xff;
+    case T1CH: return t1Counter(now) >> 8;
+    case T1LL: return t1_latch_ & 0xff;
+    case T1LH: return t1_latch_ >> 8;
+    case T2CL:
+        clearFlags(IrqT2);
+        return t2Counter(now) & 0xff;
+    case T2CH: return t2Counter(now) >> 8;
+    case SR: return sr_;
+    case ACR: return acr_;
+    case PCR: return pcr_;
+    case IFR: return ifr_ | ( irq_ ? 0x80 : 0 );
+    case IER: return ier_ | 0x80;
+    case ORA_NH: return portA();
+    }
+
+    return 0;
+}
+
+void Via6522::write(uint8_t reg, uint8_t value) {
+    uint64_t now = scheduler_.now();
+
+    switch( reg & 0xf ) {
+    case ORB:
+        clearFlags(IrqCb1 | IrqCb2);
+        orb_ = value;
+        outputB();
+        break;
+    case ORA:
+        clearFlags(IrqCa1 | IrqCa2);
+        [[fallthrough]];
+    case ORA_NH:
+        ora_ = value;
+        outputA();
+        break;
+    case DDRB:
+        ddrb_ = value;
+        outputB();
+        break;
+    case DDRA:
+        ddra_ = value;
+        outputA();
+        break;
+    case T1CL:
+    case T1LL:
+        t1CatchUp(now);
+        t1_latch_ = (t1_latch_ & 0xff00) | value;
+        t1Schedule();
+        break;
+    case T1LH:
+        t1CatchUp(now);
+        t1_latch_ = (t1_latch_ & 0x00ff) | value<<8;
+        clearFlags(IrqT1);
+        t1Schedule();
+        break;
+    case T1CH:
+        // The counter loads on the next cycle
+        t1_latch_ = (t1_latch_ & 0x00ff) | value<<8;
+        t1_count_ = t1_latch_;
+        t1_base_ = now + 1;
+        t1_armed_ = true;
+        clearFlags(IrqT1);
+        t1Schedule();
+        break;
+    case T2CL:
+        t2_latch_ = value;
+        break;
+    case T2CH:
+        t2_count_ = t2_latch_ | value<<8;
+        t2_base_ = now + 1;
+        t2_armed_ = true;
+        clearFlags(IrqT2);
+        if( !t2CountingPulses() )
+            scheduler_.schedule(t2_timeout_, t2_base_ + t2_count_ + 1);
+        break;
+    case SR:
+        sr_ = value;
+        break;
+    case ACR: {
+        // Switching T2 in or out of pulse counting stops or restarts the count where it is
+        uint16_t t2 = t2Counter(now);
+        t1CatchUp(now);
+
+        acr_ = value;
+
+        t2_count_ = t2;
+        t2_base_ = now;
+        if( t2_armed_ && !t2CountingPulses() )
+            scheduler_.schedule(t2_timeout_, t2_base_ + t2_count_ + 1);
+        else
+            scheduler_.cancel(t2_timeout_);
+
+        t1Schedule();
+        break;
+    }
+    case PCR:
+        pcr_ = value;
+        break;
+    case IFR:
+        clearFlags(value & 0x7f);
+        break;
+    case IER:
+        if( value & 0x80 )
+            ier_ |= value & 0x7f;
+        else
+            ier_ &= ~value;
+        updateIrq();
+        break;
+    }
+}
+
+void Via6522::setCa1(bool level) {
+    bool positive_edge = pcr_ & 0x01;
+    if( level!=ca1_ && level==positive_edge )
+        setFlags(IrqCa1);
+
+    ca1_ = level;
+}
+
+void Via6522::setCb1(bool level) {
+    bool positive_edge = pcr_ & 0x10;
+    if( level!=cb1_ && level==positive_edge )
+        setFlags(IrqCb1);
+
+    cb1_ = level;
+}
+
+// Moves t1_base_ to the start of the period now falls in
+void Via6522::t1CatchUp(uint64_t now) {
+    uint64_t period = t1_count_ + 2;
+    if( now<t1_base_ + period )
+        return;
+
+    // The period in progress may have started from an older latch value, but later ones all use this one
+    t1_base_ += period;
+    t1_count_ = t1_latch_;
+    period = t1_count_ + 2;
+    t1_base_ += (now - t1_base_) / period * period;
+}
+
+uint16_t Via6522::t1Counter(uint64_t now) {
+    if( now<t1_base_ )
+        return t1_count_;
+
+    t1CatchUp(now);
+
+    uint64_t elapsed = now - t1_base_;
+    return elapsed<=t1_count_ ? t1_count_ - elapsed : 0xffff;
+}
+
+// Schedules the next timeout that will raise the interrupt, if any
+void Via6522::t1Schedule() {
+    uint64_t now = scheduler_.now();
+    if( !t1_armed_ ) {
+        scheduler_.cancel(t1_timeout_);
+        return;
+    }
+
+    if( now>=t1_base_ )
+        t1CatchUp(now);
+
+    uint64_t timeout = t1_base_ + t1_count_ + 1;
+    if( timeout<=now )
+        timeout += 1 + t1_latch_ + 1;
+
+    scheduler_.schedule(t1_timeout_, timeout);
+}
+
+void Via6522::t1Timeout() {
+    setFlags(IrqT1);
+
+    // One shot mode only interrupts once per write to T1CH
+    if( !t1FreeRunning() )
+        t1_armed_ = false;
+    t1Schedule();
+}
+
+uint16_t Via6522::t2Counter(uint64_t now) const {
+    if( now<t2_base_ || t2CountingPulses() )
+        return t2_count_;
+
+    return t2_count_ - (now - t2_base_);
+}
+
+void Via6522::t2Timeout() {
+    setFlags(IrqT2);
+    t2_armed_ = false;
+}
+
+void Via6522::setFlags(uint8_t flags) {
+    ifr_ |= flags;
+    updateIrq();
+}
+
+void Via6522::clearFlags(uint8_t flags) {
+    ifr_ &= ~flags;
+    updateIrq();
+}
+
+void Via6522::updateIrq() {
+    bool irq = ifr_ & ier_ & 0x7f;
+    if( irq==irq_ )
+        return;
+
+    irq_ = irq;
+    if( on_irq )
+        on_irq(irq);
+}
+
+void Via6522::outputA() {
+    if( on_port_a )
+        on_port_a( ora_ | ~ddra_ );
+}
+
+void Via6522::outputB() {
+    if( on_port_b )
+        on_port_b( orb_ | ~ddrb_ );
+}
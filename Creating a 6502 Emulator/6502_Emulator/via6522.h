@@ -0,0 +1,92 @@
+#pragma once
+
+#include "scheduler.h"
+
+#include <functional>
+
+#include <stdint.h>
+
+// MOS 6522 VIA.
+//
+// Nothing here runs per cycle. Timer counters are worked out from the scheduler's cycle count when read,
+// and a timer only costs an event at the cycle it times out, which is when the interrupt flag is set.
+//
+// Not modelled: the shift register (SR reads back what was written), T2 pulse counting (T2 holds its
+// value in that mode), PB7 output from T1, CA2/CB2 other than as manual outputs, and input latching.
+class Via6522 {
+public:
+    enum Register : uint8_t {
+        ORB, ORA, DDRB, DDRA, T1CL, T1CH, T1LL, T1LH, T2CL, T2CH, SR, ACR, PCR, IFR, IER, ORA_NH
+    };
+
+    static constexpr uint8_t
+            IrqCa2 = 0x01, IrqCa1 = 0x02, IrqSr = 0x04, IrqCb2 = 0x08, IrqCb1 = 0x10, IrqT2 = 0x20, IrqT1 = 0x40;
+
+    // Called when the IRQ output changes, typically wired to c6502::setIrq
+    std::function<void (bool active)> on_irq;
+    // Called when port outputs change. Pins set as inputs read as high.
+    std::function<void (uint8_t value)> on_port_a, on_port_b;
+
+private:
+    Scheduler &scheduler_;
+    Scheduler::Event t1_timeout_, t2_timeout_;
+
+    uint8_t ora_ = 0, orb_ = 0, ddra_ = 0, ddrb_ = 0;
+    uint8_t input_a_ = 0xff, input_b_ = 0xff;
+    uint8_t sr_ = 0, acr_ = 0, pcr_ = 0, ifr_ = 0, ier_ = 0;
+    bool ca1_ = false, cb1_ = false;
+    bool irq_ = false;
+
+    // The counter holds t1_count_ at cycle t1_base_, counts down through 0 to 0xffff, and reloads from
+    // the latch on the cycle after that. t1_count_ is the latch value the current period started with.
+    uint16_t t1_latch_ = 0, t1_count_ = 0;
+    uint64_t t1_base_ = 0;
+    bool t1_armed_ = false;
+
+    // T2 just keeps counting down past its timeout
+    uint8_t t2_latch_ = 0;
+    uint16_t t2_count_ = 0;
+    uint64_t t2_base_ = 0;
+    bool t2_armed_ = false;
+
+public:
+    explicit Via6522(Scheduler &scheduler);
+    ~Via6522();
+
+    Via6522(const Via6522 &that) = delete;
+    Via6522 &operator=(const Via6522 &that) = delete;
+
+    uint8_t read(uint8_t reg);
+    void write(uint8_t reg, uint8_t value);
+
+    // Levels on the input pins
+    void setPortA(uint8_t input) { input_a_ = input; }
+    void setPortB(uint8_t input) { input_b_ = input; }
+    void setCa1(bool level);
+    void setCb1(bool level);
+
+    // Levels on CA2 and CB2 when the PCR sets them to manual output; high in any other mode
+    bool ca2() const { return (pcr_ & 0x0e)!=0x0c; }
+    bool cb2() const { return (pcr_ & 0xe0)!=0xc0; }
+
+private:
+    bool t1FreeRunning() const { return acr_ & 0x40; }
+    bool t2CountingPulses() const { return acr_ & 0x20; }
+
+    void t1CatchUp(uint64_t now);
+    uint16_t t1Counter(uint64_t now);
+    void t1Schedule();
+    void t1Timeout();
+
+    uint16_t t2Counter(uint64_t now) const;
+    void t2Timeout();
+
+    void setFlags(uint8_t flags);
+    void clearFlags(uint8_t flags);
+    void updateIrq();
+
+    uint8_t portA() const { return (ora_ & ddra_) | (input_a_ & ~ddra_); }
+    uint8_t portB() const { return (orb_ & ddrb_) | (input_b_ & ~ddrb_); }
+    void outputA();
+    void outputB();
+};
@@ -0,0 +1,148 @@
+// Runs c6502 with a 6522 VIA whose T1 interrupts at a fixed rate, while the main program counts in a
+// loop. Checks the number of interrupts taken against the timer period, and reports emulated MHz with
+// the VIA in the loop.
+
+#include "Bus.h"
+#include "c6502.h"
+#include "scheduler.h"
+#include "via6522.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+using Image = std::array<uint8_t, 65536>;
+
+static constexpr Addr CodeAddress = 0x0400, IrqAddress = 0x0500;
+static constexpr Addr ViaAddress = 0xc000;
+static constexpr Addr Ticks = 0x0010;
+
+// Starts T1 free running with the latch patched in at LatchLow/LatchHigh, then counts forever
+static constexpr uint8_t MainProgram[] = {
+    0x78,                   //        SEI
+    0xa9, 0x40,             //        LDA #$40
+    0x8d, 0x0b, 0xc0,       //        STA ACR
+    0xa9, 0x00,             //        LDA #<latch
+    0x8d, 0x04, 0xc0,       //        STA T1CL
+    0xa9, 0x00,             //        LDA #>latch
+    0x8d, 0x05, 0xc0,       //        STA T1CH
+    0xa9, 0xc0,             //        LDA #$C0
+    0x8d, 0x0e, 0xc0,       //        STA IER
+    0x58,                   //        CLI
+    0xe6, 0x20,             // loop:  INC $20
+    0xd0, 0xfc,             //        BNE loop
+    0xe6, 0x21,             //        INC $21
+    0x4c, 0x16, 0x04,       //        JMP loop
+};
+static constexpr size_t LatchLow = 7, LatchHigh = 12;
+
+// Acknowledges T1 and counts the interrupt in Ticks
+static constexpr uint8_t IrqProgram[] = {
+    0x48,                   //        PHA
+    0xad, 0x04, 0xc0,       //        LDA T1CL
+    0xe6, 0x10,             //        INC Ticks
+    0xd0, 0x02,             //        BNE done
+    0xe6, 0x11,             //        INC Ticks+1
+    0x68,                   // done:  PLA
+    0x40,                   //        RTI
+};
+
+class RunDone {};
+
+class ViaBus : public Bus {
+    Image       &memory;
+    Scheduler   &scheduler;
+    Via6522     &via;
+
+public:
+    ViaBus(Image &memory, Scheduler &scheduler, Via6522 &via) : memory(memory), scheduler(scheduler), via(via) {}
+
+    virtual uint8_t read( c6502 *cpu, Addr address, bool sync = false ) override {
+        scheduler.tick();
+
+        if( (address & 0xfff0)==ViaAddress )
+            return via.read(address);
+
+        return memory[address];
+    }
+
+    virtual void write( c6502 *cpu, Addr address, uint8_t value ) override {
+        scheduler.tick();
+
+        if( (address & 0xfff0)==ViaAddress )
+            via.write(address, value);
+        else
+            memory[address] = value;
+    }
+};
+
+static void usage(const char *name) {
+    std::cerr<<"Usage: "<<name<<" [-l latch] [-c cycles]\n"
+            "  -l    T1 latch value; interrupts come every latch+2 cycles (default 998)\n"
+            "  -c    Cycles to run (default 10000000)\n";
+    exit(2);
+}
+
+int main(int argc, char *argv[]) {
+    unsigned latch = 998;
+    uint64_t cycles = 10000000;
+
+    int opt;
+    while( (opt = getopt(argc, argv, "l:c:")) != -1 ) {
+        switch( opt ) {
+        case 'l': latch = strtoul(optarg, nullptr, 0); break;
+        case 'c': cycles = strtoull(optarg, nullptr, 0); break;
+        default: usage(argv[0]);
+        }
+    }
+
+    // Below about 60 cycles the handler can't keep up
+    if( argc!=optind || latch<64 || latch>0xffff )
+        usage(argv[0]);
+
+    Image memory{};
+    memcpy(&memory[CodeAddress], MainProgram, sizeof(MainProgram));
+    memory[CodeAddress + LatchLow] = latch & 0xff;
+    memory[CodeAddress + LatchHigh] = latch >> 8;
+    memcpy(&memory[IrqAddress], IrqProgram, sizeof(IrqProgram));
+    memory[0xfffe] = IrqAddress & 0xff;
+    memory[0xffff] = IrqAddress >> 8;
+
+    Scheduler scheduler;
+    Via6522 via(scheduler);
+    ViaBus bus(memory, scheduler, via);
+    c6502 cpu(bus);
+    cpu.setSignalLogging(false);
+    via.on_irq = [&cpu](bool active) { cpu.setIrq(active); };
+
+    Scheduler::Event end( []() { throw RunDone(); } );
+    scheduler.schedule(end, cycles);
+
+    cpu.setState( c6502::State{ .regA = 0, .regX = 0, .regY = 0, .regSp = 0xfd, .regStatus = 0x34,
+            .pc = CodeAddress } );
+
+    auto start = std::chrono::steady_clock::now();
+    try {
+        cpu.runCpu();
+    } catch( RunDone ex ) {
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - start );
+
+    unsigned ticks = memory[Ticks] | memory[Ticks+1]<<8;
+    // The first interrupt comes later by the setup code's length, and the last may still be pending
+    unsigned expected = ( cycles / (latch+2) ) & 0xffff;
+    bool ok = ticks+1>=expected && ticks<=expected;
+
+    char buffer[160];
+    snprintf(buffer, sizeof(buffer), "%llu cycles in %.3fs (%.3f emulated MHz), %u interrupts, expected %u: %s\n",
+            (unsigned long long)cycles, elapsed.count() / 1e6, double(cycles) / std::max<int64_t>(elapsed.count(), 1),
+            ticks, expected, ok ? "ok" : "WRONG");
+    std::cout<<buffer;
+
+    return ok ? 0 : 1;
+}
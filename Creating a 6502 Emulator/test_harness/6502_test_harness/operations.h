@@ -73,7 +73,7 @@ enum class Operation {
   Op_WAI
 };
 
-const char *OperationNames[] = {
+const char * const OperationNames[] = {
   "???",
   "ADC",
   "AND",
@@ -151,11 +151,11 @@ enum class AddressingMode {
   Unknown, Abs, Abs_x_ind, Abs_x, Abs_y, Abs_ind, Accumulator, Immediate, Implied, Pc_rel, Stack, Zp, Zp_x_ind, Zp_x, Zp_y, Zp_ind, Zp_ind_y
 };
 
-const char *AddressingModeNames[] = {
+const char * const AddressingModeNames[] = {
   "", " abs", " (abs,x)", " abs,x", " abs,y", " (abs)", " A", " #Immediate", "", " pc+rel", " stack", " zp", " (zp,x)", " zp,x", " zp,y", " (zp)", " (zp),y"
 };
 
-const struct { Operation op; AddressingMode mode; } opcodes[] = {
+constexpr struct { Operation op; AddressingMode mode; } opcodes[] = {
   {Operation::Op_BRK, AddressingMode::Stack},           // 00
   {Operation::Op_ORA, AddressingMode::Zp_x_ind},
   {Operation::Op_Unknown},
@@ -307,7 +307,7 @@ const struct { Operation op; AddressingMode mode; } opcodes[] = {
   {Operation::Op_STY, AddressingMode::Zp_x},
   {Operation::Op_STA, AddressingMode::Zp_x},
   {Operation::Op_STX, AddressingMode::Zp_y},
-  {Operation::Op_SMB, AddressingMode::Pc_rel},
+  {Operation::Op_SMB, AddressingMode::Zp},
   {Operation::Op_TYA, AddressingMode::Implied},
   {Operation::Op_STA, AddressingMode::Abs_y},
   {Operation::Op_TXS, AddressingMode::Implied},
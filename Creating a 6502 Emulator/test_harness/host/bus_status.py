@@ -0,0 +1,12 @@
+from typing import Optional
+
+
+class BusStatus:
+    def __init__(self, address: str, data: str, read: bool, flags: tuple[str], opcode: Optional[str] = None):
+        self.address = int(address, 16)
+        if data is not None:
+            self.data = int(data, 16)
+        self.read = read
+        self.write = not read
+        self.flags = set( [flag for flag in flags if flag] )
+        self.opcode = opcode
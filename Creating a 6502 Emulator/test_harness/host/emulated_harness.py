@@ -0,0 +1,46 @@
+import libc6502
+
+from bus_status import BusStatus
+
+
+class EmulatedHarness:
+    """
+    Drop in replacement for TestHarness that runs an emulated 6502 in process, through libc6502.so,
+    rather than a real one over the serial line.
+
+    Parameters:
+    backend (str): The CPU backend to emulate with, "c6502" or "netlist".
+    """
+    def __init__(self, backend: str):
+        print(f"Setting up emulated test harness with the {backend} backend")
+        self.machine = libc6502.Machine(backend)
+
+    def read_memory(self, address: int) -> int:
+        return self.machine.dump(address, 1)[0]
+
+    def write_memory(self, address: int, data: int) -> None:
+        self.machine.load(address, bytes([data]))
+
+    def reset(self, state: bool) -> None:
+        self.machine.set_signal(libc6502.RESET, state)
+
+    def irq(self, state: bool) -> None:
+        self.machine.set_signal(libc6502.IRQ, state)
+
+    def nmi(self, state: bool) -> None:
+        self.machine.set_signal(libc6502.NMI, state)
+
+    def ready(self, state: bool) -> None:
+        self.machine.set_signal(libc6502.READY, state)
+
+    def setOverflow(self, state: bool) -> None:
+        self.machine.set_signal(libc6502.SO, state)
+
+    def cycle(self) -> BusStatus:
+        cycle = self.machine.step()
+
+        return BusStatus(
+                f"{cycle.address:04x}",
+                f"{cycle.data:02x}",
+                bool(cycle.read),
+                ("SYNC",) if cycle.sync else () )
@@ -0,0 +1,166 @@
+import ctypes
+import os
+
+from typing import Callable, Optional
+
+
+_API_VERSION = 1
+_DEFAULT_PATH = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", "6502_Emulator", "libc6502.so")
+
+RESET, IRQ, NMI, READY, SO = range(5)
+
+
+class BusCycle(ctypes.Structure):
+    _fields_ = [
+            ("address", ctypes.c_uint16),
+            ("data", ctypes.c_uint8),
+            ("read", ctypes.c_uint8),
+            ("sync", ctypes.c_uint8) ]
+
+
+class Registers(ctypes.Structure):
+    _fields_ = [
+            ("a", ctypes.c_uint8),
+            ("x", ctypes.c_uint8),
+            ("y", ctypes.c_uint8),
+            ("sp", ctypes.c_uint8),
+            ("status", ctypes.c_uint8),
+            ("pc", ctypes.c_uint16) ]
+
+
+_ReadCallback = ctypes.CFUNCTYPE(ctypes.c_uint8, ctypes.c_void_p, ctypes.c_uint16, ctypes.c_int)
+_WriteCallback = ctypes.CFUNCTYPE(None, ctypes.c_void_p, ctypes.c_uint16, ctypes.c_uint8)
+
+_library = None
+
+def _load_library() -> ctypes.CDLL:
+    global _library
+    if _library is not None:
+        return _library
+
+    library = ctypes.CDLL( os.environ.get("LIBC6502", _DEFAULT_PATH) )
+
+    machine = ctypes.c_void_p
+    signatures = {
+        "c6502_api_version": (ctypes.c_int, []),
+        "c6502_create": (machine, [ctypes.c_char_p]),
+        "c6502_destroy": (None, [machine]),
+        "c6502_error": (ctypes.c_char_p, [machine]),
+        "c6502_load": (None, [machine, ctypes.c_uint16, ctypes.c_char_p, ctypes.c_size_t]),
+        "c6502_dump": (None, [machine, ctypes.c_uint16, ctypes.c_char_p, ctypes.c_size_t]),
+        "c6502_set_io": (None, [machine, ctypes.c_uint16, ctypes.c_uint16, _ReadCallback, _WriteCallback, ctypes.c_void_p]),
+        "c6502_set_signal": (None, [machine, ctypes.c_int, ctypes.c_int]),
+        "c6502_run": (ctypes.c_int, [machine, ctypes.c_uint64]),
+        "c6502_step": (ctypes.c_int, [machine, ctypes.POINTER(BusCycle)]),
+        "c6502_run_to_instruction": (ctypes.c_int, [machine, ctypes.c_uint64]),
+        "c6502_cycles": (ctypes.c_uint64, [machine]),
+        "c6502_registers": (ctypes.c_int, [machine, ctypes.POINTER(Registers)]),
+        "c6502_save_state": (ctypes.c_void_p, [machine]),
+        "c6502_restore_state": (ctypes.c_int, [machine, ctypes.c_void_p]),
+        "c6502_free_state": (None, [ctypes.c_void_p]),
+    }
+    for name, (restype, argtypes) in signatures.items():
+        function = getattr(library, name)
+        function.restype = restype
+        function.argtypes = argtypes
+
+    version = library.c6502_api_version()
+    if version != _API_VERSION:
+        raise RuntimeError(f"libc6502.so has API version {version}, expected {_API_VERSION}")
+
+    _library = library
+    return library
+
+
+class State:
+    """
+    A saved machine state. Only restores into a machine with the same backend.
+    """
+    def __init__(self, library: ctypes.CDLL, handle: int):
+        self._library = library
+        self.handle = handle
+
+    def __del__(self):
+        self._library.c6502_free_state(self.handle)
+
+
+class Machine:
+    """
+    A 6502 from libc6502.so, running in process on 64K of RAM.
+
+    Parameters:
+    backend (str): "c6502", or "netlist" for the perfect6502 netlist.
+    """
+    def __init__(self, backend: str = "c6502"):
+        self._library = _load_library()
+        self._handle = self._library.c6502_create(backend.encode())
+        if not self._handle:
+            raise RuntimeError(f"Unknown CPU backend {backend}")
+
+        # Reused, so stepping doesn't allocate
+        self._cycle = BusCycle()
+        self._callbacks = None
+
+    def __del__(self):
+        if getattr(self, "_handle", None):
+            self._library.c6502_destroy(self._handle)
+
+    def load(self, address: int, data: bytes) -> None:
+        self._library.c6502_load(self._handle, address, data, len(data))
+
+    def dump(self, address: int, size: int) -> bytes:
+        buffer = ctypes.create_string_buffer(size)
+        self._library.c6502_dump(self._handle, address, buffer, size)
+
+        return buffer.raw
+
+    def set_io(self, mask: int, match: int, read: Callable[[int, bool], int], write: Callable[[int, int], None]) -> None:
+        """
+        Sends accesses where (address & mask)==match to read(address, sync) and write(address, value).
+        """
+        self._callbacks = (
+                _ReadCallback( lambda context, address, sync: read(address, bool(sync)) ),
+                _WriteCallback( lambda context, address, value: write(address, value) ) )
+        self._library.c6502_set_io(self._handle, mask, match, *self._callbacks, None)
+
+    def set_signal(self, signal: int, asserted: bool) -> None:
+        self._library.c6502_set_signal(self._handle, signal, asserted)
+
+    def run(self, cycles: int) -> None:
+        self._check( self._library.c6502_run(self._handle, cycles) )
+
+    def step(self) -> BusCycle:
+        """
+        Runs one cycle. The BusCycle returned is overwritten by the next step.
+        """
+        self._check( self._library.c6502_step(self._handle, self._cycle) )
+
+        return self._cycle
+
+    def run_to_instruction(self, max_cycles: int = 100) -> None:
+        self._check( self._library.c6502_run_to_instruction(self._handle, max_cycles) )
+
+    @property
+    def cycles(self) -> int:
+        return self._library.c6502_cycles(self._handle)
+
+    def registers(self) -> Optional[Registers]:
+        registers = Registers()
+        if self._library.c6502_registers(self._handle, registers) != 0:
+            return None
+
+        return registers
+
+    def save_state(self) -> State:
+        handle = self._library.c6502_save_state(self._handle)
+        if not handle:
+            self._check(-1)
+
+        return State(self._library, handle)
+
+    def restore_state(self, state: State) -> None:
+        self._check( self._library.c6502_restore_state(self._handle, state.handle) )
+
+    def _check(self, result: int) -> None:
+        if result != 0:
+            raise RuntimeError( self._library.c6502_error(self._handle).decode() )
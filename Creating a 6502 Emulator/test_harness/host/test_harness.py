@@ -2,20 +2,9 @@ import re
 import serial
 import time
 
-from typing import Optional
-
 import colored
 
-
-class BusStatus:
-    def __init__(self, address: str, data: str, read: bool, flags: tuple[str], opcode: Optional[str] = None):
-        self.address = int(address, 16)
-        if data is not None:
-            self.data = int(data, 16)
-        self.read = read
-        self.write = not read
-        self.flags = set( [flag for flag in flags if flag] )
-        self.opcode = opcode
+from bus_status import BusStatus
 
 
 class TestHarness:
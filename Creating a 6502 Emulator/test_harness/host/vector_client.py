@@ -0,0 +1,101 @@
+import os
+import socket
+
+from dataclasses import dataclass, field
+from typing import Callable, Iterable, Optional
+
+
+@dataclass
+class VectorResult:
+    """
+    How a job on the vector service ended.
+
+    status is "pass", "fail", "limit" or "error". registers is (a, x, y, sp, status, pc), when the service
+    sent them.
+    """
+    status: str
+    cycles: int = 0
+    message: str = ""
+    registers: Optional[tuple[int, ...]] = None
+    notes: list[str] = field(default_factory=list)
+
+    @property
+    def passed(self) -> bool:
+        return self.status == "pass"
+
+
+class VectorClient:
+    """
+    A connection to vector_service, which runs test programs on CPUs it keeps warm.
+
+    Parameters:
+    socket_path (str): The Unix socket the service listens on.
+    """
+    def __init__(self, socket_path: str = "vector_service.sock"):
+        self.socket = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self.socket.connect(socket_path)
+        self.replies = self.socket.makefile("r")
+
+    def close(self) -> None:
+        self.replies.close()
+        self.socket.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc_info):
+        self.close()
+
+    def run(self, memory_file: str, test_plan_file: Optional[str] = None, backend: str = "c6502",
+            signals: Iterable[tuple[str, int, int]] = (), stop: Optional[int] = None, limit: Optional[int] = None,
+            trace: Optional[Callable[[str], None]] = None) -> VectorResult:
+        """
+        Runs one job. signals are (name, on cycle, off cycle). trace, if given, is called with each bus cycle
+        as the service streams it.
+        """
+        # Paths are opened by the service, which may not share our working directory. Each takes up the rest
+        # of its line, so it may have spaces but not line breaks.
+        paths = [memory_file] + ([test_plan_file] if test_plan_file is not None else [])
+        if any("\n" in path or "\r" in path for path in paths):
+            raise ValueError("The vector service can't take paths with line breaks in them")
+
+        job = [f"backend {backend}", f"mem {os.path.abspath(memory_file)}"]
+        if test_plan_file is not None:
+            job.append(f"plan {os.path.abspath(test_plan_file)}")
+        for name, on, off in signals:
+            job.append(f"signal {name} {on} {off}")
+        if stop is not None:
+            job.append(f"stop {stop:x}")
+        if limit is not None:
+            job.append(f"limit {limit}")
+        if trace is not None:
+            job.append("trace")
+        job.append("run")
+
+        self.socket.sendall( ("\n".join(job) + "\n").encode() )
+
+        result = VectorResult("error")
+        for line in self.replies:
+            kind, _, rest = line.rstrip("\n").partition(" ")
+
+            if kind == "trace":
+                trace(rest)
+            elif kind == "note":
+                result.notes.append(rest)
+            elif kind == "registers":
+                result.registers = tuple( int(value, 16) for value in rest.split() )
+            elif kind in ("pass", "limit"):
+                result.status = kind
+                result.cycles = int(rest)
+                return result
+            elif kind == "fail":
+                cycles, _, message = rest.partition(" ")
+                result.status = kind
+                result.cycles = int(cycles)
+                result.message = message
+                return result
+            elif kind == "error":
+                result.message = rest
+                return result
+
+        raise ConnectionError("The vector service closed the connection")
@@ -691,6 +691,63 @@ isNodeHigh(state_t *state, nodenum_t nn)
 	return get_nodes_value(state, nn);
 }
 
+/************************************************************
+ *
+ * Snapshots
+ *
+ ************************************************************/
+
+/*
+ * Between steps the node lists are empty, so the pullup/pulldown
+ * state of the inputs plus the node and transistor values are
+ * everything needed to resume the chip later, possibly in another
+ * state built from the same netlist.
+ */
+
+static unsigned int
+nodeBitmapSize(state_t *state)
+{
+	return WORDS_FOR_BITS(state->nodes) * sizeof(bitmap_t);
+}
+
+static unsigned int
+transistorBitmapSize(state_t *state)
+{
+	return WORDS_FOR_BITS(state->transistors) * sizeof(bitmap_t);
+}
+
+unsigned int
+nodeStateSize(state_t *state)
+{
+	return 3 * nodeBitmapSize(state) + transistorBitmapSize(state);
+}
+
+void
+saveNodeState(state_t *state, void *buffer)
+{
+	unsigned char *out = buffer;
+	memcpy(out, state->nodes_pullup, nodeBitmapSize(state));
+	out += nodeBitmapSize(state);
+	memcpy(out, state->nodes_pulldown, nodeBitmapSize(state));
+	out += nodeBitmapSize(state);
+	memcpy(out, state->nodes_value, nodeBitmapSize(state));
+	out += nodeBitmapSize(state);
+	memcpy(out, state->transistors_on, transistorBitmapSize(state));
+}
+
+void
+restoreNodeState(state_t *state, const void *buffer)
+{
+	const unsigned char *in = buffer;
+	memcpy(state->nodes_pullup, in, nodeBitmapSize(state));
+	in += nodeBitmapSize(state);
+	memcpy(state->nodes_pulldown, in, nodeBitmapSize(state));
+	in += nodeBitmapSize(state);
+	memcpy(state->nodes_value, in, nodeBitmapSize(state));
+	in += nodeBitmapSize(state);
+	memcpy(state->transistors_on, in, transistorBitmapSize(state));
+}
+
 /************************************************************
  *
  * Interfacing and Extracting State
@@ -9,5 +9,9 @@ BOOL isNodeHigh(state_t *state, nodenum_t nn);
 unsigned int readNodes(state_t *state, int count, nodenum_t *nodelist);
 void writeNodes(state_t *state, int count, nodenum_t *nodelist, int v);
 
+unsigned int nodeStateSize(state_t *state);
+void saveNodeState(state_t *state, void *buffer);
+void restoreNodeState(state_t *state, const void *buffer);
+
 void recalcNodeList(state_t *state);
 void stabilizeChip(state_t *state);
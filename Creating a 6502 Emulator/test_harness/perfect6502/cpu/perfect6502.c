@@ -204,6 +204,21 @@ destroyChip(void *state)
     destroyNodesAndTransistors(state);
 }
 
+/* FNV-1a hash of the netlist, to tell which netlist produced a set of results */
+unsigned int
+netlistChecksum()
+{
+	const unsigned char *parts[] = { (const unsigned char *)netlist_6502_node_is_pullup, (const unsigned char *)netlist_6502_transdefs };
+	size_t sizes[] = { sizeof(netlist_6502_node_is_pullup), sizeof(netlist_6502_transdefs) };
+	unsigned int hash = 2166136261u;
+
+	for (int part = 0; part < 2; part++)
+		for (size_t i = 0; i < sizes[part]; i++)
+			hash = (hash ^ parts[part][i]) * 16777619u;
+
+	return hash;
+}
+
 /************************************************************
  *
  * Tracing/Debugging
@@ -4,6 +4,7 @@
 
 extern state_t *initAndResetChip();
 extern void destroyChip(state_t *state);
+extern unsigned int netlistChecksum();
 extern void step(state_t *state);
 extern void chipStatus(state_t *state);
 extern unsigned short readPC(state_t *state);
@@ -123,6 +123,7 @@ start:
     pha
     .endif
 
+test_flags:
     ; Direct flags manipulation
     lda #$ff
     sta $1fe
@@ -152,6 +153,7 @@ start:
     clv
     jsr flags_dump
 
+test_addressing:
     ; Test addressing modes
     lda lda_abs_test
     lda lda_abs_test,x          ; No page transition
@@ -171,6 +173,7 @@ start:
     lda (lda_zp_test),y         ; With page transition
 
 
+test_asl:
     ; ASL test
     lda #1
 asl_loop:
@@ -186,6 +189,7 @@ asl_loop:
     jsr flags_dump
     bne asl_loop
 
+test_adc:
     ; ADC tests
     ldx #2
     ldy #1
@@ -250,6 +254,7 @@ adc_loop:
     dex
     bne adc_loop
 
+test_sbc:
 sbc_loop:
     stx value_dump
     sty value_dump
@@ -316,6 +321,7 @@ sbc_loop:
     dey
     bne sbc_loop
 
+test_bit:
     ; BIT test
     lda #$4f
     php
@@ -337,6 +343,7 @@ sbc_loop:
     bit bit_zp_test
     php
 
+test_brk:
     ; BRK test
     sed
     cli
@@ -347,6 +354,7 @@ sbc_loop:
     brk
     .byte $2
 
+test_cmp:
     ; CMP test
     cmp cmp_abs_test
     php
@@ -375,6 +383,7 @@ sbc_loop:
     cmp #$50
     php
 
+test_cpx:
     ; CPX test
     cpx cmp_abs_test
     php
@@ -392,6 +401,7 @@ sbc_loop:
     cpx #$0
     php
 
+test_cpy:
     ; CPY test
     cpy cmp_abs_test
     php
@@ -409,6 +419,7 @@ sbc_loop:
     cpy #$0
     php
 
+test_dec:
     ; DEC test
     dec dec_abs_test
     php
@@ -434,6 +445,7 @@ dec_loop:
     sta branch_bit_test
     jsr bb_test
 
+test_eor:
     ; EOR test
     php
     eor eor_abs_test
@@ -474,6 +486,7 @@ dec_loop:
     php
 
 
+test_inc:
     ; inc tests
     .if C02
     dec
@@ -501,6 +514,7 @@ inc_loop:
     dex
     bne inc_loop
 
+test_jmp:
     .if C02
     jmp jmp_tests_c02
     .else
@@ -511,6 +525,7 @@ jmp_test_continues:
     php
 
 
+test_ldx:
     ; LDX test
     ldx ldx_abs_test
     php
@@ -532,6 +547,7 @@ jmp_test_continues:
     stx value_dump
 
 
+test_ldy:
     ; LDY test
     ldy ldy_abs_test
     php
@@ -550,6 +566,7 @@ jmp_test_continues:
     sty value_dump
 
 
+test_lsr:
     ; LSR test
     lsr lsr_abs_test
     php
@@ -564,6 +581,7 @@ jmp_test_continues:
     php
 
 
+test_pull:
     ; Stack pull tests
     ldy #0
     lda #$fc
@@ -619,6 +637,7 @@ pull_test_loop2:
 
 
     .if CPU_WDC
+test_rmb_smb:
     ; RMB/SMB test
     rmb 0,rmb_zp_test
     rmb 0,rmb_zp_test+1
@@ -656,6 +675,7 @@ pull_test_loop2:
     .endif
 
 
+test_rol_ror:
     ; ROL/ROR test
     ldx #1
     lda #$af
@@ -683,6 +703,7 @@ pull_test_loop2:
     php
 
 
+test_sta:
     ; STA test
     ldy #$02
     sta sta_abs_test
@@ -749,6 +770,7 @@ pull_test_loop2:
     php
 
 
+test_stx:
     ; STX test
     stx sta_abs_test
     inx
@@ -758,6 +780,7 @@ pull_test_loop2:
     php
 
 
+test_sty:
     ; STY test
     ldx #$2
     sty sta_abs_test
@@ -770,6 +793,7 @@ pull_test_loop2:
 
     ; STZ test
     .if C02
+test_stz:
     stz sta_abs_test
     stz sta_abs_test,x
     stz sta_zp_test
@@ -778,6 +802,7 @@ pull_test_loop2:
     .endif
 
 
+test_transfer:
     ; Transfer test
     lda #$85
     jsr transfer_tests
@@ -794,6 +819,7 @@ pull_test_loop2:
 
     ; TSB/TRB test
     .if C02
+test_tsb_trb:
     lda #$89
     trb trb_abs_test
     jsr dump_state
@@ -822,6 +848,7 @@ pull_test_loop2:
     jsr regression1_apple2_disassembly
 
 
+test_irq:
     ; IRQ test
     lda #$6
     sta IRQ_TRIGGER_COUNT
@@ -854,6 +881,7 @@ pull_test_loop2:
     nop
 
 
+test_nmi:
     ; NMI test
     lda #40
     sta NMI_TRIGGER_COUNT
@@ -881,6 +909,7 @@ pull_test_loop2:
     nop
 
 
+test_ready_so:
     ; Ready and SO tests
     clv
 
@@ -897,6 +926,7 @@ so_test_loop:
     bvc so_test_loop
     
 
+test_stp:
     ; STP test
     lda #(stp_test_cont1 % 256)
     sta reset_vector
@@ -977,6 +1007,7 @@ stp_test_cont3:
 
     ; WAI tests
     .if CPU_WDC
+test_wai:
     cli
     lda #6
     sta IRQ_TRIGGER_COUNT